@@ -0,0 +1,105 @@
+#include <string.h>
+
+#include "memory.h"
+
+#include "arena.h"
+
+#define ALIGNMENT 16
+#define INITIAL_CHUNK_SIZE (64 * 1024)
+
+typedef struct Chunk
+{
+    struct Chunk *next;
+    int64_t size;
+    int64_t used;
+    unsigned char *data;
+} Chunk;
+
+struct Arena
+{
+    Chunk *chunks;
+    int64_t nextChunkSize;
+    int64_t bytes;
+};
+
+static Chunk *newChunk(int64_t size, Chunk *next)
+{
+    Chunk *chunk = ALLOCATE(Chunk, 1);
+
+    chunk->next = next;
+    chunk->size = size;
+    chunk->used = 0;
+    chunk->data = ALLOCATE(unsigned char, size);
+
+    return chunk;
+}
+
+Arena *arena_new(void)
+{
+    Arena *arena = ALLOCATE(Arena, 1);
+
+    arena->chunks = NULL;
+    arena->nextChunkSize = INITIAL_CHUNK_SIZE;
+    arena->bytes = 0;
+
+    return arena;
+}
+
+void arena_free(Arena *arena)
+{
+    Chunk *chunk = arena->chunks;
+
+    while (chunk != NULL)
+    {
+        Chunk *next = chunk->next;
+
+        FREE(chunk->data);
+        FREE(chunk);
+        chunk = next;
+    }
+
+    FREE(arena);
+}
+
+void *arena_allocate(Arena *arena, int64_t bytes)
+{
+    int64_t size = (bytes + ALIGNMENT - 1) & ~(int64_t)(ALIGNMENT - 1);
+    Chunk *chunk = arena->chunks;
+
+    if (chunk == NULL || chunk->used + size > chunk->size)
+    {
+        /* Each chunk doubles the last, and an allocation larger than that has a chunk of its own. */
+        int64_t chunkSize = arena->nextChunkSize;
+
+        if (size > chunkSize)
+            chunkSize = size;
+        else
+            arena->nextChunkSize *= 2;
+
+        chunk = newChunk(chunkSize, arena->chunks);
+        arena->chunks = chunk;
+    }
+
+    void *result = chunk->data + chunk->used;
+
+    chunk->used += size;
+    arena->bytes += size;
+    memset(result, 0, size);
+
+    return result;
+}
+
+char *arena_strndup(Arena *arena, char *string, int64_t length)
+{
+    char *result = ARENA_ALLOCATE(arena, char, length + 1);
+
+    memcpy(result, string, length);
+    result[length] = '\0';
+
+    return result;
+}
+
+int64_t arena_bytes(Arena *arena)
+{
+    return arena->bytes;
+}
@@ -0,0 +1,27 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stdint.h>
+
+/*
+ * A region that allocations are carved from and that is freed as a whole.
+ * The front end allocates its syntax tree and types from an arena, none of
+ * which outlive a compilation, so nothing is freed one node at a time.
+ * Chunks grow as the arena does so a large program costs few allocations.
+ */
+typedef struct Arena Arena;
+
+extern Arena *arena_new(void);
+extern void arena_free(Arena *arena);
+
+/* Zeroed and aligned for any of the front end's structures. */
+extern void *arena_allocate(Arena *arena, int64_t bytes);
+extern char *arena_strndup(Arena *arena, char *string, int64_t length);
+
+/* The bytes allocated from the arena so far. */
+extern int64_t arena_bytes(Arena *arena);
+
+#define ARENA_ALLOCATE(arena, type, count) \
+    (type *)arena_allocate(arena, sizeof(type) * (count))
+
+#endif
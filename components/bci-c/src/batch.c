@@ -0,0 +1,405 @@
+#include <dirent.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "buffer.h"
+#include "memory.h"
+#include "schedule.h"
+#include "stringbuilder.h"
+#include "timer.h"
+
+#include "batch.h"
+
+/*
+ * Each worker owns a deque of job indices.  A worker takes jobs from the head
+ * of its own deque and, once that is empty, steals from the tail of the other
+ * workers' deques.
+ */
+typedef struct
+{
+    pthread_mutex_t lock;
+    int32_t head;
+    int32_t tail;
+} Deque;
+
+typedef struct
+{
+    Batch *batch;
+    Deque *deques;
+    int32_t threads;
+    int32_t id;
+    int64_t start;
+} Worker;
+
+typedef struct
+{
+    Batch *batch;
+    int32_t *jobs;
+    int64_t start;
+} Slices;
+
+static int compareFileNames(const void *a, const void *b)
+{
+    return strcmp(((BatchJob *)a)->fileName, ((BatchJob *)b)->fileName);
+}
+
+static int compareLatencies(const void *a, const void *b)
+{
+    int64_t la = *(int64_t *)a;
+    int64_t lb = *(int64_t *)b;
+
+    return (la > lb) - (la < lb);
+}
+
+static void addJob(Buffer *jobs, char *directory, char *name)
+{
+    BatchJob job;
+    StringBuilder *sb = stringbuilder_new();
+
+    if (directory != NULL && name[0] != '/')
+    {
+        stringbuilder_append(sb, directory);
+        stringbuilder_append_char(sb, '/');
+    }
+    stringbuilder_append(sb, name);
+
+    job.fileName = stringbuilder_free_use(sb);
+    job.status = BCI_OK;
+    job.output = NULL;
+    job.latency = 0;
+    job.turnaround = 0;
+
+    buffer_append(jobs, &job, 1);
+}
+
+static int readDirectory(Buffer *jobs, char *path)
+{
+    DIR *dir = opendir(path);
+    struct dirent *entry;
+
+    if (dir == NULL)
+        return 0;
+
+    while ((entry = readdir(dir)) != NULL)
+    {
+        int length = strlen(entry->d_name);
+
+        if (length > 4 && strcmp(entry->d_name + length - 4, ".bin") == 0)
+            addJob(jobs, path, entry->d_name);
+    }
+    closedir(dir);
+
+    qsort(buffer_content(jobs), buffer_count(jobs), sizeof(BatchJob), compareFileNames);
+
+    return 1;
+}
+
+static int readManifest(Buffer *jobs, char *path)
+{
+    FILE *fp = fopen(path, "r");
+    if (fp == NULL)
+        return 0;
+
+    char *directory = STRDUP(path);
+    char *slash = strrchr(directory, '/');
+    if (slash == NULL)
+    {
+        FREE(directory);
+        directory = NULL;
+    }
+    else
+        *slash = '\0';
+
+    char line[1024];
+    while (fgets(line, sizeof(line), fp) != NULL)
+    {
+        char *start = line;
+        while (*start == ' ' || *start == '\t')
+            start++;
+
+        char *end = start + strlen(start);
+        while (end > start && (end[-1] == '\n' || end[-1] == '\r' || end[-1] == ' ' || end[-1] == '\t'))
+            end--;
+        *end = '\0';
+
+        if (*start != '\0' && *start != '#')
+            addJob(jobs, directory, start);
+    }
+    fclose(fp);
+
+    if (directory != NULL)
+        FREE(directory);
+
+    return 1;
+}
+
+Batch *batch_new(char *path)
+{
+    struct stat st;
+
+    if (stat(path, &st) != 0)
+    {
+        printf("File not found: %s\n", path);
+        return NULL;
+    }
+
+    Buffer *jobs = buffer_new(sizeof(BatchJob));
+
+    if (S_ISDIR(st.st_mode) ? !readDirectory(jobs, path) : !readManifest(jobs, path))
+    {
+        printf("Unable to read: %s\n", path);
+        buffer_free(jobs);
+        return NULL;
+    }
+
+    Batch *batch = ALLOCATE(Batch, 1);
+
+    batch->count = buffer_count(jobs);
+    batch->jobs = buffer_free_use(jobs);
+    batch->threads = 0;
+    batch->quantum = 0;
+    bci_defaultLimits(&batch->limits);
+    batch->elapsed = 0;
+
+    return batch;
+}
+
+void batch_free(Batch *batch)
+{
+    for (int i = 0; i < batch->count; i++)
+    {
+        FREE(batch->jobs[i].fileName);
+        if (batch->jobs[i].output != NULL)
+            FREE(batch->jobs[i].output);
+    }
+
+    FREE(batch->jobs);
+    FREE(batch);
+}
+
+static void finishJob(BatchJob *job, BciVM *vm, int64_t start)
+{
+    job->turnaround = timer_now() - start;
+    job->output = STRDUP(job->status == BCI_OK ? bci_result(vm)->text : bci_errorMessage(vm));
+}
+
+static void runJob(BciVM *vm, BatchJob *job, int64_t batchStart)
+{
+    int64_t start = timer_now();
+
+    job->status = bci_loadFile(vm, job->fileName);
+    if (job->status == BCI_OK)
+        job->status = bci_run(vm, 0);
+
+    job->latency = timer_now() - start;
+    finishJob(job, vm, batchStart);
+}
+
+static int32_t takeJob(Worker *worker)
+{
+    Deque *own = &worker->deques[worker->id];
+    int32_t job = -1;
+
+    pthread_mutex_lock(&own->lock);
+    if (own->head < own->tail)
+        job = own->head++;
+    pthread_mutex_unlock(&own->lock);
+
+    for (int i = 1; job == -1 && i < worker->threads; i++)
+    {
+        Deque *victim = &worker->deques[(worker->id + i) % worker->threads];
+
+        pthread_mutex_lock(&victim->lock);
+        if (victim->head < victim->tail)
+            job = --victim->tail;
+        pthread_mutex_unlock(&victim->lock);
+    }
+
+    return job;
+}
+
+static void *workerMain(void *arg)
+{
+    Worker *worker = (Worker *)arg;
+    BciVM *vm = bci_newVM();
+    int32_t job;
+
+    bci_setLimits(vm, &worker->batch->limits);
+    while ((job = takeJob(worker)) != -1)
+        runJob(vm, &worker->batch->jobs[job], worker->start);
+
+    bci_freeVM(vm);
+
+    return NULL;
+}
+
+static void completeSlice(int32_t index, BciVM *vm, BciStatus status, void *context)
+{
+    Slices *slices = (Slices *)context;
+    BatchJob *job = &slices->batch->jobs[slices->jobs[index]];
+
+    job->status = status;
+    finishJob(job, vm, slices->start);
+    job->latency = job->turnaround;
+
+    bci_freeVM(vm);
+}
+
+/*
+ * Every program is admitted when the batch starts, so in this mode a job's
+ * latency is measured from admission rather than from when it was first run.
+ */
+static void executeSlices(Batch *batch, int32_t threads, int64_t quantum, int64_t start)
+{
+    BciVM **vms = ALLOCATE(BciVM *, batch->count);
+    Slices slices;
+    int32_t count = 0;
+
+    slices.batch = batch;
+    slices.jobs = ALLOCATE(int32_t, batch->count);
+    slices.start = start;
+
+    for (int i = 0; i < batch->count; i++)
+    {
+        BatchJob *job = &batch->jobs[i];
+        BciVM *vm = bci_newVM();
+
+        bci_setLimits(vm, &batch->limits);
+        job->status = bci_loadFile(vm, job->fileName);
+        if (job->status == BCI_OK)
+            job->status = bci_start(vm, 0);
+
+        if (job->status == BCI_OK)
+        {
+            vms[count] = vm;
+            slices.jobs[count] = i;
+            count++;
+        }
+        else
+        {
+            finishJob(job, vm, start);
+            job->latency = job->turnaround;
+            bci_freeVM(vm);
+        }
+    }
+
+    schedule_run(vms, count, threads, quantum, completeSlice, &slices);
+
+    FREE(slices.jobs);
+    FREE(vms);
+}
+
+static void executeJobs(Batch *batch, int32_t threads, int64_t start)
+{
+
+    Deque *deques = ALLOCATE(Deque, threads);
+    Worker *workers = ALLOCATE(Worker, threads);
+    pthread_t *ids = ALLOCATE(pthread_t, threads);
+
+    for (int i = 0; i < threads; i++)
+    {
+        pthread_mutex_init(&deques[i].lock, NULL);
+        deques[i].head = (int32_t)((int64_t)batch->count * i / threads);
+        deques[i].tail = (int32_t)((int64_t)batch->count * (i + 1) / threads);
+
+        workers[i].batch = batch;
+        workers[i].deques = deques;
+        workers[i].threads = threads;
+        workers[i].id = i;
+        workers[i].start = start;
+    }
+
+    for (int i = 0; i < threads; i++)
+        pthread_create(&ids[i], NULL, workerMain, &workers[i]);
+    for (int i = 0; i < threads; i++)
+        pthread_join(ids[i], NULL);
+
+    for (int i = 0; i < threads; i++)
+        pthread_mutex_destroy(&deques[i].lock);
+
+    FREE(ids);
+    FREE(workers);
+    FREE(deques);
+}
+
+void batch_execute(Batch *batch, int32_t threads, int64_t quantum)
+{
+    if (threads < 1)
+        threads = 1;
+    if (quantum < 0)
+        quantum = 0;
+
+    int64_t start = timer_now();
+
+    if (quantum == 0)
+        executeJobs(batch, threads, start);
+    else
+        executeSlices(batch, threads, quantum, start);
+
+    batch->elapsed = timer_now() - start;
+    batch->threads = threads;
+    batch->quantum = quantum;
+}
+
+static double percentile(int64_t *sorted, int32_t count, int p)
+{
+    int32_t index = (int32_t)(((int64_t)count * p + 99) / 100) - 1;
+
+    if (index < 0)
+        index = 0;
+
+    return sorted[index] / 1000.0;
+}
+
+static void printPercentiles(char *name, int64_t *latencies, int32_t count)
+{
+    qsort(latencies, count, sizeof(int64_t), compareLatencies);
+
+    printf(". %s: p50 %.1fus   p90 %.1fus   p99 %.1fus   max %.1fus\n",
+           name,
+           percentile(latencies, count, 50),
+           percentile(latencies, count, 90),
+           percentile(latencies, count, 99),
+           latencies[count - 1] / 1000.0);
+}
+
+int32_t batch_report(Batch *batch)
+{
+    int32_t failed = 0;
+
+    for (int i = 0; i < batch->count; i++)
+    {
+        BatchJob *job = &batch->jobs[i];
+
+        printf("%s: %s\n", job->fileName, job->output);
+        if (job->status != BCI_OK)
+            failed++;
+    }
+
+    printf(". Programs: %d   Failed: %d   Threads: %d", batch->count, failed, batch->threads);
+    if (batch->quantum > 0)
+        printf("   Quantum: %ld", (long)batch->quantum);
+    printf("\n");
+    printf(". Elapsed: %.3fms   Throughput: %.1f programs/s\n",
+           batch->elapsed / 1000000.0,
+           batch->elapsed == 0 ? 0.0 : batch->count * 1000000000.0 / batch->elapsed);
+
+    if (batch->count > 0)
+    {
+        int64_t *latencies = ALLOCATE(int64_t, batch->count);
+
+        for (int i = 0; i < batch->count; i++)
+            latencies[i] = batch->jobs[i].latency;
+        printPercentiles("Latency", latencies, batch->count);
+
+        for (int i = 0; i < batch->count; i++)
+            latencies[i] = batch->jobs[i].turnaround;
+        printPercentiles("Turnaround", latencies, batch->count);
+
+        FREE(latencies);
+    }
+
+    return failed;
+}
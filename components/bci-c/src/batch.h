@@ -0,0 +1,42 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <stdint.h>
+
+#include "vm.h"
+
+typedef struct
+{
+    char *fileName;
+
+    BciStatus status;
+    char *output;
+    int64_t latency;
+    int64_t turnaround;
+} BatchJob;
+
+typedef struct
+{
+    int32_t count;
+    BatchJob *jobs;
+
+    /* Applied to every job - defaults to no limits. */
+    BciLimits limits;
+
+    int32_t threads;
+    int64_t quantum;
+    int64_t elapsed;
+} Batch;
+
+extern Batch *batch_new(char *path);
+extern void batch_free(Batch *batch);
+
+/*
+ * Runs every job in the batch.  With a quantum of 0 each worker runs its jobs
+ * to completion one at a time; otherwise all of the jobs are started together
+ * and are resumed round-robin for quantum instructions at a time.
+ */
+extern void batch_execute(Batch *batch, int32_t threads, int64_t quantum);
+extern int32_t batch_report(Batch *batch);
+
+#endif
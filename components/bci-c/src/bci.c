@@ -1,100 +1,791 @@
+#include <getopt.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/resource.h>
 #include <unistd.h>
 
+#include "batch.h"
+#include "cache.h"
+#include "collector.h"
 #include "dis.h"
-#include "op.h"
+#include "gcstats.h"
+#include "memo.h"
 #include "memory.h"
-#include "run.h"
-#include "value.h"
+#include "perf.h"
+#include "profile.h"
+#include "serve.h"
+#include "snapshot.h"
+#include "stlc.h"
+#include "symbols.h"
+#include "trace.h"
+#include "vm.h"
 
-void readBinaryFile(char *fileName, unsigned char **block, int32_t *size)
+#define DEFAULT_HEAP_SNAPSHOT "heap.snapshot"
+#define DEFAULT_TOP_RETAINERS 20
+#define DEFAULT_MEMO_ENTRIES 65536
+#define DEFAULT_GC_PARALLEL_THRESHOLD 65536
+
+/* Records held by a trace, the last of which survive in the file. */
+#define DEFAULT_TRACE_RECORDS (1 << 20)
+
+/* The exit code when a program is stopped by a resource limit or runs out of memory. */
+#define EXIT_LIMIT 3
+
+enum
 {
-  FILE *fp = fopen(fileName, "rb");
-  if (fp == NULL)
-  {
-    printf("File not found: %s\n", fileName);
-    exit(1);
-  }
-
-  fseek(fp, 0, SEEK_END);
-  *size = ftell(fp);
-  fseek(fp, 0, SEEK_SET);
-  *block = ALLOCATE(unsigned char, *size);
-  fread(*block, *size, 1, fp);
-  fclose(fp);
+    OPTION_MAX_INSTRUCTIONS = 256,
+    OPTION_MAX_OBJECTS,
+    OPTION_MAX_BYTES,
+    OPTION_MAX_DEPTH,
+    OPTION_TIMEOUT,
+    OPTION_STATS,
+    OPTION_PROFILE,
+    OPTION_SYMBOLS,
+    OPTION_COLLAPSED,
+    OPTION_TRACE,
+    OPTION_TRACE_RECORDS,
+    OPTION_GC_STATS,
+    OPTION_MEMORY_PROFILE,
+    OPTION_HEAP_SNAPSHOT,
+    OPTION_HEAP_SNAPSHOT_AT,
+    OPTION_TOP,
+    OPTION_COUNTERS,
+    OPTION_MEMOIZE,
+    OPTION_PARALLEL,
+    OPTION_GC_THREADS,
+    OPTION_GC_PARALLEL_THRESHOLD,
+    OPTION_NO_CACHE,
+    OPTION_CACHE_DIR,
+    OPTION_CACHE_STATS
+};
+
+static struct option longOptions[] = {
+    {"max-instructions", required_argument, NULL, OPTION_MAX_INSTRUCTIONS},
+    {"max-objects", required_argument, NULL, OPTION_MAX_OBJECTS},
+    {"max-bytes", required_argument, NULL, OPTION_MAX_BYTES},
+    {"max-depth", required_argument, NULL, OPTION_MAX_DEPTH},
+    {"timeout", required_argument, NULL, OPTION_TIMEOUT},
+    {"stats", no_argument, NULL, OPTION_STATS},
+    {"profile", no_argument, NULL, OPTION_PROFILE},
+    {"symbols", required_argument, NULL, OPTION_SYMBOLS},
+    {"collapsed", required_argument, NULL, OPTION_COLLAPSED},
+    {"trace", required_argument, NULL, OPTION_TRACE},
+    {"trace-records", required_argument, NULL, OPTION_TRACE_RECORDS},
+    {"gc-stats", optional_argument, NULL, OPTION_GC_STATS},
+    {"memory-profile", optional_argument, NULL, OPTION_MEMORY_PROFILE},
+    {"heap-snapshot", required_argument, NULL, OPTION_HEAP_SNAPSHOT},
+    {"heap-snapshot-at", required_argument, NULL, OPTION_HEAP_SNAPSHOT_AT},
+    {"top", required_argument, NULL, OPTION_TOP},
+    {"counters", no_argument, NULL, OPTION_COUNTERS},
+    {"memoize", optional_argument, NULL, OPTION_MEMOIZE},
+    {"parallel", optional_argument, NULL, OPTION_PARALLEL},
+    {"gc-threads", optional_argument, NULL, OPTION_GC_THREADS},
+    {"gc-parallel-threshold", required_argument, NULL, OPTION_GC_PARALLEL_THRESHOLD},
+    {"no-cache", no_argument, NULL, OPTION_NO_CACHE},
+    {"cache-dir", required_argument, NULL, OPTION_CACHE_DIR},
+    {"cache-stats", no_argument, NULL, OPTION_CACHE_STATS},
+    {NULL, 0, NULL, 0}};
+
+static void usage(char *name)
+{
+    printf("Usage: %s [dis | run] [-d] [--stats] [--counters] [--memoize[=<entries>]] [--parallel[=<threads>]] [<collector>] [--gc-stats[=<file>]] [--memory-profile[=<file>]] [<profile>] [<trace>] [<limits>] <file>\n", name);
+    printf("       %s compile [--parallel] [--stats] [<cache>] <file.stlc> [-o <file.bin>]\n", name);
+    printf("       %s eval [--parallel[=<threads>]] [<cache>] [<limits>] <file.stlc>\n", name);
+    printf("       %s trace-dump <trace file> [<file>]\n", name);
+    printf("       %s heap-analyze [--top=<n>] <snapshot file>\n", name);
+    printf("       %s batch [-j <threads>] [-q <instructions>] [<limits>] <manifest | directory>\n", name);
+    printf("       %s serve [-s <socket>] [<limits>]\n", name);
+    printf("Profile: --profile [--symbols=<file.bci>] [--collapsed=<file>]\n");
+    printf("Trace: --trace=<file> [--trace-records=<n>]\n");
+    printf("Heap snapshot: --heap-snapshot-at=<instructions | gc> [--heap-snapshot=<file>]\n");
+    printf("Memory: --memory-profile[=<file>] reports allocation sites and leaks\n");
+    printf("Memoize: --memoize[=<entries>] caches the results of calls on an int or bool, least recently used first out\n");
+    printf("Parallel: --parallel[=<threads>] evaluates SPAWNed thunks on a pool of threads, one per processor by default\n");
+    printf("Collector: --gc-threads[=<threads>] [--gc-parallel-threshold=<objects>] marks and sweeps heaps of at least %d objects on a pool of threads\n", DEFAULT_GC_PARALLEL_THRESHOLD);
+    printf("GC statistics: --gc-stats[=<file>] as JSON at exit and after the next collection on SIGUSR1\n");
+    printf("Cache: --no-cache | [--cache-dir=<directory>] [--cache-stats] reuses compiled programs, from $STLC_CACHE or ~/.cache/stlc by default\n");
+    printf("Limits: --max-instructions=<n> --max-objects=<n> --max-bytes=<n> --max-depth=<n> --timeout=<ms>\n");
 }
 
-int32_t main(int argc, char *argv[])
+static int setLimit(int opt, char *arg, BciLimits *limits)
 {
-  if (argc == 0 || argc == 1)
-  {
-    printf("Usage: %s [dis | run] [-d] <file>\n", argv[0]);
-    exit(1);
-  }
-  if (strcmp(argv[1], "run") == 0)
-  {
-    int debug = 0;
-    int opt;
-    while ((opt = getopt(argc - 1, argv + 1, "d")) != -1)
-    {
-      switch (opt)
-      {
-      case 'd':
-        debug = 1;
-        break;
-      default:
-        printf("Usage: %s [dis | run] [-d] <file>\n", argv[0]);
+    switch (opt)
+    {
+    case OPTION_MAX_INSTRUCTIONS:
+        limits->instructions = atoll(arg);
+        return 1;
+    case OPTION_MAX_OBJECTS:
+        limits->heapObjects = atoll(arg);
         return 1;
-      }
+    case OPTION_MAX_BYTES:
+        limits->heapBytes = atoll(arg);
+        return 1;
+    case OPTION_MAX_DEPTH:
+        limits->depth = atoll(arg);
+        return 1;
+    case OPTION_TIMEOUT:
+        limits->timeout = atoll(arg) * 1000000;
+        return 1;
+    default:
+        return 0;
     }
+}
 
-    unsigned char *block = NULL;
-    int32_t size;
+static void printUsage(BciUsage *usage)
+{
+    printf(". Instructions: %ld   Heap: %ld objects, %ld bytes   Stack: %d values   Depth: %ld activations\n",
+           (long)usage->instructions,
+           (long)usage->heapObjects,
+           (long)usage->heapBytes,
+           usage->stack,
+           (long)usage->depth);
+}
 
-    readBinaryFile(argv[optind + 1], &block, &size);
+static long peakRss(void)
+{
+    struct rusage rusage;
 
-    int start_memory_allocated = memory_allocated();
+    getrusage(RUSAGE_SELF, &rusage);
 
-    op_initialise();
-    value_initialise();
+#ifdef __APPLE__
+    return rusage.ru_maxrss / 1024;
+#else
+    return rusage.ru_maxrss;
+#endif
+}
+
+/*
+ * Function names come from the labels of the program's source, which is
+ * taken to be alongside the binary unless named with --symbols.
+ */
+static Symbols *loadSymbols(char *symbolsName, char *fileName)
+{
+    if (symbolsName != NULL)
+        return symbols_load(symbolsName);
+
+    int length = strlen(fileName);
+    if (length < 4 || strcmp(fileName + length - 4, ".bin") != 0)
+        return NULL;
+
+    char *source = STRDUP(fileName);
+    strcpy(source + length - 4, ".bci");
+    Symbols *symbols = symbols_load(source);
+    FREE(source);
+
+    return symbols;
+}
+
+static void reportProfile(Profile *profile, char *symbolsName, char *collapsedName, char *fileName)
+{
+    Symbols *symbols = loadSymbols(symbolsName, fileName);
+
+    if (symbolsName != NULL && symbols == NULL)
+        printf(". Unable to read symbols: %s\n", symbolsName);
+
+    profile_report(profile, symbols, stdout);
+
+    if (collapsedName != NULL)
+    {
+        FILE *fp = fopen(collapsedName, "w");
+
+        if (fp == NULL)
+            printf(". Unable to write: %s\n", collapsedName);
+        else
+        {
+            profile_writeCollapsed(profile, symbols, fp);
+            fclose(fp);
+        }
+    }
+
+    if (symbols != NULL)
+        symbols_free(symbols);
+}
 
-    execute(block, debug);
+/* The allocation site table goes to stderr, unless named, so that stdout remains the program's result. */
+static void reportMemory(char *fileName)
+{
+    if (fileName == NULL)
+    {
+        memory_report(stderr);
+        return;
+    }
 
-    value_finalise();
-    op_finalise();
+    FILE *fp = fopen(fileName, "w");
+    if (fp == NULL)
+    {
+        printf(". Unable to write: %s\n", fileName);
+        return;
+    }
 
-    int end_memory_allocated = memory_allocated();
+    memory_report(fp);
+    fclose(fp);
+}
 
-    if (debug)
+/*
+ * A single JSON line on stderr so that stdout remains the program's result.
+ * Hardware counters, if requested, are included rather than printed.
+ */
+static void printStats(BciUsage *usage, Perf *perf)
+{
+    fprintf(stderr, "{\"instructions\": %ld, \"allocations\": %ld, \"collections\": %ld, \"gcNs\": %ld, \"peakRssKb\": %ld",
+            (long)usage->instructions,
+            (long)usage->allocations,
+            (long)usage->collections,
+            (long)usage->gcTime,
+            peakRss());
+    if (perf != NULL)
     {
-      printf(". Memory allocated delta: %d\n", end_memory_allocated - start_memory_allocated);
+        fprintf(stderr, ", \"counters\": ");
+        perf_writeJson(perf, usage->instructions, stderr);
+    }
+    fprintf(stderr, "}\n");
+}
+
+/* The binary alongside the source: its extension, if it has one, replaced with .bin. */
+static char *binaryName(char *sourceName)
+{
+    char *slash = strrchr(sourceName, '/');
+    char *dot = strrchr(sourceName, '.');
+    int length = dot == NULL || (slash != NULL && dot < slash) ? (int)strlen(sourceName) : (int)(dot - sourceName);
+    char *result = ALLOCATE(char, length + 5);
+
+    memcpy(result, sourceName, length);
+    strcpy(result + length, ".bin");
+
+    return result;
+}
+
+/* The compile cache in directory, or the default one - NULL if it is disabled or there is nowhere for it. */
+static Cache *openCache(int noCache, char *directory)
+{
+    if (noCache)
+        return NULL;
+    if (directory != NULL)
+        return cache_new(directory);
+
+    char *defaultDirectory = cache_defaultDirectory();
+    if (defaultDirectory == NULL)
+        return NULL;
 
-      if (end_memory_allocated > start_memory_allocated)
-      {
-        printf(". Memory leak detected: %d allocations leaked\n", end_memory_allocated - start_memory_allocated);
-      }
+    Cache *cache = cache_new(defaultDirectory);
+    FREE(defaultDirectory);
+
+    return cache;
+}
+
+static void closeCache(Cache *cache, int stats)
+{
+    if (cache == NULL)
+        return;
+
+    if (stats)
+        fprintf(stderr, "{\"cacheHits\": %ld, \"cacheMisses\": %ld, \"cacheFailures\": %ld}\n",
+                (long)cache_hits(cache),
+                (long)cache_misses(cache),
+                (long)cache_failures(cache));
+    cache_free(cache);
+}
+
+/* Compiles the STLC program in fileName, through cache unless it is NULL, printing the error and returning 0 if it cannot be. */
+static int compileSource(char *fileName, int parallel, Cache *cache, Stlc *stlc)
+{
+    char *source = stlc_readFile(fileName);
+
+    if (source == NULL)
+    {
+        printf("Unable to read: %s\n", fileName);
+        return 0;
     }
 
-    return 0;
-  }
-  else if (strcmp(argv[1], "dis") == 0)
-  {
-    unsigned char *block = NULL;
-    int32_t size;
+    int ok = cache == NULL ? stlc_compile(source, parallel, stlc) : cache_compile(cache, source, parallel, stlc);
+    FREE(source);
 
-    readBinaryFile(argv[2], &block, &size);
+    if (!ok)
+        printf("%s\n", stlc->errorMessage);
 
-    op_initialise();
-    dis(block, size);
-    op_finalise();
+    return ok;
+}
 
-    return 0;
-  }
-  else
-  {
-    printf("Unknown command: %s\n", argv[1]);
-    return 1;
-  }
+int32_t main(int argc, char *argv[])
+{
+    if (argc == 0 || argc == 1)
+    {
+        usage(argv[0]);
+        exit(1);
+    }
+    if (strcmp(argv[1], "run") == 0)
+    {
+        int debug = 0;
+        int stats = 0;
+        int profiling = 0;
+        char *symbolsName = NULL;
+        char *collapsedName = NULL;
+        char *traceName = NULL;
+        int64_t traceRecords = DEFAULT_TRACE_RECORDS;
+        int gcStatsEnabled = 0;
+        char *gcStatsName = NULL;
+        int memoryProfile = 0;
+        char *memoryProfileName = NULL;
+        char *snapshotName = DEFAULT_HEAP_SNAPSHOT;
+        int64_t snapshotAt = 0;
+        int snapshotting = 0;
+        int counters = 0;
+        int32_t memoEntries = 0;
+        int32_t threads = 1;
+        int32_t gcThreads = 1;
+        int64_t gcParallelThreshold = DEFAULT_GC_PARALLEL_THRESHOLD;
+        BciLimits limits;
+        int opt;
+
+        bci_defaultLimits(&limits);
+        while ((opt = getopt_long(argc - 1, argv + 1, "d", longOptions, NULL)) != -1)
+        {
+            switch (opt)
+            {
+            case 'd':
+                debug = 1;
+                break;
+            case OPTION_STATS:
+                stats = 1;
+                break;
+            case OPTION_PROFILE:
+                profiling = 1;
+                break;
+            case OPTION_SYMBOLS:
+                symbolsName = optarg;
+                break;
+            case OPTION_COLLAPSED:
+                profiling = 1;
+                collapsedName = optarg;
+                break;
+            case OPTION_TRACE:
+                traceName = optarg;
+                break;
+            case OPTION_TRACE_RECORDS:
+                traceRecords = atoll(optarg);
+                break;
+            case OPTION_GC_STATS:
+                gcStatsEnabled = 1;
+                gcStatsName = optarg;
+                break;
+            case OPTION_MEMORY_PROFILE:
+                memoryProfile = 1;
+                memoryProfileName = optarg;
+                break;
+            case OPTION_HEAP_SNAPSHOT:
+                snapshotName = optarg;
+                break;
+            case OPTION_COUNTERS:
+                counters = 1;
+                break;
+            case OPTION_MEMOIZE:
+                memoEntries = optarg == NULL ? DEFAULT_MEMO_ENTRIES : atoi(optarg);
+                break;
+            case OPTION_PARALLEL:
+                threads = optarg == NULL ? (int32_t)sysconf(_SC_NPROCESSORS_ONLN) : atoi(optarg);
+                break;
+            case OPTION_GC_THREADS:
+                gcThreads = optarg == NULL ? (int32_t)sysconf(_SC_NPROCESSORS_ONLN) : atoi(optarg);
+                break;
+            case OPTION_GC_PARALLEL_THRESHOLD:
+                gcParallelThreshold = atoll(optarg);
+                break;
+            case OPTION_HEAP_SNAPSHOT_AT:
+                snapshotting = 1;
+                snapshotAt = strcmp(optarg, "gc") == 0 ? SNAPSHOT_AT_GC : atoll(optarg);
+                break;
+            default:
+                if (!setLimit(opt, optarg, &limits))
+                {
+                    usage(argv[0]);
+                    return 1;
+                }
+            }
+        }
+        if (optind + 1 >= argc)
+        {
+            usage(argv[0]);
+            return 1;
+        }
+
+        if (memoryProfile && !memory_setProfiling(1))
+        {
+            printf("Allocation sites are only tracked when built with DEBUG_MEMORY\n");
+            memoryProfile = 0;
+        }
+
+        int start_memory_allocated = memory_allocated();
+
+        BciVM *vm = bci_newVM();
+        BciStatus status = bci_loadFile(vm, argv[optind + 1]);
+        Profile *profile = profiling ? profile_new() : NULL;
+        Trace *trace = NULL;
+        GcStats *gcStats = NULL;
+        Snapshot *snapshot = snapshotting ? snapshot_new(snapshotName, snapshotAt) : NULL;
+        Perf *perf = counters ? perf_new() : NULL;
+        Memo *memo = memoEntries > 0 ? memo_new(memoEntries) : NULL;
+        Collector *collector = gcThreads > 1 ? collector_new(gcThreads, gcParallelThreshold) : NULL;
+
+        if (traceName != NULL)
+        {
+            trace = trace_new(traceName, traceRecords);
+            if (trace == NULL)
+            {
+                printf("Unable to write: %s\n", traceName);
+                bci_freeVM(vm);
+                return 1;
+            }
+        }
+
+        bci_setLimits(vm, &limits);
+        bci_setProfile(vm, profile);
+        bci_setTrace(vm, trace);
+        bci_setSnapshot(vm, snapshot);
+        bci_setPerf(vm, perf);
+        bci_setMemo(vm, memo);
+        bci_setParallel(vm, threads);
+        bci_setCollector(vm, collector);
+        if (gcStatsEnabled)
+        {
+            gcStats = gcstats_new(gcStatsName);
+            gcstats_writeOnSignal(SIGUSR1);
+            bci_setGcStats(vm, gcStats);
+        }
+        if (status == BCI_OK)
+            status = bci_run(vm, debug);
+
+        if (status == BCI_OK)
+            printf("%s\n", bci_result(vm)->text);
+        else
+            printf("%s\n", bci_errorMessage(vm));
+
+        if (status == BCI_ERROR_LIMIT || status == BCI_ERROR_MEMORY)
+            printUsage(bci_usage(vm));
+        if (stats)
+            printStats(bci_usage(vm), perf);
+        else if (perf != NULL)
+            perf_report(perf, bci_usage(vm)->instructions, stdout);
+        if (perf != NULL)
+            perf_free(perf);
+        if (memo != NULL)
+            memo_report(memo, stdout);
+        if (gcStats != NULL)
+        {
+            gcstats_write(gcStats);
+            gcstats_free(gcStats);
+        }
+        if (profile != NULL)
+        {
+            reportProfile(profile, symbolsName, collapsedName, argv[optind + 1]);
+            profile_free(profile);
+        }
+
+        bci_freeVM(vm);
+        if (memo != NULL)
+            memo_free(memo);
+        if (collector != NULL)
+            collector_free(collector);
+        if (trace != NULL)
+            trace_free(trace);
+        if (snapshot != NULL)
+        {
+            printf(". Heap snapshots written to %s: %d\n", snapshotName, snapshot_taken(snapshot));
+            snapshot_free(snapshot);
+        }
+
+        int end_memory_allocated = memory_allocated();
+
+        if (debug)
+            printf(". Memory allocated delta: %d\n", end_memory_allocated - start_memory_allocated);
+        if ((debug || memoryProfile) && end_memory_allocated > start_memory_allocated)
+        {
+            printf(". Memory leak detected: %d allocations leaked\n", end_memory_allocated - start_memory_allocated);
+            memory_reportLeaks(stdout);
+        }
+        if (memoryProfile)
+            reportMemory(memoryProfileName);
+
+        if (status == BCI_ERROR_LIMIT || status == BCI_ERROR_MEMORY)
+            return EXIT_LIMIT;
+
+        return status == BCI_OK ? 0 : 1;
+    }
+    else if (strcmp(argv[1], "batch") == 0)
+    {
+        int threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+        long quantum = 0;
+        BciLimits limits;
+        int opt;
+
+        bci_defaultLimits(&limits);
+        while ((opt = getopt_long(argc - 1, argv + 1, "j:q:", longOptions, NULL)) != -1)
+        {
+            switch (opt)
+            {
+            case 'j':
+                threads = atoi(optarg);
+                break;
+            case 'q':
+                quantum = atol(optarg);
+                break;
+            default:
+                if (!setLimit(opt, optarg, &limits))
+                {
+                    usage(argv[0]);
+                    return 1;
+                }
+            }
+        }
+        if (optind + 1 >= argc)
+        {
+            usage(argv[0]);
+            return 1;
+        }
+
+        Batch *batch = batch_new(argv[optind + 1]);
+        if (batch == NULL)
+            return 1;
+
+        batch->limits = limits;
+        batch_execute(batch, threads, quantum);
+        int failed = batch_report(batch);
+        batch_free(batch);
+
+        return failed == 0 ? 0 : 1;
+    }
+    else if (strcmp(argv[1], "serve") == 0)
+    {
+        char *socketPath = NULL;
+        BciLimits limits;
+        int opt;
+
+        bci_defaultLimits(&limits);
+        while ((opt = getopt_long(argc - 1, argv + 1, "s:", longOptions, NULL)) != -1)
+        {
+            switch (opt)
+            {
+            case 's':
+                socketPath = optarg;
+                break;
+            default:
+                if (!setLimit(opt, optarg, &limits))
+                {
+                    usage(argv[0]);
+                    return 1;
+                }
+            }
+        }
+
+        Server *server = serve_new();
+        serve_setLimits(server, &limits);
+        int ok = 1;
+
+        /* A client that goes away closes its connection rather than the server. */
+        signal(SIGPIPE, SIG_IGN);
+
+        if (socketPath == NULL)
+            serve_connection(server, STDIN_FILENO, STDOUT_FILENO);
+        else
+            ok = serve_socket(server, socketPath);
+
+        serve_free(server);
+
+        return ok ? 0 : 1;
+    }
+    else if (strcmp(argv[1], "trace-dump") == 0)
+    {
+        if (argc < 3 || argc > 4)
+        {
+            usage(argv[0]);
+            return 1;
+        }
+
+        return trace_dump(argv[2], argc == 4 ? argv[3] : NULL, stdout) ? 0 : 1;
+    }
+    else if (strcmp(argv[1], "heap-analyze") == 0)
+    {
+        int32_t top = DEFAULT_TOP_RETAINERS;
+        int opt;
+
+        while ((opt = getopt_long(argc - 1, argv + 1, "", longOptions, NULL)) != -1)
+        {
+            if (opt != OPTION_TOP)
+            {
+                usage(argv[0]);
+                return 1;
+            }
+            top = atoi(optarg);
+        }
+        if (optind + 2 != argc)
+        {
+            usage(argv[0]);
+            return 1;
+        }
+
+        return snapshot_analyze(argv[optind + 1], top, stdout) ? 0 : 1;
+    }
+    else if (strcmp(argv[1], "compile") == 0)
+    {
+        int parallel = 0;
+        int stats = 0;
+        int noCache = 0;
+        char *cacheDirectory = NULL;
+        int cacheStats = 0;
+        char *outputName = NULL;
+        int opt;
+
+        while ((opt = getopt_long(argc - 1, argv + 1, "o:", longOptions, NULL)) != -1)
+        {
+            switch (opt)
+            {
+            case 'o':
+                outputName = optarg;
+                break;
+            case OPTION_PARALLEL:
+                parallel = 1;
+                break;
+            case OPTION_STATS:
+                stats = 1;
+                break;
+            case OPTION_NO_CACHE:
+                noCache = 1;
+                break;
+            case OPTION_CACHE_DIR:
+                cacheDirectory = optarg;
+                break;
+            case OPTION_CACHE_STATS:
+                cacheStats = 1;
+                break;
+            default:
+                usage(argv[0]);
+                return 1;
+            }
+        }
+        if (optind + 2 != argc)
+        {
+            usage(argv[0]);
+            return 1;
+        }
+
+        Stlc stlc;
+        Cache *cache = openCache(noCache, cacheDirectory);
+        int compiled = compileSource(argv[optind + 1], parallel, cache, &stlc);
+
+        closeCache(cache, cacheStats);
+        if (!compiled)
+            return 1;
+
+        char *fileName = outputName == NULL ? binaryName(argv[optind + 1]) : STRDUP(outputName);
+        FILE *fp = fopen(fileName, "wb");
+        int ok = fp != NULL && fwrite(stlc.block, 1, stlc.size, fp) == (size_t)stlc.size;
+
+        if (fp != NULL)
+            ok = fclose(fp) == 0 && ok;
+        if (!ok)
+            printf("Unable to write: %s\n", fileName);
+
+        if (stats)
+            fprintf(stderr, "{\"parseNs\": %ld, \"inferNs\": %ld, \"compileNs\": %ld, \"arenaBytes\": %ld, \"bytes\": %d, \"cached\": %s}\n",
+                    (long)stlc.parseTime,
+                    (long)stlc.inferTime,
+                    (long)stlc.compileTime,
+                    (long)stlc.arenaBytes,
+                    stlc.size,
+                    stlc.cached ? "true" : "false");
+
+        FREE(fileName);
+        stlc_free(&stlc);
+
+        return ok ? 0 : 1;
+    }
+    else if (strcmp(argv[1], "eval") == 0)
+    {
+        int32_t threads = 1;
+        int noCache = 0;
+        char *cacheDirectory = NULL;
+        int cacheStats = 0;
+        BciLimits limits;
+        int opt;
+
+        bci_defaultLimits(&limits);
+        while ((opt = getopt_long(argc - 1, argv + 1, "", longOptions, NULL)) != -1)
+        {
+            if (opt == OPTION_PARALLEL)
+                threads = optarg == NULL ? (int32_t)sysconf(_SC_NPROCESSORS_ONLN) : atoi(optarg);
+            else if (opt == OPTION_NO_CACHE)
+                noCache = 1;
+            else if (opt == OPTION_CACHE_DIR)
+                cacheDirectory = optarg;
+            else if (opt == OPTION_CACHE_STATS)
+                cacheStats = 1;
+            else if (!setLimit(opt, optarg, &limits))
+            {
+                usage(argv[0]);
+                return 1;
+            }
+        }
+        if (optind + 2 != argc)
+        {
+            usage(argv[0]);
+            return 1;
+        }
+
+        Stlc stlc;
+        Cache *cache = openCache(noCache, cacheDirectory);
+        int compiled = compileSource(argv[optind + 1], threads > 1, cache, &stlc);
+
+        closeCache(cache, cacheStats);
+        if (!compiled)
+            return 1;
+
+        BciVM *vm = bci_newVM();
+        BciStatus status = bci_loadShared(vm, stlc.block, stlc.size);
+
+        bci_setLimits(vm, &limits);
+        bci_setParallel(vm, threads);
+        if (status == BCI_OK)
+            status = bci_run(vm, 0);
+
+        /* As the REPL prints them, a function by its type alone. */
+        if (status != BCI_OK)
+            printf("%s\n", bci_errorMessage(vm));
+        else if (stlc.function)
+            printf("function: %s\n", stlc.type);
+        else
+            printf("%s\n", bci_result(vm)->text);
+
+        if (status == BCI_ERROR_LIMIT || status == BCI_ERROR_MEMORY)
+            printUsage(bci_usage(vm));
+
+        bci_freeVM(vm);
+        stlc_free(&stlc);
+
+        if (status == BCI_ERROR_LIMIT || status == BCI_ERROR_MEMORY)
+            return EXIT_LIMIT;
+
+        return status == BCI_OK ? 0 : 1;
+    }
+    else if (strcmp(argv[1], "dis") == 0)
+    {
+        BciVM *vm = bci_newVM();
+
+        if (bci_loadFile(vm, argv[2]) != BCI_OK)
+        {
+            printf("%s\n", bci_errorMessage(vm));
+            bci_freeVM(vm);
+            return 1;
+        }
+
+        dis(bci_block(vm), bci_blockSize(vm));
+        bci_freeVM(vm);
+
+        return 0;
+    }
+    else
+    {
+        printf("Unknown command: %s\n", argv[1]);
+        return 1;
+    }
 }
@@ -51,7 +51,7 @@ void buffer_append(Buffer *sb, void *v, int count)
     if (sb->items_count + count >= sb->buffer_count)
     {
         int new_buffer_size = sb->items_count + count + BUFFER_TRANCHE;
-        sb->buffer = REALLOCATE(sb->buffer, char, new_buffer_size);
+        sb->buffer = REALLOCATE(sb->buffer, char, new_buffer_size * sb->item_size);
         sb->buffer_count = new_buffer_size;
     }
 
@@ -69,3 +69,8 @@ void buffer_write(Buffer *sb, int offset, void *v, int count)
 
     memcpy(sb->buffer + offset * sb->item_size, v, count * sb->item_size);
 }
+
+void buffer_clear(Buffer *sb)
+{
+    sb->items_count = 0;
+}
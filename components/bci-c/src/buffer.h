@@ -20,5 +20,6 @@ extern int32_t buffer_count(Buffer *buffer);
 extern int32_t buffer_offset(Buffer *buffer);
 extern void buffer_append(Buffer *b, void *v, int count);
 extern void buffer_write(Buffer *b, int32_t offset, void *v, int count);
+extern void buffer_clear(Buffer *b);
 
 #endif
@@ -0,0 +1,322 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "memory.h"
+
+#include "cache.h"
+
+#define MAGIC "STLC"
+#define FORMAT 1
+
+struct Cache
+{
+    char *directory;
+
+    int64_t hits;
+    int64_t misses;
+    int64_t failures;
+};
+
+typedef struct
+{
+    unsigned char *data;
+    int64_t size;
+    int64_t offset;
+} Reader;
+
+static uint64_t hashBytes(uint64_t hash, const void *bytes, int64_t size)
+{
+    const unsigned char *p = bytes;
+
+    for (int64_t i = 0; i < size; i++)
+    {
+        hash ^= p[i];
+        hash *= 1099511628211ULL;
+    }
+
+    return hash;
+}
+
+static const char *options(int parallel)
+{
+    return parallel ? "parallel" : "";
+}
+
+/* Each part is hashed with its terminating NUL so that no two keys run together. */
+static uint64_t entryKey(char *source, int parallel)
+{
+    uint64_t hash = 14695981039346656037ULL;
+
+    hash = hashBytes(hash, STLC_COMPILER_VERSION, strlen(STLC_COMPILER_VERSION) + 1);
+    hash = hashBytes(hash, options(parallel), strlen(options(parallel)) + 1);
+    hash = hashBytes(hash, source, strlen(source) + 1);
+
+    return hash;
+}
+
+static char *entryName(Cache *cache, uint64_t key)
+{
+    char *name = ALLOCATE(char, strlen(cache->directory) + 18);
+
+    sprintf(name, "%s/%016llx", cache->directory, (unsigned long long)key);
+
+    return name;
+}
+
+/* Creates directory and any parents it is missing. */
+static int makeDirectories(char *directory)
+{
+    char *path = STRDUP(directory);
+    int ok = 1;
+
+    for (char *p = path + 1; ok && *p != '\0'; p++)
+    {
+        if (*p == '/')
+        {
+            *p = '\0';
+            ok = mkdir(path, 0777) == 0 || errno == EEXIST;
+            *p = '/';
+        }
+    }
+    if (ok)
+        ok = mkdir(path, 0777) == 0 || errno == EEXIST;
+
+    FREE(path);
+
+    return ok;
+}
+
+char *cache_defaultDirectory(void)
+{
+    char *directory = getenv("STLC_CACHE");
+    if (directory != NULL && *directory != '\0')
+        return STRDUP(directory);
+
+    char *base = getenv("XDG_CACHE_HOME");
+    char *suffix = "/stlc";
+    if (base == NULL || *base == '\0')
+    {
+        base = getenv("HOME");
+        suffix = "/.cache/stlc";
+    }
+    if (base == NULL || *base == '\0')
+        return NULL;
+
+    char *result = ALLOCATE(char, strlen(base) + strlen(suffix) + 1);
+    strcpy(result, base);
+    strcat(result, suffix);
+
+    return result;
+}
+
+Cache *cache_new(char *directory)
+{
+    Cache *cache = ALLOCATE(Cache, 1);
+
+    cache->directory = STRDUP(directory);
+    cache->hits = 0;
+    cache->misses = 0;
+    cache->failures = 0;
+
+    return cache;
+}
+
+void cache_free(Cache *cache)
+{
+    FREE(cache->directory);
+    FREE(cache);
+}
+
+static unsigned char *readFile(char *fileName, int64_t *size)
+{
+    FILE *fp = fopen(fileName, "rb");
+    if (fp == NULL)
+        return NULL;
+
+    fseek(fp, 0, SEEK_END);
+    long length = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+
+    unsigned char *data = length < 0 ? NULL : ALLOCATE(unsigned char, length + 1);
+    if (data != NULL && fread(data, 1, length, fp) != (size_t)length)
+    {
+        FREE(data);
+        data = NULL;
+    }
+    fclose(fp);
+
+    *size = length;
+
+    return data;
+}
+
+static int readInt32(Reader *reader, int32_t *value)
+{
+    if (reader->offset + 4 > reader->size)
+        return 0;
+
+    unsigned char *p = reader->data + reader->offset;
+    *value = (int32_t)((uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24));
+    reader->offset += 4;
+
+    return 1;
+}
+
+/* Points bytes at the next length prefixed field. */
+static int readField(Reader *reader, unsigned char **bytes, int32_t *length)
+{
+    if (!readInt32(reader, length) || *length < 0 || reader->offset + *length > reader->size)
+        return 0;
+
+    *bytes = reader->data + reader->offset;
+    reader->offset += *length;
+
+    return 1;
+}
+
+static int matches(Reader *reader, const char *expected)
+{
+    unsigned char *bytes;
+    int32_t length;
+
+    return readField(reader, &bytes, &length) && length == (int32_t)strlen(expected) && memcmp(bytes, expected, length) == 0;
+}
+
+static int lookup(Cache *cache, char *fileName, char *source, int parallel, Stlc *stlc)
+{
+    Reader reader;
+    int32_t format;
+    unsigned char *type;
+    int32_t typeLength;
+    unsigned char *block;
+    int32_t size;
+
+    reader.data = readFile(fileName, &reader.size);
+    reader.offset = 4;
+    if (reader.data == NULL)
+        return 0;
+
+    int found = reader.size >= 4 && memcmp(reader.data, MAGIC, 4) == 0 &&
+                readInt32(&reader, &format) && format == FORMAT &&
+                matches(&reader, STLC_COMPILER_VERSION) &&
+                matches(&reader, options(parallel)) &&
+                matches(&reader, source) &&
+                readField(&reader, &type, &typeLength) && typeLength < (int32_t)sizeof(stlc->type) &&
+                readField(&reader, &block, &size) && reader.offset == reader.size;
+
+    if (found)
+    {
+        memcpy(stlc->type, type, typeLength);
+        stlc->type[typeLength] = '\0';
+        /* A program's type is never a tuple, so it is a function exactly when it has an arrow. */
+        stlc->function = strstr(stlc->type, "->") != NULL;
+        stlc->block = ALLOCATE(unsigned char, size > 0 ? size : 1);
+        memcpy(stlc->block, block, size);
+        stlc->size = size;
+        stlc->cached = 1;
+        cache->hits++;
+    }
+
+    FREE(reader.data);
+
+    return found;
+}
+
+static void writeInt32(FILE *fp, int32_t value)
+{
+    unsigned char p[4];
+
+    for (int i = 0; i < 4; i++)
+        p[i] = ((uint32_t)value >> (i * 8)) & 0xff;
+    fwrite(p, 1, 4, fp);
+}
+
+static void writeField(FILE *fp, const void *bytes, int32_t length)
+{
+    writeInt32(fp, length);
+    fwrite(bytes, 1, length, fp);
+}
+
+static int store(Cache *cache, char *fileName, char *source, int parallel, Stlc *stlc)
+{
+    if (!makeDirectories(cache->directory))
+        return 0;
+
+    char *temporary = ALLOCATE(char, strlen(fileName) + 8);
+    sprintf(temporary, "%s.XXXXXX", fileName);
+
+    int fd = mkstemp(temporary);
+    FILE *fp = fd < 0 ? NULL : fdopen(fd, "wb");
+    int ok = fp != NULL;
+
+    if (ok)
+    {
+        fwrite(MAGIC, 1, 4, fp);
+        writeInt32(fp, FORMAT);
+        writeField(fp, STLC_COMPILER_VERSION, strlen(STLC_COMPILER_VERSION));
+        writeField(fp, options(parallel), strlen(options(parallel)));
+        writeField(fp, source, strlen(source));
+        writeField(fp, stlc->type, strlen(stlc->type));
+        writeField(fp, stlc->block, stlc->size);
+
+        ok = !ferror(fp);
+        ok = fclose(fp) == 0 && ok;
+        ok = ok && rename(temporary, fileName) == 0;
+    }
+    else if (fd >= 0)
+        close(fd);
+
+    if (!ok && fd >= 0)
+        unlink(temporary);
+    FREE(temporary);
+
+    return ok;
+}
+
+int cache_compile(Cache *cache, char *source, int parallel, Stlc *stlc)
+{
+    char *fileName = entryName(cache, entryKey(source, parallel));
+
+    stlc->block = NULL;
+    stlc->size = 0;
+    stlc->errorMessage[0] = '\0';
+    stlc->parseTime = 0;
+    stlc->inferTime = 0;
+    stlc->compileTime = 0;
+    stlc->arenaBytes = 0;
+
+    if (lookup(cache, fileName, source, parallel, stlc))
+    {
+        FREE(fileName);
+        return 1;
+    }
+
+    cache->misses++;
+
+    int ok = stlc_compile(source, parallel, stlc);
+    if (ok && !store(cache, fileName, source, parallel, stlc))
+        cache->failures++;
+
+    FREE(fileName);
+
+    return ok;
+}
+
+int64_t cache_hits(Cache *cache)
+{
+    return cache->hits;
+}
+
+int64_t cache_misses(Cache *cache)
+{
+    return cache->misses;
+}
+
+int64_t cache_failures(Cache *cache)
+{
+    return cache->failures;
+}
@@ -0,0 +1,44 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stdint.h>
+
+#include "stlc.h"
+
+/*
+ * A directory of compiled STLC programs addressed by their content: an
+ * entry is named by the FNV-1a hash of the compiler's version, the options
+ * it compiled with and the source, and holds those together with the
+ * program's type and bytecode.  The Kotlin front end's CompileCache.kt reads
+ * and writes the same entries under its own version.
+ *
+ * An entry is only a hit if what it holds matches exactly, so neither a
+ * hash collision nor a damaged entry can stand in for a compilation.  An
+ * entry is written to a temporary file that is then renamed over its name,
+ * so that builds sharing a directory only ever see whole entries.  Failing
+ * to read or write the cache only costs a compilation.
+ *
+ * Entry layout, little endian: "STLC", int32 format, and then the version,
+ * options, source, type and bytecode, each an int32 length followed by its
+ * bytes.  The type is as the REPL prints it.
+ */
+typedef struct Cache Cache;
+
+/* Bumped whenever the bytecode or type the front end produces changes. */
+#define STLC_COMPILER_VERSION "bci-c stlc 2"
+
+/* The directory named by STLC_CACHE, or else stlc within XDG_CACHE_HOME or ~/.cache - NULL if there is no home. */
+extern char *cache_defaultDirectory(void);
+
+extern Cache *cache_new(char *directory);
+extern void cache_free(Cache *cache);
+
+/* As stlc_compile, taking the program from the cache if it has been compiled before and storing it if not. */
+extern int cache_compile(Cache *cache, char *source, int parallel, Stlc *stlc);
+
+extern int64_t cache_hits(Cache *cache);
+extern int64_t cache_misses(Cache *cache);
+/* Entries that could not be written. */
+extern int64_t cache_failures(Cache *cache);
+
+#endif
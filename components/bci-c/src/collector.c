@@ -0,0 +1,298 @@
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <string.h>
+
+#include "memory.h"
+
+#include "collector.h"
+
+/* The length of a private stack at which its older half is published. */
+#define PUBLISH_AT 256
+
+#define INITIAL_CAPACITY 1024
+
+struct CollectorThread
+{
+    Collector *collector;
+    int32_t id;
+    pthread_t thread;
+
+    /* Only ever touched by this thread. */
+    void **stack;
+    int32_t size;
+    int32_t capacity;
+
+    /* Published grey values, taken from the head by this thread and by thieves alike. */
+    pthread_mutex_t lock;
+    void **published;
+    int32_t head;
+    int32_t tail;
+    int32_t publishedCapacity;
+    atomic_int publishedSize;
+};
+
+struct Collector
+{
+    int32_t threadCount;
+    int64_t threshold;
+    CollectorThread *threads;
+
+    pthread_mutex_t lock;
+    pthread_cond_t start;
+    pthread_cond_t finish;
+    int64_t generation;
+    int32_t finished;
+    int stopping;
+
+    void (*work)(void *context, CollectorThread *thread);
+    void *context;
+
+    /* Threads that may yet push: marking is complete once it reaches 0. */
+    atomic_int active;
+};
+
+static void *threadMain(void *arg)
+{
+    CollectorThread *thread = (CollectorThread *)arg;
+    Collector *collector = thread->collector;
+    int64_t seen = 0;
+
+    pthread_mutex_lock(&collector->lock);
+    while (1)
+    {
+        while (!collector->stopping && collector->generation == seen)
+            pthread_cond_wait(&collector->start, &collector->lock);
+        if (collector->stopping)
+            break;
+
+        seen = collector->generation;
+        pthread_mutex_unlock(&collector->lock);
+
+        collector->work(collector->context, thread);
+
+        pthread_mutex_lock(&collector->lock);
+        if (++collector->finished == collector->threadCount - 1)
+            pthread_cond_signal(&collector->finish);
+    }
+    pthread_mutex_unlock(&collector->lock);
+
+    return NULL;
+}
+
+Collector *collector_new(int32_t threads, int64_t threshold)
+{
+    Collector *collector = ALLOCATE(Collector, 1);
+
+    collector->threadCount = threads < 1 ? 1 : threads;
+    collector->threshold = threshold;
+    collector->threads = ALLOCATE(CollectorThread, collector->threadCount);
+    pthread_mutex_init(&collector->lock, NULL);
+    pthread_cond_init(&collector->start, NULL);
+    pthread_cond_init(&collector->finish, NULL);
+    collector->generation = 0;
+    collector->finished = 0;
+    collector->stopping = 0;
+    collector->work = NULL;
+    collector->context = NULL;
+    atomic_init(&collector->active, 0);
+
+    for (int i = 0; i < collector->threadCount; i++)
+    {
+        CollectorThread *thread = &collector->threads[i];
+
+        thread->collector = collector;
+        thread->id = i;
+        thread->stack = ALLOCATE(void *, INITIAL_CAPACITY);
+        thread->size = 0;
+        thread->capacity = INITIAL_CAPACITY;
+        pthread_mutex_init(&thread->lock, NULL);
+        thread->published = ALLOCATE(void *, INITIAL_CAPACITY);
+        thread->head = 0;
+        thread->tail = 0;
+        thread->publishedCapacity = INITIAL_CAPACITY;
+        atomic_init(&thread->publishedSize, 0);
+    }
+
+    for (int i = 1; i < collector->threadCount; i++)
+        pthread_create(&collector->threads[i].thread, NULL, threadMain, &collector->threads[i]);
+
+    return collector;
+}
+
+void collector_free(Collector *collector)
+{
+    pthread_mutex_lock(&collector->lock);
+    collector->stopping = 1;
+    pthread_cond_broadcast(&collector->start);
+    pthread_mutex_unlock(&collector->lock);
+
+    for (int i = 1; i < collector->threadCount; i++)
+        pthread_join(collector->threads[i].thread, NULL);
+
+    for (int i = 0; i < collector->threadCount; i++)
+    {
+        CollectorThread *thread = &collector->threads[i];
+
+        pthread_mutex_destroy(&thread->lock);
+        FREE(thread->published);
+        FREE(thread->stack);
+    }
+
+    pthread_cond_destroy(&collector->finish);
+    pthread_cond_destroy(&collector->start);
+    pthread_mutex_destroy(&collector->lock);
+
+    FREE(collector->threads);
+    FREE(collector);
+}
+
+int32_t collector_threads(Collector *collector)
+{
+    return collector->threadCount;
+}
+
+int64_t collector_threshold(Collector *collector)
+{
+    return collector->threshold;
+}
+
+void collector_run(Collector *collector, void (*work)(void *context, CollectorThread *thread), void *context)
+{
+    pthread_mutex_lock(&collector->lock);
+    collector->work = work;
+    collector->context = context;
+    collector->finished = 0;
+    atomic_store(&collector->active, collector->threadCount);
+    collector->generation++;
+    pthread_cond_broadcast(&collector->start);
+    pthread_mutex_unlock(&collector->lock);
+
+    work(context, &collector->threads[0]);
+
+    pthread_mutex_lock(&collector->lock);
+    while (collector->finished < collector->threadCount - 1)
+        pthread_cond_wait(&collector->finish, &collector->lock);
+    pthread_mutex_unlock(&collector->lock);
+}
+
+int32_t collector_id(CollectorThread *thread)
+{
+    return thread->id;
+}
+
+static void ensureStack(CollectorThread *thread, int32_t size)
+{
+    if (size > thread->capacity)
+    {
+        while (size > thread->capacity)
+            thread->capacity *= 2;
+        thread->stack = REALLOCATE(thread->stack, void *, thread->capacity);
+    }
+}
+
+/* Moves the older half of the private stack to the published deque, which is empty. */
+static void publish(CollectorThread *thread)
+{
+    int32_t count = thread->size / 2;
+
+    pthread_mutex_lock(&thread->lock);
+    if (count > thread->publishedCapacity)
+    {
+        while (count > thread->publishedCapacity)
+            thread->publishedCapacity *= 2;
+        thread->published = REALLOCATE(thread->published, void *, thread->publishedCapacity);
+    }
+    memcpy(thread->published, thread->stack, count * sizeof(void *));
+    thread->head = 0;
+    thread->tail = count;
+    atomic_store(&thread->publishedSize, count);
+    pthread_mutex_unlock(&thread->lock);
+
+    memmove(thread->stack, thread->stack + count, (thread->size - count) * sizeof(void *));
+    thread->size -= count;
+}
+
+void collector_push(CollectorThread *thread, void *grey)
+{
+    ensureStack(thread, thread->size + 1);
+    thread->stack[thread->size++] = grey;
+
+    if (thread->size >= PUBLISH_AT && thread->collector->threadCount > 1 && atomic_load_explicit(&thread->publishedSize, memory_order_relaxed) == 0)
+        publish(thread);
+}
+
+/* Moves all of victim's published values, or half of them if victim is another thread, to thread's private stack. */
+static int takePublished(CollectorThread *thread, CollectorThread *victim)
+{
+    if (atomic_load(&victim->publishedSize) == 0)
+        return 0;
+
+    pthread_mutex_lock(&victim->lock);
+    int32_t available = victim->tail - victim->head;
+    int32_t count = victim == thread ? available : (available + 1) / 2;
+
+    ensureStack(thread, thread->size + count);
+    memcpy(thread->stack + thread->size, victim->published + victim->head, count * sizeof(void *));
+    thread->size += count;
+    victim->head += count;
+    atomic_store(&victim->publishedSize, victim->tail - victim->head);
+    pthread_mutex_unlock(&victim->lock);
+
+    return count > 0;
+}
+
+static int findWork(CollectorThread *thread)
+{
+    Collector *collector = thread->collector;
+
+    if (takePublished(thread, thread))
+        return 1;
+
+    for (int i = 1; i < collector->threadCount; i++)
+    {
+        if (takePublished(thread, &collector->threads[(thread->id + i) % collector->threadCount]))
+            return 1;
+    }
+
+    return 0;
+}
+
+static int anyPublished(Collector *collector)
+{
+    for (int i = 0; i < collector->threadCount; i++)
+    {
+        if (atomic_load(&collector->threads[i].publishedSize) > 0)
+            return 1;
+    }
+
+    return 0;
+}
+
+void *collector_take(CollectorThread *thread)
+{
+    Collector *collector = thread->collector;
+
+    while (thread->size == 0)
+    {
+        if (findWork(thread))
+            break;
+
+        /*
+         * Only a thread that is active publishes, so once no thread is
+         * active and nothing is published there is nothing left to mark.
+         */
+        atomic_fetch_sub(&collector->active, 1);
+        while (1)
+        {
+            if (atomic_load(&collector->active) == 0)
+                return NULL;
+            if (anyPublished(collector))
+                break;
+            sched_yield();
+        }
+        atomic_fetch_add(&collector->active, 1);
+    }
+
+    return thread->stack[--thread->size];
+}
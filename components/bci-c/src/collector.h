@@ -0,0 +1,37 @@
+#ifndef COLLECTOR_H
+#define COLLECTOR_H
+
+#include <stdint.h>
+
+/*
+ * The threads of a parallel collector, enabled by attaching a Collector to a
+ * VM.  A collection of a heap holding at least threshold values marks and
+ * sweeps on every thread, the collecting thread included, rather than on the
+ * collecting thread alone.  Below the threshold waking the other threads
+ * costs more than they save.
+ *
+ * Marking shares out grey values through a work-stealing deque for each
+ * thread: a thread pushes the values it shades onto a private stack,
+ * publishes the older half of that stack once it grows long enough and
+ * nothing of its own is published, and once its stack is empty takes back
+ * what it published or steals what others have published.
+ */
+typedef struct Collector Collector;
+typedef struct CollectorThread CollectorThread;
+
+extern Collector *collector_new(int32_t threads, int64_t threshold);
+extern void collector_free(Collector *collector);
+
+extern int32_t collector_threads(Collector *collector);
+extern int64_t collector_threshold(Collector *collector);
+
+/* Calls work on every thread, with the calling thread as thread 0, and returns once every call has returned. */
+extern void collector_run(Collector *collector, void (*work)(void *context, CollectorThread *thread), void *context);
+
+extern int32_t collector_id(CollectorThread *thread);
+
+extern void collector_push(CollectorThread *thread, void *grey);
+/* Returns NULL once every thread's deque is empty and no thread is still pushing. */
+extern void *collector_take(CollectorThread *thread);
+
+#endif
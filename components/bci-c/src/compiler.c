@@ -0,0 +1,457 @@
+#include <string.h>
+
+#include "memory.h"
+#include "op.h"
+
+#include "compiler.h"
+
+#define INITIAL_BLOCK_SIZE 64
+#define INITIAL_SIZE 16
+
+typedef struct
+{
+    unsigned char *bytes;
+    int32_t size;
+    int32_t capacity;
+} Block;
+
+/* A label is a block's start or a position marked within a block. */
+typedef struct
+{
+    int32_t block;
+    int32_t offset;
+} Label;
+
+typedef struct
+{
+    int32_t block;
+    int32_t offset;
+    int32_t label;
+} Patch;
+
+typedef struct
+{
+    int32_t depth;
+    int32_t offset;
+    /* The binding of the same name that this one hides, plus 1, or 0. */
+    int32_t hidden;
+} Binding;
+
+/*
+ * Blocks are laid out in the order they are created.  Bindings are pushed
+ * and popped as the compiler enters and leaves scopes, so they form a stack,
+ * and innermost holds the top binding of each name.
+ */
+typedef struct
+{
+    int parallel;
+
+    Block *blocks;
+    int32_t blockCount;
+    int32_t blockSize;
+
+    Label *labels;
+    int32_t labelCount;
+    int32_t labelSize;
+
+    Patch *patches;
+    int32_t patchCount;
+    int32_t patchSize;
+
+    Binding *bindings;
+    int32_t bindingCount;
+    int32_t bindingSize;
+    int32_t *innermost;
+} Compiler;
+
+/* The scope compiled into: the activation depth and the next free slot of its state. */
+typedef struct
+{
+    int32_t depth;
+    int32_t nextOffset;
+} Environment;
+
+#define GROW(array, type, count, size)                  \
+    if ((count) == (size))                              \
+    {                                                   \
+        (size) *= 2;                                    \
+        (array) = REALLOCATE(array, type, size);        \
+    }
+
+static int32_t newLabel(Compiler *compiler)
+{
+    GROW(compiler->labels, Label, compiler->labelCount, compiler->labelSize);
+    compiler->labels[compiler->labelCount].block = -1;
+    compiler->labels[compiler->labelCount].offset = 0;
+
+    return compiler->labelCount++;
+}
+
+static int32_t createBlock(Compiler *compiler, int32_t label)
+{
+    GROW(compiler->blocks, Block, compiler->blockCount, compiler->blockSize);
+
+    Block *block = &compiler->blocks[compiler->blockCount];
+    block->bytes = ALLOCATE(unsigned char, INITIAL_BLOCK_SIZE);
+    block->size = 0;
+    block->capacity = INITIAL_BLOCK_SIZE;
+
+    compiler->labels[label].block = compiler->blockCount;
+    compiler->labels[label].offset = 0;
+
+    return compiler->blockCount++;
+}
+
+static void writeByte(Compiler *compiler, int32_t b, unsigned char byte)
+{
+    Block *block = &compiler->blocks[b];
+
+    GROW(block->bytes, unsigned char, block->size, block->capacity);
+    block->bytes[block->size++] = byte;
+}
+
+static void writeInt(Compiler *compiler, int32_t b, int32_t v)
+{
+    writeByte(compiler, b, v & 0xff);
+    writeByte(compiler, b, (v >> 8) & 0xff);
+    writeByte(compiler, b, (v >> 16) & 0xff);
+    writeByte(compiler, b, (v >> 24) & 0xff);
+}
+
+static void writeOpInt(Compiler *compiler, int32_t b, InstructionOpCode opCode, int32_t v)
+{
+    writeByte(compiler, b, opCode);
+    writeInt(compiler, b, v);
+}
+
+static void writeLabel(Compiler *compiler, int32_t b, int32_t label)
+{
+    GROW(compiler->patches, Patch, compiler->patchCount, compiler->patchSize);
+
+    Patch *patch = &compiler->patches[compiler->patchCount++];
+    patch->block = b;
+    patch->offset = compiler->blocks[b].size;
+    patch->label = label;
+
+    writeInt(compiler, b, 0);
+}
+
+static void markLabel(Compiler *compiler, int32_t b, int32_t label)
+{
+    compiler->labels[label].block = b;
+    compiler->labels[label].offset = compiler->blocks[b].size;
+}
+
+static Environment bind(Compiler *compiler, Environment env, int32_t name)
+{
+    GROW(compiler->bindings, Binding, compiler->bindingCount, compiler->bindingSize);
+
+    Binding *binding = &compiler->bindings[compiler->bindingCount];
+    binding->depth = env.depth;
+    binding->offset = env.nextOffset;
+    binding->hidden = compiler->innermost[name];
+    compiler->innermost[name] = ++compiler->bindingCount;
+
+    env.nextOffset++;
+
+    return env;
+}
+
+static void unbind(Compiler *compiler, int32_t name)
+{
+    compiler->innermost[name] = compiler->bindings[--compiler->bindingCount].hidden;
+}
+
+/* Passes over slots taken by an expression compiled earlier in the same activation. */
+static Environment skip(Environment env, int32_t slots)
+{
+    env.nextOffset += slots;
+
+    return env;
+}
+
+static Environment openScope(Environment env)
+{
+    env.depth++;
+    env.nextOffset = 0;
+
+    return env;
+}
+
+static int spawned(Compiler *compiler, Expression *e1, Expression *e2)
+{
+    return compiler->parallel && e1->expensive && e2->expensive;
+}
+
+/*
+ * Fills in, bottom up, whether each expression makes a call and the slots
+ * its activation's state needs for the names it binds.  A let's
+ * declarations may bind names of their own so their slots are counted too.
+ * Each subexpression binds its names in slots of its own, after those of
+ * the subexpressions compiled before it, as a closure made by one may read
+ * its slots after the next has run.
+ */
+static void measure(Compiler *compiler, Expression *e)
+{
+    switch (e->kind)
+    {
+    case EXPRESSION_APP:
+        measure(compiler, e->data.app.e1);
+        measure(compiler, e->data.app.e2);
+        e->expensive = 1;
+        e->enterSize = e->data.app.e1->enterSize + e->data.app.e2->enterSize;
+        break;
+    case EXPRESSION_IF:
+        measure(compiler, e->data.ifs.e1);
+        measure(compiler, e->data.ifs.e2);
+        measure(compiler, e->data.ifs.e3);
+        e->expensive = e->data.ifs.e1->expensive || e->data.ifs.e2->expensive || e->data.ifs.e3->expensive;
+        e->enterSize = e->data.ifs.e1->enterSize + e->data.ifs.e2->enterSize + e->data.ifs.e3->enterSize;
+        break;
+    case EXPRESSION_LAM:
+        measure(compiler, e->data.lam.e);
+        e->expensive = 0;
+        e->enterSize = 0;
+        break;
+    case EXPRESSION_LET:
+    case EXPRESSION_LET_REC:
+        measure(compiler, e->data.let.e);
+        e->expensive = e->data.let.e->expensive;
+        e->enterSize = e->data.let.count + e->data.let.e->enterSize;
+        for (int32_t i = 0; i < e->data.let.count; i++)
+        {
+            Expression *decl = e->data.let.decls[i].e;
+
+            measure(compiler, decl);
+            e->expensive = e->expensive || decl->expensive;
+            e->enterSize += decl->enterSize;
+        }
+        break;
+    case EXPRESSION_OP:
+        measure(compiler, e->data.op.e1);
+        measure(compiler, e->data.op.e2);
+        e->expensive = e->data.op.e1->expensive || e->data.op.e2->expensive;
+        /* A SPAWNed operand binds its names in the thunk's activation rather than in this one. */
+        e->enterSize = (spawned(compiler, e->data.op.e1, e->data.op.e2) ? 0 : e->data.op.e1->enterSize) + e->data.op.e2->enterSize;
+        break;
+    default:
+        e->expensive = 0;
+        e->enterSize = 0;
+    }
+}
+
+static void compileExpression(Compiler *compiler, Expression *e, int32_t bb, Environment env);
+
+static void compileThunk(Compiler *compiler, Expression *e, int32_t bb, Environment env)
+{
+    int32_t label = newLabel(compiler);
+    int32_t thunkBlock = createBlock(compiler, label);
+
+    if (e->enterSize > 0)
+        writeOpInt(compiler, thunkBlock, ENTER, e->enterSize);
+    compileExpression(compiler, e, thunkBlock, openScope(env));
+    writeByte(compiler, thunkBlock, RET);
+
+    writeByte(compiler, bb, SPAWN);
+    writeLabel(compiler, bb, label);
+}
+
+static void compileExpression(Compiler *compiler, Expression *e, int32_t bb, Environment env)
+{
+    switch (e->kind)
+    {
+    case EXPRESSION_APP:
+        compileExpression(compiler, e->data.app.e1, bb, env);
+        compileExpression(compiler, e->data.app.e2, bb, skip(env, e->data.app.e1->enterSize));
+        writeByte(compiler, bb, SWAP_CALL);
+        break;
+    case EXPRESSION_IF:
+    {
+        int32_t thenLabel = newLabel(compiler);
+        int32_t nextLabel = newLabel(compiler);
+        Environment branchEnv = skip(env, e->data.ifs.e1->enterSize);
+
+        compileExpression(compiler, e->data.ifs.e1, bb, env);
+        writeByte(compiler, bb, JMP_TRUE);
+        writeLabel(compiler, bb, thenLabel);
+
+        compileExpression(compiler, e->data.ifs.e3, bb, branchEnv);
+        writeByte(compiler, bb, JMP);
+        writeLabel(compiler, bb, nextLabel);
+
+        markLabel(compiler, bb, thenLabel);
+        compileExpression(compiler, e->data.ifs.e2, bb, branchEnv);
+
+        markLabel(compiler, bb, nextLabel);
+        break;
+    }
+    case EXPRESSION_BOOL:
+        writeByte(compiler, bb, e->data.b ? PUSH_TRUE : PUSH_FALSE);
+        break;
+    case EXPRESSION_INT:
+        writeOpInt(compiler, bb, PUSH_INT, e->data.i);
+        break;
+    case EXPRESSION_LAM:
+    {
+        int32_t label = newLabel(compiler);
+        int32_t lambdaBlock = createBlock(compiler, label);
+
+        writeOpInt(compiler, lambdaBlock, ENTER, 1 + e->data.lam.e->enterSize);
+        writeOpInt(compiler, lambdaBlock, STORE_VAR, 0);
+        compileExpression(compiler, e->data.lam.e, lambdaBlock, bind(compiler, openScope(env), e->data.lam.name));
+        unbind(compiler, e->data.lam.name);
+        writeByte(compiler, lambdaBlock, RET);
+
+        writeByte(compiler, bb, PUSH_CLOSURE);
+        writeLabel(compiler, bb, label);
+        break;
+    }
+    case EXPRESSION_LET:
+    {
+        Environment newEnv = env;
+
+        for (int32_t i = 0; i < e->data.let.count; i++)
+        {
+            Declaration *decl = &e->data.let.decls[i];
+
+            /* The declaration's own lets follow its slot. */
+            compileExpression(compiler, decl->e, bb, skip(newEnv, 1));
+            writeOpInt(compiler, bb, STORE_VAR, newEnv.nextOffset);
+            newEnv = skip(bind(compiler, newEnv, decl->name), decl->e->enterSize);
+        }
+
+        compileExpression(compiler, e->data.let.e, bb, newEnv);
+        for (int32_t i = e->data.let.count - 1; i >= 0; i--)
+            unbind(compiler, e->data.let.decls[i].name);
+        break;
+    }
+    case EXPRESSION_LET_REC:
+    {
+        Environment newEnv = env;
+
+        for (int32_t i = 0; i < e->data.let.count; i++)
+            newEnv = bind(compiler, newEnv, e->data.let.decls[i].name);
+
+        for (int32_t i = 0; i < e->data.let.count; i++)
+        {
+            Declaration *decl = &e->data.let.decls[i];
+
+            compileExpression(compiler, decl->e, bb, newEnv);
+            writeOpInt(compiler, bb, STORE_VAR, env.nextOffset + i);
+            newEnv = skip(newEnv, decl->e->enterSize);
+        }
+
+        compileExpression(compiler, e->data.let.e, bb, newEnv);
+        for (int32_t i = e->data.let.count - 1; i >= 0; i--)
+            unbind(compiler, e->data.let.decls[i].name);
+        break;
+    }
+    case EXPRESSION_OP:
+    {
+        static const InstructionOpCode opCodes[] = {EQ, ADD, SUB, MUL, DIV};
+
+        if (spawned(compiler, e->data.op.e1, e->data.op.e2))
+        {
+            compileThunk(compiler, e->data.op.e1, bb, env);
+            compileExpression(compiler, e->data.op.e2, bb, env);
+            writeByte(compiler, bb, JOIN);
+        }
+        else
+        {
+            compileExpression(compiler, e->data.op.e1, bb, env);
+            compileExpression(compiler, e->data.op.e2, bb, skip(env, e->data.op.e1->enterSize));
+        }
+        writeByte(compiler, bb, opCodes[e->data.op.op]);
+        break;
+    }
+    case EXPRESSION_VAR:
+    {
+        Binding *binding = &compiler->bindings[compiler->innermost[e->data.name] - 1];
+
+        writeByte(compiler, bb, PUSH_VAR);
+        writeInt(compiler, bb, env.depth - binding->depth);
+        writeInt(compiler, bb, binding->offset);
+        break;
+    }
+    }
+}
+
+/* Concatenates the blocks and fills in each label with its full 4 byte offset. */
+static unsigned char *link(Compiler *compiler, int32_t *size)
+{
+    int32_t *starts = ALLOCATE(int32_t, compiler->blockCount);
+    int32_t total = 0;
+
+    for (int32_t i = 0; i < compiler->blockCount; i++)
+    {
+        starts[i] = total;
+        total += compiler->blocks[i].size;
+    }
+
+    unsigned char *result = ALLOCATE(unsigned char, total);
+
+    for (int32_t i = 0; i < compiler->blockCount; i++)
+        memcpy(result + starts[i], compiler->blocks[i].bytes, compiler->blocks[i].size);
+
+    for (int32_t i = 0; i < compiler->patchCount; i++)
+    {
+        Patch *patch = &compiler->patches[i];
+        Label *label = &compiler->labels[patch->label];
+        int32_t offset = starts[label->block] + label->offset;
+        unsigned char *at = result + starts[patch->block] + patch->offset;
+
+        at[0] = offset & 0xff;
+        at[1] = (offset >> 8) & 0xff;
+        at[2] = (offset >> 16) & 0xff;
+        at[3] = (offset >> 24) & 0xff;
+    }
+
+    FREE(starts);
+    *size = total;
+
+    return result;
+}
+
+unsigned char *compiler_compile(Program *program, int parallel, int32_t *size)
+{
+    Compiler compiler;
+
+    compiler.parallel = parallel;
+    compiler.blocks = ALLOCATE(Block, INITIAL_SIZE);
+    compiler.blockCount = 0;
+    compiler.blockSize = INITIAL_SIZE;
+    compiler.labels = ALLOCATE(Label, INITIAL_SIZE);
+    compiler.labelCount = 0;
+    compiler.labelSize = INITIAL_SIZE;
+    compiler.patches = ALLOCATE(Patch, INITIAL_SIZE);
+    compiler.patchCount = 0;
+    compiler.patchSize = INITIAL_SIZE;
+    compiler.bindings = ALLOCATE(Binding, INITIAL_SIZE);
+    compiler.bindingCount = 0;
+    compiler.bindingSize = INITIAL_SIZE;
+    compiler.innermost = ALLOCATE(int32_t, program->nameCount + 1);
+    memset(compiler.innermost, 0, sizeof(int32_t) * (program->nameCount + 1));
+
+    Expression *toplevel = program->expression;
+    measure(&compiler, toplevel);
+
+    int32_t bb = createBlock(&compiler, newLabel(&compiler));
+    if (toplevel->enterSize > 0)
+        writeOpInt(&compiler, bb, ENTER, toplevel->enterSize);
+
+    Environment env = {0, 0};
+    compileExpression(&compiler, toplevel, bb, env);
+    writeByte(&compiler, bb, RET);
+
+    unsigned char *result = link(&compiler, size);
+
+    for (int32_t i = 0; i < compiler.blockCount; i++)
+        FREE(compiler.blocks[i].bytes);
+    FREE(compiler.innermost);
+    FREE(compiler.bindings);
+    FREE(compiler.patches);
+    FREE(compiler.labels);
+    FREE(compiler.blocks);
+
+    return result;
+}
@@ -0,0 +1,18 @@
+#ifndef COMPILER_H
+#define COMPILER_H
+
+#include <stdint.h>
+
+#include "parser.h"
+
+/*
+ * Generates the same bytecode as the Kotlin front end's bci/Compiler.kt from
+ * a program that has been type checked.  With parallel the operands of an
+ * operator that make calls, and that are followed by another that does, are
+ * compiled into thunks that are SPAWNed.
+ *
+ * Returns the program in a block that the caller frees.
+ */
+extern unsigned char *compiler_compile(Program *program, int parallel, int32_t *size);
+
+#endif
@@ -24,7 +24,7 @@ void dis(unsigned char *code, int codeLength)
 
         unsigned char opcode = code[i++];
 
-        Instruction *instruction = find(opcode);
+        const Instruction *instruction = find(opcode);
         if (instruction == NULL)
         {
             printf("Unknown opcode: %d\n", (int)opcode);
@@ -0,0 +1,207 @@
+#include <signal.h>
+#include <string.h>
+
+#include "memory.h"
+#include "timer.h"
+
+#include "gcstats.h"
+
+#define TYPES (VActivation + 1)
+#define BUCKETS 48
+
+typedef struct
+{
+    int64_t count;
+    int64_t total;
+    int64_t max;
+    int64_t buckets[BUCKETS];
+} Histogram;
+
+struct GcStats
+{
+    char *fileName;
+    int64_t start;
+
+    int64_t collections;
+    Histogram mark;
+    Histogram sweep;
+    Histogram pause;
+
+    int64_t allocatedObjects[TYPES];
+    int64_t allocatedBytes[TYPES];
+    int64_t freedObjects[TYPES];
+    int64_t freedBytes[TYPES];
+
+    int64_t peakObjects;
+    int64_t peakBytes;
+
+    /* Objects found live and examined over every collection. */
+    int64_t survived;
+    int64_t examined;
+    double lastSurvival;
+};
+
+static volatile sig_atomic_t writeRequested = 0;
+
+static char *typeNames[TYPES] = {"int", "bool", "closure", "activation"};
+
+GcStats *gcstats_new(char *fileName)
+{
+    GcStats *stats = ALLOCATE(GcStats, 1);
+
+    memset(stats, 0, sizeof(GcStats));
+    stats->fileName = fileName == NULL || strcmp(fileName, "-") == 0 ? NULL : STRDUP(fileName);
+    stats->start = timer_now();
+
+    return stats;
+}
+
+void gcstats_free(GcStats *stats)
+{
+    if (stats->fileName != NULL)
+        FREE(stats->fileName);
+    FREE(stats);
+}
+
+static void record(Histogram *histogram, int64_t time)
+{
+    int bucket = 0;
+
+    while (bucket < BUCKETS - 1 && (time >> (bucket + 1)) > 0)
+        bucket++;
+
+    histogram->count++;
+    histogram->total += time;
+    if (time > histogram->max)
+        histogram->max = time;
+    histogram->buckets[bucket]++;
+}
+
+void gcstats_allocate(GcStats *stats, ValueType type, int objects, int64_t bytes, MemoryState *mm)
+{
+    stats->allocatedObjects[type] += objects;
+    stats->allocatedBytes[type] += bytes;
+
+    if (mm->size > stats->peakObjects)
+        stats->peakObjects = mm->size;
+    if (mm->bytes > stats->peakBytes)
+        stats->peakBytes = mm->bytes;
+}
+
+void gcstats_collect(GcStats *stats, int before, int after, int64_t markTime, int64_t sweepTime, int64_t *freedObjects, int64_t *freedBytes)
+{
+    stats->collections++;
+    record(&stats->mark, markTime);
+    record(&stats->sweep, sweepTime);
+    record(&stats->pause, markTime + sweepTime);
+
+    for (int i = 0; i < TYPES; i++)
+    {
+        stats->freedObjects[i] += freedObjects[i];
+        stats->freedBytes[i] += freedBytes[i];
+    }
+
+    stats->survived += after;
+    stats->examined += before;
+    stats->lastSurvival = before == 0 ? 1.0 : (double)after / before;
+
+    if (writeRequested)
+    {
+        writeRequested = 0;
+        gcstats_write(stats);
+    }
+}
+
+static void writeHistogram(char *name, Histogram *histogram, FILE *out)
+{
+    int first = 1;
+
+    fprintf(out, "\"%s\": {\"count\": %ld, \"total\": %ld, \"max\": %ld, \"mean\": %.1f, \"histogram\": [",
+            name,
+            (long)histogram->count,
+            (long)histogram->total,
+            (long)histogram->max,
+            histogram->count == 0 ? 0.0 : (double)histogram->total / histogram->count);
+
+    for (int i = 0; i < BUCKETS; i++)
+    {
+        if (histogram->buckets[i] == 0)
+            continue;
+
+        fprintf(out, "%s{\"lt\": %ld, \"count\": %ld}", first ? "" : ", ", 1L << (i + 1), (long)histogram->buckets[i]);
+        first = 0;
+    }
+
+    fprintf(out, "]}");
+}
+
+static void writeByType(char *name, int64_t *objects, int64_t *bytes, FILE *out)
+{
+    fprintf(out, "\"%s\": {", name);
+    for (int i = 0; i < TYPES; i++)
+        fprintf(out, "%s\"%s\": {\"objects\": %ld, \"bytes\": %ld}", i == 0 ? "" : ", ", typeNames[i], (long)objects[i], (long)bytes[i]);
+    fprintf(out, "}");
+}
+
+void gcstats_writeJson(GcStats *stats, FILE *out)
+{
+    int64_t elapsed = timer_now() - stats->start;
+    int64_t allocated = 0;
+
+    for (int i = 0; i < TYPES; i++)
+        allocated += stats->allocatedObjects[i];
+
+    fprintf(out, "{\"elapsedNs\": %ld, \"collections\": %ld, ", (long)elapsed, (long)stats->collections);
+    writeHistogram("markNs", &stats->mark, out);
+    fprintf(out, ", ");
+    writeHistogram("sweepNs", &stats->sweep, out);
+    fprintf(out, ", ");
+    writeHistogram("pauseNs", &stats->pause, out);
+    fprintf(out, ", ");
+    writeByType("allocated", stats->allocatedObjects, stats->allocatedBytes, out);
+    fprintf(out, ", ");
+    writeByType("freed", stats->freedObjects, stats->freedBytes, out);
+    fprintf(out, ", \"allocationsPerSecond\": %.0f, \"peakObjects\": %ld, \"peakBytes\": %ld, \"survivalRate\": %.4f, \"lastSurvivalRate\": %.4f}\n",
+            elapsed == 0 ? 0.0 : allocated * 1000000000.0 / elapsed,
+            (long)stats->peakObjects,
+            (long)stats->peakBytes,
+            stats->examined == 0 ? 1.0 : (double)stats->survived / stats->examined,
+            stats->lastSurvival);
+}
+
+void gcstats_write(GcStats *stats)
+{
+    if (stats->fileName == NULL)
+    {
+        gcstats_writeJson(stats, stderr);
+        return;
+    }
+
+    FILE *fp = fopen(stats->fileName, "w");
+    if (fp == NULL)
+    {
+        fprintf(stderr, "Unable to write: %s\n", stats->fileName);
+        return;
+    }
+
+    gcstats_writeJson(stats, fp);
+    fclose(fp);
+}
+
+static void requestWrite(int signal)
+{
+    (void)signal;
+
+    writeRequested = 1;
+}
+
+void gcstats_writeOnSignal(int signal)
+{
+    struct sigaction action;
+
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = requestWrite;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_RESTART;
+    sigaction(signal, &action, NULL);
+}
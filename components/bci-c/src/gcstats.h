@@ -0,0 +1,34 @@
+#ifndef GCSTATS_H
+#define GCSTATS_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "value.h"
+
+/*
+ * Collector telemetry for a single heap, enabled by attaching a GcStats to a
+ * VM.  Pause times are kept as log2 histograms in nanoseconds; objects and
+ * bytes are broken down by value type, where an activation's bytes include
+ * its state.
+ */
+typedef struct GcStats GcStats;
+
+/* Writes to fileName, or stderr if it is NULL or "-". */
+extern GcStats *gcstats_new(char *fileName);
+extern void gcstats_free(GcStats *stats);
+
+extern void gcstats_allocate(GcStats *stats, ValueType type, int objects, int64_t bytes, MemoryState *mm);
+extern void gcstats_collect(GcStats *stats, int before, int after, int64_t markTime, int64_t sweepTime, int64_t *freedObjects, int64_t *freedBytes);
+
+extern void gcstats_writeJson(GcStats *stats, FILE *out);
+/* Writes the statistics to the file given to gcstats_new. */
+extern void gcstats_write(GcStats *stats);
+
+/*
+ * Installs a handler for signal after which the statistics are written at
+ * the end of the next collection.
+ */
+extern void gcstats_writeOnSignal(int signal);
+
+#endif
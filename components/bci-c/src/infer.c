@@ -0,0 +1,844 @@
+#include <setjmp.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "memory.h"
+
+#include "infer.h"
+
+#define INITIAL_VARIABLES 256
+#define INITIAL_CONSTRAINTS 256
+
+typedef enum
+{
+    TYPE_VAR,
+    TYPE_CON,
+    TYPE_ARR,
+    TYPE_TUPLE
+} TypeKind;
+
+/*
+ * A type carries the location it was inferred at, which an error message
+ * reports, so moving a type to another location copies the node.  Nodes are
+ * otherwise shared and never changed once built.
+ */
+struct Type
+{
+    TypeKind kind;
+    int hasVariables;
+    Location *location;
+
+    union
+    {
+        int32_t var;
+        const char *name;
+        struct
+        {
+            Type *domain;
+            Type *range;
+        } arr;
+        struct
+        {
+            Type **types;
+            int32_t count;
+        } tuple;
+    } data;
+};
+
+static Type typeInt = {TYPE_CON, 0, NULL, {.name = "Int"}};
+static Type typeBool = {TYPE_CON, 0, NULL, {.name = "Bool"}};
+
+static Type intToInt = {TYPE_ARR, 0, NULL, {.arr = {&typeInt, &typeInt}}};
+static Type intToBool = {TYPE_ARR, 0, NULL, {.arr = {&typeInt, &typeBool}}};
+static Type arithmetic = {TYPE_ARR, 0, NULL, {.arr = {&typeInt, &intToInt}}};
+static Type equality = {TYPE_ARR, 0, NULL, {.arr = {&typeInt, &intToBool}}};
+
+/* Indexed on BinaryOp. */
+static Type *ops[] = {&equality, &arithmetic, &arithmetic, &arithmetic, &arithmetic};
+
+typedef struct
+{
+    int32_t *names;
+    int32_t count;
+    Type *type;
+} Scheme;
+
+typedef struct Scope
+{
+    Scheme scheme;
+    struct Scope *next;
+} Scope;
+
+/*
+ * The state of Inference.kt and of Constraints.kt's UnionFind together.
+ * Variables are numbered from 1, as the Kotlin Pump names them V1, V2, ...,
+ * and each variable's binding, level and resolved type are held in arrays
+ * indexed on its number.
+ */
+typedef struct
+{
+    Arena *arena;
+    jmp_buf errorHandler;
+    char *errorMessage;
+    Program *program;
+
+    /* Indexed on a name's number, the innermost binding of the name first. */
+    Scope **scopes;
+    Scope *freeScopes;
+    int32_t level;
+
+    int32_t variableCount;
+    int32_t variableSize;
+    Type **bindings;
+    int32_t *levels;
+
+    /* The resolved types of bound variables, valid while resolvedAt matches generation. */
+    Type **resolved;
+    int64_t *resolvedAt;
+    int64_t generation;
+
+    /* The variables collected by ftv, each marked by seen matching seenStamp. */
+    int32_t *variables;
+    int32_t variablesCount;
+    int64_t *seen;
+    int64_t seenStamp;
+
+    Type **constraints;
+    int32_t constraintCount;
+    int32_t constraintSize;
+    /* The number of constraints, from the first, that have been unified. */
+    int32_t solved;
+} Inference;
+
+typedef struct
+{
+    char *buffer;
+    int32_t size;
+    int32_t length;
+} Text;
+
+static void append(Text *text, const char *s)
+{
+    int32_t length = strlen(s);
+
+    if (text->length + length >= text->size)
+        length = text->size - text->length - 1;
+    if (length > 0)
+    {
+        memcpy(text->buffer + text->length, s, length);
+        text->length += length;
+        text->buffer[text->length] = '\0';
+    }
+}
+
+static void appendVariable(Text *text, int32_t var, int32_t *renamed)
+{
+    char name[32];
+
+    if (renamed == NULL)
+        sprintf(name, "V%d", var);
+    else if (renamed[var] < 26)
+        sprintf(name, "%c", 'a' + renamed[var]);
+    else
+        sprintf(name, "t%d", renamed[var] - 26);
+
+    append(text, name);
+}
+
+static void appendType(Text *text, Type *type, int32_t *renamed)
+{
+    switch (type->kind)
+    {
+    case TYPE_VAR:
+        appendVariable(text, type->data.var, renamed);
+        break;
+    case TYPE_CON:
+        append(text, type->data.name);
+        break;
+    case TYPE_ARR:
+        if (type->data.arr.domain->kind == TYPE_ARR)
+        {
+            append(text, "(");
+            appendType(text, type->data.arr.domain, renamed);
+            append(text, ")");
+        }
+        else
+            appendType(text, type->data.arr.domain, renamed);
+        append(text, " -> ");
+        appendType(text, type->data.arr.range, renamed);
+        break;
+    case TYPE_TUPLE:
+        append(text, "(");
+        for (int32_t i = 0; i < type->data.tuple.count; i++)
+        {
+            if (i > 0)
+                append(text, " * ");
+            appendType(text, type->data.tuple.types[i], renamed);
+        }
+        append(text, ")");
+        break;
+    }
+}
+
+/* Type.prettyPrint: the type and, if it has one, its location. */
+static void appendPretty(Text *text, Type *type)
+{
+    appendType(text, type, NULL);
+    if (type->location != NULL)
+    {
+        char location[64];
+
+        parser_locationToString(type->location, location, sizeof(location));
+        append(text, " from ");
+        append(text, location);
+    }
+}
+
+static Type *newType(Inference *state, TypeKind kind, int hasVariables, Location *location)
+{
+    Type *type = ARENA_ALLOCATE(state->arena, Type, 1);
+
+    type->kind = kind;
+    type->hasVariables = hasVariables;
+    type->location = location;
+
+    return type;
+}
+
+static Type *atLocation(Inference *state, Type *type, Location *location)
+{
+    Type *result = newType(state, type->kind, type->hasVariables, location);
+
+    result->data = type->data;
+
+    return result;
+}
+
+static Type *newArr(Inference *state, Type *domain, Type *range, Location *location)
+{
+    Type *type = newType(state, TYPE_ARR, domain->hasVariables || range->hasVariables, location);
+
+    type->data.arr.domain = domain;
+    type->data.arr.range = range;
+
+    return type;
+}
+
+static Type *newTuple(Inference *state, Type **types, int32_t count)
+{
+    Type *type = newType(state, TYPE_TUPLE, 0, NULL);
+
+    type->data.tuple.types = types;
+    type->data.tuple.count = count;
+    for (int32_t i = 0; i < count; i++)
+        type->hasVariables |= types[i]->hasVariables;
+
+    return type;
+}
+
+static Type *fresh(Inference *state)
+{
+    if (state->variableCount + 1 == state->variableSize)
+    {
+        state->variableSize *= 2;
+        state->bindings = REALLOCATE(state->bindings, Type *, state->variableSize);
+        state->levels = REALLOCATE(state->levels, int32_t, state->variableSize);
+        state->resolved = REALLOCATE(state->resolved, Type *, state->variableSize);
+        state->resolvedAt = REALLOCATE(state->resolvedAt, int64_t, state->variableSize);
+        state->variables = REALLOCATE(state->variables, int32_t, state->variableSize);
+        state->seen = REALLOCATE(state->seen, int64_t, state->variableSize);
+    }
+
+    int32_t var = ++state->variableCount;
+    Type *type = newType(state, TYPE_VAR, 1, NULL);
+
+    type->data.var = var;
+    state->bindings[var] = NULL;
+    state->levels[var] = state->level;
+    state->resolved[var] = NULL;
+    state->resolvedAt[var] = -1;
+    state->seen[var] = 0;
+
+    return type;
+}
+
+static void addConstraint(Inference *state, Type *t1, Type *t2)
+{
+    if (state->constraintCount + 2 > state->constraintSize)
+    {
+        state->constraintSize *= 2;
+        state->constraints = REALLOCATE(state->constraints, Type *, state->constraintSize);
+    }
+
+    state->constraints[state->constraintCount++] = t1;
+    state->constraints[state->constraintCount++] = t2;
+}
+
+static Type *find(Inference *state, Type *t)
+{
+    Type *end = t;
+    while (end->kind == TYPE_VAR && state->bindings[end->data.var] != NULL)
+        end = state->bindings[end->data.var];
+
+    Type *v = t;
+    while (v->kind == TYPE_VAR && v != end)
+    {
+        Type *next = state->bindings[v->data.var];
+        if (next == NULL)
+            break;
+        state->bindings[v->data.var] = end;
+        v = next;
+    }
+
+    return end;
+}
+
+/* Resolves every variable within type, returning type itself if none is bound. */
+static Type *resolve(Inference *state, Type *type)
+{
+    if (type->kind == TYPE_VAR && state->resolvedAt[type->data.var] == state->generation)
+        return state->resolved[type->data.var];
+
+    if (!type->hasVariables)
+        return type;
+
+    Type *t = find(state, type);
+    Type *result = t;
+
+    if (t->kind == TYPE_ARR)
+    {
+        Type *domain = resolve(state, t->data.arr.domain);
+        Type *range = resolve(state, t->data.arr.range);
+
+        if (domain != t->data.arr.domain || range != t->data.arr.range)
+            result = newArr(state, domain, range, NULL);
+    }
+    else if (t->kind == TYPE_TUPLE)
+    {
+        Type **types = NULL;
+
+        for (int32_t i = 0; i < t->data.tuple.count; i++)
+        {
+            Type *resolvedType = resolve(state, t->data.tuple.types[i]);
+
+            if (types == NULL && resolvedType != t->data.tuple.types[i])
+            {
+                types = ARENA_ALLOCATE(state->arena, Type *, t->data.tuple.count);
+                memcpy(types, t->data.tuple.types, sizeof(Type *) * i);
+            }
+            if (types != NULL)
+                types[i] = resolvedType;
+        }
+        if (types != NULL)
+            result = newTuple(state, types, t->data.tuple.count);
+    }
+
+    if (type->kind == TYPE_VAR && state->bindings[type->data.var] != NULL)
+    {
+        state->resolved[type->data.var] = result;
+        state->resolvedAt[type->data.var] = state->generation;
+    }
+
+    return result;
+}
+
+static void mismatch(Inference *state, Type *t1, Type *t2)
+{
+    Text text = {state->errorMessage, STLC_ERROR_MESSAGE_SIZE, 0};
+
+    text.buffer[0] = '\0';
+    append(&text, "Unification Mismatch: unable to unify ");
+    appendPretty(&text, resolve(state, t1));
+    append(&text, " with ");
+    appendType(&text, resolve(state, t2), NULL);
+
+    longjmp(state->errorHandler, 1);
+}
+
+/* Lowers the level of every other variable within type to at most level on the way. */
+static int occurs(Inference *state, int32_t var, int32_t level, Type *type)
+{
+    if (!type->hasVariables)
+        return 0;
+
+    Type *t = find(state, type);
+
+    switch (t->kind)
+    {
+    case TYPE_VAR:
+        if (state->levels[t->data.var] > level)
+            state->levels[t->data.var] = level;
+        return t->data.var == var;
+    case TYPE_ARR:
+        return occurs(state, var, level, t->data.arr.domain) || occurs(state, var, level, t->data.arr.range);
+    case TYPE_TUPLE:
+        for (int32_t i = 0; i < t->data.tuple.count; i++)
+        {
+            if (occurs(state, var, level, t->data.tuple.types[i]))
+                return 1;
+        }
+        return 0;
+    default:
+        return 0;
+    }
+}
+
+static void bind(Inference *state, Type *v, Type *type)
+{
+    int32_t var = v->data.var;
+
+    if (occurs(state, var, state->levels[var], type))
+    {
+        Text text = {state->errorMessage, STLC_ERROR_MESSAGE_SIZE, 0};
+        char name[32];
+
+        sprintf(name, "V%d", var);
+        text.buffer[0] = '\0';
+        append(&text, "Infinite Type: unable to unify ");
+        append(&text, name);
+        append(&text, " with ");
+        appendPretty(&text, resolve(state, type));
+
+        longjmp(state->errorHandler, 1);
+    }
+
+    state->bindings[var] = v->location == NULL || type->location != NULL ? type : atLocation(state, type, v->location);
+}
+
+static void unify(Inference *state, Type *t1, Type *t2)
+{
+    Type *r1 = find(state, t1);
+    Type *r2 = find(state, t2);
+
+    if (r1->kind == TYPE_VAR && r2->kind == TYPE_VAR && r1->data.var == r2->data.var)
+        return;
+    if (r1->kind == TYPE_VAR)
+        bind(state, r1, r2);
+    else if (r2->kind == TYPE_VAR)
+        bind(state, r2, r1);
+    else if (r1->kind == TYPE_ARR && r2->kind == TYPE_ARR)
+    {
+        unify(state, r1->data.arr.domain, r2->data.arr.domain);
+        unify(state, r1->data.arr.range, r2->data.arr.range);
+    }
+    else if (r1->kind == TYPE_TUPLE && r2->kind == TYPE_TUPLE)
+    {
+        if (r1->data.tuple.count != r2->data.tuple.count)
+            mismatch(state, r1, r2);
+        for (int32_t i = 0; i < r1->data.tuple.count; i++)
+            unify(state, r1->data.tuple.types[i], r2->data.tuple.types[i]);
+    }
+    else if (!(r1->kind == TYPE_CON && r2->kind == TYPE_CON && r1->data.name == r2->data.name))
+        mismatch(state, r1, r2);
+}
+
+static void solveAdded(Inference *state)
+{
+    if (state->solved < state->constraintCount)
+        state->generation++;
+
+    while (state->solved < state->constraintCount)
+    {
+        Type *t1 = state->constraints[state->solved++];
+        Type *t2 = state->constraints[state->solved++];
+
+        unify(state, t1, t2);
+    }
+}
+
+/* Appends the variables of type not yet seen, in the order Type.ftv lists them. */
+static void ftv(Inference *state, Type *type)
+{
+    if (!type->hasVariables)
+        return;
+
+    switch (type->kind)
+    {
+    case TYPE_VAR:
+        if (state->seen[type->data.var] != state->seenStamp)
+        {
+            state->seen[type->data.var] = state->seenStamp;
+            state->variables[state->variablesCount++] = type->data.var;
+        }
+        break;
+    case TYPE_ARR:
+        ftv(state, type->data.arr.domain);
+        ftv(state, type->data.arr.range);
+        break;
+    case TYPE_TUPLE:
+        for (int32_t i = 0; i < type->data.tuple.count; i++)
+            ftv(state, type->data.tuple.types[i]);
+        break;
+    default:
+        break;
+    }
+}
+
+/* Solves and then quantifies every variable of type that was created, and is still only reachable, deeper than level. */
+static Scheme generalise(Inference *state, Type *type, int32_t level)
+{
+    solveAdded(state);
+
+    Scheme scheme;
+    Type *t = resolve(state, type);
+
+    scheme.type = t;
+    scheme.names = NULL;
+    scheme.count = 0;
+
+    if (!t->hasVariables)
+        return scheme;
+
+    state->seenStamp++;
+    state->variablesCount = 0;
+    ftv(state, t);
+
+    for (int32_t i = 0; i < state->variablesCount; i++)
+    {
+        if (state->levels[state->variables[i]] > level)
+            state->variables[scheme.count++] = state->variables[i];
+    }
+    scheme.names = ARENA_ALLOCATE(state->arena, int32_t, scheme.count);
+    memcpy(scheme.names, state->variables, sizeof(int32_t) * scheme.count);
+
+    return scheme;
+}
+
+static Type *substitute(Inference *state, Type *type, Scheme *scheme, Type **instances)
+{
+    if (!type->hasVariables)
+        return type;
+
+    switch (type->kind)
+    {
+    case TYPE_VAR:
+        for (int32_t i = 0; i < scheme->count; i++)
+        {
+            if (scheme->names[i] == type->data.var)
+                return instances[i];
+        }
+        return type;
+    case TYPE_ARR:
+    {
+        Type *domain = substitute(state, type->data.arr.domain, scheme, instances);
+        Type *range = substitute(state, type->data.arr.range, scheme, instances);
+
+        return domain == type->data.arr.domain && range == type->data.arr.range ? type : newArr(state, domain, range, NULL);
+    }
+    case TYPE_TUPLE:
+    {
+        Type **types = ARENA_ALLOCATE(state->arena, Type *, type->data.tuple.count);
+        int changed = 0;
+
+        for (int32_t i = 0; i < type->data.tuple.count; i++)
+        {
+            types[i] = substitute(state, type->data.tuple.types[i], scheme, instances);
+            changed |= types[i] != type->data.tuple.types[i];
+        }
+
+        return changed ? newTuple(state, types, type->data.tuple.count) : type;
+    }
+    default:
+        return type;
+    }
+}
+
+static Type *instantiate(Inference *state, Scheme *scheme)
+{
+    if (scheme->count == 0)
+        return scheme->type;
+
+    Type **instances = ARENA_ALLOCATE(state->arena, Type *, scheme->count);
+
+    for (int32_t i = 0; i < scheme->count; i++)
+        instances[i] = fresh(state);
+
+    return substitute(state, scheme->type, scheme, instances);
+}
+
+static void bindName(Inference *state, int32_t name, Scheme scheme)
+{
+    Scope *scope = state->freeScopes;
+
+    if (scope == NULL)
+        scope = ARENA_ALLOCATE(state->arena, Scope, 1);
+    else
+        state->freeScopes = scope->next;
+
+    scope->scheme = scheme;
+    scope->next = state->scopes[name];
+    state->scopes[name] = scope;
+}
+
+static void unbindName(Inference *state, int32_t name)
+{
+    Scope *scope = state->scopes[name];
+
+    state->scopes[name] = scope->next;
+    scope->next = state->freeScopes;
+    state->freeScopes = scope;
+}
+
+static Scheme monomorphic(Type *type)
+{
+    Scheme scheme = {NULL, 0, type};
+
+    return scheme;
+}
+
+static Type *infer(Inference *state, Expression *e)
+{
+    switch (e->kind)
+    {
+    case EXPRESSION_APP:
+    {
+        Type *t1 = infer(state, e->data.app.e1);
+        Type *t2 = infer(state, e->data.app.e2);
+        Type *tv = fresh(state);
+
+        addConstraint(state, t1, newArr(state, t2, tv, NULL));
+
+        return tv;
+    }
+    case EXPRESSION_IF:
+    {
+        Type *t1 = infer(state, e->data.ifs.e1);
+        Type *t2 = infer(state, e->data.ifs.e2);
+        Type *t3 = infer(state, e->data.ifs.e3);
+
+        addConstraint(state, t1, &typeBool);
+        addConstraint(state, t2, t3);
+
+        return t2;
+    }
+    case EXPRESSION_LAM:
+    {
+        Type *tv = fresh(state);
+
+        bindName(state, e->data.lam.name, monomorphic(tv));
+        Type *t = infer(state, e->data.lam.e);
+        unbindName(state, e->data.lam.name);
+
+        return newArr(state, tv, t, NULL);
+    }
+    case EXPRESSION_BOOL:
+        return atLocation(state, &typeBool, &e->location);
+    case EXPRESSION_INT:
+        return atLocation(state, &typeInt, &e->location);
+    case EXPRESSION_LET:
+    {
+        for (int32_t i = 0; i < e->data.let.count; i++)
+        {
+            Declaration *decl = &e->data.let.decls[i];
+
+            state->level++;
+            Type *inferredType = infer(state, decl->e);
+            state->level--;
+
+            bindName(state, decl->name, generalise(state, inferredType, state->level));
+        }
+
+        Type *t = infer(state, e->data.let.e);
+        for (int32_t i = e->data.let.count - 1; i >= 0; i--)
+            unbindName(state, e->data.let.decls[i].name);
+
+        return t;
+    }
+    case EXPRESSION_LET_REC:
+    {
+        int32_t count = e->data.let.count;
+        Declaration *decls = e->data.let.decls;
+        Type **tvs = ARENA_ALLOCATE(state->arena, Type *, count);
+        Type **types = ARENA_ALLOCATE(state->arena, Type *, count);
+
+        state->level++;
+        for (int32_t i = 0; i < count; i++)
+            tvs[i] = fresh(state);
+        for (int32_t i = 0; i < count; i++)
+            bindName(state, decls[i].name, monomorphic(tvs[i]));
+
+        /*
+         * fix (\_bob -> (e1, ..., en)), as Inference.kt infers the
+         * declarations.  _bob is never referred to, so is left unbound.
+         */
+        Type *bob = fresh(state);
+        for (int32_t i = 0; i < count; i++)
+            types[i] = infer(state, decls[i].e);
+        Type *t1 = newArr(state, bob, newTuple(state, types, count), NULL);
+        Type *declarationType = fresh(state);
+        addConstraint(state, newArr(state, declarationType, declarationType, NULL), t1);
+
+        addConstraint(state, declarationType, newTuple(state, tvs, count));
+        for (int32_t i = count - 1; i >= 0; i--)
+            unbindName(state, decls[i].name);
+        state->level--;
+
+        Scheme *schemes = ARENA_ALLOCATE(state->arena, Scheme, count);
+        for (int32_t i = 0; i < count; i++)
+            schemes[i] = generalise(state, tvs[i], state->level);
+        for (int32_t i = 0; i < count; i++)
+            bindName(state, decls[i].name, schemes[i]);
+
+        Type *t = infer(state, e->data.let.e);
+        for (int32_t i = count - 1; i >= 0; i--)
+            unbindName(state, decls[i].name);
+
+        return t;
+    }
+    case EXPRESSION_OP:
+    {
+        Type *t1 = infer(state, e->data.op.e1);
+        Type *t2 = infer(state, e->data.op.e2);
+        Type *tv = atLocation(state, fresh(state), &e->location);
+
+        Type *u1 = newArr(state, t1, newArr(state, t2, tv, NULL), &e->location);
+        Type *u2 = atLocation(state, ops[e->data.op.op], &e->location);
+        addConstraint(state, u1, u2);
+
+        return tv;
+    }
+    case EXPRESSION_VAR:
+    {
+        Scope *scope = state->scopes[e->data.name];
+
+        if (scope == NULL)
+        {
+            char location[64];
+
+            parser_locationToString(&e->location, location, sizeof(location));
+            snprintf(state->errorMessage, STLC_ERROR_MESSAGE_SIZE, "Unknown Name: %s at %s", state->program->names[e->data.name], location);
+            longjmp(state->errorHandler, 1);
+        }
+
+        return atLocation(state, instantiate(state, &scope->scheme), &e->location);
+    }
+    }
+
+    return NULL;
+}
+
+static void freeInference(Inference *state)
+{
+    FREE(state->constraints);
+    FREE(state->seen);
+    FREE(state->variables);
+    FREE(state->resolvedAt);
+    FREE(state->resolved);
+    FREE(state->levels);
+    FREE(state->bindings);
+    FREE(state);
+}
+
+Type *infer_program(Arena *arena, Program *program, char *errorMessage)
+{
+    /* On the heap so that its fields are intact after a longjmp. */
+    Inference *state = ALLOCATE(Inference, 1);
+
+    state->arena = arena;
+    state->errorMessage = errorMessage;
+    state->program = program;
+    state->scopes = ARENA_ALLOCATE(arena, Scope *, program->nameCount);
+    state->freeScopes = NULL;
+    state->level = 0;
+    state->variableCount = 0;
+    state->variableSize = INITIAL_VARIABLES;
+    state->bindings = ALLOCATE(Type *, INITIAL_VARIABLES);
+    state->levels = ALLOCATE(int32_t, INITIAL_VARIABLES);
+    state->resolved = ALLOCATE(Type *, INITIAL_VARIABLES);
+    state->resolvedAt = ALLOCATE(int64_t, INITIAL_VARIABLES);
+    state->generation = 0;
+    state->variables = ALLOCATE(int32_t, INITIAL_VARIABLES);
+    state->variablesCount = 0;
+    state->seen = ALLOCATE(int64_t, INITIAL_VARIABLES);
+    state->seenStamp = 0;
+    state->constraints = ALLOCATE(Type *, INITIAL_CONSTRAINTS);
+    state->constraintCount = 0;
+    state->constraintSize = INITIAL_CONSTRAINTS;
+    state->solved = 0;
+
+    if (setjmp(state->errorHandler) != 0)
+    {
+        freeInference(state);
+        return NULL;
+    }
+
+    Type *type = infer(state, program->expression);
+    solveAdded(state);
+    type = resolve(state, type);
+
+    freeInference(state);
+
+    return type;
+}
+
+static void renameVariables(Type *type, int32_t *renamed, int32_t *count)
+{
+    switch (type->kind)
+    {
+    case TYPE_VAR:
+        if (renamed[type->data.var] < 0)
+            renamed[type->data.var] = (*count)++;
+        break;
+    case TYPE_ARR:
+        renameVariables(type->data.arr.domain, renamed, count);
+        renameVariables(type->data.arr.range, renamed, count);
+        break;
+    case TYPE_TUPLE:
+        for (int32_t i = 0; i < type->data.tuple.count; i++)
+            renameVariables(type->data.tuple.types[i], renamed, count);
+        break;
+    default:
+        break;
+    }
+}
+
+static int32_t maxVariable(Type *type)
+{
+    int32_t result = 0;
+
+    switch (type->kind)
+    {
+    case TYPE_VAR:
+        return type->data.var;
+    case TYPE_ARR:
+    {
+        int32_t domain = maxVariable(type->data.arr.domain);
+        int32_t range = maxVariable(type->data.arr.range);
+
+        return domain > range ? domain : range;
+    }
+    case TYPE_TUPLE:
+        for (int32_t i = 0; i < type->data.tuple.count; i++)
+        {
+            int32_t m = maxVariable(type->data.tuple.types[i]);
+
+            if (m > result)
+                result = m;
+        }
+        return result;
+    default:
+        return 0;
+    }
+}
+
+void infer_typeToString(Type *type, char *buffer, int32_t size)
+{
+    Text text = {buffer, size, 0};
+    int32_t variables = maxVariable(type) + 1;
+    int32_t *renamed = ALLOCATE(int32_t, variables);
+    int32_t count = 0;
+
+    for (int32_t i = 0; i < variables; i++)
+        renamed[i] = -1;
+    renameVariables(type, renamed, &count);
+
+    buffer[0] = '\0';
+    appendType(&text, type, renamed);
+
+    FREE(renamed);
+}
+
+int infer_isFunction(Type *type)
+{
+    return type->kind == TYPE_ARR;
+}
@@ -0,0 +1,22 @@
+#ifndef INFER_H
+#define INFER_H
+
+#include "arena.h"
+#include "parser.h"
+
+/*
+ * Infers the type of a program as the Kotlin front end's Inference.kt and
+ * Constraints.kt do, constraint for constraint and variable for variable, so
+ * that a program is rejected with the same message by both.
+ */
+typedef struct Type Type;
+
+/* Returns NULL, with the error in errorMessage, if program is not well typed. */
+extern Type *infer_program(Arena *arena, Program *program, char *errorMessage);
+
+/* Renders type with its variables renamed a, b, ... in the order they first appear, as the REPL does. */
+extern void infer_typeToString(Type *type, char *buffer, int32_t size);
+
+extern int infer_isFunction(Type *type);
+
+#endif
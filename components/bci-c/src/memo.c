@@ -0,0 +1,460 @@
+#include "memory.h"
+
+#include "memo.h"
+
+#define NONE -1
+#define INITIAL_PENDING 64
+
+/*
+ * An entry is chained from its hash bucket, linked from the newest to the
+ * oldest use and linked with the other entries keyed on its environment.
+ * Removed entries are chained from free.
+ */
+typedef struct
+{
+    MemoKey key;
+    ValueType resultType;
+    int32_t result;
+
+    int32_t chain;
+    int32_t newer;
+    int32_t older;
+    int32_t nextSibling;
+    int32_t previousSibling;
+} Entry;
+
+/* A distinct environment and the first of the entries keyed on it. */
+typedef struct
+{
+    Value *environment;
+    int32_t first;
+} Environment;
+
+typedef struct
+{
+    MemoKey key;
+    Value *activation;
+} Pending;
+
+struct Memo
+{
+    int32_t capacity;
+    int32_t used;
+    int32_t count;
+    int32_t peak;
+    int32_t free;
+    Entry *entries;
+
+    int32_t bucketMask;
+    int32_t *buckets;
+
+    int32_t newest;
+    int32_t oldest;
+
+    /*
+     * The collector runs often so looks at each distinct environment once
+     * rather than once per entry.  environmentSlots indexes environments,
+     * which is kept dense, by address.
+     */
+    int32_t environmentCount;
+    Environment *environments;
+    int32_t environmentMask;
+    int32_t *environmentSlots;
+
+    int32_t pendingCount;
+    int32_t pendingCapacity;
+    Pending *pending;
+
+    int64_t hits;
+    int64_t misses;
+    int64_t evictions;
+    int64_t collected;
+    int64_t uncacheable;
+};
+
+Memo *memo_new(int32_t capacity)
+{
+    Memo *memo = ALLOCATE(Memo, 1);
+    int32_t buckets = 1;
+
+    if (capacity < 1)
+        capacity = 1;
+    while (buckets < capacity)
+        buckets <<= 1;
+
+    memo->capacity = capacity;
+    memo->peak = 0;
+    memo->entries = ALLOCATE(Entry, capacity);
+    memo->bucketMask = buckets - 1;
+    memo->buckets = ALLOCATE(int32_t, buckets);
+    memo->environments = ALLOCATE(Environment, capacity);
+    memo->environmentMask = buckets * 2 - 1;
+    memo->environmentSlots = ALLOCATE(int32_t, buckets * 2);
+    memo->pendingCapacity = INITIAL_PENDING;
+    memo->pending = ALLOCATE(Pending, INITIAL_PENDING);
+
+    memo->hits = 0;
+    memo->misses = 0;
+    memo->evictions = 0;
+    memo->collected = 0;
+    memo->uncacheable = 0;
+
+    memo_clear(memo);
+
+    return memo;
+}
+
+void memo_free(Memo *memo)
+{
+    FREE(memo->pending);
+    FREE(memo->environmentSlots);
+    FREE(memo->environments);
+    FREE(memo->buckets);
+    FREE(memo->entries);
+    FREE(memo);
+}
+
+void memo_clear(Memo *memo)
+{
+    for (int i = 0; i <= memo->bucketMask; i++)
+        memo->buckets[i] = NONE;
+    for (int i = 0; i <= memo->environmentMask; i++)
+        memo->environmentSlots[i] = NONE;
+
+    memo->used = 0;
+    memo->count = 0;
+    memo->free = NONE;
+    memo->newest = NONE;
+    memo->oldest = NONE;
+    memo->environmentCount = 0;
+    memo->pendingCount = 0;
+}
+
+static uint32_t mix(uint64_t h)
+{
+    h ^= h >> 31;
+    h *= 0x94d049bb133111ebULL;
+    h ^= h >> 29;
+
+    return (uint32_t)h;
+}
+
+static uint32_t hash(MemoKey *key)
+{
+    uint64_t h = (uint64_t)(uintptr_t)key->environment;
+
+    h ^= (uint64_t)(uint32_t)key->ip * 0x9e3779b97f4a7c15ULL;
+    h ^= ((uint64_t)(uint32_t)key->argument << 1 | key->argumentType) * 0xc2b2ae3d27d4eb4fULL;
+
+    return mix(h);
+}
+
+static int sameKey(MemoKey *a, MemoKey *b)
+{
+    return a->environment == b->environment && a->ip == b->ip && a->argumentType == b->argumentType && a->argument == b->argument;
+}
+
+/* Every activation reachable from environment, through closures' captured activations, has all of its slots stored. */
+static int complete(Value *environment)
+{
+    while (environment != NULL)
+    {
+        if (value_getType(environment) != VActivation || environment->data.a.state == NULL)
+            return 0;
+
+        for (int i = 0; i < environment->data.a.stateSize; i++)
+        {
+            if (environment->data.a.state[i] == NULL)
+                return 0;
+        }
+
+        Value *closure = environment->data.a.closure;
+        environment = closure == NULL ? NULL : closure->data.c.previousActivation;
+    }
+
+    return 1;
+}
+
+int memo_key(Memo *memo, Value *closure, Value *argument, MemoKey *key)
+{
+    if (value_getType(closure) != VClosure || (value_getType(argument) != VInt && value_getType(argument) != VBool) || !complete(closure->data.c.previousActivation))
+    {
+        memo->uncacheable++;
+        return 0;
+    }
+
+    key->environment = closure->data.c.previousActivation;
+    key->ip = closure->data.c.ip;
+    key->argumentType = value_getType(argument);
+    key->argument = key->argumentType == VInt ? argument->data.i : argument->data.b;
+
+    return 1;
+}
+
+static int32_t environmentHome(Memo *memo, Value *environment)
+{
+    return mix((uint64_t)(uintptr_t)environment) & memo->environmentMask;
+}
+
+static int32_t findEnvironmentSlot(Memo *memo, Value *environment)
+{
+    int32_t i = environmentHome(memo, environment);
+
+    while (memo->environmentSlots[i] != NONE && memo->environments[memo->environmentSlots[i]].environment != environment)
+        i = (i + 1) & memo->environmentMask;
+
+    return i;
+}
+
+/* Removes the environment at slot by shifting back the slots probed past it. */
+static void removeEnvironment(Memo *memo, int32_t slot)
+{
+    int32_t index = memo->environmentSlots[slot];
+    int32_t i = slot;
+    int32_t j = slot;
+
+    while (1)
+    {
+        j = (j + 1) & memo->environmentMask;
+        if (memo->environmentSlots[j] == NONE)
+            break;
+
+        int32_t home = environmentHome(memo, memo->environments[memo->environmentSlots[j]].environment);
+        if (((j - home) & memo->environmentMask) >= ((j - i) & memo->environmentMask))
+        {
+            memo->environmentSlots[i] = memo->environmentSlots[j];
+            i = j;
+        }
+    }
+    memo->environmentSlots[i] = NONE;
+
+    int32_t last = --memo->environmentCount;
+    if (index != last)
+    {
+        memo->environments[index] = memo->environments[last];
+        memo->environmentSlots[findEnvironmentSlot(memo, memo->environments[index].environment)] = index;
+    }
+}
+
+static void addSibling(Memo *memo, int32_t index)
+{
+    Entry *entry = &memo->entries[index];
+    int32_t slot = findEnvironmentSlot(memo, entry->key.environment);
+
+    if (memo->environmentSlots[slot] == NONE)
+    {
+        memo->environments[memo->environmentCount].environment = entry->key.environment;
+        memo->environments[memo->environmentCount].first = NONE;
+        memo->environmentSlots[slot] = memo->environmentCount++;
+    }
+
+    Environment *environment = &memo->environments[memo->environmentSlots[slot]];
+
+    entry->previousSibling = NONE;
+    entry->nextSibling = environment->first;
+    if (environment->first != NONE)
+        memo->entries[environment->first].previousSibling = index;
+    environment->first = index;
+}
+
+static void removeSibling(Memo *memo, int32_t index)
+{
+    Entry *entry = &memo->entries[index];
+
+    if (entry->nextSibling != NONE)
+        memo->entries[entry->nextSibling].previousSibling = entry->previousSibling;
+
+    if (entry->previousSibling != NONE)
+        memo->entries[entry->previousSibling].nextSibling = entry->nextSibling;
+    else
+    {
+        int32_t slot = findEnvironmentSlot(memo, entry->key.environment);
+
+        memo->environments[memo->environmentSlots[slot]].first = entry->nextSibling;
+        if (entry->nextSibling == NONE)
+            removeEnvironment(memo, slot);
+    }
+}
+
+static void unlinkEntry(Memo *memo, int32_t index)
+{
+    Entry *entry = &memo->entries[index];
+
+    if (entry->newer == NONE)
+        memo->newest = entry->older;
+    else
+        memo->entries[entry->newer].older = entry->older;
+
+    if (entry->older == NONE)
+        memo->oldest = entry->newer;
+    else
+        memo->entries[entry->older].newer = entry->newer;
+}
+
+static void linkNewest(Memo *memo, int32_t index)
+{
+    Entry *entry = &memo->entries[index];
+
+    entry->newer = NONE;
+    entry->older = memo->newest;
+    if (memo->newest == NONE)
+        memo->oldest = index;
+    else
+        memo->entries[memo->newest].newer = index;
+    memo->newest = index;
+}
+
+static void removeFromBucket(Memo *memo, int32_t index)
+{
+    int32_t *link = &memo->buckets[hash(&memo->entries[index].key) & memo->bucketMask];
+
+    while (*link != index)
+        link = &memo->entries[*link].chain;
+
+    *link = memo->entries[index].chain;
+}
+
+/* Leaves the entry's environment list to the caller. */
+static void removeEntry(Memo *memo, int32_t index)
+{
+    unlinkEntry(memo, index);
+    removeFromBucket(memo, index);
+
+    memo->entries[index].chain = memo->free;
+    memo->free = index;
+    memo->count--;
+}
+
+int memo_find(Memo *memo, MemoKey *key, ValueType *type, int32_t *value)
+{
+    int32_t index = memo->buckets[hash(key) & memo->bucketMask];
+
+    while (index != NONE && !sameKey(&memo->entries[index].key, key))
+        index = memo->entries[index].chain;
+
+    if (index == NONE)
+    {
+        memo->misses++;
+        return 0;
+    }
+
+    if (memo->newest != index)
+    {
+        unlinkEntry(memo, index);
+        linkNewest(memo, index);
+    }
+
+    memo->hits++;
+    *type = memo->entries[index].resultType;
+    *value = memo->entries[index].result;
+
+    return 1;
+}
+
+static void insert(Memo *memo, MemoKey *key, ValueType type, int32_t value)
+{
+    if (memo->count == memo->capacity)
+    {
+        int32_t oldest = memo->oldest;
+
+        removeSibling(memo, oldest);
+        removeEntry(memo, oldest);
+        memo->evictions++;
+    }
+
+    int32_t index;
+    if (memo->free != NONE)
+    {
+        index = memo->free;
+        memo->free = memo->entries[index].chain;
+    }
+    else
+        index = memo->used++;
+
+    Entry *entry = &memo->entries[index];
+    int32_t *bucket = &memo->buckets[hash(key) & memo->bucketMask];
+
+    entry->key = *key;
+    entry->resultType = type;
+    entry->result = value;
+    entry->chain = *bucket;
+    *bucket = index;
+
+    linkNewest(memo, index);
+    addSibling(memo, index);
+
+    memo->count++;
+    if (memo->count > memo->peak)
+        memo->peak = memo->count;
+}
+
+void memo_called(Memo *memo, MemoKey *key, Value *activation)
+{
+    if (memo->pendingCount == memo->pendingCapacity)
+    {
+        memo->pendingCapacity *= 2;
+        memo->pending = REALLOCATE(memo->pending, Pending, memo->pendingCapacity);
+    }
+
+    memo->pending[memo->pendingCount].key = *key;
+    memo->pending[memo->pendingCount].activation = activation;
+    memo->pendingCount++;
+}
+
+/*
+ * Calls return in the reverse order to which they were made so a returning
+ * activation is either the most recent pending call or was not cached.
+ */
+void memo_returned(Memo *memo, Value *activation, Value *result)
+{
+    if (memo->pendingCount == 0 || memo->pending[memo->pendingCount - 1].activation != activation)
+        return;
+
+    memo->pendingCount--;
+
+    ValueType type = value_getType(result);
+    if (type == VInt)
+        insert(memo, &memo->pending[memo->pendingCount].key, type, result->data.i);
+    else if (type == VBool)
+        insert(memo, &memo->pending[memo->pendingCount].key, type, result->data.b);
+}
+
+void memo_sweep(Memo *memo, Colour live)
+{
+    int32_t i = memo->environmentCount;
+
+    /* Removing an environment moves the last into its place so walk down from the end. */
+    while (i-- > 0)
+    {
+        /* A closure made outside of any activation has no environment to collect. */
+        if (memo->environments[i].environment == NULL || value_getColour(memo->environments[i].environment) == live)
+            continue;
+
+        int32_t index = memo->environments[i].first;
+        while (index != NONE)
+        {
+            int32_t next = memo->entries[index].nextSibling;
+
+            removeEntry(memo, index);
+            memo->collected++;
+            index = next;
+        }
+
+        removeEnvironment(memo, findEnvironmentSlot(memo, memo->environments[i].environment));
+    }
+}
+
+void memo_report(Memo *memo, FILE *out)
+{
+    int64_t calls = memo->hits + memo->misses;
+
+    fprintf(out, ". Memo: %ld hits, %ld misses (%.1f%% hit)   Evictions: %ld   Collected: %ld   Uncacheable: %ld calls   Peak: %d of %d entries\n",
+            (long)memo->hits,
+            (long)memo->misses,
+            calls == 0 ? 0.0 : memo->hits * 100.0 / calls,
+            (long)memo->evictions,
+            (long)memo->collected,
+            (long)memo->uncacheable,
+            memo->peak,
+            memo->capacity);
+}
@@ -0,0 +1,53 @@
+#ifndef MEMO_H
+#define MEMO_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "value.h"
+
+/*
+ * A bounded cache of call results, enabled by attaching a Memo to a VM.  A
+ * call is keyed on the closure's code and environment and on its argument,
+ * which must be an int or a bool.  Only closures whose environment is
+ * complete - every activation on its chain has all of its slots stored - are
+ * cached as, slots being written once, nothing the body can read will then
+ * change.  Storing over a slot drops every entry.  Results that are not an
+ * int or a bool are not cached.  The least recently used entry is evicted
+ * once the cache is full.
+ *
+ * Entries do not keep their environment alive: the collector drops those
+ * whose environment it is about to free so that a key never refers to a
+ * value whose memory has been reused.
+ */
+typedef struct Memo Memo;
+
+typedef struct
+{
+    Value *environment;
+    int32_t ip;
+    ValueType argumentType;
+    int32_t argument;
+} MemoKey;
+
+extern Memo *memo_new(int32_t capacity);
+extern void memo_free(Memo *memo);
+
+/* Drops every entry and every call awaiting its result. */
+extern void memo_clear(Memo *memo);
+
+/* Returns 0, and counts the call as uncacheable, if closure applied to argument cannot be cached. */
+extern int memo_key(Memo *memo, Value *closure, Value *argument, MemoKey *key);
+/* Returns 1 with the cached result in type and value, or 0 on a miss. */
+extern int memo_find(Memo *memo, MemoKey *key, ValueType *type, int32_t *value);
+
+/* A missed call has entered activation - its result is cached when activation returns. */
+extern void memo_called(Memo *memo, MemoKey *key, Value *activation);
+extern void memo_returned(Memo *memo, Value *activation, Value *result);
+
+/* Drops the entries whose environment was not marked live by the collector - those without one are kept. */
+extern void memo_sweep(Memo *memo, Colour live);
+
+extern void memo_report(Memo *memo, FILE *out);
+
+#endif
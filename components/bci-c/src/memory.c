@@ -1,45 +1,293 @@
-#include <stdio.h>
+#include <pthread.h>
+#include <stdatomic.h>
 #include <string.h>
 
 #include "memory.h"
 
-static int32_t memory_allocated_count = 0;
+/* Sites beyond this are tracked in the allocation count only. */
+#define MAX_SITES 4096
 
-char *memory_alloc(int32_t size, char *file, int32_t line)
+typedef struct
 {
-    memory_allocated_count += 1;
-    char *mem = realloc(NULL, size);
+    char *file;
+    int32_t line;
 
-    if (mem == NULL)
+    int64_t live;
+    int64_t liveBytes;
+    int64_t peak;
+    int64_t peakBytes;
+    int64_t total;
+    int64_t totalBytes;
+} Site;
+
+/* Precedes every tracked allocation - 16 bytes to keep the payload aligned. */
+typedef struct
+{
+    int64_t size;
+    int32_t site;
+    int32_t reserved;
+} Header;
+
+static atomic_int memory_allocated_count = 0;
+
+static _Thread_local MemoryFailureHandler failureHandler = NULL;
+static _Thread_local void *failureContext = NULL;
+
+static pthread_mutex_t sitesLock = PTHREAD_MUTEX_INITIALIZER;
+static int32_t siteCount = 0;
+static Site sites[MAX_SITES];
+
+void memory_setFailureHandler(MemoryFailureHandler handler, void *context)
+{
+    failureHandler = handler;
+    failureContext = context;
+}
+
+void *memory_failed(int64_t size)
+{
+    if (failureHandler != NULL)
+        failureHandler(failureContext, size);
+
+    printf("Out of memory: unable to allocate %ld bytes\n", (long)size);
+    exit(1);
+}
+
+void *memory_realloc(void *pointer, int64_t size)
+{
+    void *mem = realloc(pointer, size);
+
+    if (mem == NULL && size > 0)
+        return memory_failed(size);
+
+    return mem;
+}
+
+int32_t memory_allocated(void)
+{
+    return atomic_load_explicit(&memory_allocated_count, memory_order_relaxed);
+}
+
+static int compareSites(const void *a, const void *b)
+{
+    const Site *sa = (const Site *)a;
+    const Site *sb = (const Site *)b;
+
+    if (sa->liveBytes != sb->liveBytes)
+        return (sa->liveBytes < sb->liveBytes) - (sa->liveBytes > sb->liveBytes);
+    if (sa->peakBytes != sb->peakBytes)
+        return (sa->peakBytes < sb->peakBytes) - (sa->peakBytes > sb->peakBytes);
+
+    int c = strcmp(sa->file, sb->file);
+    return c != 0 ? c : sa->line - sb->line;
+}
+
+/* A sorted copy of the sites, taken under the lock, which the caller frees. */
+static Site *sortedSites(int32_t *count)
+{
+    pthread_mutex_lock(&sitesLock);
+    *count = siteCount;
+    Site *copy = memory_realloc(NULL, sizeof(Site) * (siteCount + 1));
+    memcpy(copy, sites, sizeof(Site) * siteCount);
+    pthread_mutex_unlock(&sitesLock);
+
+    qsort(copy, *count, sizeof(Site), compareSites);
+
+    return copy;
+}
+
+void memory_report(FILE *out)
+{
+    int32_t count;
+    Site *copy = sortedSites(&count);
+
+    fprintf(out, ". Allocation sites: %d\n", count);
+    fprintf(out, "  %-28s %10s %12s %10s %12s %12s %14s\n", "site", "live", "live bytes", "peak", "peak bytes", "total", "total bytes");
+    for (int i = 0; i < count; i++)
     {
-        printf("Out of memory %s:%d\n", __FILE__, __LINE__);
-        exit(1);
+        char name[256];
+
+        snprintf(name, sizeof(name), "%s:%d", copy[i].file, copy[i].line);
+        fprintf(out, "  %-28s %10ld %12ld %10ld %12ld %12ld %14ld\n",
+                name,
+                (long)copy[i].live,
+                (long)copy[i].liveBytes,
+                (long)copy[i].peak,
+                (long)copy[i].peakBytes,
+                (long)copy[i].total,
+                (long)copy[i].totalBytes);
     }
 
-    return mem;
+    free(copy);
 }
 
-char *memory_strdup(char *string, char *file, int32_t line)
+int32_t memory_reportLeaks(FILE *out)
 {
-    memory_allocated_count += 1;
-    char *mem = strdup(string);
-    
-    if (mem == NULL)
+    int32_t count;
+    int32_t leaks = 0;
+    Site *copy = sortedSites(&count);
+
+    for (int i = 0; i < count; i++)
     {
-        printf("Out of memory %s:%d\n", __FILE__, __LINE__);
-        exit(1);
+        if (copy[i].live > 0)
+        {
+            fprintf(out, ". Leaked at %s:%d: %ld allocations, %ld bytes\n", copy[i].file, copy[i].line, (long)copy[i].live, (long)copy[i].liveBytes);
+            leaks++;
+        }
     }
 
-    return mem;
+    free(copy);
+
+    return leaks;
 }
 
-void memory_free(void *ptr, char *file, int32_t line)
+#ifdef DEBUG_MEMORY
+
+static atomic_int profiling = 0;
+static int32_t siteIndex[MAX_SITES * 2];
+
+int memory_setProfiling(int enabled)
 {
-    memory_allocated_count -= 1;
-    (void)realloc(ptr, 0);
+    atomic_store(&profiling, enabled);
+
+    return 1;
 }
 
-int32_t memory_allocated(void)
+/* Must be called holding sitesLock.  Returns -1 once the table is full. */
+static int32_t findSite(char *file, int32_t line)
 {
-    return memory_allocated_count;
+    uintptr_t hash = ((uintptr_t)file * 31 + line) * 2654435761U;
+    int32_t i = (int32_t)(hash % (MAX_SITES * 2));
+
+    while (siteIndex[i] != 0)
+    {
+        Site *site = &sites[siteIndex[i] - 1];
+
+        if (site->file == file && site->line == line)
+            return siteIndex[i] - 1;
+        i = (i + 1) % (MAX_SITES * 2);
+    }
+
+    if (siteCount == MAX_SITES)
+        return -1;
+
+    Site *site = &sites[siteCount];
+
+    memset(site, 0, sizeof(Site));
+    site->file = file;
+    site->line = line;
+    siteIndex[i] = ++siteCount;
+
+    return siteCount - 1;
+}
+
+/* fresh is 0 when a reallocation moves an existing allocation to this site. */
+static void addToSite(Header *header, char *file, int32_t line, int fresh)
+{
+    if (!atomic_load_explicit(&profiling, memory_order_relaxed))
+    {
+        header->site = -1;
+        return;
+    }
+
+    pthread_mutex_lock(&sitesLock);
+
+    header->site = findSite(file, line);
+    if (header->site != -1)
+    {
+        Site *site = &sites[header->site];
+
+        site->live++;
+        site->liveBytes += header->size;
+        site->total += fresh;
+        site->totalBytes += header->size;
+        if (site->live > site->peak)
+            site->peak = site->live;
+        if (site->liveBytes > site->peakBytes)
+            site->peakBytes = site->liveBytes;
+    }
+
+    pthread_mutex_unlock(&sitesLock);
+}
+
+static void removeFromSite(Header *header)
+{
+    if (header->site == -1)
+        return;
+
+    pthread_mutex_lock(&sitesLock);
+    sites[header->site].live--;
+    sites[header->site].liveBytes -= header->size;
+    pthread_mutex_unlock(&sitesLock);
+}
+
+static void *track(Header *header, int64_t size, char *file, int32_t line)
+{
+    header->size = size;
+    header->reserved = 0;
+    addToSite(header, file, line, 1);
+
+    atomic_fetch_add_explicit(&memory_allocated_count, 1, memory_order_relaxed);
+
+    return header + 1;
+}
+
+char *memory_alloc(int64_t size, char *file, int32_t line)
+{
+    Header *header = memory_realloc(NULL, sizeof(Header) + size);
+
+    return track(header, size, file, line);
+}
+
+char *memory_strdup(char *string, char *file, int32_t line)
+{
+    int64_t size = strlen(string) + 1;
+    Header *header = memory_realloc(NULL, sizeof(Header) + size);
+
+    memcpy(header + 1, string, size);
+
+    return track(header, size, file, line);
+}
+
+/* The allocation is moved to the reallocating site. */
+void *memory_reallocate(void *pointer, int64_t size, char *file, int32_t line)
+{
+    if (pointer == NULL)
+        return memory_alloc(size, file, line);
+
+    /* The old block, and its site's counts, stand until realloc succeeds as
+       the failure handler may raise with it still live.  The header moves
+       with the block so its old site and size are still there to remove. */
+    Header *header = memory_realloc((Header *)pointer - 1, sizeof(Header) + size);
+
+    removeFromSite(header);
+    header->size = size;
+    addToSite(header, file, line, 0);
+
+    return header + 1;
 }
+
+void memory_free(void *pointer, char *file, int32_t line)
+{
+    (void)file;
+    (void)line;
+
+    if (pointer == NULL)
+        return;
+
+    Header *header = (Header *)pointer - 1;
+
+    removeFromSite(header);
+    atomic_fetch_sub_explicit(&memory_allocated_count, 1, memory_order_relaxed);
+    free(header);
+}
+
+#else
+
+int memory_setProfiling(int enabled)
+{
+    (void)enabled;
+
+    return 0;
+}
+
+#endif
@@ -1,17 +1,49 @@
 #ifndef MEMORY_H
 #define MEMORY_H
 
-#define DEBUG_MEMORY
-
+#include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
 
-#ifdef DEBUG_MEMORY
+/*
+ * Allocation goes through ALLOCATE, STRDUP, REALLOCATE and FREE.  Built with
+ * DEBUG_MEMORY, as the Makefile does by default, every allocation carries a
+ * header recording its size and allocation site so that live allocations are
+ * counted and, once memory_setProfiling is enabled, attributed to the site
+ * that made them.  Without DEBUG_MEMORY the macros are plain allocation.
+ */
+
+/*
+ * Called, on the allocating thread, when an allocation fails.  A handler is
+ * not expected to return - without one the process exits.
+ */
+typedef void (*MemoryFailureHandler)(void *context, int64_t size);
 
-extern char *memory_alloc(int32_t size, char *file, int line);
-extern char *memory_strdup(char *str, char *file, int32_t line);
-extern void memory_free(void *ptr, char *file, int32_t line);
+extern void memory_setFailureHandler(MemoryFailureHandler handler, void *context);
+extern void *memory_failed(int64_t size);
+extern void *memory_realloc(void *pointer, int64_t size);
+
+/* Allocations made and not yet freed - always 0 without DEBUG_MEMORY. */
 extern int32_t memory_allocated(void);
 
+/*
+ * Enables attributing allocations to their site from this point on.  Returns
+ * 0 if the build does not track allocations.
+ */
+extern int memory_setProfiling(int enabled);
+
+/* Writes each site's live, peak and total allocations, largest live first. */
+extern void memory_report(FILE *out);
+/* Writes the sites with live allocations.  Returns the number of sites listed. */
+extern int32_t memory_reportLeaks(FILE *out);
+
+#ifdef DEBUG_MEMORY
+
+extern char *memory_alloc(int64_t size, char *file, int32_t line);
+extern char *memory_strdup(char *string, char *file, int32_t line);
+extern void *memory_reallocate(void *pointer, int64_t size, char *file, int32_t line);
+extern void memory_free(void *pointer, char *file, int32_t line);
+
 #define ALLOCATE(type, count) \
     (type *)memory_alloc(sizeof(type) * (count), __FILE__, __LINE__)
 
@@ -19,24 +51,26 @@ extern int32_t memory_allocated(void);
     (char *)memory_strdup(string, __FILE__, __LINE__)
 
 #define REALLOCATE(pointer, type, count) \
-    (type *)realloc(pointer, sizeof(type) * (count))
+    (type *)memory_reallocate(pointer, sizeof(type) * (count), __FILE__, __LINE__)
 
 #define FREE(pointer) \
     memory_free(pointer, __FILE__, __LINE__)
 
 #else
 
+#include <string.h>
+
 #define ALLOCATE(type, count) \
-    (type *)realloc(NULL, sizeof(type) * (count))
+    (type *)memory_realloc(NULL, sizeof(type) * (count))
 
 #define STRDUP(string) \
     strdup(string)
 
 #define REALLOCATE(pointer, type, count) \
-    (type *)realloc(pointer, sizeof(type) * (count))
+    (type *)memory_realloc(pointer, sizeof(type) * (count))
 
 #define FREE(pointer) \
-    ((void)realloc(pointer, 0))
+    free(pointer)
 
 #endif
 
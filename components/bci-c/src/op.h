@@ -19,7 +19,9 @@ typedef enum
     SWAP_CALL,
     ENTER,
     RET,
-    STORE_VAR
+    STORE_VAR,
+    SPAWN,
+    JOIN
 } InstructionOpCode;
 
 typedef enum {
@@ -31,13 +33,10 @@ typedef struct {
     char *name;
     InstructionOpCode opcode;
     int arity;
-    OpParameter *parameters;
+    const OpParameter *parameters;
 } Instruction;
 
-extern void op_initialise(void);
-extern void op_finalise(void);
-
-extern Instruction* find(InstructionOpCode opcode);
-extern Instruction* findOnName(char *name);
+extern const Instruction* find(InstructionOpCode opcode);
+extern const Instruction* findOnName(char *name);
 
 #endif
@@ -0,0 +1,620 @@
+#include <setjmp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "parser.h"
+
+#define INITIAL_NAMES 64
+
+/* The tokens of components/stlc/Scanner.llld. */
+typedef enum
+{
+    T_EQUAL,
+    T_ELSE,
+    T_IF,
+    T_IN,
+    T_SEMICOLON,
+    T_REC,
+    T_LET,
+    T_DASH_GREATER_THAN,
+    T_BACKSLASH,
+    T_FALSE,
+    T_TRUE,
+    T_RPAREN,
+    T_LPAREN,
+    T_SLASH,
+    T_STAR,
+    T_DASH,
+    T_PLUS,
+    T_EQUAL_EQUAL,
+    T_LITERAL_INT,
+    T_IDENTIFIER,
+    T_EOS,
+    T_ERROR
+} TToken;
+
+static const char *tokenNames[] = {
+    "'='", "else", "if", "in", "';'", "rec", "let", "'->'", "'\\'", "False", "True", "')'", "'('",
+    "'/'", "'*'", "'-'", "'+'", "'=='", "literal int", "identifier", "<end-of-stream>", "<error>"};
+
+static const struct
+{
+    const char *lexeme;
+    TToken token;
+} keywords[] = {
+    {"else", T_ELSE},
+    {"if", T_IF},
+    {"in", T_IN},
+    {"rec", T_REC},
+    {"let", T_LET},
+    {"False", T_FALSE},
+    {"True", T_TRUE}};
+
+typedef struct
+{
+    TToken token;
+    char *lexeme;
+    int32_t length;
+    Location location;
+} Token;
+
+typedef struct
+{
+    Arena *arena;
+    jmp_buf errorHandler;
+    char *errorMessage;
+
+    char *source;
+    int64_t offset;
+    Position position;
+
+    Token current;
+
+    /* Open addressed on the name, holding a name's number plus 1.  Outgrown tables are left in the arena. */
+    int32_t *table;
+    int32_t tableSize;
+    char **names;
+    int32_t nameCount;
+    int32_t namesSize;
+} Parser;
+
+static int isLetter(char c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+static int isDigit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+static char peek(Parser *parser, int32_t ahead)
+{
+    int64_t offset = parser->offset;
+
+    for (int32_t i = 0; i < ahead; i++)
+    {
+        if (parser->source[offset] == '\0')
+            return '\0';
+        offset++;
+    }
+
+    return parser->source[offset];
+}
+
+static void nextChar(Parser *parser)
+{
+    if (parser->source[parser->offset] == '\n')
+    {
+        parser->position.line++;
+        parser->position.column = 1;
+    }
+    else
+        parser->position.column++;
+
+    parser->offset++;
+}
+
+static void skipBlanks(Parser *parser)
+{
+    while (1)
+    {
+        char c = peek(parser, 0);
+
+        if (c != '\0' && (unsigned char)c <= ' ')
+            nextChar(parser);
+        else if (c == '-' && peek(parser, 1) == '-')
+        {
+            while (peek(parser, 0) != '\0' && peek(parser, 0) != '\n')
+                nextChar(parser);
+        }
+        else
+            return;
+    }
+}
+
+static void next(Parser *parser)
+{
+    skipBlanks(parser);
+
+    Token *token = &parser->current;
+    Position start = parser->position;
+    Position end = start;
+    char c = peek(parser, 0);
+
+    token->lexeme = parser->source + parser->offset;
+
+    if (c == '\0')
+    {
+        token->token = T_EOS;
+        token->length = 0;
+        token->location.start = start;
+        token->location.end = start;
+        token->location.range = 0;
+        return;
+    }
+
+    int32_t length = 1;
+
+    if (isLetter(c))
+    {
+        while (isLetter(peek(parser, length)) || isDigit(peek(parser, length)))
+            length++;
+
+        token->token = T_IDENTIFIER;
+        for (int i = 0; i < (int)(sizeof(keywords) / sizeof(keywords[0])); i++)
+        {
+            if ((int32_t)strlen(keywords[i].lexeme) == length && strncmp(keywords[i].lexeme, token->lexeme, length) == 0)
+                token->token = keywords[i].token;
+        }
+    }
+    else if (isDigit(c) || (c == '-' && isDigit(peek(parser, 1))))
+    {
+        while (isDigit(peek(parser, length)))
+            length++;
+        token->token = T_LITERAL_INT;
+    }
+    else if (c == '-' && peek(parser, 1) == '>')
+    {
+        length = 2;
+        token->token = T_DASH_GREATER_THAN;
+    }
+    else if (c == '=' && peek(parser, 1) == '=')
+    {
+        length = 2;
+        token->token = T_EQUAL_EQUAL;
+    }
+    else
+    {
+        switch (c)
+        {
+        case '=':
+            token->token = T_EQUAL;
+            break;
+        case ';':
+            token->token = T_SEMICOLON;
+            break;
+        case '\\':
+            token->token = T_BACKSLASH;
+            break;
+        case ')':
+            token->token = T_RPAREN;
+            break;
+        case '(':
+            token->token = T_LPAREN;
+            break;
+        case '/':
+            token->token = T_SLASH;
+            break;
+        case '*':
+            token->token = T_STAR;
+            break;
+        case '-':
+            token->token = T_DASH;
+            break;
+        case '+':
+            token->token = T_PLUS;
+            break;
+        default:
+            token->token = T_ERROR;
+        }
+    }
+
+    for (int32_t i = 0; i < length; i++)
+    {
+        end = parser->position;
+        nextChar(parser);
+    }
+
+    token->length = length;
+    token->location.start = start;
+    token->location.end = end;
+    token->location.range = length > 1;
+}
+
+static int before(Position a, Position b)
+{
+    return a.line < b.line || (a.line == b.line && a.column < b.column);
+}
+
+static Location combine(Location a, Location b)
+{
+    Location result;
+
+    result.start = before(b.start, a.start) ? b.start : a.start;
+    result.end = before(a.end, b.end) ? b.end : a.end;
+    result.range = result.start.line != result.end.line || result.start.column != result.end.column;
+
+    return result;
+}
+
+void parser_locationToString(Location *location, char *buffer, int32_t size)
+{
+    if (!location->range)
+        snprintf(buffer, size, "%d:%d", location->start.line, location->start.column);
+    else if (location->start.line == location->end.line)
+        snprintf(buffer, size, "%d:%d-%d", location->start.line, location->start.column, location->end.column);
+    else
+        snprintf(buffer, size, "%d:%d-%d:%d", location->start.line, location->start.column, location->end.line, location->end.column);
+}
+
+static void syntaxError(Parser *parser, int32_t count, const TToken *expected)
+{
+    char location[64];
+    char *message = parser->errorMessage;
+    int32_t length = snprintf(message, STLC_ERROR_MESSAGE_SIZE, "Syntax Error: expected ");
+
+    for (int32_t i = 0; i < count && length < STLC_ERROR_MESSAGE_SIZE; i++)
+        length += snprintf(message + length, STLC_ERROR_MESSAGE_SIZE - length, "%s%s", i == 0 ? "" : ", ", tokenNames[expected[i]]);
+
+    parser_locationToString(&parser->current.location, location, sizeof(location));
+    if (length < STLC_ERROR_MESSAGE_SIZE)
+        snprintf(message + length, STLC_ERROR_MESSAGE_SIZE - length, " but found %s at %s", tokenNames[parser->current.token], location);
+
+    longjmp(parser->errorHandler, 1);
+}
+
+static int isToken(Parser *parser, TToken token)
+{
+    return parser->current.token == token;
+}
+
+static Token matchToken(Parser *parser, TToken token)
+{
+    if (!isToken(parser, token))
+        syntaxError(parser, 1, &token);
+
+    Token result = parser->current;
+    next(parser);
+
+    return result;
+}
+
+static const TToken factorFirst[] = {T_LPAREN, T_LITERAL_INT, T_TRUE, T_FALSE, T_BACKSLASH, T_LET, T_IF, T_IDENTIFIER};
+
+static int isFactorFirst(Parser *parser)
+{
+    for (int i = 0; i < (int)(sizeof(factorFirst) / sizeof(factorFirst[0])); i++)
+    {
+        if (isToken(parser, factorFirst[i]))
+            return 1;
+    }
+
+    return 0;
+}
+
+static uint32_t hash(char *lexeme, int32_t length)
+{
+    uint32_t h = 2166136261u;
+
+    for (int32_t i = 0; i < length; i++)
+        h = (h ^ (unsigned char)lexeme[i]) * 16777619u;
+
+    return h;
+}
+
+static void growTable(Parser *parser)
+{
+    int32_t oldSize = parser->tableSize;
+
+    parser->tableSize = oldSize == 0 ? INITIAL_NAMES * 2 : oldSize * 2;
+    parser->table = ARENA_ALLOCATE(parser->arena, int32_t, parser->tableSize);
+
+    for (int32_t i = 0; i < parser->nameCount; i++)
+    {
+        char *name = parser->names[i];
+        uint32_t slot = hash(name, strlen(name)) & (parser->tableSize - 1);
+
+        while (parser->table[slot] != 0)
+            slot = (slot + 1) & (parser->tableSize - 1);
+        parser->table[slot] = i + 1;
+    }
+}
+
+static int32_t intern(Parser *parser, Token *token)
+{
+    if (2 * (parser->nameCount + 1) > parser->tableSize)
+        growTable(parser);
+
+    uint32_t slot = hash(token->lexeme, token->length) & (parser->tableSize - 1);
+
+    while (parser->table[slot] != 0)
+    {
+        char *name = parser->names[parser->table[slot] - 1];
+
+        if (strncmp(name, token->lexeme, token->length) == 0 && name[token->length] == '\0')
+            return parser->table[slot] - 1;
+        slot = (slot + 1) & (parser->tableSize - 1);
+    }
+
+    if (parser->nameCount == parser->namesSize)
+    {
+        char **names = ARENA_ALLOCATE(parser->arena, char *, parser->namesSize * 2);
+
+        memcpy(names, parser->names, sizeof(char *) * parser->namesSize);
+        parser->names = names;
+        parser->namesSize *= 2;
+    }
+
+    parser->names[parser->nameCount] = arena_strndup(parser->arena, token->lexeme, token->length);
+    parser->table[slot] = parser->nameCount + 1;
+
+    return parser->nameCount++;
+}
+
+static Expression *newExpression(Parser *parser, ExpressionKind kind, Location location)
+{
+    Expression *e = ARENA_ALLOCATE(parser->arena, Expression, 1);
+
+    e->kind = kind;
+    e->location = location;
+
+    return e;
+}
+
+static Expression *newOp(Parser *parser, Expression *e1, Expression *e2, BinaryOp op)
+{
+    Expression *e = newExpression(parser, EXPRESSION_OP, combine(e1->location, e2->location));
+
+    e->data.op.e1 = e1;
+    e->data.op.e2 = e2;
+    e->data.op.op = op;
+
+    return e;
+}
+
+/* Nests a lambda of each of names, the first outermost, around e. */
+static Expression *composeLambda(Parser *parser, Token *names, int32_t count, Expression *e)
+{
+    for (int32_t i = count - 1; i >= 0; i--)
+    {
+        Expression *lam = newExpression(parser, EXPRESSION_LAM, combine(names[i].location, e->location));
+
+        lam->data.lam.name = intern(parser, &names[i]);
+        lam->data.lam.e = e;
+        e = lam;
+    }
+
+    return e;
+}
+
+static Expression *expression(Parser *parser);
+
+/* The names of a lambda, or the parameters of a declaration, up to terminator and then its body. */
+static Expression *parameters(Parser *parser, Token *first, TToken terminator)
+{
+    int32_t size = 8;
+    int32_t count = 0;
+    Token *names = ARENA_ALLOCATE(parser->arena, Token, size);
+
+    if (first != NULL)
+        names[count++] = *first;
+    while (isToken(parser, T_IDENTIFIER))
+    {
+        if (count == size)
+        {
+            Token *grown = ARENA_ALLOCATE(parser->arena, Token, size * 2);
+            memcpy(grown, names, sizeof(Token) * size);
+            names = grown;
+            size *= 2;
+        }
+        names[count++] = matchToken(parser, T_IDENTIFIER);
+    }
+    matchToken(parser, terminator);
+
+    return composeLambda(parser, names, count, expression(parser));
+}
+
+static void declaration(Parser *parser, Declaration *declaration)
+{
+    Token name = matchToken(parser, T_IDENTIFIER);
+
+    declaration->name = intern(parser, &name);
+    declaration->e = parameters(parser, NULL, T_EQUAL);
+}
+
+static Expression *factor(Parser *parser)
+{
+    Token token = parser->current;
+
+    switch (token.token)
+    {
+    case T_LPAREN:
+    {
+        next(parser);
+        Expression *e = expression(parser);
+        matchToken(parser, T_RPAREN);
+        return e;
+    }
+    case T_LITERAL_INT:
+    {
+        Expression *e = newExpression(parser, EXPRESSION_INT, token.location);
+        e->data.i = (int32_t)strtoll(token.lexeme, NULL, 10);
+        next(parser);
+        return e;
+    }
+    case T_TRUE:
+    case T_FALSE:
+    {
+        Expression *e = newExpression(parser, EXPRESSION_BOOL, token.location);
+        e->data.b = token.token == T_TRUE;
+        next(parser);
+        return e;
+    }
+    case T_BACKSLASH:
+    {
+        next(parser);
+        Token name = matchToken(parser, T_IDENTIFIER);
+        return parameters(parser, &name, T_DASH_GREATER_THAN);
+    }
+    case T_LET:
+    {
+        next(parser);
+        int rec = isToken(parser, T_REC);
+        if (rec)
+            next(parser);
+
+        int32_t size = 4;
+        int32_t count = 0;
+        Declaration *decls = ARENA_ALLOCATE(parser->arena, Declaration, size);
+
+        while (1)
+        {
+            if (count == size)
+            {
+                Declaration *grown = ARENA_ALLOCATE(parser->arena, Declaration, size * 2);
+                memcpy(grown, decls, sizeof(Declaration) * size);
+                decls = grown;
+                size *= 2;
+            }
+            declaration(parser, &decls[count++]);
+            if (!isToken(parser, T_SEMICOLON))
+                break;
+            next(parser);
+        }
+        matchToken(parser, T_IN);
+
+        Expression *body = expression(parser);
+        Expression *e = newExpression(parser, rec ? EXPRESSION_LET_REC : EXPRESSION_LET, combine(token.location, body->location));
+        e->data.let.decls = decls;
+        e->data.let.count = count;
+        e->data.let.e = body;
+        return e;
+    }
+    case T_IF:
+    {
+        next(parser);
+        matchToken(parser, T_LPAREN);
+        Expression *e1 = expression(parser);
+        matchToken(parser, T_RPAREN);
+        Expression *e2 = expression(parser);
+        matchToken(parser, T_ELSE);
+        Expression *e3 = expression(parser);
+
+        Expression *e = newExpression(parser, EXPRESSION_IF, combine(token.location, e3->location));
+        e->data.ifs.e1 = e1;
+        e->data.ifs.e2 = e2;
+        e->data.ifs.e3 = e3;
+        return e;
+    }
+    case T_IDENTIFIER:
+    {
+        Expression *e = newExpression(parser, EXPRESSION_VAR, token.location);
+        e->data.name = intern(parser, &token);
+        next(parser);
+        return e;
+    }
+    default:
+        syntaxError(parser, sizeof(factorFirst) / sizeof(factorFirst[0]), factorFirst);
+        return NULL;
+    }
+}
+
+static Expression *multiplicative(Parser *parser)
+{
+    Expression *e = factor(parser);
+
+    while (isToken(parser, T_STAR) || isToken(parser, T_SLASH))
+    {
+        BinaryOp op = isToken(parser, T_STAR) ? OP_TIMES : OP_DIVIDE;
+
+        next(parser);
+        e = newOp(parser, e, factor(parser), op);
+    }
+
+    return e;
+}
+
+static Expression *additive(Parser *parser)
+{
+    Expression *e = multiplicative(parser);
+
+    while (isToken(parser, T_PLUS) || isToken(parser, T_DASH))
+    {
+        BinaryOp op = isToken(parser, T_PLUS) ? OP_PLUS : OP_MINUS;
+
+        next(parser);
+        e = newOp(parser, e, multiplicative(parser), op);
+    }
+
+    return e;
+}
+
+static Expression *relational(Parser *parser)
+{
+    Expression *e = additive(parser);
+
+    if (isToken(parser, T_EQUAL_EQUAL))
+    {
+        next(parser);
+        e = newOp(parser, e, additive(parser), OP_EQUALS);
+    }
+
+    return e;
+}
+
+static Expression *expression(Parser *parser)
+{
+    Expression *e = relational(parser);
+
+    while (isFactorFirst(parser))
+    {
+        Expression *argument = relational(parser);
+        Expression *app = newExpression(parser, EXPRESSION_APP, combine(e->location, argument->location));
+
+        app->data.app.e1 = e;
+        app->data.app.e2 = argument;
+        e = app;
+    }
+
+    return e;
+}
+
+/* As the generated parsers do, whatever follows the program's expression is ignored. */
+int parser_parse(Arena *arena, char *source, Program *program, char *errorMessage)
+{
+    Parser parser;
+
+    parser.arena = arena;
+    parser.errorMessage = errorMessage;
+    parser.source = source;
+    parser.offset = 0;
+    parser.position.line = 1;
+    parser.position.column = 1;
+    parser.table = NULL;
+    parser.tableSize = 0;
+    parser.names = ARENA_ALLOCATE(arena, char *, INITIAL_NAMES);
+    parser.nameCount = 0;
+    parser.namesSize = INITIAL_NAMES;
+
+    if (setjmp(parser.errorHandler) != 0)
+        return 0;
+
+    next(&parser);
+    program->expression = expression(&parser);
+    program->names = parser.names;
+    program->nameCount = parser.nameCount;
+
+    return 1;
+}
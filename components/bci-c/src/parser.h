@@ -0,0 +1,124 @@
+#ifndef PARSER_H
+#define PARSER_H
+
+#include <stdint.h>
+
+#include "arena.h"
+
+/* Large enough for a syntax error or a type error that names a couple of modest types. */
+#define STLC_ERROR_MESSAGE_SIZE 1024
+
+/*
+ * The syntax tree of an STLC program, as built by the Kotlin front end's
+ * ParserVisitor: a lambda of several names, and a declaration with
+ * parameters, are nested lambdas of one name each.  Names are numbered as
+ * they are first seen so that the passes over the tree keep their scopes in
+ * arrays indexed on the name.
+ */
+
+typedef struct
+{
+    int32_t line;
+    int32_t column;
+} Position;
+
+/* A single character is a coordinate - anything longer is a range, both ends inclusive. */
+typedef struct
+{
+    Position start;
+    Position end;
+    int range;
+} Location;
+
+typedef enum
+{
+    EXPRESSION_APP,
+    EXPRESSION_IF,
+    EXPRESSION_LAM,
+    EXPRESSION_LET,
+    EXPRESSION_LET_REC,
+    EXPRESSION_BOOL,
+    EXPRESSION_INT,
+    EXPRESSION_OP,
+    EXPRESSION_VAR
+} ExpressionKind;
+
+typedef enum
+{
+    OP_EQUALS,
+    OP_PLUS,
+    OP_MINUS,
+    OP_TIMES,
+    OP_DIVIDE
+} BinaryOp;
+
+typedef struct Expression Expression;
+
+typedef struct
+{
+    int32_t name;
+    Expression *e;
+} Declaration;
+
+struct Expression
+{
+    ExpressionKind kind;
+    Location location;
+
+    union
+    {
+        struct
+        {
+            Expression *e1;
+            Expression *e2;
+        } app;
+        struct
+        {
+            Expression *e1;
+            Expression *e2;
+            Expression *e3;
+        } ifs;
+        struct
+        {
+            int32_t name;
+            Expression *e;
+        } lam;
+        /* Both let and let rec. */
+        struct
+        {
+            Declaration *decls;
+            int32_t count;
+            Expression *e;
+        } let;
+        int32_t b;
+        int32_t i;
+        struct
+        {
+            Expression *e1;
+            Expression *e2;
+            BinaryOp op;
+        } op;
+        int32_t name;
+    } data;
+
+    /* Filled in by the compiler. */
+    int32_t enterSize;
+    int expensive;
+};
+
+typedef struct
+{
+    Expression *expression;
+
+    /* Indexed on a name's number. */
+    char **names;
+    int32_t nameCount;
+} Program;
+
+/* Returns 0, with the error in errorMessage, if source is not a program. */
+extern int parser_parse(Arena *arena, char *source, Program *program, char *errorMessage);
+
+/* As the Kotlin front end prints it: "l:c", "l:c-c" or "l:c-l:c". */
+extern void parser_locationToString(Location *location, char *buffer, int32_t size);
+
+#endif
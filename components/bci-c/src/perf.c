@@ -0,0 +1,286 @@
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+
+#include "memory.h"
+
+#include "perf.h"
+
+struct Perf
+{
+    /* The first open counter of a phase leads its group so that one call enables or disables them all. */
+    int fds[PERF_PHASES][PERF_COUNTERS];
+    int leaders[PERF_PHASES];
+    int available;
+    char error[128];
+};
+
+static char *phaseNames[PERF_PHASES] = {"execute", "mark", "sweep"};
+static char *counterNames[PERF_COUNTERS] = {"cycles", "instructions", "branchMisses", "l1dMisses", "llcMisses"};
+
+#ifdef __linux__
+
+static int openCounter(PerfCounter counter, int leader)
+{
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.disabled = leader == -1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+
+    switch (counter)
+    {
+    case PERF_CYCLES:
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = PERF_COUNT_HW_CPU_CYCLES;
+        break;
+    case PERF_INSTRUCTIONS:
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+        break;
+    case PERF_BRANCH_MISSES:
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = PERF_COUNT_HW_BRANCH_MISSES;
+        break;
+    case PERF_L1D_MISSES:
+        attr.type = PERF_TYPE_HW_CACHE;
+        attr.config = PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        break;
+    case PERF_LLC_MISSES:
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = PERF_COUNT_HW_CACHE_MISSES;
+        break;
+    }
+
+    return (int)syscall(__NR_perf_event_open, &attr, 0, -1, leader, 0);
+}
+
+Perf *perf_new(void)
+{
+    Perf *perf = ALLOCATE(Perf, 1);
+
+    perf->available = 0;
+    strcpy(perf->error, "no counters");
+
+    for (int p = 0; p < PERF_PHASES; p++)
+    {
+        perf->leaders[p] = -1;
+
+        for (int c = 0; c < PERF_COUNTERS; c++)
+        {
+            perf->fds[p][c] = openCounter(c, perf->leaders[p]);
+
+            if (perf->fds[p][c] == -1)
+            {
+                if (p == 0 && c == 0)
+                    snprintf(perf->error, sizeof(perf->error), "%s: %s", counterNames[c], strerror(errno));
+            }
+            else
+            {
+                if (perf->leaders[p] == -1)
+                    perf->leaders[p] = perf->fds[p][c];
+                perf->available = 1;
+            }
+        }
+    }
+
+    return perf;
+}
+
+void perf_start(Perf *perf, PerfPhase phase)
+{
+    if (perf->leaders[phase] != -1)
+        ioctl(perf->leaders[phase], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+}
+
+void perf_stop(Perf *perf, PerfPhase phase)
+{
+    if (perf->leaders[phase] != -1)
+        ioctl(perf->leaders[phase], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+}
+
+#else
+
+Perf *perf_new(void)
+{
+    Perf *perf = ALLOCATE(Perf, 1);
+
+    for (int p = 0; p < PERF_PHASES; p++)
+    {
+        perf->leaders[p] = -1;
+        for (int c = 0; c < PERF_COUNTERS; c++)
+            perf->fds[p][c] = -1;
+    }
+    perf->available = 0;
+    strcpy(perf->error, "perf_event_open requires Linux");
+
+    return perf;
+}
+
+void perf_start(Perf *perf, PerfPhase phase)
+{
+}
+
+void perf_stop(Perf *perf, PerfPhase phase)
+{
+}
+
+#endif
+
+void perf_free(Perf *perf)
+{
+    for (int p = 0; p < PERF_PHASES; p++)
+    {
+        for (int c = 0; c < PERF_COUNTERS; c++)
+        {
+            if (perf->fds[p][c] != -1)
+                close(perf->fds[p][c]);
+        }
+    }
+
+    FREE(perf);
+}
+
+int perf_available(Perf *perf)
+{
+    return perf->available;
+}
+
+char *perf_error(Perf *perf)
+{
+    return perf->error;
+}
+
+void perf_read(Perf *perf, PerfPhase phase, int64_t *values)
+{
+    for (int c = 0; c < PERF_COUNTERS; c++)
+    {
+        uint64_t value;
+
+        if (perf->fds[phase][c] != -1 && read(perf->fds[phase][c], &value, sizeof(value)) == sizeof(value))
+            values[c] = (int64_t)value;
+        else
+            values[c] = -1;
+    }
+}
+
+/* The mutator's counts are execution less collection, where all three are known. */
+static void readAll(Perf *perf, int64_t values[PERF_PHASES + 1][PERF_COUNTERS])
+{
+    for (int p = 0; p < PERF_PHASES; p++)
+        perf_read(perf, p, values[p]);
+
+    for (int c = 0; c < PERF_COUNTERS; c++)
+    {
+        int64_t execute = values[PERF_EXECUTE][c];
+        int64_t mark = values[PERF_MARK][c];
+        int64_t sweep = values[PERF_SWEEP][c];
+
+        values[PERF_PHASES][c] = execute < 0 || mark < 0 || sweep < 0 ? -1 : execute - mark - sweep;
+    }
+}
+
+static double ratio(int64_t a, int64_t b)
+{
+    return a < 0 || b <= 0 ? -1.0 : (double)a / b;
+}
+
+static void printCount(int64_t value, FILE *out)
+{
+    if (value < 0)
+        fprintf(out, " %14s", "-");
+    else
+        fprintf(out, " %14ld", (long)value);
+}
+
+static void printRatio(double value, FILE *out)
+{
+    if (value < 0)
+        fprintf(out, " %10s", "-");
+    else
+        fprintf(out, " %10.3f", value);
+}
+
+void perf_report(Perf *perf, int64_t instructions, FILE *out)
+{
+    if (!perf->available)
+    {
+        fprintf(out, ". Hardware counters unavailable: %s\n", perf->error);
+        return;
+    }
+
+    int64_t values[PERF_PHASES + 1][PERF_COUNTERS];
+    char *names[PERF_PHASES + 1] = {"execute", "mark", "sweep", "mutator"};
+
+    readAll(perf, values);
+
+    fprintf(out, ". Hardware counters: %ld bytecode instructions\n", (long)instructions);
+    fprintf(out, "  %-8s %14s %14s %10s %14s %14s %14s %10s %10s %10s\n",
+            "phase", "cycles", "instructions", "IPC", "branch-miss", "L1d-miss", "LLC-miss", "br/op", "L1d/op", "LLC/op");
+
+    for (int p = 0; p <= PERF_PHASES; p++)
+    {
+        int64_t *v = values[p];
+
+        fprintf(out, "  %-8s", names[p]);
+        printCount(v[PERF_CYCLES], out);
+        printCount(v[PERF_INSTRUCTIONS], out);
+        printRatio(ratio(v[PERF_INSTRUCTIONS], v[PERF_CYCLES]), out);
+        printCount(v[PERF_BRANCH_MISSES], out);
+        printCount(v[PERF_L1D_MISSES], out);
+        printCount(v[PERF_LLC_MISSES], out);
+        printRatio(ratio(v[PERF_BRANCH_MISSES], instructions), out);
+        printRatio(ratio(v[PERF_L1D_MISSES], instructions), out);
+        printRatio(ratio(v[PERF_LLC_MISSES], instructions), out);
+        fprintf(out, "\n");
+    }
+}
+
+static void writeValue(int64_t value, FILE *out)
+{
+    if (value < 0)
+        fprintf(out, "null");
+    else
+        fprintf(out, "%ld", (long)value);
+}
+
+void perf_writeJson(Perf *perf, int64_t instructions, FILE *out)
+{
+    if (!perf->available)
+    {
+        fprintf(out, "null");
+        return;
+    }
+
+    int64_t values[PERF_PHASES + 1][PERF_COUNTERS];
+
+    readAll(perf, values);
+
+    fprintf(out, "{");
+    for (int p = 0; p <= PERF_PHASES; p++)
+    {
+        int64_t *v = values[p];
+        double ipc = ratio(v[PERF_INSTRUCTIONS], v[PERF_CYCLES]);
+
+        fprintf(out, "%s\"%s\": {", p == 0 ? "" : ", ", p < PERF_PHASES ? phaseNames[p] : "mutator");
+        for (int c = 0; c < PERF_COUNTERS; c++)
+        {
+            fprintf(out, "\"%s\": ", counterNames[c]);
+            writeValue(v[c], out);
+            fprintf(out, ", ");
+        }
+        if (ipc < 0)
+            fprintf(out, "\"ipc\": null}");
+        else
+            fprintf(out, "\"ipc\": %.3f}", ipc);
+    }
+    fprintf(out, ", \"bytecodeInstructions\": %ld}", (long)instructions);
+}
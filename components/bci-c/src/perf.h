@@ -0,0 +1,54 @@
+#ifndef PERF_H
+#define PERF_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+ * Hardware performance counters, through perf_event_open on Linux, counted
+ * separately while the interpreter executes and while the collector marks
+ * and sweeps.  Execution includes collection - the report subtracts it to
+ * give the mutator's share.  Only user-mode events are counted.  Counters
+ * the kernel or container does not permit are reported as unavailable.
+ */
+
+typedef enum
+{
+    PERF_EXECUTE,
+    PERF_MARK,
+    PERF_SWEEP
+} PerfPhase;
+
+#define PERF_PHASES (PERF_SWEEP + 1)
+
+typedef enum
+{
+    PERF_CYCLES,
+    PERF_INSTRUCTIONS,
+    PERF_BRANCH_MISSES,
+    PERF_L1D_MISSES,
+    PERF_LLC_MISSES
+} PerfCounter;
+
+#define PERF_COUNTERS (PERF_LLC_MISSES + 1)
+
+typedef struct Perf Perf;
+
+extern Perf *perf_new(void);
+extern void perf_free(Perf *perf);
+
+/* 0 if no counter could be opened - perf_error then gives the reason. */
+extern int perf_available(Perf *perf);
+extern char *perf_error(Perf *perf);
+
+extern void perf_start(Perf *perf, PerfPhase phase);
+extern void perf_stop(Perf *perf, PerfPhase phase);
+
+/* Fills values with each counter's total, or -1 where it is unavailable. */
+extern void perf_read(Perf *perf, PerfPhase phase, int64_t *values);
+
+/* instructions is the number of bytecode instructions executed, to give per-instruction rates. */
+extern void perf_report(Perf *perf, int64_t instructions, FILE *out);
+extern void perf_writeJson(Perf *perf, int64_t instructions, FILE *out);
+
+#endif
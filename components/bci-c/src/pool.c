@@ -0,0 +1,256 @@
+#include <pthread.h>
+#include <stdatomic.h>
+#include <time.h>
+
+#include "memory.h"
+#include "run.h"
+
+#include "pool.h"
+
+/*
+ * The number of tasks a deque holds before further spawns are evaluated by
+ * the spawning thread.  Keeping it small keeps the cost of a spawn that is
+ * not stolen close to that of a call.
+ */
+#define POOL_PENDING 2
+
+/* How long an idle worker sleeps before looking for work again in case it missed a wakeup. */
+#define IDLE_WAIT 1000000
+
+#define DEFAULT_STACK_SIZE 256
+
+typedef struct
+{
+    pthread_mutex_t lock;
+    Task *tasks[POOL_PENDING];
+    int32_t head;
+    int32_t tail;
+} Deque;
+
+typedef struct
+{
+    Pool *pool;
+    int32_t id;
+    pthread_t thread;
+    MemoryState memoryState;
+} Worker;
+
+struct Pool
+{
+    int32_t threads;
+    unsigned char *block;
+    int32_t size;
+
+    Deque *deques;
+    /* Indexed on deque - workers[POOL_CALLER] is unused. */
+    Worker *workers;
+
+    pthread_mutex_t lock;
+    pthread_cond_t work;
+    pthread_cond_t done;
+    atomic_int idle;
+    int stopping;
+};
+
+static Task *steal(Pool *pool, int32_t id)
+{
+    Task *task = NULL;
+
+    for (int i = 1; task == NULL && i < pool->threads; i++)
+    {
+        Deque *victim = &pool->deques[(id + i) % pool->threads];
+
+        pthread_mutex_lock(&victim->lock);
+        if (victim->head < victim->tail)
+        {
+            task = victim->tasks[victim->head++];
+            if (victim->head == victim->tail)
+                victim->head = victim->tail = 0;
+        }
+        pthread_mutex_unlock(&victim->lock);
+    }
+
+    return task;
+}
+
+static void idle(Pool *pool)
+{
+    struct timespec until;
+
+    clock_gettime(CLOCK_REALTIME, &until);
+    until.tv_nsec += IDLE_WAIT;
+    if (until.tv_nsec >= 1000000000)
+    {
+        until.tv_sec++;
+        until.tv_nsec -= 1000000000;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    if (!pool->stopping)
+    {
+        atomic_fetch_add(&pool->idle, 1);
+        pthread_cond_timedwait(&pool->work, &pool->lock, &until);
+        atomic_fetch_sub(&pool->idle, 1);
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
+
+static void *workerMain(void *arg)
+{
+    Worker *worker = (Worker *)arg;
+    Pool *pool = worker->pool;
+
+    while (1)
+    {
+        pthread_mutex_lock(&pool->lock);
+        int stopping = pool->stopping;
+        pthread_mutex_unlock(&pool->lock);
+
+        if (stopping)
+            break;
+
+        Task *task = steal(pool, worker->id);
+        if (task == NULL)
+        {
+            idle(pool);
+            continue;
+        }
+
+        run_task(pool->block, pool->size, &worker->memoryState, pool, worker->id, task);
+
+        pthread_mutex_lock(&pool->lock);
+        task->done = 1;
+        pthread_cond_broadcast(&pool->done);
+        pthread_mutex_unlock(&pool->lock);
+    }
+
+    return NULL;
+}
+
+Pool *pool_new(int32_t threads, unsigned char *block, int32_t size, MemoryState *mm)
+{
+    Pool *pool = ALLOCATE(Pool, 1);
+
+    pool->threads = threads;
+    pool->block = block;
+    pool->size = size;
+    pool->deques = ALLOCATE(Deque, threads);
+    pool->workers = ALLOCATE(Worker, threads);
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->work, NULL);
+    pthread_cond_init(&pool->done, NULL);
+    atomic_init(&pool->idle, 0);
+    pool->stopping = 0;
+
+    for (int i = 0; i < threads; i++)
+    {
+        pthread_mutex_init(&pool->deques[i].lock, NULL);
+        pool->deques[i].head = 0;
+        pool->deques[i].tail = 0;
+    }
+
+    for (int i = 1; i < threads; i++)
+    {
+        Worker *worker = &pool->workers[i];
+
+        worker->pool = pool;
+        worker->id = i;
+        worker->memoryState = value_newSharedMemoryManager(mm, DEFAULT_STACK_SIZE);
+        pthread_create(&worker->thread, NULL, workerMain, worker);
+    }
+
+    return pool;
+}
+
+void pool_free(Pool *pool)
+{
+    pthread_mutex_lock(&pool->lock);
+    pool->stopping = 1;
+    pthread_cond_broadcast(&pool->work);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (int i = 1; i < pool->threads; i++)
+    {
+        pthread_join(pool->workers[i].thread, NULL);
+        value_destroyMemoryManager(&pool->workers[i].memoryState);
+    }
+
+    for (int i = 0; i < pool->threads; i++)
+        pthread_mutex_destroy(&pool->deques[i].lock);
+
+    pthread_cond_destroy(&pool->done);
+    pthread_cond_destroy(&pool->work);
+    pthread_mutex_destroy(&pool->lock);
+
+    FREE(pool->workers);
+    FREE(pool->deques);
+    FREE(pool);
+}
+
+Task *pool_spawn(Pool *pool, int32_t deque, Value *closure, int64_t depth, int32_t spawns, int64_t deadline)
+{
+    Deque *own = &pool->deques[deque];
+
+    pthread_mutex_lock(&own->lock);
+    int full = own->tail == POOL_PENDING;
+    pthread_mutex_unlock(&own->lock);
+
+    if (full)
+        return NULL;
+
+    Task *task = ALLOCATE(Task, 1);
+
+    task->closure = closure;
+    task->depth = depth;
+    task->spawns = spawns;
+    task->deadline = deadline;
+    task->status = BCI_OK;
+    task->errorMessage[0] = '\0';
+    task->result = NULL;
+    task->values.root = NULL;
+    task->values.size = 0;
+    task->values.bytes = 0;
+    task->executed = 0;
+    task->allocations = 0;
+    task->collections = 0;
+    task->done = 0;
+
+    pthread_mutex_lock(&own->lock);
+    own->tasks[own->tail++] = task;
+    pthread_mutex_unlock(&own->lock);
+
+    if (atomic_load(&pool->idle) > 0)
+    {
+        pthread_mutex_lock(&pool->lock);
+        pthread_cond_signal(&pool->work);
+        pthread_mutex_unlock(&pool->lock);
+    }
+
+    return task;
+}
+
+int pool_reclaim(Pool *pool, int32_t deque, Task *task)
+{
+    Deque *own = &pool->deques[deque];
+    int reclaimed = 0;
+
+    pthread_mutex_lock(&own->lock);
+    if (own->tail > own->head && own->tasks[own->tail - 1] == task)
+    {
+        own->tail--;
+        if (own->head == own->tail)
+            own->head = own->tail = 0;
+        reclaimed = 1;
+    }
+    pthread_mutex_unlock(&own->lock);
+
+    return reclaimed;
+}
+
+void pool_wait(Pool *pool, Task *task)
+{
+    pthread_mutex_lock(&pool->lock);
+    while (!task->done)
+        pthread_cond_wait(&pool->done, &pool->lock);
+    pthread_mutex_unlock(&pool->lock);
+}
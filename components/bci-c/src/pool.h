@@ -0,0 +1,58 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <stdint.h>
+
+#include "value.h"
+#include "vm.h"
+
+/*
+ * A pool of worker threads that evaluates the thunks a program SPAWNs.  Each
+ * thread, the one that created the pool included, owns a deque: a thread
+ * pushes the tasks it spawns onto the tail of its own deque and, when it
+ * reaches the matching JOIN, reclaims the task from the tail if no other
+ * thread has yet taken it.  Idle workers steal from the heads of the other
+ * threads' deques.
+ *
+ * A worker runs a task in its own heap.  The task's closure, and everything
+ * the closure can reach, stays in the spawning thread's heap where the
+ * worker reads it but never marks or frees it.  When the task completes the
+ * values reachable from its result are detached from the worker's heap and
+ * are adopted by the spawning thread's heap at the JOIN.
+ */
+typedef struct Pool Pool;
+
+typedef struct
+{
+    Value *closure;
+    int64_t depth;
+    /* The SPAWNs the task is nested within, its own included. */
+    int32_t spawns;
+    int64_t deadline;
+
+    /* Written by the thread that runs the task and read once the task is done. */
+    BciStatus status;
+    char errorMessage[BCI_ERROR_MESSAGE_SIZE];
+    Value *result;
+    DetachedValues values;
+    int64_t executed;
+    int64_t allocations;
+    int64_t collections;
+
+    int done;
+} Task;
+
+/* The deque of the thread that creates the pool. */
+#define POOL_CALLER 0
+
+extern Pool *pool_new(int32_t threads, unsigned char *block, int32_t size, MemoryState *mm);
+/* Every task that has been spawned must have been reclaimed or waited for. */
+extern void pool_free(Pool *pool);
+
+/* Returns NULL, so that the caller evaluates closure itself, if deque already holds enough tasks. */
+extern Task *pool_spawn(Pool *pool, int32_t deque, Value *closure, int64_t depth, int32_t spawns, int64_t deadline);
+/* Returns 1 if task was still on the tail of deque - it is then the caller's to run and free. */
+extern int pool_reclaim(Pool *pool, int32_t deque, Task *task);
+extern void pool_wait(Pool *pool, Task *task);
+
+#endif
@@ -0,0 +1,473 @@
+#include <string.h>
+
+#include "buffer.h"
+#include "memory.h"
+#include "op.h"
+#include "stringbuilder.h"
+#include "timer.h"
+
+#include "profile.h"
+
+#define OPCODES (JOIN + 1)
+#define INITIAL_INDEX 256
+#define REPORT_PAIRS 20
+
+typedef struct
+{
+    int64_t count;
+    int64_t time;
+} Counter;
+
+typedef struct
+{
+    int32_t ip;
+    int64_t calls;
+    int64_t inclusive;
+    int64_t exclusive;
+
+    /* Frames of this function on the stack so recursion is only counted once in inclusive time. */
+    int32_t active;
+} Function;
+
+/* A node in the tree of distinct call stacks. */
+typedef struct
+{
+    int32_t parent;
+    int32_t function;
+    int64_t time;
+} Node;
+
+typedef struct
+{
+    int32_t function;
+    int32_t node;
+    int64_t start;
+} Frame;
+
+/* An open-addressing map from a non-negative key to an index. */
+typedef struct
+{
+    int32_t count;
+    int32_t capacity;
+    int64_t *keys;
+    int32_t *values;
+} Index;
+
+struct Profile
+{
+    Counter opcodes[OPCODES];
+    Counter pairs[OPCODES][OPCODES];
+
+    Buffer *functions;
+    Index functionIndex;
+    Buffer *nodes;
+    Index nodeIndex;
+    Buffer *frames;
+
+    int64_t instructions;
+    int64_t elapsed;
+
+    int64_t last;
+    int previous;
+    int64_t previousTime;
+    int beforePrevious;
+    int64_t beforePreviousTime;
+};
+
+static void initIndex(Index *index, int32_t capacity)
+{
+    index->count = 0;
+    index->capacity = capacity;
+    index->keys = ALLOCATE(int64_t, capacity);
+    index->values = ALLOCATE(int32_t, capacity);
+
+    for (int i = 0; i < capacity; i++)
+        index->keys[i] = -1;
+}
+
+static int32_t slot(Index *index, int64_t key)
+{
+    uint64_t hash = (uint64_t)key * 11400714819323198485ULL;
+    int32_t i = (int32_t)(hash >> 40) & (index->capacity - 1);
+
+    while (index->keys[i] != -1 && index->keys[i] != key)
+        i = (i + 1) & (index->capacity - 1);
+
+    return i;
+}
+
+static void putIndex(Index *index, int64_t key, int32_t value)
+{
+    if ((index->count + 1) * 2 > index->capacity)
+    {
+        Index grown;
+
+        initIndex(&grown, index->capacity * 2);
+        for (int i = 0; i < index->capacity; i++)
+        {
+            if (index->keys[i] != -1)
+                putIndex(&grown, index->keys[i], index->values[i]);
+        }
+
+        FREE(index->keys);
+        FREE(index->values);
+        *index = grown;
+    }
+
+    int32_t i = slot(index, key);
+
+    index->keys[i] = key;
+    index->values[i] = value;
+    index->count++;
+}
+
+static int32_t getIndex(Index *index, int64_t key)
+{
+    int32_t i = slot(index, key);
+
+    return index->keys[i] == -1 ? -1 : index->values[i];
+}
+
+Profile *profile_new(void)
+{
+    Profile *profile = ALLOCATE(Profile, 1);
+
+    memset(profile->opcodes, 0, sizeof(profile->opcodes));
+    memset(profile->pairs, 0, sizeof(profile->pairs));
+
+    profile->functions = buffer_new(sizeof(Function));
+    initIndex(&profile->functionIndex, INITIAL_INDEX);
+    profile->nodes = buffer_new(sizeof(Node));
+    initIndex(&profile->nodeIndex, INITIAL_INDEX);
+    profile->frames = buffer_new(sizeof(Frame));
+
+    profile->instructions = 0;
+    profile->elapsed = 0;
+
+    profile->last = 0;
+    profile->previous = -1;
+    profile->previousTime = 0;
+    profile->beforePrevious = -1;
+    profile->beforePreviousTime = 0;
+
+    return profile;
+}
+
+void profile_free(Profile *profile)
+{
+    buffer_free(profile->functions);
+    FREE(profile->functionIndex.keys);
+    FREE(profile->functionIndex.values);
+    buffer_free(profile->nodes);
+    FREE(profile->nodeIndex.keys);
+    FREE(profile->nodeIndex.values);
+    buffer_free(profile->frames);
+    FREE(profile);
+}
+
+static Function *functions(Profile *profile)
+{
+    return buffer_content(profile->functions);
+}
+
+static Node *nodes(Profile *profile)
+{
+    return buffer_content(profile->nodes);
+}
+
+static Frame *topFrame(Profile *profile)
+{
+    return (Frame *)buffer_content(profile->frames) + buffer_count(profile->frames) - 1;
+}
+
+static int32_t findFunction(Profile *profile, int32_t ip)
+{
+    int32_t function = getIndex(&profile->functionIndex, ip);
+
+    if (function == -1)
+    {
+        Function f = {ip, 0, 0, 0, 0};
+
+        function = buffer_count(profile->functions);
+        buffer_append(profile->functions, &f, 1);
+        putIndex(&profile->functionIndex, ip, function);
+    }
+
+    return function;
+}
+
+static int32_t findNode(Profile *profile, int32_t parent, int32_t function)
+{
+    int64_t key = ((int64_t)(parent + 1) << 32) | function;
+    int32_t node = getIndex(&profile->nodeIndex, key);
+
+    if (node == -1)
+    {
+        Node n = {parent, function, 0};
+
+        node = buffer_count(profile->nodes);
+        buffer_append(profile->nodes, &n, 1);
+        putIndex(&profile->nodeIndex, key, node);
+    }
+
+    return node;
+}
+
+static void pushFrame(Profile *profile, int32_t ip, int64_t now)
+{
+    int32_t parent = buffer_count(profile->frames) == 0 ? -1 : topFrame(profile)->node;
+    Frame frame;
+
+    frame.function = findFunction(profile, ip);
+    frame.node = findNode(profile, parent, frame.function);
+    frame.start = now;
+    buffer_append(profile->frames, &frame, 1);
+
+    Function *function = &functions(profile)[frame.function];
+    function->calls++;
+    function->active++;
+}
+
+static void popFrame(Profile *profile, int64_t now)
+{
+    Frame *frame = topFrame(profile);
+    Function *function = &functions(profile)[frame->function];
+
+    function->active--;
+    if (function->active == 0)
+        function->inclusive += now - frame->start;
+
+    profile->frames->items_count--;
+}
+
+/* Charges the time since the last clock read to the executing opcode and frame. */
+static void settle(Profile *profile, int64_t now)
+{
+    if (profile->previous < 0)
+        return;
+
+    int64_t elapsed = now - profile->last;
+    Frame *frame = topFrame(profile);
+
+    profile->opcodes[profile->previous].time += elapsed;
+    profile->previousTime += elapsed;
+    profile->elapsed += elapsed;
+    functions(profile)[frame->function].exclusive += elapsed;
+    nodes(profile)[frame->node].time += elapsed;
+    profile->last = now;
+}
+
+static void settlePair(Profile *profile)
+{
+    if (profile->beforePrevious >= 0)
+        profile->pairs[profile->beforePrevious][profile->previous].time += profile->beforePreviousTime + profile->previousTime;
+}
+
+void profile_instruction(Profile *profile, int opcode)
+{
+    int64_t now = timer_now();
+
+    if (buffer_count(profile->frames) == 0)
+        pushFrame(profile, 0, now);
+
+    settle(profile, now);
+
+    if (profile->previous >= 0)
+    {
+        settlePair(profile);
+        profile->pairs[profile->previous][opcode].count++;
+    }
+
+    profile->beforePrevious = profile->previous;
+    profile->beforePreviousTime = profile->previousTime;
+    profile->previous = opcode;
+    profile->previousTime = 0;
+    profile->last = now;
+
+    profile->opcodes[opcode].count++;
+    profile->instructions++;
+}
+
+void profile_call(Profile *profile, int32_t ip)
+{
+    int64_t now = timer_now();
+
+    settle(profile, now);
+    pushFrame(profile, ip, now);
+}
+
+void profile_return(Profile *profile)
+{
+    int64_t now = timer_now();
+
+    settle(profile, now);
+    if (buffer_count(profile->frames) > 1)
+        popFrame(profile, now);
+}
+
+void profile_stop(Profile *profile)
+{
+    int64_t now = timer_now();
+
+    settle(profile, now);
+    if (profile->previous >= 0)
+        settlePair(profile);
+
+    while (buffer_count(profile->frames) > 0)
+        popFrame(profile, now);
+
+    profile->previous = -1;
+    profile->previousTime = 0;
+    profile->beforePrevious = -1;
+    profile->beforePreviousTime = 0;
+}
+
+static char *functionName(Profile *profile, Symbols *symbols, int32_t function, char *buffer)
+{
+    int32_t ip = functions(profile)[function].ip;
+    char *name = symbols == NULL ? NULL : symbols_find(symbols, ip);
+
+    if (name != NULL)
+        return name;
+    if (ip == 0)
+        return "main";
+
+    sprintf(buffer, "ip%d", ip);
+    return buffer;
+}
+
+static double percentage(int64_t time, int64_t total)
+{
+    return total == 0 ? 0.0 : time * 100.0 / total;
+}
+
+static int compareCounters(const void *a, const void *b)
+{
+    int64_t ta = (*(Counter **)a)->time;
+    int64_t tb = (*(Counter **)b)->time;
+
+    return (ta < tb) - (ta > tb);
+}
+
+static int compareFunctions(const void *a, const void *b)
+{
+    int64_t ta = ((Function *)a)->exclusive;
+    int64_t tb = ((Function *)b)->exclusive;
+
+    return (ta < tb) - (ta > tb);
+}
+
+void profile_report(Profile *profile, Symbols *symbols, FILE *out)
+{
+    int64_t total = profile->elapsed;
+    Counter *counters[OPCODES * OPCODES];
+    int32_t count;
+
+    fprintf(out, ". Profile: %ld instructions in %.3fms\n", (long)profile->instructions, total / 1000000.0);
+
+    fprintf(out, ". Opcodes\n");
+    fprintf(out, "  %-24s %12s %12s %7s %9s\n", "opcode", "count", "time(ms)", "time%", "ns/op");
+    count = 0;
+    for (int i = 0; i < OPCODES; i++)
+    {
+        if (profile->opcodes[i].count > 0)
+            counters[count++] = &profile->opcodes[i];
+    }
+    qsort(counters, count, sizeof(Counter *), compareCounters);
+    for (int i = 0; i < count; i++)
+    {
+        Counter *c = counters[i];
+
+        fprintf(out, "  %-24s %12ld %12.3f %6.1f%% %9.1f\n",
+                find(c - profile->opcodes)->name,
+                (long)c->count,
+                c->time / 1000000.0,
+                percentage(c->time, total),
+                (double)c->time / c->count);
+    }
+
+    fprintf(out, ". Opcode pairs\n");
+    fprintf(out, "  %-24s %12s %12s %7s %9s\n", "pair", "count", "time(ms)", "time%", "ns/pair");
+    count = 0;
+    for (int i = 0; i < OPCODES; i++)
+    {
+        for (int j = 0; j < OPCODES; j++)
+        {
+            if (profile->pairs[i][j].count > 0)
+                counters[count++] = &profile->pairs[i][j];
+        }
+    }
+    qsort(counters, count, sizeof(Counter *), compareCounters);
+    for (int i = 0; i < count && i < REPORT_PAIRS; i++)
+    {
+        Counter *c = counters[i];
+        int32_t pair = c - &profile->pairs[0][0];
+        char name[64];
+
+        sprintf(name, "%s %s", find(pair / OPCODES)->name, find(pair % OPCODES)->name);
+        fprintf(out, "  %-24s %12ld %12.3f %6.1f%% %9.1f\n",
+                name,
+                (long)c->count,
+                c->time / 1000000.0,
+                percentage(c->time, total),
+                (double)c->time / c->count);
+    }
+
+    fprintf(out, ". Functions\n");
+    fprintf(out, "  %-24s %8s %12s %14s %14s %7s\n", "function", "entry", "calls", "inclusive(ms)", "exclusive(ms)", "excl%");
+
+    int32_t functionCount = buffer_count(profile->functions);
+    Function *sorted = ALLOCATE(Function, functionCount);
+    memcpy(sorted, functions(profile), sizeof(Function) * functionCount);
+    qsort(sorted, functionCount, sizeof(Function), compareFunctions);
+
+    for (int i = 0; i < functionCount; i++)
+    {
+        Function *f = &sorted[i];
+        char buffer[32];
+
+        fprintf(out, "  %-24s %8d %12ld %14.3f %14.3f %6.1f%%\n",
+                functionName(profile, symbols, findFunction(profile, f->ip), buffer),
+                f->ip,
+                (long)f->calls,
+                f->inclusive / 1000000.0,
+                f->exclusive / 1000000.0,
+                percentage(f->exclusive, total));
+    }
+
+    FREE(sorted);
+}
+
+void profile_writeCollapsed(Profile *profile, Symbols *symbols, FILE *out)
+{
+    Node *ns = nodes(profile);
+    int32_t count = buffer_count(profile->nodes);
+    Buffer *path = buffer_new(sizeof(int32_t));
+
+    for (int i = 0; i < count; i++)
+    {
+        if (ns[i].time == 0)
+            continue;
+
+        buffer_clear(path);
+        for (int32_t n = i; n != -1; n = ns[n].parent)
+            buffer_append(path, &ns[n].function, 1);
+
+        int32_t *functions = buffer_content(path);
+        StringBuilder *sb = stringbuilder_new();
+        char buffer[32];
+
+        for (int j = buffer_count(path) - 1; j >= 0; j--)
+        {
+            stringbuilder_append(sb, functionName(profile, symbols, functions[j], buffer));
+            if (j > 0)
+                stringbuilder_append_char(sb, ';');
+        }
+
+        char *line = stringbuilder_free_use(sb);
+        fprintf(out, "%s %ld\n", line, (long)ns[i].time);
+        FREE(line);
+    }
+
+    buffer_free(path);
+}
@@ -0,0 +1,31 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "symbols.h"
+
+/*
+ * An execution profile accumulated over one or more runs.  Each instruction
+ * is charged the time until the next instruction starts, so timing includes
+ * the profiler's own clock reads - compare times with each other rather than
+ * with an unprofiled run.  Adjacent opcode pairs are counted as candidates
+ * for fused instructions.  Functions are identified by their entry IP.
+ */
+typedef struct Profile Profile;
+
+extern Profile *profile_new(void);
+extern void profile_free(Profile *profile);
+
+extern void profile_instruction(Profile *profile, int opcode);
+extern void profile_call(Profile *profile, int32_t ip);
+extern void profile_return(Profile *profile);
+/* Closes every open frame - called when a run completes or fails. */
+extern void profile_stop(Profile *profile);
+
+extern void profile_report(Profile *profile, Symbols *symbols, FILE *out);
+/* One "caller;callee weight" line per stack as consumed by flamegraph.pl and speedscope. */
+extern void profile_writeCollapsed(Profile *profile, Symbols *symbols, FILE *out);
+
+#endif
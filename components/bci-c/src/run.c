@@ -1,36 +1,169 @@
 #include <stdio.h>
+#include <string.h>
 
+#include "memo.h"
 #include "memory.h"
 #include "value.h"
 
 #include "op.h"
+#include "perf.h"
+#include "pool.h"
+#include "profile.h"
+#include "run.h"
+#include "snapshot.h"
+#include "timer.h"
+#include "trace.h"
 
-#define DEFAULT_STACK_SIZE 256
+/* Instructions between reads of the clock when a deadline is set. */
+#define DEADLINE_INTERVAL 4096
+
+/*
+ * A SPAWN within this many others is evaluated in place rather than made a
+ * task.  A balanced tree of SPAWNs still yields up to 2^SPAWN_DEPTH tasks,
+ * plenty to share among the threads, while the many calls near its leaves
+ * are left too small to be worth a task.
+ */
+#define SPAWN_DEPTH 10
+
+/*
+ * A SPAWNed thunk awaiting its JOIN.  The thunk's closure holds slot on the
+ * stack, keeping everything the thunk can read alive, until the JOIN
+ * replaces it with the thunk's result.  task is NULL once the thunk has been
+ * evaluated in place and inlined is set while a reclaimed task is being
+ * evaluated in place.
+ */
+typedef struct
+{
+    Task *task;
+    int32_t slot;
+    int inlined;
+} Future;
 
 struct State
 {
     unsigned char *block;
+    int32_t size;
     int32_t ip;
+    int debug;
+
+    MemoryState *memoryState;
+    BciResult *result;
+    BciUsage *usage;
+    Profile *profile;
+
+    /* Whether the outermost activation has been allocated - see run_step. */
+    int started;
+
+    int64_t executed;
+    int64_t depth;
+    int64_t deadline;
 
-    MemoryState memoryState;
+    /* The executed count at which the next call or backward jump checks the budget and limits. */
+    int64_t checkAt;
+    int64_t yieldAt;
+
+    /* Evaluates SPAWNed thunks on other threads if not NULL - see pool.h. */
+    Pool *pool;
+    int32_t deque;
+    /* The task being run if this state belongs to a worker. */
+    Task *task;
+    /* The SPAWNs the task is nested within, to which futureCount adds those made since. */
+    int32_t spawns;
+    Future *futures;
+    int32_t futureCount;
+    int32_t futureCapacity;
 };
 
-static struct State initState(unsigned char *block)
+static void initState(struct State *state, unsigned char *block, int32_t size, MemoryState *mm, BciResult *result, BciUsage *usage)
 {
-    struct State state;
+    state->block = block;
+    state->size = size;
+    state->ip = 0;
+    state->debug = 0;
+    state->memoryState = mm;
+    state->result = result;
+    state->usage = usage;
+    state->profile = NULL;
+
+    state->started = 0;
+    state->executed = 0;
+    state->depth = 1;
+    state->deadline = BCI_UNLIMITED;
+    state->checkAt = 0;
+    state->yieldAt = 0;
+
+    state->pool = NULL;
+    state->deque = POOL_CALLER;
+    state->task = NULL;
+    state->spawns = 0;
+    state->futures = NULL;
+    state->futureCount = 0;
+    state->futureCapacity = 0;
+
+    mm->errorStatus = BCI_OK;
+    mm->errorMessage[0] = '\0';
+    mm->allocations = 0;
+    mm->collections = 0;
+    mm->gcTime = 0;
+}
 
-    state.block = block;
-    state.ip = 0;
-    state.memoryState = value_newMemoryManager(DEFAULT_STACK_SIZE);
-    state.memoryState.activation = value_newActivation(NULL, NULL, -1, &state.memoryState);
+struct State *run_new(unsigned char *block, int32_t size, MemoryState *mm, int debug, BciResult *result, BciUsage *usage, Profile *profile, int32_t threads)
+{
+    struct State *state = ALLOCATE(struct State, 1);
+    BciLimits *limits = &mm->limits;
+
+    initState(state, block, size, mm, result, usage);
+    state->debug = debug;
+    state->profile = profile;
+    state->deadline = limits->timeout == BCI_UNLIMITED ? BCI_UNLIMITED : timer_now() + limits->timeout;
+    if (threads > 1)
+        state->pool = pool_new(threads, block, size, mm);
 
     return state;
 }
 
+/*
+ * Waits for every outstanding task so that none is left reading this
+ * state's heap.  Their results are adopted and left for the collector.
+ */
+static void settle(struct State *state)
+{
+    while (state->futureCount > 0)
+    {
+        Task *task = state->futures[--state->futureCount].task;
+
+        if (task == NULL)
+            continue;
+        if (!pool_reclaim(state->pool, state->deque, task))
+        {
+            pool_wait(state->pool, task);
+            value_adopt(state->memoryState, &task->values);
+        }
+        FREE(task);
+    }
+}
+
+void run_free(struct State *state)
+{
+    if (state->pool != NULL)
+    {
+        settle(state);
+        pool_free(state->pool);
+    }
+    if (state->futures != NULL)
+        FREE(state->futures);
+
+    value_resetMemoryManager(state->memoryState);
+    FREE(state);
+}
+
 static int32_t readIntFrom(struct State *state, int offset)
 {
     unsigned char *block = state->block;
 
+    if (offset < 0 || offset > state->size - 4)
+        value_raise(state->memoryState, BCI_ERROR_INVALID_OPCODE, "Run: ip=%d: Operand beyond the end of the program", offset);
+
     int32_t size = (int32_t)(block[offset] |
                              ((block[offset + 1]) << 8) |
                              ((block[offset + 2]) << 16) |
@@ -42,7 +175,7 @@ static int32_t readIntFrom(struct State *state, int offset)
 static void logInstruction(struct State *state)
 {
     printf("%d: ", state->ip);
-    Instruction *instruction = find(state->block[state->ip]);
+    const Instruction *instruction = find(state->block[state->ip]);
     if (instruction == NULL)
         printf("Unknown opcode: %d", state->block[state->ip]);
     else
@@ -61,20 +194,20 @@ static void logInstruction(struct State *state)
     }
     printf(": [");
 
-    for (int i = 0; i < state->memoryState.sp; i++)
+    for (int i = 0; i < state->memoryState->sp; i++)
     {
-        // printf("--- %d of %d\n", i, state->memoryState.sp);
-        char *value = value_toString(state->memoryState.stack[i]);
+        // printf("--- %d of %d\n", i, state->memoryState->sp);
+        char *value = value_toString(state->memoryState->stack[i]);
         printf("%s", value);
         FREE(value);
         // printf("\n");
-        if (i < state->memoryState.sp - 1)
+        if (i < state->memoryState->sp - 1)
             printf(", ");
     }
     printf("] ");
     // printf("\n");
 
-    char *a = value_toString(state->memoryState.activation);
+    char *a = value_toString(state->memoryState->activation);
     printf("%s ", a);
     FREE(a);
 
@@ -88,241 +221,580 @@ static int32_t readInt(struct State *state)
     return result;
 }
 
-void execute(unsigned char *block, int debug)
+static void setResult(Value *v, BciResult *result)
+{
+    switch (value_getType(v))
+    {
+    case VInt:
+    {
+        char buffer[32];
+        sprintf(buffer, "%d: Int", v->data.i);
+        result->type = BCI_RESULT_INT;
+        result->value = v->data.i;
+        result->text = STRDUP(buffer);
+        break;
+    }
+    case VBool:
+        result->type = BCI_RESULT_BOOL;
+        result->value = v->data.b;
+        result->text = STRDUP(v->data.b ? "true: Bool" : "false: Bool");
+        break;
+    case VClosure:
+        result->type = BCI_RESULT_CLOSURE;
+        result->value = v->data.c.ip;
+        result->text = value_toString(v);
+        break;
+    case VActivation:
+        result->type = BCI_RESULT_ACTIVATION;
+        result->value = 0;
+        result->text = value_toString(v);
+        break;
+    }
+}
+
+static void outOfMemory(void *context, int64_t size)
+{
+    value_raise((MemoryState *)context, BCI_ERROR_MEMORY, "Run: out of memory: unable to allocate %ld bytes", (long)size);
+}
+
+static BciStatus stopStep(struct State *state, BciStatus status)
+{
+    MemoryState *mm = state->memoryState;
+    BciUsage *usage = state->usage;
+
+    mm->errorHandler = NULL;
+    memory_setFailureHandler(NULL, NULL);
+
+    usage->instructions = state->executed;
+    usage->heapObjects = mm->size;
+    usage->heapBytes = mm->bytes;
+    usage->depth = state->depth;
+    usage->stack = mm->sp;
+    usage->allocations = mm->allocations;
+    usage->collections = mm->collections;
+    usage->gcTime = mm->gcTime;
+
+    if (mm->perf != NULL)
+        perf_stop(mm->perf, PERF_EXECUTE);
+    if (state->profile != NULL && status != BCI_YIELDED)
+        profile_stop(state->profile);
+
+    return status;
+}
+
+static int64_t minimum(int64_t a, int64_t b)
+{
+    return a < b ? a : b;
+}
+
+/*
+ * Called on calls and backward jumps, the only places a program can loop,
+ * once executed reaches checkAt.  Returns 1 if the step's budget is spent.
+ */
+static int checkpoint(struct State *state)
+{
+    MemoryState *mm = state->memoryState;
+    BciLimits *limits = &mm->limits;
+
+    if (state->executed >= limits->instructions)
+    {
+        value_raise(mm, BCI_ERROR_LIMIT, "Run: instruction limit exceeded: %ld instructions", (long)limits->instructions);
+    }
+    if (state->deadline != BCI_UNLIMITED && timer_now() >= state->deadline)
+    {
+        value_raise(mm, BCI_ERROR_LIMIT, "Run: deadline exceeded: %ldms", (long)(limits->timeout / 1000000));
+    }
+    if (mm->snapshot != NULL)
+    {
+        snapshot_instructions(mm->snapshot, mm, state->executed);
+    }
+    if (state->executed >= state->yieldAt)
+        return 1;
+
+    state->checkAt = minimum(state->yieldAt, limits->instructions);
+    if (state->deadline != BCI_UNLIMITED)
+        state->checkAt = minimum(state->checkAt, state->executed + DEADLINE_INTERVAL);
+    if (mm->snapshot != NULL)
+        state->checkAt = minimum(state->checkAt, snapshot_due(mm->snapshot));
+
+    return 0;
+}
+
+static void addFuture(struct State *state, Task *task, int32_t slot)
+{
+    if (state->futureCount == state->futureCapacity)
+    {
+        state->futureCapacity = state->futureCapacity == 0 ? 16 : state->futureCapacity * 2;
+        state->futures = REALLOCATE(state->futures, Future, state->futureCapacity);
+    }
+
+    Future *future = &state->futures[state->futureCount++];
+
+    future->task = task;
+    future->slot = slot;
+    future->inlined = 0;
+}
+
+/* Enters the thunk closure, leaving its activation on the stack, to return to nextIP. */
+static void callThunk(struct State *state, Value *closure, int32_t nextIP)
+{
+    MemoryState *mm = state->memoryState;
+
+    if (++state->depth > mm->limits.depth)
+    {
+        value_raise(mm, BCI_ERROR_LIMIT, "Run: depth limit exceeded: %ld activations", (long)mm->limits.depth);
+    }
+
+    mm->activation = value_newActivation(mm->activation, closure, nextIP, mm);
+    state->ip = closure->data.c.ip;
+
+    if (state->profile != NULL)
+    {
+        profile_call(state->profile, state->ip);
+    }
+}
+
+BciStatus run_step(struct State *state, int64_t budget)
 {
-    struct State state = initState(block);
+    jmp_buf errorHandler;
+    MemoryState *mm = state->memoryState;
+    unsigned char *block = state->block;
+
+    mm->errorHandler = &errorHandler;
+    memory_setFailureHandler(outOfMemory, mm);
+    if (mm->perf != NULL)
+        perf_start(mm->perf, PERF_EXECUTE);
+    if (setjmp(errorHandler) != 0)
+    {
+        return stopStep(state, mm->errorStatus);
+    }
+
+    /* Allocated under the handler so that limits too small for even this fail the run rather than exit. */
+    if (!state->started)
+    {
+        state->started = 1;
+        if (state->task == NULL)
+            mm->activation = value_newActivation(NULL, NULL, -1, mm);
+        else
+        {
+            mm->activation = value_newActivation(NULL, state->task->closure, -1, mm);
+            pop(mm);
+        }
+    }
+
+    state->yieldAt = budget >= BCI_UNLIMITED - state->executed ? BCI_UNLIMITED : state->executed + budget;
+    state->checkAt = state->executed;
+    if (checkpoint(state))
+    {
+        return stopStep(state, BCI_YIELDED);
+    }
 
     while (1)
     {
-        // forceGC(&state.memoryState);
-        if (debug)
+        state->executed++;
+
+        // forceGC(state->memoryState);
+        if (state->ip < 0 || state->ip >= state->size)
+            value_raise(mm, BCI_ERROR_INVALID_OPCODE, "Run: ip=%d: Outside the program of %d bytes", state->ip, state->size);
+        if (state->debug)
+        {
+            logInstruction(state);
+        }
+        int opcode = (int)block[state->ip++];
+
+        if (state->profile != NULL)
+        {
+            profile_instruction(state->profile, opcode);
+        }
+        if (mm->trace != NULL)
         {
-            logInstruction(&state);
+            trace_instruction(mm->trace, state->ip - 1, opcode, mm->sp, mm->activation);
         }
-        int opcode = (int)block[state.ip++];
 
         switch (opcode)
         {
         case PUSH_TRUE:
-            push(value_True, &state.memoryState);
+            push(state->memoryState->trueValue, state->memoryState);
             break;
         case PUSH_FALSE:
-            push(value_False, &state.memoryState);
+            push(state->memoryState->falseValue, state->memoryState);
             break;
         case PUSH_INT:
         {
-            int32_t value = readInt(&state);
-            value_newInt(value, &state.memoryState);
+            int32_t value = readInt(state);
+            value_newInt(value, state->memoryState);
             break;
         }
         case PUSH_VAR:
         {
-            int32_t index = readInt(&state);
-            int32_t offset = readInt(&state);
+            int32_t index = readInt(state);
+            int32_t offset = readInt(state);
 
-            Value *a = state.memoryState.activation;
+            Value *a = state->memoryState->activation;
             while (index > 0)
             {
                 if (value_getType(a) != VActivation)
                 {
-                    printf("Run: PUSH_VAR: intermediate not an activation record: %d\n", index);
-                    exit(1);
+                    value_raise(state->memoryState, BCI_ERROR_TYPE_MISMATCH, "Run: PUSH_VAR: intermediate not an activation record: %d", index);
                 }
                 a = a->data.a.closure->data.c.previousActivation;
                 index--;
             }
             if (value_getType(a) != VActivation)
             {
-                printf("Run: PUSH_VAR: not an activation record: %d\n", index);
-                exit(1);
+                value_raise(state->memoryState, BCI_ERROR_TYPE_MISMATCH, "Run: PUSH_VAR: not an activation record: %d", index);
             }
             if (a->data.a.state == NULL)
             {
-                printf("Run: PUSH_VAR: activation has no state\n");
-                exit(1);
+                value_raise(state->memoryState, BCI_ERROR_ACTIVATION, "Run: PUSH_VAR: activation has no state");
             }
             if (offset >= a->data.a.stateSize)
             {
-                printf("Run: PUSH_VAR: offset out of bounds: %d >= %d\n", offset, a->data.a.stateSize);
-                exit(1);
+                value_raise(state->memoryState, BCI_ERROR_ACTIVATION, "Run: PUSH_VAR: offset out of bounds: %d >= %d", offset, a->data.a.stateSize);
             }
-            push(a->data.a.state[offset], &state.memoryState);
+            if (a->data.a.state[offset] == NULL)
+            {
+                value_raise(state->memoryState, BCI_ERROR_ACTIVATION, "Run: PUSH_VAR: variable read before it is stored: %d", offset);
+            }
+            push(a->data.a.state[offset], state->memoryState);
 
             break;
         }
         case PUSH_CLOSURE:
         {
-            int32_t targetIP = readInt(&state);
-            value_newClosure(state.memoryState.activation, targetIP, &state.memoryState);
+            int32_t targetIP = readInt(state);
+            value_newClosure(state->memoryState->activation, targetIP, state->memoryState);
             break;
         }
         case ADD:
         {
-            Value *b = pop(&state.memoryState);
-            Value *a = pop(&state.memoryState);
+            Value *b = pop(state->memoryState);
+            Value *a = pop(state->memoryState);
             if (value_getType(a) != VInt || value_getType(b) != VInt)
             {
-                printf("Run: ADD: not an int\n");
-                exit(1);
+                value_raise(state->memoryState, BCI_ERROR_TYPE_MISMATCH, "Run: ADD: not an int");
             }
-            value_newInt(a->data.i + b->data.i, &state.memoryState);
+            value_newInt(a->data.i + b->data.i, state->memoryState);
             break;
         }
         case SUB:
         {
-            Value *b = pop(&state.memoryState);
-            Value *a = pop(&state.memoryState);
+            Value *b = pop(state->memoryState);
+            Value *a = pop(state->memoryState);
             if (value_getType(a) != VInt || value_getType(b) != VInt)
             {
-                printf("Run: SUB: not an int\n");
-                exit(1);
+                value_raise(state->memoryState, BCI_ERROR_TYPE_MISMATCH, "Run: SUB: not an int");
             }
-            value_newInt(a->data.i - b->data.i, &state.memoryState);
+            value_newInt(a->data.i - b->data.i, state->memoryState);
             break;
         }
         case MUL:
         {
-            Value *b = pop(&state.memoryState);
-            Value *a = pop(&state.memoryState);
+            Value *b = pop(state->memoryState);
+            Value *a = pop(state->memoryState);
             if (value_getType(a) != VInt || value_getType(b) != VInt)
             {
-                printf("Run: MUL: not an int\n");
-                exit(1);
+                value_raise(state->memoryState, BCI_ERROR_TYPE_MISMATCH, "Run: MUL: not an int");
             }
-            value_newInt(a->data.i * b->data.i, &state.memoryState);
+            value_newInt(a->data.i * b->data.i, state->memoryState);
             break;
         }
         case DIV:
         {
-            Value *b = pop(&state.memoryState);
-            Value *a = pop(&state.memoryState);
+            Value *b = pop(state->memoryState);
+            Value *a = pop(state->memoryState);
             if (value_getType(a) != VInt || value_getType(b) != VInt)
             {
-                printf("Run: DIV: not an int\n");
-                exit(1);
+                value_raise(state->memoryState, BCI_ERROR_TYPE_MISMATCH, "Run: DIV: not an int");
+            }
+            /* Either traps the process rather than just this program. */
+            if (b->data.i == 0)
+            {
+                value_raise(state->memoryState, BCI_ERROR_ARITHMETIC, "Run: DIV: division by zero");
+            }
+            if (a->data.i == INT32_MIN && b->data.i == -1)
+            {
+                value_raise(state->memoryState, BCI_ERROR_ARITHMETIC, "Run: DIV: overflow: %d / -1", a->data.i);
             }
-            value_newInt(a->data.i / b->data.i, &state.memoryState);
+            value_newInt(a->data.i / b->data.i, state->memoryState);
             break;
         }
         case EQ:
         {
-            Value *b = pop(&state.memoryState);
-            Value *a = pop(&state.memoryState);
+            Value *b = pop(state->memoryState);
+            Value *a = pop(state->memoryState);
             if (value_getType(a) != VInt || value_getType(b) != VInt)
             {
-                printf("Run: EQ: not an int\n");
-                exit(1);
+                value_raise(state->memoryState, BCI_ERROR_TYPE_MISMATCH, "Run: EQ: not an int");
             }
-            push(a->data.i == b->data.i ? value_True : value_False, &state.memoryState);
+            push(a->data.i == b->data.i ? state->memoryState->trueValue : state->memoryState->falseValue, state->memoryState);
             break;
         }
         case JMP:
         {
-            int32_t targetIP = readInt(&state);
-            state.ip = targetIP;
+            int32_t targetIP = readInt(state);
+            if (targetIP < state->ip && state->executed >= state->checkAt && checkpoint(state))
+            {
+                state->ip = targetIP;
+                return stopStep(state, BCI_YIELDED);
+            }
+            state->ip = targetIP;
             break;
         }
         case JMP_TRUE:
         {
-            int32_t targetIP = readInt(&state);
-            Value *v = pop(&state.memoryState);
+            int32_t targetIP = readInt(state);
+            Value *v = pop(state->memoryState);
             if (value_getType(v) != VBool)
             {
-                printf("Run: JMP_TRUE: not a bool\n");
-                exit(1);
+                value_raise(state->memoryState, BCI_ERROR_TYPE_MISMATCH, "Run: JMP_TRUE: not a bool");
             }
             if (v->data.b)
-                state.ip = targetIP;
+            {
+                if (targetIP < state->ip && state->executed >= state->checkAt && checkpoint(state))
+                {
+                    state->ip = targetIP;
+                    return stopStep(state, BCI_YIELDED);
+                }
+                state->ip = targetIP;
+            }
             break;
         }
         case SWAP_CALL:
         {
-            Value *newActivation = value_newActivation(state.memoryState.activation, peek(1, &state.memoryState), state.ip, &state.memoryState);
-            state.ip = peek(2, &state.memoryState)->data.c.ip;
-            state.memoryState.activation = newActivation;
-            state.memoryState.stack[state.memoryState.sp - 3] = state.memoryState.stack[state.memoryState.sp - 2];
-            popN(2, &state.memoryState);
+            MemoKey key;
+            int memoized = mm->memo != NULL && memo_key(mm->memo, peek(1, mm), peek(0, mm), &key);
+
+            if (memoized)
+            {
+                ValueType type;
+                int32_t value;
+
+                if (memo_find(mm->memo, &key, &type, &value))
+                {
+                    popN(2, mm);
+                    if (type == VBool)
+                        push(value ? mm->trueValue : mm->falseValue, mm);
+                    else
+                        value_newInt(value, mm);
+
+                    if (state->executed >= state->checkAt && checkpoint(state))
+                    {
+                        return stopStep(state, BCI_YIELDED);
+                    }
+                    break;
+                }
+            }
+
+            if (++state->depth > mm->limits.depth)
+            {
+                value_raise(mm, BCI_ERROR_LIMIT, "Run: depth limit exceeded: %ld activations", (long)mm->limits.depth);
+            }
+
+            Value *newActivation = value_newActivation(state->memoryState->activation, peek(1, state->memoryState), state->ip, state->memoryState);
+            state->ip = peek(2, state->memoryState)->data.c.ip;
+            state->memoryState->activation = newActivation;
+            state->memoryState->stack[state->memoryState->sp - 3] = state->memoryState->stack[state->memoryState->sp - 2];
+            popN(2, state->memoryState);
+
+            if (memoized)
+            {
+                memo_called(mm->memo, &key, newActivation);
+            }
+            if (state->profile != NULL)
+            {
+                profile_call(state->profile, state->ip);
+            }
+
+            if (state->executed >= state->checkAt && checkpoint(state))
+            {
+                return stopStep(state, BCI_YIELDED);
+            }
             break;
         }
         case ENTER:
         {
-            int32_t size = readInt(&state);
+            int32_t size = readInt(state);
 
-            if (state.memoryState.activation->data.a.state == NULL)
+            if (state->memoryState->activation->data.a.state == NULL)
             {
-                state.memoryState.activation->data.a.stateSize = size;
-                state.memoryState.activation->data.a.state = ALLOCATE(Value *, size);
-
-                for (int i = 0; i < size; i++)
-                    state.memoryState.activation->data.a.state[i] = NULL;
+                value_newState(state->memoryState->activation, size, state->memoryState);
             }
             else
             {
-                printf("Run: ENTER: activation already has state\n");
-                exit(1);
+                value_raise(state->memoryState, BCI_ERROR_ACTIVATION, "Run: ENTER: activation already has state");
             }
             break;
         }
         case RET:
         {
-            if (state.memoryState.activation->data.a.parentActivation == NULL)
+            if (state->memoryState->activation->data.a.parentActivation == NULL)
             {
-                Value *v = pop(&state.memoryState);
-                switch (value_getType(v))
-                {
-                case VInt:
-                    printf("%d: Int\n", v->data.i);
-                    break;
-                case VBool:
-                    printf("%s: Bool\n", v->data.b ? "true" : "false");
-                    break;
-                case VClosure:
-                case VActivation:
-                {
-                    char *s = value_toString(v);
-
-                    printf("%s\n", s);
-                    FREE(s);
-                    break;
-                }
-                }
-                value_destroyMemoryManager(&state.memoryState);
+                if (state->task != NULL)
+                    state->task->result = pop(state->memoryState);
+                else
+                    setResult(pop(state->memoryState), state->result);
 
-                return;
+                return stopStep(state, BCI_OK);
+            }
+            state->depth--;
+            if (state->profile != NULL)
+            {
+                profile_return(state->profile);
+            }
+            if (mm->memo != NULL)
+            {
+                memo_returned(mm->memo, state->memoryState->activation, peek(0, mm));
             }
-            state.ip = state.memoryState.activation->data.a.nextIP;
-            state.memoryState.activation = state.memoryState.activation->data.a.parentActivation;
+            state->ip = state->memoryState->activation->data.a.nextIP;
+            state->memoryState->activation = state->memoryState->activation->data.a.parentActivation;
             break;
         }
         case STORE_VAR:
         {
-            int32_t index = readInt(&state);
-            Value *value = pop(&state.memoryState);
+            int32_t index = readInt(state);
+            Value *value = pop(state->memoryState);
 
-            if (state.memoryState.activation->data.a.state == NULL)
+            if (state->memoryState->activation->data.a.state == NULL)
             {
-                printf("Run: STORE_VAR: activation has no state\n");
-                exit(1);
+                value_raise(state->memoryState, BCI_ERROR_ACTIVATION, "Run: STORE_VAR: activation has no state");
             }
-            if (index >= state.memoryState.activation->data.a.stateSize)
+            if (index >= state->memoryState->activation->data.a.stateSize)
             {
-                printf("Run: STORE_VAR: index out of bounds: %d\n", index);
-                exit(1);
+                value_raise(state->memoryState, BCI_ERROR_ACTIVATION, "Run: STORE_VAR: index out of bounds: %d", index);
             }
 
-            state.memoryState.activation->data.a.state[index] = value;
+            if (mm->memo != NULL && state->memoryState->activation->data.a.state[index] != NULL)
+            {
+                memo_clear(mm->memo);
+            }
+            state->memoryState->activation->data.a.state[index] = value;
+            break;
+        }
+        case SPAWN:
+        {
+            int32_t targetIP = readInt(state);
+            Value *closure = value_newClosure(mm->activation, targetIP, mm);
+            Task *task = NULL;
+
+            if (state->pool != NULL)
+            {
+                int32_t spawns = state->spawns + state->futureCount;
+
+                if (spawns < SPAWN_DEPTH)
+                    task = pool_spawn(state->pool, state->deque, closure, state->depth + 1, spawns + 1, state->deadline);
+                addFuture(state, task, mm->sp - 1);
+            }
+            if (task == NULL)
+            {
+                callThunk(state, closure, state->ip);
+                popN(2, mm);
+
+                if (state->executed >= state->checkAt && checkpoint(state))
+                {
+                    return stopStep(state, BCI_YIELDED);
+                }
+            }
+            break;
+        }
+        case JOIN:
+        {
+            if (state->pool == NULL)
+                break;
+
+            Future *future = &state->futures[state->futureCount - 1];
+
+            if (future->inlined)
+            {
+                mm->stack[future->slot] = pop(mm);
+                state->futureCount--;
+            }
+            else if (future->task == NULL)
+                state->futureCount--;
+            else if (pool_reclaim(state->pool, state->deque, future->task))
+            {
+                FREE(future->task);
+                future->task = NULL;
+                future->inlined = 1;
+
+                /* The JOIN is executed again once the thunk returns. */
+                callThunk(state, mm->stack[future->slot], state->ip - 1);
+                pop(mm);
+
+                if (state->executed >= state->checkAt && checkpoint(state))
+                {
+                    return stopStep(state, BCI_YIELDED);
+                }
+            }
+            else
+            {
+                Task *task = future->task;
+
+                state->futureCount--;
+                pool_wait(state->pool, task);
+                value_adopt(mm, &task->values);
+
+                state->executed += task->executed;
+                mm->allocations += task->allocations;
+                mm->collections += task->collections;
+
+                if (task->status != BCI_OK)
+                {
+                    char errorMessage[BCI_ERROR_MESSAGE_SIZE];
+                    BciStatus status = task->status;
+
+                    strcpy(errorMessage, task->errorMessage);
+                    FREE(task);
+                    value_raise(mm, status, "%s", errorMessage);
+                }
+
+                mm->stack[future->slot] = task->result;
+                FREE(task);
+            }
             break;
         }
         default:
         {
-            Instruction *instruction = find(opcode);
+            const Instruction *instruction = find(opcode);
             if (instruction == NULL)
-                printf("Run: Invalid opcode: %d\n", opcode);
+                value_raise(state->memoryState, BCI_ERROR_INVALID_OPCODE, "Run: Invalid opcode: %d", opcode);
             else
-                printf("Run: ip=%d: Unknown opcode: %s (%d)\n", state.ip - 1, instruction->name, instruction->opcode);
-
-            exit(1);
+                value_raise(state->memoryState, BCI_ERROR_INVALID_OPCODE, "Run: ip=%d: Unknown opcode: %s (%d)", state->ip - 1, instruction->name, instruction->opcode);
         }
         }
     }
 }
+
+void run_task(unsigned char *block, int32_t size, MemoryState *mm, Pool *pool, int32_t deque, Task *task)
+{
+    struct State state;
+    BciResult result;
+    BciUsage usage;
+
+    initState(&state, block, size, mm, &result, &usage);
+    state.ip = task->closure->data.c.ip;
+    state.depth = task->depth;
+    state.deadline = task->deadline;
+    state.pool = pool;
+    state.deque = deque;
+    state.task = task;
+    state.spawns = task->spawns;
+
+    task->status = run_step(&state, BCI_UNLIMITED);
+
+    settle(&state);
+    if (state.futures != NULL)
+        FREE(state.futures);
+
+    task->executed = state.executed;
+    task->allocations = mm->allocations;
+    task->collections = mm->collections;
+
+    if (task->status == BCI_OK)
+        value_detach(mm, task->result, &task->values);
+    else
+    {
+        strcpy(task->errorMessage, mm->errorMessage);
+        value_resetMemoryManager(mm);
+    }
+}
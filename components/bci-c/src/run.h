@@ -1,6 +1,26 @@
 #ifndef RUN_H
 #define RUN_H
 
-extern void execute(unsigned char *block, int debug);
+#include "pool.h"
+#include "profile.h"
+#include "value.h"
+#include "vm.h"
+
+struct State;
+
+/*
+ * run_step executes budget instructions, rounded up to the next call or
+ * backward jump, and returns BCI_YIELDED if the program has not completed.
+ * Calling run_step again resumes from where the previous call stopped.  The
+ * resources in use are written to usage whenever run_step returns.  If
+ * profile is not NULL every instruction, call and return is recorded in it.
+ * With more than one thread SPAWNed thunks are evaluated in parallel.
+ */
+extern struct State *run_new(unsigned char *block, int32_t size, MemoryState *mm, int debug, BciResult *result, BciUsage *usage, Profile *profile, int32_t threads);
+extern BciStatus run_step(struct State *state, int64_t budget);
+extern void run_free(struct State *state);
+
+/* Runs task to completion on a worker of pool, using the worker's heap mm and the worker's deque. */
+extern void run_task(unsigned char *block, int32_t size, MemoryState *mm, Pool *pool, int32_t deque, Task *task);
 
 #endif
@@ -0,0 +1,124 @@
+#include <pthread.h>
+
+#include "memory.h"
+
+#include "schedule.h"
+
+typedef struct
+{
+    pthread_mutex_t lock;
+    pthread_cond_t ready;
+
+    BciVM **vms;
+    int32_t count;
+    int64_t quantum;
+
+    /* A ring of runnable VM indices - every VM that is not complete is either in the ring or being resumed. */
+    int32_t *queue;
+    int32_t head;
+    int32_t length;
+    int32_t remaining;
+
+    ScheduleCompleted completed;
+    void *context;
+} Scheduler;
+
+static int32_t dequeue(Scheduler *scheduler)
+{
+    pthread_mutex_lock(&scheduler->lock);
+
+    while (scheduler->length == 0 && scheduler->remaining > 0)
+        pthread_cond_wait(&scheduler->ready, &scheduler->lock);
+
+    int32_t index = -1;
+    if (scheduler->length > 0)
+    {
+        index = scheduler->queue[scheduler->head];
+        scheduler->head = (scheduler->head + 1) % scheduler->count;
+        scheduler->length--;
+    }
+
+    pthread_mutex_unlock(&scheduler->lock);
+
+    return index;
+}
+
+static void enqueue(Scheduler *scheduler, int32_t index)
+{
+    pthread_mutex_lock(&scheduler->lock);
+
+    scheduler->queue[(scheduler->head + scheduler->length) % scheduler->count] = index;
+    scheduler->length++;
+
+    pthread_cond_signal(&scheduler->ready);
+    pthread_mutex_unlock(&scheduler->lock);
+}
+
+static void complete(Scheduler *scheduler)
+{
+    pthread_mutex_lock(&scheduler->lock);
+
+    scheduler->remaining--;
+    if (scheduler->remaining == 0)
+        pthread_cond_broadcast(&scheduler->ready);
+
+    pthread_mutex_unlock(&scheduler->lock);
+}
+
+static void *workerMain(void *arg)
+{
+    Scheduler *scheduler = (Scheduler *)arg;
+    int32_t index;
+
+    while ((index = dequeue(scheduler)) != -1)
+    {
+        BciVM *vm = scheduler->vms[index];
+        BciStatus status = bci_resume(vm, scheduler->quantum);
+
+        if (status == BCI_YIELDED)
+            enqueue(scheduler, index);
+        else
+        {
+            scheduler->completed(index, vm, status, scheduler->context);
+            complete(scheduler);
+        }
+    }
+
+    return NULL;
+}
+
+void schedule_run(BciVM **vms, int32_t count, int32_t threads, int64_t quantum, ScheduleCompleted completed, void *context)
+{
+    if (count == 0)
+        return;
+    if (threads < 1)
+        threads = 1;
+
+    Scheduler scheduler;
+    pthread_t *ids = ALLOCATE(pthread_t, threads);
+
+    pthread_mutex_init(&scheduler.lock, NULL);
+    pthread_cond_init(&scheduler.ready, NULL);
+    scheduler.vms = vms;
+    scheduler.count = count;
+    scheduler.quantum = quantum < 1 ? BCI_UNLIMITED : quantum;
+    scheduler.queue = ALLOCATE(int32_t, count);
+    scheduler.head = 0;
+    scheduler.length = count;
+    scheduler.remaining = count;
+    scheduler.completed = completed;
+    scheduler.context = context;
+
+    for (int i = 0; i < count; i++)
+        scheduler.queue[i] = i;
+
+    for (int i = 0; i < threads; i++)
+        pthread_create(&ids[i], NULL, workerMain, &scheduler);
+    for (int i = 0; i < threads; i++)
+        pthread_join(ids[i], NULL);
+
+    pthread_cond_destroy(&scheduler.ready);
+    pthread_mutex_destroy(&scheduler.lock);
+    FREE(scheduler.queue);
+    FREE(ids);
+}
@@ -0,0 +1,18 @@
+#ifndef SCHEDULE_H
+#define SCHEDULE_H
+
+#include <stdint.h>
+
+#include "vm.h"
+
+typedef void (*ScheduleCompleted)(int32_t index, BciVM *vm, BciStatus status, void *context);
+
+/*
+ * Runs the started VMs to completion on a pool of threads.  The VMs are
+ * resumed round-robin, each for at most quantum instructions, so that short
+ * programs are not held up behind long running ones.  completed is called,
+ * from a worker thread, once for each VM as it finishes.
+ */
+extern void schedule_run(BciVM **vms, int32_t count, int32_t threads, int64_t quantum, ScheduleCompleted completed, void *context);
+
+#endif
@@ -0,0 +1,554 @@
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "buffer.h"
+#include "memory.h"
+#include "vm.h"
+
+#include "serve.h"
+
+#define INITIAL_INPUT 4096
+
+/* A power of two at least twice SERVE_MAX_MODULES, so the table never fills. */
+#define TABLE_CAPACITY 2048
+
+/*
+ * A module is shared by the connections running it.  An evicted module has
+ * left the table and is freed when the last of its users releases it.
+ */
+typedef struct
+{
+    uint64_t id;
+    unsigned char *block;
+    int32_t size;
+
+    int32_t users;
+    int evicted;
+
+    /* The server's clock when the module was last loaded or run. */
+    uint64_t used;
+} Module;
+
+struct Server
+{
+    pthread_mutex_t lock;
+    BciLimits limits;
+
+    int32_t count;
+    uint64_t clock;
+    Module *modules[TABLE_CAPACITY];
+};
+
+typedef struct
+{
+    Server *server;
+    BciVM *vm;
+
+    /* The module loaded into vm, held until the next is. */
+    Module *module;
+
+    int in;
+    int out;
+    /* Cleared once out turns out not to be a socket. */
+    int socket;
+
+    unsigned char *input;
+    int32_t inputCapacity;
+    int32_t inputStart;
+    int32_t inputEnd;
+
+    Buffer *output;
+} Connection;
+
+static uint64_t contentHash(unsigned char *block, int32_t size)
+{
+    uint64_t hash = 14695981039346656037ULL;
+
+    for (int i = 0; i < size; i++)
+    {
+        hash ^= block[i];
+        hash *= 1099511628211ULL;
+    }
+
+    return hash;
+}
+
+static void writeInt32(unsigned char *p, uint32_t v)
+{
+    for (int i = 0; i < 4; i++)
+        p[i] = (v >> (i * 8)) & 0xff;
+}
+
+static void writeUInt64(unsigned char *p, uint64_t v)
+{
+    for (int i = 0; i < 8; i++)
+        p[i] = (v >> (i * 8)) & 0xff;
+}
+
+static uint32_t readInt32(unsigned char *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint64_t readUInt64(unsigned char *p)
+{
+    uint64_t v = 0;
+
+    for (int i = 7; i >= 0; i--)
+        v = (v << 8) | p[i];
+
+    return v;
+}
+
+Server *serve_new(void)
+{
+    Server *server = ALLOCATE(Server, 1);
+
+    pthread_mutex_init(&server->lock, NULL);
+    bci_defaultLimits(&server->limits);
+    server->count = 0;
+    server->clock = 0;
+
+    for (int i = 0; i < TABLE_CAPACITY; i++)
+        server->modules[i] = NULL;
+
+    return server;
+}
+
+static void freeModule(Module *module)
+{
+    FREE(module->block);
+    FREE(module);
+}
+
+/* Every connection has finished, so no module has users. */
+void serve_free(Server *server)
+{
+    for (int i = 0; i < TABLE_CAPACITY; i++)
+    {
+        if (server->modules[i] != NULL)
+            freeModule(server->modules[i]);
+    }
+
+    pthread_mutex_destroy(&server->lock);
+    FREE(server);
+}
+
+void serve_setLimits(Server *server, BciLimits *limits)
+{
+    server->limits = *limits;
+}
+
+/* The slot holding id, or the empty slot that ends its probe sequence. */
+static int32_t findSlot(Server *server, uint64_t id)
+{
+    int32_t i = (int32_t)(id & (TABLE_CAPACITY - 1));
+
+    while (server->modules[i] != NULL && server->modules[i]->id != id)
+        i = (i + 1) & (TABLE_CAPACITY - 1);
+
+    return i;
+}
+
+/* Empties slot i, shifting back the modules after it that probed past it. */
+static void removeSlot(Server *server, int32_t i)
+{
+    int32_t j = i;
+
+    while (1)
+    {
+        int32_t home;
+
+        server->modules[i] = NULL;
+        do
+        {
+            j = (j + 1) & (TABLE_CAPACITY - 1);
+            if (server->modules[j] == NULL)
+                return;
+            home = (int32_t)(server->modules[j]->id & (TABLE_CAPACITY - 1));
+        } while (i <= j ? (i < home && home <= j) : (i < home || home <= j));
+
+        server->modules[i] = server->modules[j];
+        i = j;
+    }
+}
+
+/* Evicts the least recently used module. */
+static void evict(Server *server)
+{
+    int32_t oldest = -1;
+
+    for (int32_t i = 0; i < TABLE_CAPACITY; i++)
+    {
+        if (server->modules[i] != NULL && (oldest < 0 || server->modules[i]->used < server->modules[oldest]->used))
+            oldest = i;
+    }
+
+    Module *module = server->modules[oldest];
+
+    removeSlot(server, oldest);
+    server->count--;
+
+    if (module->users == 0)
+        freeModule(module);
+    else
+        module->evicted = 1;
+}
+
+/*
+ * A module's id is its content hash or, should a different module already
+ * have that id, the next id that is free or holds the same content.
+ */
+static BciStatus loadModule(Server *server, unsigned char *block, int32_t size, uint64_t *id)
+{
+    pthread_mutex_lock(&server->lock);
+
+    *id = contentHash(block, size);
+    while (1)
+    {
+        int32_t i = findSlot(server, *id);
+        Module *module = server->modules[i];
+
+        if (module == NULL)
+        {
+            if (server->count == SERVE_MAX_MODULES)
+            {
+                evict(server);
+                i = findSlot(server, *id);
+            }
+
+            module = ALLOCATE(Module, 1);
+            module->id = *id;
+            module->size = size;
+            module->block = ALLOCATE(unsigned char, size > 0 ? size : 1);
+            memcpy(module->block, block, size);
+            module->users = 0;
+            module->evicted = 0;
+            module->used = ++server->clock;
+
+            server->modules[i] = module;
+            server->count++;
+            break;
+        }
+        if (module->size == size && memcmp(module->block, block, size) == 0)
+        {
+            module->used = ++server->clock;
+            break;
+        }
+
+        *id += 1;
+    }
+
+    pthread_mutex_unlock(&server->lock);
+
+    return BCI_OK;
+}
+
+/* The module with id, which the caller uses until it releases it, or NULL. */
+static Module *acquireModule(Server *server, uint64_t id)
+{
+    pthread_mutex_lock(&server->lock);
+
+    Module *module = server->modules[findSlot(server, id)];
+    if (module != NULL)
+    {
+        module->users++;
+        module->used = ++server->clock;
+    }
+
+    pthread_mutex_unlock(&server->lock);
+
+    return module;
+}
+
+static void releaseModule(Server *server, Module *module)
+{
+    if (module == NULL)
+        return;
+
+    pthread_mutex_lock(&server->lock);
+
+    module->users--;
+    if (module->evicted && module->users == 0)
+        freeModule(module);
+
+    pthread_mutex_unlock(&server->lock);
+}
+
+/* A peer that has gone away fails the write with EPIPE rather than raising SIGPIPE. */
+static ssize_t writeOut(Connection *connection, unsigned char *content, int32_t count)
+{
+    if (connection->socket)
+    {
+        ssize_t n = send(connection->out, content, count, MSG_NOSIGNAL);
+        if (n >= 0 || errno != ENOTSOCK)
+            return n;
+
+        connection->socket = 0;
+    }
+
+    return write(connection->out, content, count);
+}
+
+static int flush(Connection *connection)
+{
+    unsigned char *content = buffer_content(connection->output);
+    int32_t count = buffer_count(connection->output);
+    int32_t written = 0;
+
+    while (written < count)
+    {
+        ssize_t n = writeOut(connection, content + written, count - written);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return 0;
+        written += n;
+    }
+
+    buffer_clear(connection->output);
+
+    return 1;
+}
+
+/*
+ * Returns a pointer to the next count bytes of input.  Pending responses are
+ * only flushed when the input is exhausted so that pipelined requests are
+ * answered with a single write.
+ */
+static unsigned char *readBytes(Connection *connection, int32_t count)
+{
+    while (connection->inputEnd - connection->inputStart < count)
+    {
+        int32_t available = connection->inputEnd - connection->inputStart;
+
+        if (connection->inputStart > 0)
+        {
+            memmove(connection->input, connection->input + connection->inputStart, available);
+            connection->inputStart = 0;
+            connection->inputEnd = available;
+        }
+        if (count > connection->inputCapacity)
+        {
+            /* count is at most SERVE_MAX_REQUEST. */
+            connection->inputCapacity = count;
+            connection->input = REALLOCATE(connection->input, unsigned char, count);
+        }
+
+        if (!flush(connection))
+            return NULL;
+
+        ssize_t n = read(connection->in, connection->input + connection->inputEnd, connection->inputCapacity - connection->inputEnd);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return NULL;
+
+        connection->inputEnd += n;
+    }
+
+    unsigned char *result = connection->input + connection->inputStart;
+    connection->inputStart += count;
+
+    return result;
+}
+
+static void respond(Connection *connection, unsigned char *header, int32_t headerSize, char *text)
+{
+    unsigned char length[4];
+    int32_t textSize = text == NULL ? 0 : strlen(text);
+
+    writeInt32(length, headerSize + textSize);
+    buffer_append(connection->output, length, 4);
+    buffer_append(connection->output, header, headerSize);
+    if (textSize > 0)
+        buffer_append(connection->output, text, textSize);
+}
+
+static void respondError(Connection *connection, BciStatus status, char *message)
+{
+    unsigned char header[6] = {status, BCI_RESULT_NONE, 0, 0, 0, 0};
+
+    respond(connection, header, 6, message);
+}
+
+static void handleLoad(Connection *connection, unsigned char *body, int32_t size)
+{
+    unsigned char header[9];
+    uint64_t id;
+
+    header[0] = loadModule(connection->server, body, size, &id);
+    writeUInt64(header + 1, id);
+
+    respond(connection, header, 9, NULL);
+}
+
+static void handleRun(Connection *connection, unsigned char *body, int32_t size)
+{
+    if (size != 8)
+    {
+        respondError(connection, BCI_ERROR_REQUEST, "Serve: run: expected an 8 byte hash");
+        return;
+    }
+
+    Module *module = acquireModule(connection->server, readUInt64(body));
+
+    if (module == NULL)
+    {
+        respondError(connection, BCI_ERROR_NOT_LOADED, "Serve: run: unknown module");
+        return;
+    }
+
+    BciVM *vm = connection->vm;
+    bci_loadShared(vm, module->block, module->size);
+    releaseModule(connection->server, connection->module);
+    connection->module = module;
+
+    BciStatus status = bci_run(vm, 0);
+    if (status != BCI_OK)
+    {
+        respondError(connection, status, bci_errorMessage(vm));
+        return;
+    }
+
+    BciResult *result = bci_result(vm);
+    unsigned char header[6];
+
+    header[0] = status;
+    header[1] = result->type;
+    writeInt32(header + 2, result->value);
+
+    respond(connection, header, 6, result->text);
+}
+
+void serve_connection(Server *server, int in, int out)
+{
+    Connection connection;
+
+    connection.server = server;
+    connection.vm = bci_newVM();
+    bci_setLimits(connection.vm, &server->limits);
+    connection.module = NULL;
+    connection.in = in;
+    connection.out = out;
+    connection.socket = 1;
+    connection.input = ALLOCATE(unsigned char, INITIAL_INPUT);
+    connection.inputCapacity = INITIAL_INPUT;
+    connection.inputStart = 0;
+    connection.inputEnd = 0;
+    connection.output = buffer_new(1);
+
+    while (1)
+    {
+        unsigned char *length = readBytes(&connection, 4);
+        if (length == NULL)
+            break;
+
+        int32_t size = (int32_t)readInt32(length);
+        if (size < 1)
+        {
+            respondError(&connection, BCI_ERROR_REQUEST, "Serve: empty request");
+            continue;
+        }
+        if (size > SERVE_MAX_REQUEST)
+        {
+            /* The payload is not read, so there is no next request to find. */
+            respondError(&connection, BCI_ERROR_REQUEST, "Serve: request too large");
+            break;
+        }
+
+        unsigned char *payload = readBytes(&connection, size);
+        if (payload == NULL)
+            break;
+
+        switch (payload[0])
+        {
+        case SERVE_LOAD:
+            handleLoad(&connection, payload + 1, size - 1);
+            break;
+        case SERVE_RUN:
+            handleRun(&connection, payload + 1, size - 1);
+            break;
+        default:
+            respondError(&connection, BCI_ERROR_REQUEST, "Serve: unknown request");
+            break;
+        }
+    }
+
+    flush(&connection);
+
+    buffer_free(connection.output);
+    FREE(connection.input);
+    bci_freeVM(connection.vm);
+    releaseModule(server, connection.module);
+}
+
+typedef struct
+{
+    Server *server;
+    int fd;
+} SocketConnection;
+
+static void *socketConnectionMain(void *arg)
+{
+    SocketConnection *connection = (SocketConnection *)arg;
+
+    serve_connection(connection->server, connection->fd, connection->fd);
+    close(connection->fd);
+    FREE(connection);
+
+    return NULL;
+}
+
+int serve_socket(Server *server, char *path)
+{
+    struct sockaddr_un address;
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    if (fd < 0 || strlen(path) >= sizeof(address.sun_path))
+    {
+        printf("Serve: unable to create socket: %s\n", path);
+        return 0;
+    }
+
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, path);
+    unlink(path);
+
+    if (bind(fd, (struct sockaddr *)&address, sizeof(address)) != 0 || listen(fd, 16) != 0)
+    {
+        printf("Serve: unable to listen on socket: %s\n", path);
+        close(fd);
+        return 0;
+    }
+
+    while (1)
+    {
+        int client = accept(fd, NULL, NULL);
+        if (client < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+
+        SocketConnection *connection = ALLOCATE(SocketConnection, 1);
+        pthread_t thread;
+
+        connection->server = server;
+        connection->fd = client;
+        pthread_create(&thread, NULL, socketConnectionMain, connection);
+        pthread_detach(thread);
+    }
+
+    close(fd);
+    unlink(path);
+
+    return 1;
+}
@@ -0,0 +1,46 @@
+#ifndef SERVE_H
+#define SERVE_H
+
+#include <stdint.h>
+
+#include "vm.h"
+
+/*
+ * Requests and responses are frames made up of a 32-bit little-endian payload
+ * length followed by the payload.  The first byte of a request payload is the
+ * operation:
+ *
+ *   'L' <bytecode>  Load a module and cache it on its content hash.
+ *                   Response: <status:1> <id:8>
+ *   'R' <id:8>      Run a cached module from its entry point.
+ *                   Response: <status:1> <result type:1> <value:4> <text>
+ *
+ * where status is a BciStatus and text is the rendered result or, if status
+ * is not BCI_OK, the error message.  Requests may be pipelined - responses
+ * are written in request order.
+ *
+ * A module's id is its content hash unless another module has that hash, in
+ * which case it is the next free id.  At most SERVE_MAX_MODULES are cached:
+ * loading another evicts the least recently loaded or run, and running an
+ * evicted module answers BCI_ERROR_NOT_LOADED so the client loads it again.
+ * A request longer than SERVE_MAX_REQUEST is refused and its connection
+ * closed.
+ */
+
+#define SERVE_LOAD 'L'
+#define SERVE_RUN 'R'
+
+#define SERVE_MAX_MODULES 1024
+#define SERVE_MAX_REQUEST (64 * 1024 * 1024)
+
+typedef struct Server Server;
+
+extern Server *serve_new(void);
+extern void serve_free(Server *server);
+/* Applies to every run on connections opened after the call. */
+extern void serve_setLimits(Server *server, BciLimits *limits);
+
+extern void serve_connection(Server *server, int in, int out);
+extern int serve_socket(Server *server, char *path);
+
+#endif
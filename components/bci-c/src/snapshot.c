@@ -0,0 +1,601 @@
+#include <string.h>
+
+#include "buffer.h"
+#include "memory.h"
+
+#include "snapshot.h"
+
+#define DEFAULT_MINIMUM_OBJECTS 64
+#define NO_NODE UINT32_MAX
+
+struct Snapshot
+{
+    char *fileName;
+    int64_t at;
+    int32_t taken;
+    int32_t lastObjects;
+};
+
+/* A map from the address of each value on the heap to its node id. */
+typedef struct
+{
+    uint32_t capacity;
+    Value **values;
+    uint32_t *ids;
+} Ids;
+
+typedef struct
+{
+    SnapshotHeader header;
+    SnapshotNode *nodes;
+    SnapshotEdge *edges;
+    SnapshotRoot *roots;
+} Graph;
+
+static char *typeNames[] = {"Int", "Bool", "Closure", "Activation"};
+static char *rootNames[] = {"activation", "stack", "constants"};
+
+Snapshot *snapshot_new(char *fileName, int64_t at)
+{
+    Snapshot *snapshot = ALLOCATE(Snapshot, 1);
+
+    snapshot->fileName = STRDUP(fileName);
+    snapshot->at = at;
+    snapshot->taken = 0;
+    snapshot->lastObjects = DEFAULT_MINIMUM_OBJECTS / 2;
+
+    return snapshot;
+}
+
+void snapshot_free(Snapshot *snapshot)
+{
+    FREE(snapshot->fileName);
+    FREE(snapshot);
+}
+
+int64_t snapshot_due(Snapshot *snapshot)
+{
+    return snapshot->at == SNAPSHOT_AT_GC || snapshot->taken > 0 ? BCI_UNLIMITED : snapshot->at;
+}
+
+int32_t snapshot_taken(Snapshot *snapshot)
+{
+    return snapshot->taken;
+}
+
+static void take(Snapshot *snapshot, MemoryState *mm, int64_t instructions)
+{
+    if (snapshot_write(mm, snapshot->fileName, instructions))
+        snapshot->taken++;
+    else
+    {
+        printf(". Unable to write: %s\n", snapshot->fileName);
+        snapshot->at = BCI_UNLIMITED;
+    }
+}
+
+void snapshot_instructions(Snapshot *snapshot, MemoryState *mm, int64_t executed)
+{
+    if (executed >= snapshot_due(snapshot))
+        take(snapshot, mm, executed);
+}
+
+void snapshot_collected(Snapshot *snapshot, MemoryState *mm)
+{
+    if (snapshot->at == SNAPSHOT_AT_GC && mm->size >= snapshot->lastObjects * 2)
+    {
+        snapshot->lastObjects = mm->size;
+        take(snapshot, mm, -1);
+    }
+}
+
+static uint32_t slot(Ids *ids, Value *v)
+{
+    uint64_t hash = (uint64_t)(uintptr_t)v * 11400714819323198485ULL;
+    uint32_t i = (uint32_t)(hash >> 40) & (ids->capacity - 1);
+
+    while (ids->values[i] != NULL && ids->values[i] != v)
+        i = (i + 1) & (ids->capacity - 1);
+
+    return i;
+}
+
+static uint32_t findId(Ids *ids, Value *v)
+{
+    if (v == NULL)
+        return NO_NODE;
+
+    uint32_t i = slot(ids, v);
+
+    return ids->values[i] == NULL ? NO_NODE : ids->ids[i];
+}
+
+static void addEdge(Buffer *edges, Ids *ids, uint32_t from, Value *to, SnapshotEdgeKind kind, int32_t index)
+{
+    SnapshotEdge edge;
+
+    edge.from = from;
+    edge.to = findId(ids, to);
+    edge.kind = kind;
+    edge.index = index;
+
+    if (edge.to != NO_NODE)
+        buffer_append(edges, &edge, 1);
+}
+
+static void addRoot(Buffer *roots, Ids *ids, Value *v, SnapshotRootKind kind, int32_t index)
+{
+    SnapshotRoot root;
+
+    root.node = findId(ids, v);
+    root.kind = kind;
+    root.index = index;
+
+    if (root.node != NO_NODE)
+        buffer_append(roots, &root, 1);
+}
+
+int snapshot_write(MemoryState *mm, char *fileName, int64_t instructions)
+{
+    FILE *fp = fopen(fileName, "wb");
+    if (fp == NULL)
+        return 0;
+
+    Ids ids;
+    uint32_t count = 0;
+
+    for (Value *v = mm->root; v != NULL; v = v->next)
+        count++;
+
+    ids.capacity = 16;
+    while (ids.capacity < count * 2)
+        ids.capacity *= 2;
+    ids.values = ALLOCATE(Value *, ids.capacity);
+    ids.ids = ALLOCATE(uint32_t, ids.capacity);
+    for (uint32_t i = 0; i < ids.capacity; i++)
+        ids.values[i] = NULL;
+
+    uint32_t id = 0;
+    for (Value *v = mm->root; v != NULL; v = v->next)
+    {
+        uint32_t i = slot(&ids, v);
+
+        ids.values[i] = v;
+        ids.ids[i] = id++;
+    }
+
+    SnapshotNode *nodes = ALLOCATE(SnapshotNode, count + 1);
+    Buffer *edges = buffer_new(sizeof(SnapshotEdge));
+    Buffer *roots = buffer_new(sizeof(SnapshotRoot));
+
+    id = 0;
+    for (Value *v = mm->root; v != NULL; v = v->next, id++)
+    {
+        SnapshotNode *node = &nodes[id];
+
+        memset(node, 0, sizeof(SnapshotNode));
+        node->type = value_getType(v);
+        node->size = sizeof(Value);
+
+        switch (value_getType(v))
+        {
+        case VInt:
+            node->value = v->data.i;
+            break;
+        case VBool:
+            node->value = v->data.b;
+            break;
+        case VClosure:
+            node->value = v->data.c.ip;
+            addEdge(edges, &ids, id, v->data.c.previousActivation, EDGE_CAPTURE, 0);
+            break;
+        case VActivation:
+            node->value = v->data.a.nextIP;
+            addEdge(edges, &ids, id, v->data.a.parentActivation, EDGE_PARENT, 0);
+            addEdge(edges, &ids, id, v->data.a.closure, EDGE_CLOSURE, 0);
+            if (v->data.a.state != NULL)
+            {
+                node->size += sizeof(Value *) * v->data.a.stateSize;
+                for (int i = 0; i < v->data.a.stateSize; i++)
+                    addEdge(edges, &ids, id, v->data.a.state[i], EDGE_STATE, i);
+            }
+            break;
+        }
+    }
+
+    addRoot(roots, &ids, mm->activation, ROOT_ACTIVATION, 0);
+    for (int i = 0; i < mm->sp; i++)
+        addRoot(roots, &ids, mm->stack[i], ROOT_STACK, i);
+    addRoot(roots, &ids, mm->trueValue, ROOT_CONSTANT, 0);
+    addRoot(roots, &ids, mm->falseValue, ROOT_CONSTANT, 1);
+
+    SnapshotHeader header;
+
+    memcpy(header.magic, SNAPSHOT_MAGIC, 4);
+    header.version = SNAPSHOT_VERSION;
+    header.nodes = count;
+    header.edges = buffer_count(edges);
+    header.roots = buffer_count(roots);
+    header.reserved = 0;
+    header.instructions = instructions;
+    header.collections = mm->collections;
+
+    int ok = fwrite(&header, sizeof(header), 1, fp) == 1 &&
+             fwrite(nodes, sizeof(SnapshotNode), count, fp) == count &&
+             fwrite(buffer_content(edges), sizeof(SnapshotEdge), header.edges, fp) == header.edges &&
+             fwrite(buffer_content(roots), sizeof(SnapshotRoot), header.roots, fp) == header.roots;
+
+    if (fclose(fp) != 0)
+        ok = 0;
+
+    buffer_free(roots);
+    buffer_free(edges);
+    FREE(nodes);
+    FREE(ids.ids);
+    FREE(ids.values);
+
+    return ok;
+}
+
+static int readGraph(char *fileName, Graph *graph)
+{
+    FILE *fp = fopen(fileName, "rb");
+    SnapshotHeader *header = &graph->header;
+
+    if (fp == NULL)
+    {
+        printf("File not found: %s\n", fileName);
+        return 0;
+    }
+    if (fread(header, sizeof(SnapshotHeader), 1, fp) != 1 || memcmp(header->magic, SNAPSHOT_MAGIC, 4) != 0 || header->version != SNAPSHOT_VERSION)
+    {
+        printf("Not a heap snapshot: %s\n", fileName);
+        fclose(fp);
+        return 0;
+    }
+
+    graph->nodes = ALLOCATE(SnapshotNode, header->nodes + 1);
+    graph->edges = ALLOCATE(SnapshotEdge, header->edges + 1);
+    graph->roots = ALLOCATE(SnapshotRoot, header->roots + 1);
+
+    int ok = fread(graph->nodes, sizeof(SnapshotNode), header->nodes, fp) == header->nodes &&
+             fread(graph->edges, sizeof(SnapshotEdge), header->edges, fp) == header->edges &&
+             fread(graph->roots, sizeof(SnapshotRoot), header->roots, fp) == header->roots;
+
+    for (uint32_t i = 0; ok && i < header->edges; i++)
+        ok = graph->edges[i].from < header->nodes && graph->edges[i].to < header->nodes;
+    for (uint32_t i = 0; ok && i < header->roots; i++)
+        ok = graph->roots[i].node < header->nodes && graph->roots[i].kind <= ROOT_CONSTANT;
+
+    fclose(fp);
+
+    if (!ok)
+    {
+        printf("Corrupt heap snapshot: %s\n", fileName);
+        FREE(graph->nodes);
+        FREE(graph->edges);
+        FREE(graph->roots);
+    }
+
+    return ok;
+}
+
+/*
+ * Adjacency in compressed rows: the neighbours of n are targets[starts[n]]
+ * to targets[starts[n + 1] - 1].  The virtual root, numbered after the
+ * nodes, has an edge to each root.
+ */
+static void adjacency(Graph *graph, int reverse, uint32_t **starts, uint32_t **targets)
+{
+    uint32_t n = graph->header.nodes;
+    uint32_t count = graph->header.edges + graph->header.roots;
+    uint32_t *start = ALLOCATE(uint32_t, n + 2);
+    uint32_t *target = ALLOCATE(uint32_t, count + 1);
+    uint32_t *fill = ALLOCATE(uint32_t, n + 1);
+
+    memset(start, 0, sizeof(uint32_t) * (n + 2));
+
+    for (uint32_t i = 0; i < graph->header.edges; i++)
+        start[(reverse ? graph->edges[i].to : graph->edges[i].from) + 1]++;
+    for (uint32_t i = 0; i < graph->header.roots; i++)
+        start[(reverse ? graph->roots[i].node : n) + 1]++;
+    for (uint32_t i = 0; i <= n; i++)
+        start[i + 1] += start[i];
+
+    memcpy(fill, start, sizeof(uint32_t) * (n + 1));
+
+    for (uint32_t i = 0; i < graph->header.edges; i++)
+    {
+        SnapshotEdge *edge = &graph->edges[i];
+
+        if (reverse)
+            target[fill[edge->to]++] = edge->from;
+        else
+            target[fill[edge->from]++] = edge->to;
+    }
+    for (uint32_t i = 0; i < graph->header.roots; i++)
+    {
+        if (reverse)
+            target[fill[graph->roots[i].node]++] = n;
+        else
+            target[fill[n]++] = graph->roots[i].node;
+    }
+
+    FREE(fill);
+    *starts = start;
+    *targets = target;
+}
+
+/* Numbers the nodes reachable from the virtual root in postorder.  Returns how many there are. */
+static uint32_t postorder(uint32_t n, uint32_t *starts, uint32_t *targets, uint32_t *post, uint32_t *order)
+{
+    uint32_t *stack = ALLOCATE(uint32_t, n + 1);
+    uint32_t *next = ALLOCATE(uint32_t, n + 1);
+    uint32_t sp = 0;
+    uint32_t count = 0;
+
+    for (uint32_t i = 0; i <= n; i++)
+        post[i] = NO_NODE;
+
+    /* NO_NODE - 1 marks a node that is on the stack but not yet numbered. */
+    stack[sp++] = n;
+    next[n] = starts[n];
+    post[n] = NO_NODE - 1;
+
+    while (sp > 0)
+    {
+        uint32_t v = stack[sp - 1];
+
+        if (next[v] < starts[v + 1])
+        {
+            uint32_t w = targets[next[v]++];
+
+            if (post[w] == NO_NODE)
+            {
+                post[w] = NO_NODE - 1;
+                next[w] = starts[w];
+                stack[sp++] = w;
+            }
+        }
+        else
+        {
+            post[v] = count;
+            order[count++] = v;
+            sp--;
+        }
+    }
+
+    FREE(next);
+    FREE(stack);
+
+    return count;
+}
+
+static uint32_t intersect(uint32_t a, uint32_t b, uint32_t *idom, uint32_t *post)
+{
+    while (a != b)
+    {
+        while (post[a] < post[b])
+            a = idom[a];
+        while (post[b] < post[a])
+            b = idom[b];
+    }
+
+    return a;
+}
+
+/* Cooper, Harvey and Kennedy's iterative algorithm over reverse postorder. */
+static void dominators(uint32_t n, uint32_t reachable, uint32_t *order, uint32_t *post, uint32_t *predStarts, uint32_t *preds, uint32_t *idom)
+{
+    int changed = 1;
+
+    for (uint32_t i = 0; i <= n; i++)
+        idom[i] = NO_NODE;
+    idom[n] = n;
+
+    while (changed)
+    {
+        changed = 0;
+
+        for (int64_t i = (int64_t)reachable - 2; i >= 0; i--)
+        {
+            uint32_t v = order[i];
+            uint32_t dominator = NO_NODE;
+
+            for (uint32_t j = predStarts[v]; j < predStarts[v + 1]; j++)
+            {
+                uint32_t p = preds[j];
+
+                if (idom[p] == NO_NODE)
+                    continue;
+                dominator = dominator == NO_NODE ? p : intersect(p, dominator, idom, post);
+            }
+
+            if (idom[v] != dominator)
+            {
+                idom[v] = dominator;
+                changed = 1;
+            }
+        }
+    }
+}
+
+static void describe(SnapshotNode *node, char *buffer)
+{
+    switch (node->type)
+    {
+    case VInt:
+        sprintf(buffer, "%d", node->value);
+        break;
+    case VBool:
+        strcpy(buffer, node->value ? "true" : "false");
+        break;
+    case VClosure:
+        sprintf(buffer, "c%d", node->value);
+        break;
+    case VActivation:
+        sprintf(buffer, "returns to %d, %d slots", node->value, (int)((node->size - sizeof(Value)) / sizeof(Value *)));
+        break;
+    default:
+        strcpy(buffer, "?");
+        break;
+    }
+}
+
+static uint64_t *sortKey;
+
+static int compareRetained(const void *a, const void *b)
+{
+    uint64_t ra = sortKey[*(uint32_t *)a];
+    uint64_t rb = sortKey[*(uint32_t *)b];
+
+    if (ra != rb)
+        return (ra < rb) - (ra > rb);
+
+    return (*(uint32_t *)a > *(uint32_t *)b) - (*(uint32_t *)a < *(uint32_t *)b);
+}
+
+static double percentage(uint64_t part, uint64_t total)
+{
+    return total == 0 ? 0.0 : part * 100.0 / total;
+}
+
+int snapshot_analyze(char *fileName, int32_t top, FILE *out)
+{
+    Graph graph;
+
+    if (!readGraph(fileName, &graph))
+        return 0;
+
+    uint32_t n = graph.header.nodes;
+    uint32_t *succStarts, *succs, *predStarts, *preds;
+
+    adjacency(&graph, 0, &succStarts, &succs);
+    adjacency(&graph, 1, &predStarts, &preds);
+
+    uint32_t *post = ALLOCATE(uint32_t, n + 1);
+    uint32_t *order = ALLOCATE(uint32_t, n + 1);
+    uint32_t *idom = ALLOCATE(uint32_t, n + 1);
+    uint64_t *retained = ALLOCATE(uint64_t, n + 1);
+
+    uint32_t reachable = postorder(n, succStarts, succs, post, order);
+    dominators(n, reachable, order, post, predStarts, preds, idom);
+
+    uint64_t totalBytes = 0;
+    uint64_t typeCounts[4] = {0, 0, 0, 0};
+    uint64_t typeBytes[4] = {0, 0, 0, 0};
+    uint64_t unreachableCount = 0;
+    uint64_t unreachableBytes = 0;
+
+    for (uint32_t i = 0; i < n; i++)
+    {
+        SnapshotNode *node = &graph.nodes[i];
+
+        totalBytes += node->size;
+        if (node->type < 4)
+        {
+            typeCounts[node->type]++;
+            typeBytes[node->type] += node->size;
+        }
+        if (post[i] == NO_NODE)
+        {
+            unreachableCount++;
+            unreachableBytes += node->size;
+        }
+        retained[i] = node->size;
+    }
+    retained[n] = 0;
+
+    /* A dominator finishes after everything it dominates so postorder accumulates bottom up. */
+    for (uint32_t i = 0; i + 1 < reachable; i++)
+        retained[idom[order[i]]] += retained[order[i]];
+
+    fprintf(out, ". Heap snapshot: %u values, %lu bytes, %u references, %u roots", n, (unsigned long)totalBytes, graph.header.edges, graph.header.roots);
+    if (graph.header.instructions >= 0)
+        fprintf(out, ", after %ld instructions\n", (long)graph.header.instructions);
+    else
+        fprintf(out, ", after collection %ld\n", (long)graph.header.collections);
+
+    fprintf(out, ". Types\n");
+    fprintf(out, "  %-12s %10s %12s\n", "type", "values", "bytes");
+    for (int i = 0; i < 4; i++)
+        fprintf(out, "  %-12s %10lu %12lu\n", typeNames[i], (unsigned long)typeCounts[i], (unsigned long)typeBytes[i]);
+    fprintf(out, ". Unreachable: %lu values, %lu bytes\n", (unsigned long)unreachableCount, (unsigned long)unreachableBytes);
+
+    uint64_t rootRetained[ROOT_CONSTANT + 1] = {0, 0, 0};
+    uint8_t *counted = ALLOCATE(uint8_t, n + 1);
+
+    memset(counted, 0, n + 1);
+    for (uint32_t i = 0; i < graph.header.roots; i++)
+    {
+        SnapshotRoot *root = &graph.roots[i];
+
+        if (idom[root->node] == n && !counted[root->node])
+        {
+            counted[root->node] = 1;
+            rootRetained[root->kind] += retained[root->node];
+        }
+    }
+
+    fprintf(out, ". Retained by roots\n");
+    fprintf(out, "  %-12s %12s %7s\n", "root", "bytes", "heap%");
+    uint64_t shared = retained[n];
+    for (int i = 0; i <= ROOT_CONSTANT; i++)
+    {
+        fprintf(out, "  %-12s %12lu %6.1f%%\n", rootNames[i], (unsigned long)rootRetained[i], percentage(rootRetained[i], totalBytes));
+        shared -= rootRetained[i];
+    }
+    /* Values reachable along more than one root's paths are dominated by none of them. */
+    fprintf(out, "  %-12s %12lu %6.1f%%\n", "shared", (unsigned long)shared, percentage(shared, totalBytes));
+
+    uint32_t *sorted = ALLOCATE(uint32_t, reachable + 1);
+    uint32_t count = 0;
+
+    for (uint32_t i = 0; i < reachable; i++)
+    {
+        if (order[i] != n)
+            sorted[count++] = order[i];
+    }
+    sortKey = retained;
+    qsort(sorted, count, sizeof(uint32_t), compareRetained);
+
+    fprintf(out, ". Top retainers\n");
+    fprintf(out, "  %8s %-11s %-26s %8s %12s %7s %10s\n", "id", "type", "value", "shallow", "retained", "heap%", "dominator");
+    for (uint32_t i = 0; i < count && i < (uint32_t)top; i++)
+    {
+        SnapshotNode *node = &graph.nodes[sorted[i]];
+        char value[64];
+        char dominator[16];
+
+        describe(node, value);
+        if (idom[sorted[i]] == n)
+            strcpy(dominator, "root");
+        else
+            sprintf(dominator, "#%u", idom[sorted[i]]);
+
+        fprintf(out, "  %8u %-11s %-26s %8u %12lu %6.1f%% %10s\n",
+                sorted[i],
+                node->type < 4 ? typeNames[node->type] : "?",
+                value,
+                node->size,
+                (unsigned long)retained[sorted[i]],
+                percentage(retained[sorted[i]], totalBytes),
+                dominator);
+    }
+
+    FREE(sorted);
+    FREE(counted);
+    FREE(retained);
+    FREE(idom);
+    FREE(order);
+    FREE(post);
+    FREE(succStarts);
+    FREE(succs);
+    FREE(predStarts);
+    FREE(preds);
+    FREE(graph.nodes);
+    FREE(graph.edges);
+    FREE(graph.roots);
+
+    return 1;
+}
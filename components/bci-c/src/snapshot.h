@@ -0,0 +1,104 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "value.h"
+
+/*
+ * A heap snapshot is the object graph of a MemoryState: a SnapshotHeader
+ * followed by its nodes, edges and roots, written in the machine's byte
+ * order.  Node ids are indices into the node table.
+ */
+
+#define SNAPSHOT_MAGIC "BCIH"
+#define SNAPSHOT_VERSION 1
+
+/* Take snapshots as collections find the heap at a new peak rather than after a number of instructions. */
+#define SNAPSHOT_AT_GC -1
+
+typedef enum
+{
+    EDGE_PARENT,
+    EDGE_CLOSURE,
+    EDGE_STATE,
+    EDGE_CAPTURE
+} SnapshotEdgeKind;
+
+typedef enum
+{
+    ROOT_ACTIVATION,
+    ROOT_STACK,
+    ROOT_CONSTANT
+} SnapshotRootKind;
+
+typedef struct
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t nodes;
+    uint32_t edges;
+    uint32_t roots;
+    uint32_t reserved;
+    /* The instructions executed when the snapshot was taken or -1 if taken by a collection. */
+    int64_t instructions;
+    int64_t collections;
+} SnapshotHeader;
+
+/* value is the Int or Bool, a closure's ip or an activation's return ip. */
+typedef struct
+{
+    uint8_t type;
+    uint8_t reserved[3];
+    int32_t value;
+    uint32_t size;
+} SnapshotNode;
+
+/* index is the state slot of an EDGE_STATE edge. */
+typedef struct
+{
+    uint32_t from;
+    uint32_t to;
+    uint32_t kind;
+    int32_t index;
+} SnapshotEdge;
+
+/* index is the stack slot of a ROOT_STACK root. */
+typedef struct
+{
+    uint32_t node;
+    uint32_t kind;
+    int32_t index;
+} SnapshotRoot;
+
+typedef struct Snapshot Snapshot;
+
+/*
+ * at is the number of instructions after which to take a single snapshot,
+ * rounded up to the next call or backward jump, or SNAPSHOT_AT_GC to write a
+ * snapshot whenever a collection leaves at least twice the live values of
+ * the last one written, so that the file ends up holding the heap near its
+ * peak.
+ */
+extern Snapshot *snapshot_new(char *fileName, int64_t at);
+extern void snapshot_free(Snapshot *snapshot);
+
+/* The instruction count at which a snapshot is due or BCI_UNLIMITED. */
+extern int64_t snapshot_due(Snapshot *snapshot);
+/* Snapshots written - a failure to write is reported on stdout. */
+extern int32_t snapshot_taken(Snapshot *snapshot);
+
+extern void snapshot_instructions(Snapshot *snapshot, MemoryState *mm, int64_t executed);
+extern void snapshot_collected(Snapshot *snapshot, MemoryState *mm);
+
+extern int snapshot_write(MemoryState *mm, char *fileName, int64_t instructions);
+
+/*
+ * Computes the dominator tree of a snapshot and reports its totals, the
+ * retained size held by each kind of root and the top values by retained
+ * size.  Returns 0 if the file cannot be read.
+ */
+extern int snapshot_analyze(char *fileName, int32_t top, FILE *out);
+
+#endif
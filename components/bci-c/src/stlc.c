@@ -0,0 +1,79 @@
+#include <stdio.h>
+
+#include "arena.h"
+#include "compiler.h"
+#include "infer.h"
+#include "memory.h"
+#include "timer.h"
+
+#include "stlc.h"
+
+int stlc_compile(char *source, int parallel, Stlc *stlc)
+{
+    Arena *arena = arena_new();
+    Program program;
+    int64_t start = timer_now();
+
+    stlc->block = NULL;
+    stlc->size = 0;
+    stlc->type[0] = '\0';
+    stlc->function = 0;
+    stlc->errorMessage[0] = '\0';
+    stlc->cached = 0;
+    stlc->parseTime = 0;
+    stlc->inferTime = 0;
+    stlc->compileTime = 0;
+    stlc->arenaBytes = 0;
+
+    int ok = parser_parse(arena, source, &program, stlc->errorMessage);
+    int64_t parsed = timer_now();
+    stlc->parseTime = parsed - start;
+
+    if (ok)
+    {
+        Type *type = infer_program(arena, &program, stlc->errorMessage);
+        int64_t inferred = timer_now();
+        stlc->inferTime = inferred - parsed;
+
+        if (type == NULL)
+            ok = 0;
+        else
+        {
+            infer_typeToString(type, stlc->type, sizeof(stlc->type));
+            stlc->function = infer_isFunction(type);
+            stlc->block = compiler_compile(&program, parallel, &stlc->size);
+            stlc->compileTime = timer_now() - inferred;
+        }
+    }
+
+    stlc->arenaBytes = arena_bytes(arena);
+    arena_free(arena);
+
+    return ok;
+}
+
+void stlc_free(Stlc *stlc)
+{
+    if (stlc->block != NULL)
+        FREE(stlc->block);
+    stlc->block = NULL;
+}
+
+char *stlc_readFile(char *fileName)
+{
+    FILE *fp = fopen(fileName, "rb");
+    if (fp == NULL)
+        return NULL;
+
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+
+    char *source = ALLOCATE(char, size + 1);
+    size_t read = fread(source, 1, size, fp);
+    fclose(fp);
+
+    source[read] = '\0';
+
+    return source;
+}
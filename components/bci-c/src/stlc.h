@@ -0,0 +1,43 @@
+#ifndef STLC_H
+#define STLC_H
+
+#include <stdint.h>
+
+#include "parser.h"
+
+/*
+ * The native STLC front end: parses, type checks and compiles a program's
+ * source into the bytecode the Kotlin front end would produce for it, without
+ * the start up cost of a JVM.  The syntax tree and types are allocated from an
+ * arena that is freed once the program is compiled.
+ */
+typedef struct
+{
+    /* The program's bytecode, owned by the Stlc. */
+    unsigned char *block;
+    int32_t size;
+
+    /* The program's type as the REPL prints it, with its variables renamed a, b, ... */
+    char type[STLC_ERROR_MESSAGE_SIZE];
+    int function;
+
+    char errorMessage[STLC_ERROR_MESSAGE_SIZE];
+
+    /* Set by cache_compile when the program came from the cache rather than the front end. */
+    int cached;
+
+    /* Nanoseconds spent in each pass, and the arena's size. */
+    int64_t parseTime;
+    int64_t inferTime;
+    int64_t compileTime;
+    int64_t arenaBytes;
+} Stlc;
+
+/* Returns 0, with the error in errorMessage, if source is not a well typed program. */
+extern int stlc_compile(char *source, int parallel, Stlc *stlc);
+extern void stlc_free(Stlc *stlc);
+
+/* Reads the whole of fileName into an allocation the caller frees, or returns NULL. */
+extern char *stlc_readFile(char *fileName);
+
+#endif
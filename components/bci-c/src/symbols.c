@@ -0,0 +1,153 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "buffer.h"
+#include "memory.h"
+#include "op.h"
+
+#include "symbols.h"
+
+static char *trim(char *line)
+{
+    while (*line == ' ' || *line == '\t')
+        line++;
+
+    char *end = line + strlen(line);
+    while (end > line && (end[-1] == '\n' || end[-1] == '\r' || end[-1] == ' ' || end[-1] == '\t'))
+        end--;
+    *end = '\0';
+
+    return line;
+}
+
+static int compareSymbols(const void *a, const void *b)
+{
+    return ((Symbol *)a)->ip - ((Symbol *)b)->ip;
+}
+
+static void freeNames(Buffer *buffer)
+{
+    Symbol *symbols = buffer_content(buffer);
+
+    for (int i = 0; i < buffer_count(buffer); i++)
+        FREE(symbols[i].name);
+    buffer_free(buffer);
+}
+
+Symbols *symbols_load(char *fileName)
+{
+    FILE *fp = fopen(fileName, "r");
+    if (fp == NULL)
+        return NULL;
+
+    Buffer *labels = buffer_new(sizeof(Symbol));
+    Buffer *targets = buffer_new(sizeof(Symbol));
+    int32_t ip = 0;
+    int valid = 1;
+    char line[1024];
+
+    while (valid && fgets(line, sizeof(line), fp) != NULL)
+    {
+        char *l = trim(line);
+
+        if (*l == '\0' || *l == '#')
+            continue;
+
+        if (*l == ':')
+        {
+            Symbol label = {ip, STRDUP(l + 1)};
+            buffer_append(labels, &label, 1);
+            continue;
+        }
+
+        char *name = strtok(l, " \t");
+        const Instruction *instruction = findOnName(name);
+        if (instruction == NULL)
+        {
+            valid = 0;
+            break;
+        }
+
+        if (instruction->opcode == PUSH_CLOSURE)
+        {
+            char *target = strtok(NULL, " \t");
+            if (target == NULL)
+            {
+                valid = 0;
+                break;
+            }
+
+            Symbol reference = {0, STRDUP(target)};
+            buffer_append(targets, &reference, 1);
+        }
+
+        ip += 1 + instruction->arity * 4;
+    }
+    fclose(fp);
+
+    if (!valid)
+    {
+        freeNames(labels);
+        freeNames(targets);
+        return NULL;
+    }
+
+    Symbol *ls = buffer_content(labels);
+    Symbol *ts = buffer_content(targets);
+    Buffer *functions = buffer_new(sizeof(Symbol));
+
+    for (int i = 0; i < buffer_count(labels); i++)
+    {
+        int isTarget = 0;
+
+        for (int j = 0; !isTarget && j < buffer_count(targets); j++)
+            isTarget = strcmp(ls[i].name, ts[j].name) == 0;
+
+        if (isTarget)
+        {
+            char *name = ls[i].name;
+            Symbol function = {ls[i].ip, STRDUP(strncmp(name, "$$", 2) == 0 ? name + 2 : name)};
+            buffer_append(functions, &function, 1);
+        }
+    }
+
+    freeNames(labels);
+    freeNames(targets);
+
+    Symbols *symbols = ALLOCATE(Symbols, 1);
+    symbols->count = buffer_count(functions);
+    symbols->symbols = buffer_free_use(functions);
+
+    qsort(symbols->symbols, symbols->count, sizeof(Symbol), compareSymbols);
+
+    return symbols;
+}
+
+void symbols_free(Symbols *symbols)
+{
+    for (int i = 0; i < symbols->count; i++)
+        FREE(symbols->symbols[i].name);
+
+    FREE(symbols->symbols);
+    FREE(symbols);
+}
+
+char *symbols_find(Symbols *symbols, int32_t ip)
+{
+    int32_t low = 0;
+    int32_t high = symbols->count - 1;
+
+    while (low <= high)
+    {
+        int32_t middle = (low + high) / 2;
+
+        if (symbols->symbols[middle].ip == ip)
+            return symbols->symbols[middle].name;
+        if (symbols->symbols[middle].ip < ip)
+            low = middle + 1;
+        else
+            high = middle - 1;
+    }
+
+    return NULL;
+}
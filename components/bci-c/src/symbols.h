@@ -0,0 +1,30 @@
+#ifndef SYMBOLS_H
+#define SYMBOLS_H
+
+#include <stdint.h>
+
+typedef struct
+{
+    int32_t ip;
+    char *name;
+} Symbol;
+
+/* Function names recovered from the labels of a .bci source file. */
+typedef struct
+{
+    int32_t count;
+    Symbol *symbols;
+} Symbols;
+
+/*
+ * Assembles the source far enough to give each label its address and keeps
+ * those labels that are the target of a PUSH_CLOSURE, less their "$$"
+ * prefix.  Returns NULL if the file cannot be read or is not valid.
+ */
+extern Symbols *symbols_load(char *fileName);
+extern void symbols_free(Symbols *symbols);
+
+/* The name of the function entered at ip or NULL if it has none. */
+extern char *symbols_find(Symbols *symbols, int32_t ip);
+
+#endif
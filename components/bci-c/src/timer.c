@@ -0,0 +1,11 @@
+#include <time.h>
+
+#include "timer.h"
+
+int64_t timer_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((int64_t)ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
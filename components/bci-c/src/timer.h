@@ -0,0 +1,9 @@
+#ifndef TIMER_H
+#define TIMER_H
+
+#include <stdint.h>
+
+/* Monotonic time in nanoseconds. */
+extern int64_t timer_now(void);
+
+#endif
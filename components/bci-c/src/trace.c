@@ -0,0 +1,383 @@
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "memory.h"
+#include "op.h"
+#include "value.h"
+
+#include "trace.h"
+
+#define MINIMUM_CAPACITY 1024
+#define INITIAL_IDS 1024
+
+struct Trace
+{
+    int fd;
+    size_t length;
+    TraceHeader *header;
+    TraceRecord *records;
+    uint64_t mask;
+};
+
+/* Numbers objects in order of allocation as addresses are reused once swept. */
+typedef struct
+{
+    int32_t count;
+    int32_t capacity;
+    uint64_t *addresses;
+    int32_t *ids;
+    int32_t next;
+} Ids;
+
+static uint64_t contentHash(unsigned char *block, int32_t size)
+{
+    uint64_t hash = 14695981039346656037ULL;
+
+    for (int i = 0; i < size; i++)
+    {
+        hash ^= block[i];
+        hash *= 1099511628211ULL;
+    }
+
+    return hash;
+}
+
+Trace *trace_new(char *fileName, int64_t capacity)
+{
+    uint64_t size = MINIMUM_CAPACITY;
+
+    while (size < (uint64_t)capacity)
+        size *= 2;
+
+    int fd = open(fileName, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        return NULL;
+
+    size_t length = sizeof(TraceHeader) + size * sizeof(TraceRecord);
+    if (ftruncate(fd, length) != 0)
+    {
+        close(fd);
+        return NULL;
+    }
+
+    void *mapping = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (mapping == MAP_FAILED)
+    {
+        close(fd);
+        return NULL;
+    }
+
+    Trace *trace = ALLOCATE(Trace, 1);
+
+    trace->fd = fd;
+    trace->length = length;
+    trace->header = (TraceHeader *)mapping;
+    trace->records = (TraceRecord *)(trace->header + 1);
+    trace->mask = size - 1;
+
+    memcpy(trace->header->magic, TRACE_MAGIC, 4);
+    trace->header->version = TRACE_VERSION;
+    trace->header->recordSize = sizeof(TraceRecord);
+    trace->header->programSize = 0;
+    trace->header->programHash = 0;
+    trace->header->capacity = size;
+    trace->header->count = 0;
+
+    return trace;
+}
+
+/* Truncates the file to the records written when the ring has not wrapped. */
+void trace_free(Trace *trace)
+{
+    uint64_t count = trace->header->count;
+
+    munmap(trace->header, trace->length);
+    if (count <= trace->mask)
+    {
+        if (ftruncate(trace->fd, sizeof(TraceHeader) + count * sizeof(TraceRecord)) != 0)
+            perror("trace");
+    }
+    close(trace->fd);
+    FREE(trace);
+}
+
+void trace_setProgram(Trace *trace, unsigned char *block, int32_t size)
+{
+    trace->header->programSize = size;
+    trace->header->programHash = contentHash(block, size);
+}
+
+static TraceRecord *nextRecord(Trace *trace, TraceKind kind)
+{
+    TraceRecord *record = &trace->records[trace->header->count & trace->mask];
+
+    trace->header->count++;
+    record->kind = kind;
+    record->reserved = 0;
+
+    return record;
+}
+
+void trace_instruction(Trace *trace, int32_t ip, int opcode, int32_t sp, void *activation)
+{
+    TraceRecord *record = nextRecord(trace, TRACE_INSTRUCTION);
+
+    record->object = (uint64_t)(uintptr_t)activation;
+    record->ip = ip;
+    record->sp = sp;
+    record->heap = 0;
+    record->code = opcode;
+}
+
+void trace_allocation(Trace *trace, void *value, int type, int32_t heap)
+{
+    TraceRecord *record = nextRecord(trace, TRACE_ALLOCATION);
+
+    record->object = (uint64_t)(uintptr_t)value;
+    record->ip = -1;
+    record->sp = 0;
+    record->heap = heap;
+    record->code = type;
+}
+
+void trace_collection(Trace *trace, int32_t before, int32_t after)
+{
+    TraceRecord *record = nextRecord(trace, TRACE_COLLECTION);
+
+    record->object = 0;
+    record->ip = -1;
+    record->sp = before;
+    record->heap = after;
+    record->code = 0;
+}
+
+static void initIds(Ids *ids, int32_t capacity)
+{
+    ids->count = 0;
+    ids->capacity = capacity;
+    ids->addresses = ALLOCATE(uint64_t, capacity);
+    ids->ids = ALLOCATE(int32_t, capacity);
+
+    for (int i = 0; i < capacity; i++)
+        ids->addresses[i] = 0;
+}
+
+static int32_t slot(Ids *ids, uint64_t address)
+{
+    int32_t i = (int32_t)((address * 11400714819323198485ULL) >> 40) & (ids->capacity - 1);
+
+    while (ids->addresses[i] != 0 && ids->addresses[i] != address)
+        i = (i + 1) & (ids->capacity - 1);
+
+    return i;
+}
+
+/* Gives address a new id if fresh is set or it has not been seen before. */
+static int32_t findId(Ids *ids, uint64_t address, int fresh)
+{
+    if (address == 0)
+        return 0;
+
+    if ((ids->count + 1) * 2 > ids->capacity)
+    {
+        Ids grown;
+
+        initIds(&grown, ids->capacity * 2);
+        for (int i = 0; i < ids->capacity; i++)
+        {
+            if (ids->addresses[i] != 0)
+            {
+                int32_t j = slot(&grown, ids->addresses[i]);
+
+                grown.addresses[j] = ids->addresses[i];
+                grown.ids[j] = ids->ids[i];
+                grown.count++;
+            }
+        }
+        grown.next = ids->next;
+
+        FREE(ids->addresses);
+        FREE(ids->ids);
+        *ids = grown;
+    }
+
+    int32_t i = slot(ids, address);
+
+    if (ids->addresses[i] == 0)
+    {
+        ids->addresses[i] = address;
+        ids->count++;
+        fresh = 1;
+    }
+    if (fresh)
+        ids->ids[i] = ++ids->next;
+
+    return ids->ids[i];
+}
+
+static char *typeName(int type)
+{
+    switch (type)
+    {
+    case VInt:
+        return "Int";
+    case VBool:
+        return "Bool";
+    case VClosure:
+        return "Closure";
+    case VActivation:
+        return "Activation";
+    default:
+        return "Unknown";
+    }
+}
+
+static unsigned char *readProgram(char *fileName, int32_t *size)
+{
+    FILE *fp = fopen(fileName, "rb");
+    if (fp == NULL)
+        return NULL;
+
+    fseek(fp, 0, SEEK_END);
+    size_t length = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+
+    unsigned char *block = ALLOCATE(unsigned char, length);
+    if (fread(block, 1, length, fp) != length)
+    {
+        FREE(block);
+        block = NULL;
+    }
+    fclose(fp);
+    *size = length;
+
+    return block;
+}
+
+static int32_t readOperand(unsigned char *block, int32_t offset)
+{
+    return (int32_t)(block[offset] |
+                     ((block[offset + 1]) << 8) |
+                     ((block[offset + 2]) << 16) |
+                     ((block[offset + 3]) << 24));
+}
+
+static void dumpInstruction(TraceRecord *record, Ids *ids, unsigned char *block, int32_t size, FILE *out)
+{
+    const Instruction *instruction = find(record->code);
+
+    fprintf(out, "%d: ", record->ip);
+    if (instruction == NULL)
+        fprintf(out, "Unknown opcode: %d", record->code);
+    else
+    {
+        fprintf(out, "%s", instruction->name);
+        if (block != NULL && record->ip + 1 + instruction->arity * 4 <= size)
+        {
+            for (int i = 0; i < instruction->arity; i++)
+                fprintf(out, " %d", readOperand(block, record->ip + 1 + i * 4));
+        }
+    }
+    fprintf(out, ": [%d values] #%d\n", record->sp, findId(ids, record->object, 0));
+}
+
+int trace_dump(char *traceName, char *programName, FILE *out)
+{
+    FILE *fp = fopen(traceName, "rb");
+    TraceHeader header;
+
+    if (fp == NULL)
+    {
+        printf("File not found: %s\n", traceName);
+        return 0;
+    }
+    if (fread(&header, sizeof(header), 1, fp) != 1 || memcmp(header.magic, TRACE_MAGIC, 4) != 0 ||
+        header.version != TRACE_VERSION || header.recordSize != sizeof(TraceRecord))
+    {
+        printf("Not a trace: %s\n", traceName);
+        fclose(fp);
+        return 0;
+    }
+
+    unsigned char *block = NULL;
+    int32_t size = 0;
+
+    if (programName != NULL)
+    {
+        block = readProgram(programName, &size);
+        if (block == NULL)
+        {
+            printf("Unable to read: %s\n", programName);
+            fclose(fp);
+            return 0;
+        }
+        if (size != header.programSize || contentHash(block, size) != header.programHash)
+            printf(". Warning: %s is not the traced program\n", programName);
+    }
+
+    uint64_t held = header.count < header.capacity ? header.count : header.capacity;
+    uint64_t first = header.count - held;
+    TraceRecord *records = ALLOCATE(TraceRecord, held);
+
+    /* The ring wraps at capacity so the oldest held record is at first modulo capacity. */
+    uint64_t start = first % header.capacity;
+    int ok = 1;
+
+    fseek(fp, sizeof(TraceHeader) + start * sizeof(TraceRecord), SEEK_SET);
+    if (fread(records, sizeof(TraceRecord), held - start, fp) != held - start)
+        ok = 0;
+    fseek(fp, sizeof(TraceHeader), SEEK_SET);
+    if (ok && start > 0 && fread(records + held - start, sizeof(TraceRecord), start, fp) != start)
+        ok = 0;
+    fclose(fp);
+
+    if (!ok)
+    {
+        printf("Truncated trace: %s\n", traceName);
+        FREE(records);
+        if (block != NULL)
+            FREE(block);
+        return 0;
+    }
+
+    Ids ids;
+    initIds(&ids, INITIAL_IDS);
+    ids.next = 0;
+
+    fprintf(out, ". Trace: %ld records", (long)header.count);
+    if (first > 0)
+        fprintf(out, ", the first %ld overwritten", (long)first);
+    fprintf(out, "\n");
+
+    for (uint64_t i = 0; i < held; i++)
+    {
+        TraceRecord *record = &records[i];
+
+        switch (record->kind)
+        {
+        case TRACE_INSTRUCTION:
+            dumpInstruction(record, &ids, block, size, out);
+            break;
+        case TRACE_ALLOCATION:
+            fprintf(out, "  alloc: %s #%d: %d live\n", typeName(record->code), findId(&ids, record->object, 1), record->heap);
+            break;
+        case TRACE_COLLECTION:
+            fprintf(out, "  gc: collected %d objects, %d remaining\n", record->sp - record->heap, record->heap);
+            break;
+        default:
+            fprintf(out, "  unknown record: %d\n", record->kind);
+            break;
+        }
+    }
+
+    FREE(ids.addresses);
+    FREE(ids.ids);
+    FREE(records);
+    if (block != NULL)
+        FREE(block);
+
+    return 1;
+}
@@ -0,0 +1,72 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+ * A binary execution trace held in a memory-mapped file.  The file is a
+ * TraceHeader followed by a ring of fixed-size records so that, however long
+ * a program runs, the file holds its most recent records.  The header's count
+ * is updated with every record so the file remains readable if the process
+ * dies mid-run.  Records are written in the machine's byte order.
+ */
+
+#define TRACE_MAGIC "BCIT"
+#define TRACE_VERSION 1
+
+typedef enum
+{
+    TRACE_INSTRUCTION,
+    TRACE_ALLOCATION,
+    TRACE_COLLECTION
+} TraceKind;
+
+typedef struct
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t recordSize;
+    int32_t programSize;
+    uint64_t programHash;
+    uint64_t capacity;
+    /* Records written - the last min(count, capacity) are held in the ring. */
+    uint64_t count;
+} TraceHeader;
+
+/*
+ * object is the current activation of an instruction or the new value of an
+ * allocation.  heap is the number of live values, after a collection for a
+ * collection record, whose sp holds the number before.
+ */
+typedef struct
+{
+    uint64_t object;
+    int32_t ip;
+    int32_t sp;
+    int32_t heap;
+    uint8_t kind;
+    uint8_t code;
+    uint16_t reserved;
+} TraceRecord;
+
+typedef struct Trace Trace;
+
+/* capacity is rounded up to a power of two.  Returns NULL if the file cannot be mapped. */
+extern Trace *trace_new(char *fileName, int64_t capacity);
+extern void trace_free(Trace *trace);
+
+/* Identifies the program being traced so that the decoder can check its operands. */
+extern void trace_setProgram(Trace *trace, unsigned char *block, int32_t size);
+
+extern void trace_instruction(Trace *trace, int32_t ip, int opcode, int32_t sp, void *activation);
+extern void trace_allocation(Trace *trace, void *value, int type, int32_t heap);
+extern void trace_collection(Trace *trace, int32_t before, int32_t after);
+
+/*
+ * Renders a trace in the format of the -d debug trace.  Operands are shown
+ * if the program is given.  Returns 0 if either file cannot be read.
+ */
+extern int trace_dump(char *traceName, char *programName, FILE *out);
+
+#endif
@@ -1,22 +1,33 @@
+#include <stdarg.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <string.h>
-#include <sys/time.h>
 
+#include "collector.h"
+#include "gcstats.h"
+#include "memo.h"
 #include "memory.h"
+#include "perf.h"
+#include "snapshot.h"
 #include "stringbuilder.h"
+#include "timer.h"
+#include "trace.h"
 
 #include "value.h"
 
-Value *value_True;
-Value *value_False;
-
 #define DEFAULT_CAPACITY 256
 
-// #define TIME_GC
+/* The number of values in a segment of the heap that is swept as a unit - see Segments. */
+#define SEGMENT_SIZE 4096
+
+/* Segments swept without allocating somewhere to keep track of them. */
+#define SWEEP_UNITS 64
+
 // #define DEBUG_GC
 #define GC_FORCE
 
-static MemoryState internalMM;
+/* The id of the next heap to be created - see Colour. */
+static atomic_uint nextHeap = 1;
 
 static int activationDepth(Value *v)
 {
@@ -113,17 +124,38 @@ char *value_toString(Value *v)
     }
 }
 
-MemoryState value_newMemoryManager(int initialStackSize)
+static MemoryState newMemoryManager(int initialStackSize)
 {
     MemoryState mm;
 
-    mm.colour = VWhite;
+    mm.colour = atomic_fetch_add_explicit(&nextHeap, 1, memory_order_relaxed) << 1;
 
     mm.size = 0;
     mm.capacity = DEFAULT_CAPACITY;
 
+    mm.bytes = sizeof(Value *) * initialStackSize;
+    bci_defaultLimits(&mm.limits);
+
+    mm.allocations = 0;
+    mm.collections = 0;
+    mm.gcTime = 0;
+    mm.trace = NULL;
+    mm.gcStats = NULL;
+    mm.snapshot = NULL;
+    mm.perf = NULL;
+    mm.memo = NULL;
+    mm.collector = NULL;
+
     mm.root = NULL;
+    mm.segments.swept = NULL;
+    mm.segments.sweptCount = 0;
+    mm.segments.sweptCapacity = 0;
+    mm.segments.allocated = NULL;
+    mm.segments.allocatedCount = 0;
+    mm.segments.allocatedCapacity = 0;
+    mm.segments.sinceAllocated = 0;
     mm.activation = NULL;
+    mm.free = NULL;
 
     mm.sp = 0;
     mm.stackSize = initialStackSize;
@@ -132,24 +164,123 @@ MemoryState value_newMemoryManager(int initialStackSize)
     for (int i = 0; i < initialStackSize; i++)
         mm.stack[i] = NULL;
 
+    mm.trueValue = NULL;
+    mm.falseValue = NULL;
+
+    mm.errorHandler = NULL;
+    mm.errorStatus = BCI_OK;
+    mm.errorMessage[0] = '\0';
+
+    return mm;
+}
+
+MemoryState value_newMemoryManager(int initialStackSize)
+{
+    MemoryState mm = newMemoryManager(initialStackSize);
+
+    mm.trueValue = value_newBool(1, &mm);
+    mm.falseValue = value_newBool(0, &mm);
+    popN(2, &mm);
+
     return mm;
 }
 
+MemoryState value_newSharedMemoryManager(MemoryState *shared, int initialStackSize)
+{
+    MemoryState mm = newMemoryManager(initialStackSize);
+
+    mm.limits = shared->limits;
+    mm.trueValue = shared->trueValue;
+    mm.falseValue = shared->falseValue;
+
+    return mm;
+}
+
+/* Releasing a finished run's heap is not one of its collections so is neither counted, measured nor snapshotted. */
+void value_resetMemoryManager(MemoryState *mm)
+{
+    struct GcStats *gcStats = mm->gcStats;
+    struct Snapshot *snapshot = mm->snapshot;
+    struct Perf *perf = mm->perf;
+
+    mm->sp = 0;
+    mm->activation = NULL;
+    if (mm->memo != NULL)
+        memo_clear(mm->memo);
+
+    mm->gcStats = NULL;
+    mm->snapshot = NULL;
+    mm->perf = NULL;
+    forceGC(mm);
+    mm->gcStats = gcStats;
+    mm->snapshot = snapshot;
+    mm->perf = perf;
+}
+
 void value_destroyMemoryManager(MemoryState *mm)
 {
     mm->stackSize = 0;
     mm->sp = 0;
     mm->activation = NULL;
+    mm->trueValue = NULL;
+    mm->falseValue = NULL;
+    mm->gcStats = NULL;
+    mm->snapshot = NULL;
+    mm->perf = NULL;
+    mm->memo = NULL;
+    mm->collector = NULL;
 
     forceGC(mm);
 
+    while (mm->free != NULL)
+    {
+        Value *v = mm->free;
+        mm->free = v->next;
+        FREE(v);
+    }
+
+    if (mm->segments.swept != NULL)
+        FREE(mm->segments.swept);
+    if (mm->segments.allocated != NULL)
+        FREE(mm->segments.allocated);
+
     FREE(mm->stack);
 }
 
+void value_raise(MemoryState *mm, BciStatus status, const char *format, ...)
+{
+    va_list args;
+
+    va_start(args, format);
+    vsnprintf(mm->errorMessage, BCI_ERROR_MESSAGE_SIZE, format, args);
+    va_end(args);
+
+    mm->errorStatus = status;
+
+    if (mm->errorHandler == NULL)
+    {
+        printf("%s\n", mm->errorMessage);
+        exit(1);
+    }
+
+    longjmp(*mm->errorHandler, 1);
+}
+
+static void reserveBytes(int64_t bytes, MemoryState *mm)
+{
+    if (mm->bytes + bytes > mm->limits.heapBytes)
+    {
+        value_raise(mm, BCI_ERROR_LIMIT, "Run: heap byte limit exceeded: %ld bytes", (long)mm->limits.heapBytes);
+    }
+}
+
 void push(Value *value, MemoryState *mm)
 {
     if (mm->sp == mm->stackSize)
     {
+        reserveBytes(sizeof(Value *) * mm->stackSize, mm);
+
+        mm->bytes += sizeof(Value *) * mm->stackSize;
         mm->stackSize *= 2;
         mm->stack = REALLOCATE(mm->stack, Value *, mm->stackSize);
 
@@ -164,8 +295,7 @@ Value *pop(MemoryState *mm)
 {
     if (mm->sp == 0)
     {
-        printf("Run: pop: stack is empty\n");
-        exit(1);
+        value_raise(mm, BCI_ERROR_STACK, "Run: pop: stack is empty");
     }
 
     return mm->stack[--mm->sp];
@@ -175,8 +305,7 @@ void popN(int n, MemoryState *mm)
 {
     if (mm->sp < n)
     {
-        printf("Run: popN: stack is too small\n");
-        exit(1);
+        value_raise(mm, BCI_ERROR_STACK, "Run: popN: stack is too small");
     }
 
     mm->sp -= n;
@@ -186,48 +315,24 @@ Value *peek(int offset, MemoryState *mm)
 {
     if (mm->sp <= offset)
     {
-        printf("Run: peek: stack is too small\n");
-        exit(1);
+        value_raise(mm, BCI_ERROR_STACK, "Run: peek: stack is too small");
     }
 
     return mm->stack[mm->sp - 1 - offset];
 }
 
-long long timeInMilliseconds(void)
+static void setColour(Value *v, Colour colour)
 {
-    struct timeval tv;
-
-    gettimeofday(&tv, NULL);
-    return (((long long)tv.tv_sec) * 1000) + (tv.tv_usec / 1000);
+    atomic_store_explicit(&v->colour, colour, memory_order_relaxed);
 }
 
+/* A value that is already marked, or that is not in this heap, has neither this colour nor its pair. */
 static void mark(Value *v, Colour colour)
 {
-    if (v == NULL)
-        return;
-
-    if (value_getColour(v) == colour)
+    if (v == NULL || value_getColour(v) != (colour ^ 1))
         return;
 
-#ifdef DEBUG_GC
-    ValueType oldValueType = value_getType(v);
-    Colour oldColour = value_getColour(v);
-#endif
-
-    v->type = (value_getType(v) & 7) | colour;
-
-#ifdef DEBUG_GC
-    if (oldValueType != value_getType(v))
-    {
-        printf("gc: mark: type changed.\n");
-        exit(1);
-    }
-    else if (oldColour == value_getColour(v))
-    {
-        printf("gc: mark: colour did not change.\n");
-        exit(1);
-    }
-#endif
+    setColour(v, colour);
 
 #ifdef DEBUG_GC
     char *s = value_toString(v);
@@ -251,40 +356,110 @@ static void mark(Value *v, Colour colour)
     }
 }
 
-static void sweep(MemoryState *mm)
+typedef struct
+{
+    MemoryState *mm;
+    Colour colour;
+    int32_t threads;
+} MarkContext;
+
+/* Claims v for the calling thread, which then scans it, if no other thread has yet marked it. */
+static void shade(CollectorThread *thread, Value *v, Colour colour)
+{
+    Colour unmarked = colour ^ 1;
+
+    if (v != NULL && atomic_compare_exchange_strong_explicit(&v->colour, &unmarked, colour, memory_order_relaxed, memory_order_relaxed))
+        collector_push(thread, v);
+}
+
+static void markOnThread(void *context, CollectorThread *thread)
 {
+    MarkContext *marking = (MarkContext *)context;
+    MemoryState *mm = marking->mm;
+    Colour colour = marking->colour;
+    int32_t id = collector_id(thread);
+
+    if (id == 0)
+    {
+        shade(thread, mm->activation, colour);
+        shade(thread, mm->trueValue, colour);
+        shade(thread, mm->falseValue, colour);
+    }
+    for (int i = id; i < mm->sp; i += marking->threads)
+        shade(thread, mm->stack[i], colour);
+
     Value *v;
-#ifdef DEBUG_GC
-    v = mm->root;
-    while (v != NULL)
+    while ((v = collector_take(thread)) != NULL)
     {
-        Value *nextV = v->next;
-        if (value_getColour(v) != mm->colour)
+        if (value_getType(v) == VActivation)
         {
-            char *s = value_toString(v);
-            printf("gc: releasing %s\n", s);
-            FREE(s);
+            shade(thread, v->data.a.parentActivation, colour);
+            shade(thread, v->data.a.closure, colour);
+            if (v->data.a.state != NULL)
+            {
+                for (int i = 0; i < v->data.a.stateSize; i++)
+                    shade(thread, v->data.a.state[i], colour);
+            }
+        }
+        else if (value_getType(v) == VClosure)
+        {
+            shade(thread, v->data.c.previousActivation, colour);
         }
-        v = nextV;
     }
-#endif
+}
 
-    Value *newRoot = NULL;
-    int newSize = 0;
+/* A run of the heap's list, from start up to but excluding end, and what sweeping it leaves. */
+typedef struct
+{
+    Value *start;
+    Value *end;
+
+    Value *live;
+    Value *liveTail;
+    int32_t liveSize;
+    Value *freed;
+    Value *freedTail;
+    /* What a unit swept in parallel frees is tallied here and added up once every unit is swept. */
+    int64_t freedObjects[VActivation + 1];
+    int64_t freedBytes[VActivation + 1];
+} SweepUnit;
+
+typedef struct
+{
+    SweepUnit *units;
+    int32_t count;
+    Colour live;
+    atomic_int next;
+} SweepContext;
 
-    v = mm->root;
-    while (v != NULL)
+static void sweepUnit(SweepUnit *unit, Colour live, int64_t *freedObjects, int64_t *freedBytes)
+{
+    unit->live = NULL;
+    unit->liveTail = NULL;
+    unit->liveSize = 0;
+    unit->freed = NULL;
+    unit->freedTail = NULL;
+
+    Value *v = unit->start;
+    while (v != unit->end)
     {
         Value *nextV = v->next;
-        if (value_getColour(v) == mm->colour)
+        if (value_getColour(v) == live)
         {
-            v->next = newRoot;
-            newRoot = v;
-            newSize++;
+            if (unit->live == NULL)
+                unit->liveTail = v;
+            v->next = unit->live;
+            unit->live = v;
+            unit->liveSize++;
         }
         else
         {
-            switch (value_getType(v))
+            int type = value_getType(v);
+
+            freedObjects[type]++;
+            freedBytes[type] += sizeof(Value);
+
+            switch (type)
             {
             case VInt:
             case VBool:
@@ -302,6 +477,7 @@ static void sweep(MemoryState *mm)
             case VActivation:
                 if (v->data.a.state != NULL)
                 {
+                    freedBytes[type] += sizeof(Value *) * v->data.a.stateSize;
                     FREE(v->data.a.state);
                 }
 #ifdef DEBUG_GC
@@ -314,21 +490,178 @@ static void sweep(MemoryState *mm)
                 break;
             }
             v->type = 0;
+            setColour(v, 0);
 
-            FREE(v);
+            if (unit->freed == NULL)
+                unit->freedTail = v;
+            v->next = unit->freed;
+            unit->freed = v;
         }
         v = nextV;
     }
+}
+
+static void sweepOnThread(void *context, CollectorThread *thread)
+{
+    SweepContext *sweeping = (SweepContext *)context;
+    int32_t i;
+
+    (void)thread;
+
+    while ((i = atomic_fetch_add(&sweeping->next, 1)) < sweeping->count)
+    {
+        SweepUnit *unit = &sweeping->units[i];
+
+        for (int type = 0; type <= VActivation; type++)
+        {
+            unit->freedObjects[type] = 0;
+            unit->freedBytes[type] = 0;
+        }
+        sweepUnit(unit, sweeping->live, unit->freedObjects, unit->freedBytes);
+    }
+}
+
+static void appendSegment(Value ***segments, int32_t *count, int32_t *capacity, Value *v)
+{
+    if (*count == *capacity)
+    {
+        *capacity = *capacity == 0 ? 16 : *capacity * 2;
+        *segments = REALLOCATE(*segments, Value *, *capacity);
+    }
+    (*segments)[(*count)++] = v;
+}
+
+static void clearSegments(Segments *segments)
+{
+    segments->sweptCount = 0;
+    segments->allocatedCount = 0;
+    segments->sinceAllocated = 0;
+}
+
+static void startUnit(SweepUnit *units, int32_t *count, Value *start)
+{
+    if (*count > 0)
+    {
+        if (units[*count - 1].start == start)
+            return;
+        units[*count - 1].end = start;
+    }
+    units[*count].start = start;
+    units[*count].end = NULL;
+    (*count)++;
+}
+
+/* Splits the heap's list into units at its segments' starts, returning the number of units. */
+static int32_t sweepUnits(MemoryState *mm, SweepUnit *units)
+{
+    Segments *segments = &mm->segments;
+    int32_t count = 0;
 
-#ifdef TIME_GC
-    if (mm->size != newSize)
+    if (mm->root == NULL)
+        return 0;
+
+    startUnit(units, &count, mm->root);
+    for (int i = segments->allocatedCount - 1; i >= 0; i--)
+        startUnit(units, &count, segments->allocated[i]);
+    for (int i = 0; i < segments->sweptCount; i++)
+        startUnit(units, &count, segments->swept[i]);
+
+    return count;
+}
+
+/*
+ * Tallies what is released by type into freedObjects and freedBytes.  The
+ * values that survive are left in segments of about SEGMENT_SIZE.
+ */
+static void sweep(MemoryState *mm, int parallel, int64_t *freedObjects, int64_t *freedBytes)
+{
+#ifdef DEBUG_GC
+    Value *v = mm->root;
+    while (v != NULL)
     {
-        printf("gc: collected %d objects, %d remaining\n", mm->size - newSize, newSize);
+        Value *nextV = v->next;
+        if (value_getColour(v) != mm->colour)
+        {
+            char *s = value_toString(v);
+            printf("gc: releasing %s\n", s);
+            FREE(s);
+        }
+        v = nextV;
     }
 #endif
 
-    mm->root = newRoot;
-    mm->size = newSize;
+    SweepUnit local[SWEEP_UNITS];
+    int32_t capacity = 1 + mm->segments.allocatedCount + mm->segments.sweptCount;
+    SweepUnit *units = capacity <= SWEEP_UNITS ? local : ALLOCATE(SweepUnit, capacity);
+    int32_t count = sweepUnits(mm, units);
+
+    parallel = parallel && count > 1;
+    if (parallel)
+    {
+        SweepContext sweeping;
+
+        sweeping.units = units;
+        sweeping.count = count;
+        sweeping.live = mm->colour;
+        atomic_init(&sweeping.next, 0);
+        collector_run(mm->collector, sweepOnThread, &sweeping);
+    }
+    else
+    {
+        for (int i = 0; i < count; i++)
+            sweepUnit(&units[i], mm->colour, freedObjects, freedBytes);
+    }
+
+    Value *tail = NULL;
+    int32_t fill = SEGMENT_SIZE;
+
+    mm->root = NULL;
+    mm->size = 0;
+    clearSegments(&mm->segments);
+    for (int i = 0; i < count; i++)
+    {
+        SweepUnit *unit = &units[i];
+
+        if (parallel)
+        {
+            for (int type = 0; type <= VActivation; type++)
+            {
+                freedObjects[type] += unit->freedObjects[type];
+                freedBytes[type] += unit->freedBytes[type];
+            }
+        }
+        if (unit->freed != NULL)
+        {
+            unit->freedTail->next = mm->free;
+            mm->free = unit->freed;
+        }
+
+        if (unit->live == NULL)
+            continue;
+
+        if (tail == NULL)
+            mm->root = unit->live;
+        else
+            tail->next = unit->live;
+        tail = unit->liveTail;
+
+        /* Runs of small units are merged so that segments stay close to SEGMENT_SIZE. */
+        if (fill + unit->liveSize > SEGMENT_SIZE)
+        {
+            appendSegment(&mm->segments.swept, &mm->segments.sweptCount, &mm->segments.sweptCapacity, unit->live);
+            fill = 0;
+        }
+        fill += unit->liveSize;
+        mm->size += unit->liveSize;
+    }
+    if (tail != NULL)
+        tail->next = NULL;
+
+    for (int type = 0; type <= VActivation; type++)
+        mm->bytes -= freedBytes[type];
+
+    if (units != local)
+        FREE(units);
 
 #ifdef DEBUG_GC
     v = mm->root;
@@ -349,36 +682,119 @@ void forceGC(MemoryState *mm)
     printf("gc: forcing garbage collection ------------------------------\n");
 #endif
 
-#ifdef TIME_GC
-    long long start = timeInMilliseconds();
-#endif
+    if (mm->perf != NULL)
+        perf_start(mm->perf, PERF_MARK);
+
+    int64_t startTime = timer_now();
+    int size = mm->size;
+    Colour newColour = mm->colour ^ 1;
 
-    Colour newColour = (mm->colour == VWhite) ? VBlack : VWhite;
+    int parallel = mm->collector != NULL && collector_threads(mm->collector) > 1 && mm->size >= collector_threshold(mm->collector);
 
-    if (mm->activation != NULL)
+    if (parallel)
     {
-        mark(mm->activation, newColour);
+        MarkContext marking;
+
+        marking.mm = mm;
+        marking.colour = newColour;
+        marking.threads = collector_threads(mm->collector);
+        collector_run(mm->collector, markOnThread, &marking);
     }
-    for (int i = 0; i < mm->sp; i++)
+    else
     {
-        mark(mm->stack[i], newColour);
+        if (mm->activation != NULL)
+        {
+            mark(mm->activation, newColour);
+        }
+        mark(mm->trueValue, newColour);
+        mark(mm->falseValue, newColour);
+        for (int i = 0; i < mm->sp; i++)
+        {
+            mark(mm->stack[i], newColour);
+        }
     }
 
     mm->colour = newColour;
+    if (mm->memo != NULL)
+        memo_sweep(mm->memo, newColour);
+
+    int64_t markTime = timer_now();
+
+    if (mm->perf != NULL)
+    {
+        perf_stop(mm->perf, PERF_MARK);
+        perf_start(mm->perf, PERF_SWEEP);
+    }
+    int64_t freedObjects[VActivation + 1] = {0, 0, 0, 0};
+    int64_t freedBytes[VActivation + 1] = {0, 0, 0, 0};
 
-#ifdef TIME_GC
-    long long endMark = timeInMilliseconds();
-#endif
 #ifdef DEBUG_GC
     printf("gc: sweeping\n");
 #endif
-    sweep(mm);
+    sweep(mm, parallel, freedObjects, freedBytes);
 
-#ifdef TIME_GC
-    long long endSweep = timeInMilliseconds();
+    int64_t endTime = timer_now();
 
-    printf("gc: mark took %lldms, sweep took %lldms\n", endMark - start, endSweep - endMark);
-#endif
+    if (mm->perf != NULL)
+        perf_stop(mm->perf, PERF_SWEEP);
+
+    mm->collections++;
+    mm->gcTime += endTime - startTime;
+
+    if (mm->gcStats != NULL)
+        gcstats_collect(mm->gcStats, size, mm->size, markTime - startTime, endTime - markTime, freedObjects, freedBytes);
+    if (mm->snapshot != NULL)
+        snapshot_collected(mm->snapshot, mm);
+
+    if (mm->trace != NULL)
+        trace_collection(mm->trace, size, mm->size);
+}
+
+void value_detach(MemoryState *mm, Value *root, DetachedValues *values)
+{
+    mm->sp = 0;
+    mm->activation = NULL;
+    push(root, mm);
+    forceGC(mm);
+    mm->sp = 0;
+
+    values->root = mm->root;
+    values->size = mm->size;
+    values->bytes = 0;
+    for (Value *v = mm->root; v != NULL; v = v->next)
+    {
+        values->bytes += sizeof(Value);
+        if (value_getType(v) == VActivation && v->data.a.state != NULL)
+            values->bytes += sizeof(Value *) * v->data.a.stateSize;
+    }
+
+    mm->root = NULL;
+    mm->size = 0;
+    mm->bytes -= values->bytes;
+    clearSegments(&mm->segments);
+}
+
+void value_adopt(MemoryState *mm, DetachedValues *values)
+{
+    Value *last = NULL;
+
+    for (Value *v = values->root; v != NULL; v = v->next)
+    {
+        setColour(v, mm->colour);
+        last = v;
+    }
+
+    if (last != NULL)
+    {
+        last->next = mm->root;
+        mm->root = values->root;
+    }
+    mm->size += values->size;
+    mm->bytes += values->bytes;
+
+    values->root = NULL;
+    values->size = 0;
+    values->bytes = 0;
 }
 
 static void gc(MemoryState *mm)
@@ -399,36 +815,75 @@ static void gc(MemoryState *mm)
         }
     }
 #endif
+
+    /* Only collect again when a limit would otherwise be reached. */
+    if (mm->size >= mm->limits.heapObjects || mm->bytes + (int64_t)sizeof(Value) > mm->limits.heapBytes)
+    {
+        forceGC(mm);
+
+        if (mm->size >= mm->limits.heapObjects)
+        {
+            value_raise(mm, BCI_ERROR_LIMIT, "Run: heap object limit exceeded: %ld objects", (long)mm->limits.heapObjects);
+        }
+        reserveBytes(sizeof(Value), mm);
+    }
+}
+
+static Value *newValue(MemoryState *mm)
+{
+    Value *v = mm->free;
+
+    if (v == NULL)
+        return ALLOCATE(Value, 1);
+
+    mm->free = v->next;
+    return v;
 }
 
 static void attachValue(Value *v, MemoryState *mm)
 {
+    mm->allocations++;
     mm->size++;
+    mm->bytes += sizeof(Value);
     v->next = mm->root;
     mm->root = v;
+
+    if (++mm->segments.sinceAllocated == SEGMENT_SIZE)
+    {
+        appendSegment(&mm->segments.allocated, &mm->segments.allocatedCount, &mm->segments.allocatedCapacity, v);
+        mm->segments.sinceAllocated = 0;
+    }
+
+    if (mm->trace != NULL)
+        trace_allocation(mm->trace, v, value_getType(v), mm->size);
+    if (mm->gcStats != NULL)
+        gcstats_allocate(mm->gcStats, value_getType(v), 1, sizeof(Value), mm);
 }
 
 Value *value_newInt(int i, MemoryState *mm)
 {
     gc(mm);
 
-    Value *v = ALLOCATE(Value, 1);
-    v->type = VInt | mm->colour;
+    Value *v = newValue(mm);
+    v->type = VInt;
+    setColour(v, mm->colour);
     v->data.i = i;
 
-    push(v, mm);
-
+    /* Attached first as push can raise on growing the stack. */
     attachValue(v, mm);
 
+    push(v, mm);
+
     return v;
 }
 Value *value_newBool(int b, MemoryState *mm)
 {
     gc(mm);
 
-    Value *v = ALLOCATE(Value, 1);
+    Value *v = newValue(mm);
 
-    v->type = VBool | mm->colour;
+    v->type = VBool;
+    setColour(v, mm->colour);
     v->data.b = b;
     attachValue(v, mm);
 
@@ -443,13 +898,13 @@ Value *value_newClosure(Value *previousActivation, int ip, MemoryState *mm)
 
     if (previousActivation != NULL && value_getType(previousActivation) != VActivation)
     {
-        printf("Error: value_newClosure: previousActivation is not an activation: %s\n", value_toString(previousActivation));
-        exit(1);
+        value_raise(mm, BCI_ERROR_TYPE_MISMATCH, "Error: value_newClosure: previousActivation is not an activation");
     }
 
-    Value *v = ALLOCATE(Value, 1);
+    Value *v = newValue(mm);
 
-    v->type = VClosure | mm->colour;
+    v->type = VClosure;
+    setColour(v, mm->colour);
     v->data.c.previousActivation = previousActivation;
     v->data.c.ip = ip;
     attachValue(v, mm);
@@ -465,18 +920,17 @@ Value *value_newActivation(Value *parentActivation, Value *closure, int nextIp,
 
     if (parentActivation != NULL && value_getType(parentActivation) != VActivation)
     {
-        printf("Error: value_newActivation: parentActivation is not an activation: %s\n", value_toString(parentActivation));
-        exit(1);
+        value_raise(mm, BCI_ERROR_TYPE_MISMATCH, "Error: value_newActivation: parentActivation is not an activation");
     }
     if (closure != NULL && value_getType(closure) != VClosure)
     {
-        printf("Error: value_newActivation: closure is not a closure: %s\n", value_toString(closure));
-        exit(1);
+        value_raise(mm, BCI_ERROR_TYPE_MISMATCH, "Error: value_newActivation: closure is not a closure");
     }
 
-    Value *v = ALLOCATE(Value, 1);
+    Value *v = newValue(mm);
 
-    v->type = VActivation | mm->colour;
+    v->type = VActivation;
+    setColour(v, mm->colour);
     v->data.a.parentActivation = parentActivation;
     v->data.a.closure = closure;
     v->data.a.nextIP = nextIp;
@@ -490,28 +944,37 @@ Value *value_newActivation(Value *parentActivation, Value *closure, int nextIp,
     return v;
 }
 
-void value_initialise(void)
+void value_newState(Value *activation, int size, MemoryState *mm)
 {
-    internalMM = value_newMemoryManager(2);
+    int64_t bytes = sizeof(Value *) * (int64_t)size;
 
-    value_True = value_newBool(1, &internalMM);
-    value_False = value_newBool(0, &internalMM);
-}
+    if (mm->bytes + bytes > mm->limits.heapBytes)
+    {
+        forceGC(mm);
+        reserveBytes(bytes, mm);
+    }
 
-void value_finalise(void)
-{
-    value_destroyMemoryManager(&internalMM);
+    activation->data.a.stateSize = size;
+    activation->data.a.state = ALLOCATE(Value *, size);
+    mm->bytes += bytes;
+    if (mm->gcStats != NULL)
+        gcstats_allocate(mm->gcStats, VActivation, 0, bytes, mm);
 
-    value_True = NULL;
-    value_False = NULL;
+    for (int i = 0; i < size; i++)
+        activation->data.a.state[i] = NULL;
 }
 
 ValueType value_getType(Value *v)
 {
-    return v->type & 0x7;
+    return v->type;
 }
 
+/*
+ * A value's colour is only ever changed by its own heap but another heap's
+ * collector reads it to learn that the value is not its own, hence the
+ * relaxed atomics - either colour it reads says as much.
+ */
 Colour value_getColour(Value *v)
 {
-    return v->type & 0x8;
+    return atomic_load_explicit(&v->colour, memory_order_relaxed);
 }
@@ -1,10 +1,18 @@
 #ifndef VALUE_H
 #define VALUE_H
 
-typedef enum {
-    VBlack = 8,
-    VWhite = 0
-} Colour;
+#include <setjmp.h>
+#include <stdatomic.h>
+#include <stdint.h>
+
+#include "vm.h"
+
+/*
+ * Every heap has its own pair of colours, the heap's id shifted left with the
+ * low bit flipped by each collection, so that a value's colour also says
+ * which heap it belongs to.  A collection never marks another heap's values.
+ */
+typedef uint32_t Colour;
 
 typedef enum {
     VInt,
@@ -27,7 +35,8 @@ typedef struct Closure {
 } Closure;
 
 typedef struct Value {
-    Colour colour;
+    /* Read by other heaps' collectors - see value_getColour. */
+    _Atomic Colour colour;
     ValueType type;
     union {
         int i;
@@ -38,28 +47,89 @@ typedef struct Value {
     struct Value *next;
 } Value;
 
+/*
+ * The heap's list of values split into segments which are swept in
+ * parallel.  Each collection leaves the list in segments that start at the
+ * values in swept, in list order, and every SEGMENT_SIZE-th value allocated
+ * since, each of which goes on the front of the list, starts another.
+ */
+typedef struct {
+    Value **swept;
+    int32_t sweptCount;
+    int32_t sweptCapacity;
+
+    Value **allocated;
+    int32_t allocatedCount;
+    int32_t allocatedCapacity;
+    int32_t sinceAllocated;
+} Segments;
+
 typedef struct {
     Colour colour;
 
     int size;
     int capacity;
 
+    /* Bytes held by live values, activation state and the stack. */
+    int64_t bytes;
+    BciLimits limits;
+
+    int64_t allocations;
+    int64_t collections;
+    int64_t gcTime;
+
+    /* Receives allocations and collections if not NULL - see trace.h. */
+    struct Trace *trace;
+    /* Collector telemetry if not NULL - see gcstats.h. */
+    struct GcStats *gcStats;
+    /* Takes heap snapshots if not NULL - see snapshot.h. */
+    struct Snapshot *snapshot;
+    /* Counts hardware events while collecting if not NULL - see perf.h. */
+    struct Perf *perf;
+    /* Caches call results if not NULL - see memo.h. */
+    struct Memo *memo;
+    /* Marks and sweeps large heaps on several threads if not NULL - see collector.h. */
+    struct Collector *collector;
+
     Value *root;
+    Segments segments;
     Value *activation;
 
+    /* Swept values retained for reuse so that a heap stays warm across runs. */
+    Value *free;
+
     int32_t sp;
     int32_t stackSize;
     Value **stack;
+
+    Value *trueValue;
+    Value *falseValue;
+
+    jmp_buf *errorHandler;
+    BciStatus errorStatus;
+    char errorMessage[BCI_ERROR_MESSAGE_SIZE];
 } MemoryState;
 
-extern Value *value_True;
-extern Value *value_False;
+/* Values detached from one heap so that they can be adopted by another. */
+typedef struct {
+    Value *root;
+    int size;
+    int64_t bytes;
+} DetachedValues;
 
 extern char *value_toString(Value *v);
 
 extern MemoryState value_newMemoryManager(int initialStackSize);
+/*
+ * A heap for another thread that reads, but never marks or frees, the values
+ * of shared.  Its bools and limits are shared's.
+ */
+extern MemoryState value_newSharedMemoryManager(MemoryState *shared, int initialStackSize);
+extern void value_resetMemoryManager(MemoryState *mm);
 extern void value_destroyMemoryManager(MemoryState *mm);
 
+extern void value_raise(MemoryState *mm, BciStatus status, const char *format, ...);
+
 extern void push(Value *value, MemoryState *mm);
 extern Value *pop(MemoryState *mm);
 extern void popN(int n, MemoryState *mm);
@@ -67,13 +137,15 @@ extern Value *peek(int offset, MemoryState *mm);
 
 extern void forceGC(MemoryState *mm);
 
+/* Collects everything but the values reachable from root and detaches those that remain from the heap. */
+extern void value_detach(MemoryState *mm, Value *root, DetachedValues *values);
+extern void value_adopt(MemoryState *mm, DetachedValues *values);
+
 extern Value *value_newInt(int i, MemoryState *mm);
 extern Value *value_newBool(int b, MemoryState *mm);
 extern Value *value_newClosure(Value *previousActivation, int ip, MemoryState *mm);
 extern Value *value_newActivation(Value *parentActivation, Value *closure, int nextIp, MemoryState *mm);
-
-extern void value_initialise(void);
-extern void value_finalise(void);
+extern void value_newState(Value *activation, int size, MemoryState *mm);
 
 extern ValueType value_getType(Value *v);
 extern Colour value_getColour(Value *v);
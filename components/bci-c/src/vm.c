@@ -0,0 +1,311 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "memory.h"
+#include "run.h"
+#include "trace.h"
+#include "value.h"
+
+#include "vm.h"
+
+#define DEFAULT_STACK_SIZE 256
+
+struct BciVM
+{
+    unsigned char *block;
+    int32_t size;
+    int ownsBlock;
+
+    MemoryState memoryState;
+    struct State *state;
+
+    BciResult result;
+    BciUsage usage;
+    struct Profile *profile;
+    int32_t threads;
+    char errorMessage[BCI_ERROR_MESSAGE_SIZE];
+};
+
+static void resetResult(BciVM *vm)
+{
+    if (vm->result.text != NULL)
+        FREE(vm->result.text);
+
+    vm->result.type = BCI_RESULT_NONE;
+    vm->result.value = 0;
+    vm->result.text = NULL;
+    vm->errorMessage[0] = '\0';
+}
+
+static void stop(BciVM *vm)
+{
+    if (vm->state != NULL)
+        run_free(vm->state);
+
+    vm->state = NULL;
+}
+
+static void unload(BciVM *vm)
+{
+    stop(vm);
+
+    if (vm->block != NULL && vm->ownsBlock)
+        FREE(vm->block);
+
+    vm->block = NULL;
+    vm->size = 0;
+    vm->ownsBlock = 0;
+}
+
+BciVM *bci_newVM(void)
+{
+    BciVM *vm = ALLOCATE(BciVM, 1);
+
+    vm->block = NULL;
+    vm->size = 0;
+    vm->ownsBlock = 0;
+    vm->memoryState = value_newMemoryManager(DEFAULT_STACK_SIZE);
+    vm->state = NULL;
+    vm->result.text = NULL;
+    resetResult(vm);
+
+    vm->usage.instructions = 0;
+    vm->usage.heapObjects = 0;
+    vm->usage.heapBytes = 0;
+    vm->usage.depth = 0;
+    vm->usage.stack = 0;
+    vm->usage.allocations = 0;
+    vm->usage.collections = 0;
+    vm->usage.gcTime = 0;
+    vm->profile = NULL;
+    vm->threads = 1;
+
+    return vm;
+}
+
+void bci_freeVM(BciVM *vm)
+{
+    resetResult(vm);
+    unload(vm);
+    value_destroyMemoryManager(&vm->memoryState);
+    FREE(vm);
+}
+
+BciStatus bci_load(BciVM *vm, unsigned char *block, int32_t size)
+{
+    resetResult(vm);
+    unload(vm);
+
+    vm->block = ALLOCATE(unsigned char, size);
+    vm->size = size;
+    vm->ownsBlock = 1;
+    memcpy(vm->block, block, size);
+
+    return BCI_OK;
+}
+
+BciStatus bci_loadShared(BciVM *vm, unsigned char *block, int32_t size)
+{
+    resetResult(vm);
+    unload(vm);
+
+    vm->block = block;
+    vm->size = size;
+
+    return BCI_OK;
+}
+
+BciStatus bci_loadFile(BciVM *vm, char *fileName)
+{
+    resetResult(vm);
+    unload(vm);
+
+    FILE *fp = fopen(fileName, "rb");
+    if (fp == NULL)
+    {
+        snprintf(vm->errorMessage, BCI_ERROR_MESSAGE_SIZE, "File not found: %s", fileName);
+        return BCI_ERROR_LOAD;
+    }
+
+    fseek(fp, 0, SEEK_END);
+    size_t size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+
+    unsigned char *block = ALLOCATE(unsigned char, size);
+    if (fread(block, 1, size, fp) != size)
+    {
+        fclose(fp);
+        FREE(block);
+        snprintf(vm->errorMessage, BCI_ERROR_MESSAGE_SIZE, "Unable to read: %s", fileName);
+        return BCI_ERROR_LOAD;
+    }
+    fclose(fp);
+
+    vm->block = block;
+    vm->size = size;
+    vm->ownsBlock = 1;
+
+    return BCI_OK;
+}
+
+unsigned char *bci_block(BciVM *vm)
+{
+    return vm->block;
+}
+
+int32_t bci_blockSize(BciVM *vm)
+{
+    return vm->size;
+}
+
+void bci_defaultLimits(BciLimits *limits)
+{
+    limits->instructions = BCI_UNLIMITED;
+    limits->heapObjects = BCI_UNLIMITED;
+    limits->heapBytes = BCI_UNLIMITED;
+    limits->depth = BCI_UNLIMITED;
+    limits->timeout = BCI_UNLIMITED;
+}
+
+void bci_setLimits(BciVM *vm, BciLimits *limits)
+{
+    vm->memoryState.limits = *limits;
+}
+
+void bci_setProfile(BciVM *vm, struct Profile *profile)
+{
+    vm->profile = profile;
+}
+
+void bci_setTrace(BciVM *vm, struct Trace *trace)
+{
+    vm->memoryState.trace = trace;
+}
+
+void bci_setGcStats(BciVM *vm, struct GcStats *gcStats)
+{
+    vm->memoryState.gcStats = gcStats;
+}
+
+void bci_setSnapshot(BciVM *vm, struct Snapshot *snapshot)
+{
+    vm->memoryState.snapshot = snapshot;
+}
+
+void bci_setPerf(BciVM *vm, struct Perf *perf)
+{
+    vm->memoryState.perf = perf;
+}
+
+void bci_setMemo(BciVM *vm, struct Memo *memo)
+{
+    vm->memoryState.memo = memo;
+}
+
+void bci_setCollector(BciVM *vm, struct Collector *collector)
+{
+    vm->memoryState.collector = collector;
+}
+
+void bci_setParallel(BciVM *vm, int32_t threads)
+{
+    vm->threads = threads;
+}
+
+BciStatus bci_run(BciVM *vm, int debug)
+{
+    BciStatus status = bci_start(vm, debug);
+
+    if (status == BCI_OK)
+        status = bci_resume(vm, BCI_UNLIMITED);
+
+    return status;
+}
+
+BciStatus bci_start(BciVM *vm, int debug)
+{
+    stop(vm);
+    resetResult(vm);
+
+    if (vm->block == NULL)
+    {
+        strcpy(vm->errorMessage, "No program loaded");
+        return BCI_ERROR_NOT_LOADED;
+    }
+
+    if (vm->memoryState.trace != NULL)
+        trace_setProgram(vm->memoryState.trace, vm->block, vm->size);
+
+    vm->state = run_new(vm->block, vm->size, &vm->memoryState, debug, &vm->result, &vm->usage, vm->profile, vm->threads);
+
+    return BCI_OK;
+}
+
+BciStatus bci_resume(BciVM *vm, int64_t budget)
+{
+    if (vm->state == NULL)
+    {
+        strcpy(vm->errorMessage, "No program started");
+        return BCI_ERROR_NOT_LOADED;
+    }
+
+    BciStatus status = run_step(vm->state, budget);
+
+    if (status == BCI_YIELDED)
+        return status;
+
+    if (status != BCI_OK)
+        strcpy(vm->errorMessage, vm->memoryState.errorMessage);
+
+    stop(vm);
+
+    return status;
+}
+
+BciResult *bci_result(BciVM *vm)
+{
+    return &vm->result;
+}
+
+char *bci_errorMessage(BciVM *vm)
+{
+    return vm->errorMessage;
+}
+
+BciUsage *bci_usage(BciVM *vm)
+{
+    return &vm->usage;
+}
+
+char *bci_statusName(BciStatus status)
+{
+    switch (status)
+    {
+    case BCI_OK:
+        return "ok";
+    case BCI_YIELDED:
+        return "yielded";
+    case BCI_ERROR_LOAD:
+        return "load";
+    case BCI_ERROR_NOT_LOADED:
+        return "not-loaded";
+    case BCI_ERROR_INVALID_OPCODE:
+        return "invalid-opcode";
+    case BCI_ERROR_TYPE_MISMATCH:
+        return "type-mismatch";
+    case BCI_ERROR_STACK:
+        return "stack";
+    case BCI_ERROR_ACTIVATION:
+        return "activation";
+    case BCI_ERROR_REQUEST:
+        return "request";
+    case BCI_ERROR_LIMIT:
+        return "limit";
+    case BCI_ERROR_MEMORY:
+        return "memory";
+    case BCI_ERROR_ARITHMETIC:
+        return "arithmetic";
+    default:
+        return "unknown";
+    }
+}
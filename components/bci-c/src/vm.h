@@ -0,0 +1,145 @@
+#ifndef VM_H
+#define VM_H
+
+#include <stdint.h>
+
+#define BCI_ERROR_MESSAGE_SIZE 256
+#define BCI_UNLIMITED INT64_MAX
+
+typedef enum
+{
+    BCI_OK,
+    BCI_YIELDED,
+    BCI_ERROR_LOAD,
+    BCI_ERROR_NOT_LOADED,
+    BCI_ERROR_INVALID_OPCODE,
+    BCI_ERROR_TYPE_MISMATCH,
+    BCI_ERROR_STACK,
+    BCI_ERROR_ACTIVATION,
+    BCI_ERROR_REQUEST,
+    BCI_ERROR_LIMIT,
+    BCI_ERROR_MEMORY,
+    BCI_ERROR_ARITHMETIC
+} BciStatus;
+
+typedef enum
+{
+    BCI_RESULT_NONE,
+    BCI_RESULT_INT,
+    BCI_RESULT_BOOL,
+    BCI_RESULT_CLOSURE,
+    BCI_RESULT_ACTIVATION
+} BciResultType;
+
+typedef struct
+{
+    BciResultType type;
+
+    /* The int or bool value, or the entry IP when the result is a closure. */
+    int32_t value;
+
+    /* The result as rendered by "bci run" - owned by the VM. */
+    char *text;
+} BciResult;
+
+/*
+ * Resource limits enforced while a program runs.  Each limit defaults to
+ * BCI_UNLIMITED.  The instruction limit and deadline are checked on calls and
+ * backward jumps, so a program may overrun them by a straight-line block.
+ * Exceeding a limit aborts the run with BCI_ERROR_LIMIT.
+ */
+typedef struct
+{
+    int64_t instructions;
+    int64_t heapObjects;
+    int64_t heapBytes;
+    int64_t depth;
+
+    /* Wall-clock nanoseconds from bci_start. */
+    int64_t timeout;
+} BciLimits;
+
+/*
+ * Resources in use when a run last stopped, whether it completed or not,
+ * together with the run's allocation and collection totals.
+ */
+typedef struct
+{
+    int64_t instructions;
+    int64_t heapObjects;
+    int64_t heapBytes;
+    int64_t depth;
+    int32_t stack;
+
+    int64_t allocations;
+    int64_t collections;
+    /* Nanoseconds spent collecting. */
+    int64_t gcTime;
+} BciUsage;
+
+typedef struct BciVM BciVM;
+
+/* See gcstats.h, perf.h, profile.h, snapshot.h and trace.h. */
+struct Collector;
+struct GcStats;
+struct Memo;
+struct Perf;
+struct Profile;
+struct Snapshot;
+struct Trace;
+
+/*
+ * Each BciVM owns its program, heap and result.  No mutable state is shared
+ * between VMs so separate VMs may be used concurrently on separate threads.
+ * A single VM must not be used from more than one thread at a time.
+ */
+extern BciVM *bci_newVM(void);
+extern void bci_freeVM(BciVM *vm);
+
+extern BciStatus bci_load(BciVM *vm, unsigned char *block, int32_t size);
+extern BciStatus bci_loadFile(BciVM *vm, char *fileName);
+/* Uses the caller's block without copying - it must outlive its use by the VM. */
+extern BciStatus bci_loadShared(BciVM *vm, unsigned char *block, int32_t size);
+extern unsigned char *bci_block(BciVM *vm);
+extern int32_t bci_blockSize(BciVM *vm);
+
+extern void bci_defaultLimits(BciLimits *limits);
+/* Applies to subsequent runs of the VM. */
+extern void bci_setLimits(BciVM *vm, BciLimits *limits);
+/* Records subsequent runs of the VM into profile, or stops recording if NULL. */
+extern void bci_setProfile(BciVM *vm, struct Profile *profile);
+/* Records subsequent runs of the VM into trace, or stops recording if NULL. */
+extern void bci_setTrace(BciVM *vm, struct Trace *trace);
+/* Records the collector's work on subsequent runs of the VM into gcStats, or stops if NULL. */
+extern void bci_setGcStats(BciVM *vm, struct GcStats *gcStats);
+/* Takes heap snapshots during subsequent runs of the VM, or stops if NULL. */
+extern void bci_setSnapshot(BciVM *vm, struct Snapshot *snapshot);
+/* Counts hardware events during subsequent runs of the VM, or stops if NULL. */
+extern void bci_setPerf(BciVM *vm, struct Perf *perf);
+/* Caches call results during subsequent runs of the VM, or stops if NULL. */
+extern void bci_setMemo(BciVM *vm, struct Memo *memo);
+/*
+ * Evaluates the thunks of SPAWN instructions on threads threads during
+ * subsequent runs of the VM.  With 1, the default, they are evaluated in
+ * place as though they were calls.
+ */
+extern void bci_setParallel(BciVM *vm, int32_t threads);
+/* Collects large heaps on the collector's threads during subsequent runs of the VM, or on the running thread alone if NULL. */
+extern void bci_setCollector(BciVM *vm, struct Collector *collector);
+
+extern BciStatus bci_run(BciVM *vm, int debug);
+
+/*
+ * bci_start prepares the loaded program and bci_resume then executes at most
+ * budget instructions, returning BCI_YIELDED if the program has not yet
+ * completed.  A yielded VM may be resumed on any thread.
+ */
+extern BciStatus bci_start(BciVM *vm, int debug);
+extern BciStatus bci_resume(BciVM *vm, int64_t budget);
+
+extern BciResult *bci_result(BciVM *vm);
+extern char *bci_errorMessage(BciVM *vm);
+extern BciUsage *bci_usage(BciVM *vm);
+extern char *bci_statusName(BciStatus status);
+
+#endif
@@ -0,0 +1,301 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "../src/op.h"
+#include "../src/serve.h"
+#include "../src/vm.h"
+#include "minunit.h"
+
+#define I32(n) ((n) & 0xff), (((n) >> 8) & 0xff), (((n) >> 16) & 0xff), (((n) >> 24) & 0xff)
+
+static unsigned char loadAdd[] = {
+    I32(13), SERVE_LOAD,
+    PUSH_INT, I32(3),
+    PUSH_INT, I32(4),
+    ADD,
+    RET};
+
+static unsigned char loadBad[] = {
+    I32(4), SERVE_LOAD,
+    PUSH_TRUE,
+    PUSH_FALSE,
+    ADD};
+
+/* Modules that would read past their end: a truncated operand, no code at all, a jump out of the module and no RET. */
+static unsigned char loadTruncated[] = {
+    I32(2), SERVE_LOAD,
+    PUSH_INT};
+
+static unsigned char loadEmpty[] = {
+    I32(1), SERVE_LOAD};
+
+static unsigned char loadFarJump[] = {
+    I32(6), SERVE_LOAD,
+    JMP, I32(1000000)};
+
+static unsigned char loadNoReturn[] = {
+    I32(6), SERVE_LOAD,
+    PUSH_INT, I32(1)};
+
+typedef struct
+{
+    Server *server;
+    int in;
+    int out;
+} ServeArgs;
+
+static void *serveMain(void *arg)
+{
+    ServeArgs *args = (ServeArgs *)arg;
+
+    serve_connection(args->server, args->in, args->out);
+    close(args->out);
+
+    return NULL;
+}
+
+static int readFrame(int fd, unsigned char *frame)
+{
+    unsigned char length[4];
+    int32_t got = 0;
+
+    while (got < 4)
+    {
+        ssize_t n = read(fd, length + got, 4 - got);
+        if (n <= 0)
+            return -1;
+        got += n;
+    }
+
+    int32_t size = length[0] | (length[1] << 8) | (length[2] << 16) | (length[3] << 24);
+    got = 0;
+    while (got < size)
+    {
+        ssize_t n = read(fd, frame + got, size - got);
+        if (n <= 0)
+            return -1;
+        got += n;
+    }
+
+    return size;
+}
+
+static void writeRun(int fd, unsigned char *hash)
+{
+    unsigned char request[13] = {I32(9), SERVE_RUN};
+
+    memcpy(request + 5, hash, 8);
+    write(fd, request, sizeof(request));
+}
+
+static char *test_pipelined_requests(void)
+{
+    int requests[2];
+    int responses[2];
+    unsigned char frame[256];
+    unsigned char addHash[8];
+    unsigned char badHash[8];
+    unsigned char unknownHash[8] = {1, 2, 3, 4, 5, 6, 7, 8};
+    pthread_t thread;
+
+    pipe(requests);
+    pipe(responses);
+
+    ServeArgs args = {serve_new(), requests[0], responses[1]};
+    pthread_create(&thread, NULL, serveMain, &args);
+
+    write(requests[1], loadAdd, sizeof(loadAdd));
+    write(requests[1], loadBad, sizeof(loadBad));
+    write(requests[1], loadAdd, sizeof(loadAdd));
+
+    mu_assert_label(readFrame(responses[0], frame) == 9);
+    mu_assert_label(frame[0] == BCI_OK);
+    memcpy(addHash, frame + 1, 8);
+
+    mu_assert_label(readFrame(responses[0], frame) == 9);
+    mu_assert_label(frame[0] == BCI_OK);
+    memcpy(badHash, frame + 1, 8);
+
+    mu_assert_label(readFrame(responses[0], frame) == 9);
+    mu_assert_label(memcmp(addHash, frame + 1, 8) == 0);
+
+    for (int i = 0; i < 3; i++)
+        writeRun(requests[1], addHash);
+    writeRun(requests[1], badHash);
+    writeRun(requests[1], unknownHash);
+    close(requests[1]);
+
+    for (int i = 0; i < 3; i++)
+    {
+        mu_assert_label(readFrame(responses[0], frame) == 6 + 6);
+        mu_assert_label(frame[0] == BCI_OK);
+        mu_assert_label(frame[1] == BCI_RESULT_INT);
+        mu_assert_label(frame[2] == 7);
+        mu_assert_label(memcmp(frame + 6, "7: Int", 6) == 0);
+    }
+
+    mu_assert_label(readFrame(responses[0], frame) > 6);
+    mu_assert_label(frame[0] == BCI_ERROR_TYPE_MISMATCH);
+
+    mu_assert_label(readFrame(responses[0], frame) > 6);
+    mu_assert_label(frame[0] == BCI_ERROR_NOT_LOADED);
+
+    mu_assert_label(readFrame(responses[0], frame) == -1);
+
+    pthread_join(thread, NULL);
+    close(requests[0]);
+    close(responses[0]);
+    serve_free(args.server);
+
+    return NULL;
+}
+
+/* Loads PUSH_INT value RET, leaving its id in id. */
+static int load(int fd, int32_t value, unsigned char *id)
+{
+    unsigned char request[] = {I32(7), SERVE_LOAD, PUSH_INT, I32(value), RET};
+    unsigned char frame[256];
+
+    write(fd, request, sizeof(request));
+    if (readFrame(fd, frame) != 9 || frame[0] != BCI_OK)
+        return 0;
+    memcpy(id, frame + 1, 8);
+
+    return 1;
+}
+
+static BciStatus run(int fd, unsigned char *id)
+{
+    unsigned char frame[256];
+
+    writeRun(fd, id);
+
+    return readFrame(fd, frame) < 6 ? BCI_ERROR_REQUEST : frame[0];
+}
+
+static char *test_eviction(void)
+{
+    int sockets[2];
+    unsigned char first[8];
+    unsigned char last[8];
+    pthread_t thread;
+
+    socketpair(AF_UNIX, SOCK_STREAM, 0, sockets);
+
+    ServeArgs args = {serve_new(), sockets[1], sockets[1]};
+    pthread_create(&thread, NULL, serveMain, &args);
+
+    /* The connection still runs the first module when it is evicted. */
+    mu_assert_label(load(sockets[0], 0, first));
+    mu_assert_label(run(sockets[0], first) == BCI_OK);
+    for (int i = 1; i <= SERVE_MAX_MODULES; i++)
+        mu_assert_label(load(sockets[0], i, last));
+
+    mu_assert_label(run(sockets[0], first) == BCI_ERROR_NOT_LOADED);
+    mu_assert_label(run(sockets[0], last) == BCI_OK);
+    mu_assert_label(load(sockets[0], 0, first));
+    mu_assert_label(run(sockets[0], first) == BCI_OK);
+
+    close(sockets[0]);
+    pthread_join(thread, NULL);
+    serve_free(args.server);
+
+    return NULL;
+}
+
+static char *test_oversized_request(void)
+{
+    int sockets[2];
+    unsigned char request[] = {I32(SERVE_MAX_REQUEST + 1), SERVE_LOAD};
+    unsigned char frame[256];
+    pthread_t thread;
+
+    socketpair(AF_UNIX, SOCK_STREAM, 0, sockets);
+
+    ServeArgs args = {serve_new(), sockets[1], sockets[1]};
+    pthread_create(&thread, NULL, serveMain, &args);
+
+    write(sockets[0], request, sizeof(request));
+    mu_assert_label(readFrame(sockets[0], frame) > 6);
+    mu_assert_label(frame[0] == BCI_ERROR_REQUEST);
+    mu_assert_label(readFrame(sockets[0], frame) == -1);
+
+    pthread_join(thread, NULL);
+    close(sockets[0]);
+    serve_free(args.server);
+
+    return NULL;
+}
+
+/* A module is checked against its size as it runs so a malformed one fails its RUN and the server carries on. */
+static char *test_malformed_modules(void)
+{
+    unsigned char *modules[] = {loadTruncated, loadEmpty, loadFarJump, loadNoReturn};
+    int32_t sizes[] = {sizeof(loadTruncated), sizeof(loadEmpty), sizeof(loadFarJump), sizeof(loadNoReturn)};
+    int sockets[2];
+    unsigned char frame[256];
+    unsigned char id[8];
+    unsigned char add[8];
+    pthread_t thread;
+
+    socketpair(AF_UNIX, SOCK_STREAM, 0, sockets);
+
+    ServeArgs args = {serve_new(), sockets[1], sockets[1]};
+    pthread_create(&thread, NULL, serveMain, &args);
+
+    for (int i = 0; i < 4; i++)
+    {
+        write(sockets[0], modules[i], sizes[i]);
+        mu_assert_label(readFrame(sockets[0], frame) == 9);
+        mu_assert_label(frame[0] == BCI_OK);
+        memcpy(id, frame + 1, 8);
+
+        mu_assert_label(run(sockets[0], id) == BCI_ERROR_INVALID_OPCODE);
+    }
+
+    mu_assert_label(load(sockets[0], 7, add));
+    mu_assert_label(run(sockets[0], add) == BCI_OK);
+
+    close(sockets[0]);
+    pthread_join(thread, NULL);
+    serve_free(args.server);
+
+    return NULL;
+}
+
+/* A client that stops reading ends its connection, not the process, with SIGPIPE. */
+static char *test_client_gone(void)
+{
+    int sockets[2];
+    pthread_t thread;
+
+    socketpair(AF_UNIX, SOCK_STREAM, 0, sockets);
+
+    ServeArgs args = {serve_new(), sockets[1], sockets[1]};
+
+    write(sockets[0], loadAdd, sizeof(loadAdd));
+    write(sockets[0], loadAdd, sizeof(loadAdd));
+    shutdown(sockets[0], SHUT_RD);
+
+    pthread_create(&thread, NULL, serveMain, &args);
+    pthread_join(thread, NULL);
+
+    close(sockets[0]);
+    serve_free(args.server);
+
+    return NULL;
+}
+
+char *serve_tests(void)
+{
+    mu_run_test(test_pipelined_requests);
+    mu_run_test(test_eviction);
+    mu_run_test(test_oversized_request);
+    mu_run_test(test_malformed_modules);
+    mu_run_test(test_client_gone);
+
+    return NULL;
+}
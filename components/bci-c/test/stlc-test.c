@@ -0,0 +1,272 @@
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../src/cache.h"
+#include "../src/op.h"
+#include "../src/stlc.h"
+#include "../src/vm.h"
+#include "minunit.h"
+
+#define I32(n) ((n) & 0xff), (((n) >> 8) & 0xff), (((n) >> 16) & 0xff), (((n) >> 24) & 0xff)
+
+/* Long enough for "function: " and the longest type. */
+#define RESULT_SIZE (sizeof("function: ") + STLC_ERROR_MESSAGE_SIZE)
+
+/* As bci/Compiler.kt compiles it. */
+static char *factorialSource = "let rec factorial n = if (n == 0) 1 else n * (factorial (n - 1)) in factorial 10";
+
+static unsigned char factorial[] = {
+    ENTER, I32(1),
+    PUSH_CLOSURE, I32(31),
+    STORE_VAR, I32(0),
+    PUSH_VAR, I32(0), I32(0),
+    PUSH_INT, I32(10),
+    SWAP_CALL,
+    RET,
+    /* 31: factorial */
+    ENTER, I32(1),
+    STORE_VAR, I32(0),
+    PUSH_VAR, I32(0), I32(0),
+    PUSH_INT, I32(0),
+    EQ,
+    JMP_TRUE, I32(101),
+    PUSH_VAR, I32(0), I32(0),
+    PUSH_VAR, I32(1), I32(0),
+    PUSH_VAR, I32(0), I32(0),
+    PUSH_INT, I32(1),
+    SUB,
+    SWAP_CALL,
+    MUL,
+    JMP, I32(106),
+    /* 101: then */
+    PUSH_INT, I32(1),
+    /* 106: next */
+    RET};
+
+/* Compiles and runs source, rendering its result as the REPL does. */
+static int evaluate(char *source, int parallel, char *result, int32_t size)
+{
+    Stlc stlc;
+
+    if (!stlc_compile(source, parallel, &stlc))
+    {
+        snprintf(result, size, "%s", stlc.errorMessage);
+        return 0;
+    }
+
+    BciVM *vm = bci_newVM();
+    int ok = bci_load(vm, stlc.block, stlc.size) == BCI_OK && bci_run(vm, 0) == BCI_OK;
+
+    if (!ok)
+        snprintf(result, size, "%s", bci_errorMessage(vm));
+    else if (stlc.function)
+        snprintf(result, size, "function: %s", stlc.type);
+    else
+        snprintf(result, size, "%s", bci_result(vm)->text);
+
+    bci_freeVM(vm);
+    stlc_free(&stlc);
+
+    return ok;
+}
+
+static int evaluatesTo(char *source, char *expected)
+{
+    char result[RESULT_SIZE];
+
+    if (!evaluate(source, 0, result, sizeof(result)) || strcmp(result, expected) != 0)
+    {
+        printf("    %s: %s\n", source, result);
+        return 0;
+    }
+
+    return 1;
+}
+
+static int failsWith(char *source, char *expected)
+{
+    Stlc stlc;
+
+    if (stlc_compile(source, 0, &stlc))
+    {
+        stlc_free(&stlc);
+        return 0;
+    }
+    if (strcmp(stlc.errorMessage, expected) != 0)
+    {
+        printf("    %s: %s\n", source, stlc.errorMessage);
+        return 0;
+    }
+
+    return 1;
+}
+
+static char *test_compile_as_kotlin(void)
+{
+    Stlc stlc;
+
+    mu_assert_label(stlc_compile(factorialSource, 0, &stlc));
+    mu_assert_label(stlc.size == sizeof(factorial));
+    mu_assert_label(memcmp(stlc.block, factorial, sizeof(factorial)) == 0);
+    mu_assert_label(strcmp(stlc.type, "Int") == 0);
+    stlc_free(&stlc);
+
+    return NULL;
+}
+
+static char *test_evaluate(void)
+{
+    mu_assert_label(evaluatesTo("(\\a -> \\b -> a + b) 10 20", "30: Int"));
+    mu_assert_label(evaluatesTo("if (True) 1 else 2", "1: Int"));
+    mu_assert_label(evaluatesTo("\\a -> \\b -> a + b", "function: Int -> Int -> Int"));
+    mu_assert_label(evaluatesTo("let add a b = a + b ; incr = add 1 in incr 10", "11: Int"));
+    mu_assert_label(evaluatesTo("let rec fact n = if (n == 0) 1 else n * (fact (n - 1)) in fact", "function: Int -> Int"));
+    mu_assert_label(evaluatesTo("let rec isOdd n = if (n == 0) False else isEven (n - 1); isEven n = if (n == 0) True else isOdd (n - 1) in isOdd 5", "true: Bool"));
+    mu_assert_label(evaluatesTo("9 / 2 == 4", "true: Bool"));
+    mu_assert_label(evaluatesTo("let x = \\a -> a in x", "function: a -> a"));
+    mu_assert_label(evaluatesTo("\\f g x -> f (g x)", "function: (a -> b) -> (c -> a) -> c -> b"));
+    mu_assert_label(evaluatesTo("let x n = let ss b = if (b == n) 1 else 2 in ss 5 in x", "function: Int -> Int"));
+    mu_assert_label(evaluatesTo("let id x = x in if (id True) id 1 else 2 -- a comment", "1: Int"));
+
+    return NULL;
+}
+
+/* The names a declaration, or an operand, binds have slots of their own that a closure can still read. */
+static char *test_let_within_declaration(void)
+{
+    mu_assert_label(evaluatesTo("let x = let y = 3 in y * 2 ; z = let w = 1 in w in x + z", "7: Int"));
+    mu_assert_label(evaluatesTo("let a = let b = 7 in \\x -> b; c = 3 in a 0", "7: Int"));
+    mu_assert_label(evaluatesTo("let rec a = let b = 7 in \\x -> b; c = let d = 3 in d in a c", "7: Int"));
+    mu_assert_label(evaluatesTo("(let a = 7 in \\x -> a) (let c = 3 in c)", "7: Int"));
+
+    return NULL;
+}
+
+static char *test_errors(void)
+{
+    mu_assert_label(failsWith("let x = in x * x", "Syntax Error: expected '(', literal int, True, False, '\\', let, if, identifier but found in at 1:9-10"));
+    mu_assert_label(failsWith("10 + ", "Syntax Error: expected '(', literal int, True, False, '\\', let, if, identifier but found <end-of-stream> at 1:6"));
+    mu_assert_label(failsWith("1 + True", "Unification Mismatch: unable to unify Bool from 1:5-8 with Int"));
+    mu_assert_label(failsWith("if (1) 1 else 2", "Unification Mismatch: unable to unify Int from 1:5 with Bool"));
+    mu_assert_label(failsWith("if (1 + 2) 1 else 2", "Unification Mismatch: unable to unify Int from 1:5-9 with Bool"));
+    mu_assert_label(failsWith("hello", "Unknown Name: hello at 1:1-5"));
+    mu_assert_label(failsWith("\\x -> x x", "Infinite Type: unable to unify V1 with V1 -> V2"));
+
+    return NULL;
+}
+
+static char *test_parallel(void)
+{
+    char *source = "let rec fib n = if (n == 0) 0 else if (n == 1) 1 else (fib (n - 1)) + (fib (n - 2)) in fib 18";
+    char result[RESULT_SIZE];
+    Stlc stlc;
+
+    mu_assert_label(stlc_compile(source, 1, &stlc));
+    mu_assert_label(memchr(stlc.block, SPAWN, stlc.size) != NULL);
+    stlc_free(&stlc);
+
+    mu_assert_label(evaluate(source, 1, result, sizeof(result)));
+    mu_assert_label(strcmp(result, "2584: Int") == 0);
+
+    return NULL;
+}
+
+/* Truncates each of the entries in directory to size, or removes them if size is negative. */
+static int truncateEntries(char *directory, off_t size)
+{
+    char entry[256];
+    int count = 0;
+    DIR *dir = opendir(directory);
+    struct dirent *file;
+
+    while (dir != NULL && (file = readdir(dir)) != NULL)
+    {
+        if (file->d_name[0] == '.')
+            continue;
+
+        if (snprintf(entry, sizeof(entry), "%s/%s", directory, file->d_name) >= (int)sizeof(entry))
+            continue;
+        if (size < 0 ? unlink(entry) == 0 : truncate(entry, size) == 0)
+            count++;
+    }
+    if (dir != NULL)
+        closedir(dir);
+
+    return count;
+}
+
+static char *test_cache(void)
+{
+    char directory[] = "/tmp/stlc-cache-XXXXXX";
+    Stlc stlc;
+
+    mu_assert_label(mkdtemp(directory) != NULL);
+
+    Cache *cache = cache_new(directory);
+
+    mu_assert_label(cache_compile(cache, factorialSource, 0, &stlc));
+    mu_assert_label(!stlc.cached);
+    stlc_free(&stlc);
+
+    mu_assert_label(cache_compile(cache, factorialSource, 0, &stlc));
+    mu_assert_label(stlc.cached);
+    mu_assert_label(stlc.size == sizeof(factorial));
+    mu_assert_label(memcmp(stlc.block, factorial, sizeof(factorial)) == 0);
+    mu_assert_label(strcmp(stlc.type, "Int") == 0);
+    mu_assert_label(!stlc.function);
+    stlc_free(&stlc);
+
+    mu_assert_label(cache_compile(cache, "\\a -> a", 0, &stlc));
+    stlc_free(&stlc);
+    mu_assert_label(cache_compile(cache, "\\a -> a", 0, &stlc));
+    mu_assert_label(stlc.cached);
+    mu_assert_label(stlc.function);
+    mu_assert_label(strcmp(stlc.type, "a -> a") == 0);
+    stlc_free(&stlc);
+
+    /* Neither the options nor a program that fails to compile share an entry. */
+    mu_assert_label(cache_compile(cache, factorialSource, 1, &stlc));
+    mu_assert_label(!stlc.cached);
+    stlc_free(&stlc);
+    mu_assert_label(!cache_compile(cache, "1 + True", 0, &stlc));
+    mu_assert_label(!cache_compile(cache, "1 + True", 0, &stlc));
+    mu_assert_label(!stlc.cached);
+
+    mu_assert_label(cache_hits(cache) == 2);
+    mu_assert_label(cache_misses(cache) == 5);
+    mu_assert_label(cache_failures(cache) == 0);
+
+    cache_free(cache);
+
+    /* A damaged entry is a miss, and is replaced. */
+    mu_assert_label(truncateEntries(directory, 20) == 3);
+
+    cache = cache_new(directory);
+    mu_assert_label(cache_compile(cache, factorialSource, 0, &stlc));
+    mu_assert_label(!stlc.cached);
+    stlc_free(&stlc);
+    mu_assert_label(cache_compile(cache, factorialSource, 0, &stlc));
+    mu_assert_label(stlc.cached);
+    stlc_free(&stlc);
+    cache_free(cache);
+
+    mu_assert_label(truncateEntries(directory, -1) == 3);
+    mu_assert_label(rmdir(directory) == 0);
+
+    return NULL;
+}
+
+char *stlc_tests(void)
+{
+    mu_run_test(test_compile_as_kotlin);
+    mu_run_test(test_evaluate);
+    mu_run_test(test_let_within_declaration);
+    mu_run_test(test_errors);
+    mu_run_test(test_parallel);
+    mu_run_test(test_cache);
+
+    return NULL;
+}
@@ -20,10 +20,16 @@ int main(void)
     char *result = NULL;
 
 #ifdef DEBUG_MEMORY
+    memory_setProfiling(1);
+
     int start_memory_allocated = memory_allocated();
     printf(". Memory allocated delta: %d\n", start_memory_allocated);
 #endif
 
+    TEST_SUITE(vm_tests);
+    TEST_SUITE(serve_tests);
+    TEST_SUITE(stlc_tests);
+
     if (result == NULL)
     {
         printf(". All tests passed\n");
@@ -42,6 +48,7 @@ int main(void)
     if (end_memory_allocated > start_memory_allocated)
     {
         printf(". Memory leak detected: %d allocations leaked\n", end_memory_allocated - start_memory_allocated);
+        memory_reportLeaks(stdout);
         return 1;
     }
 #endif
@@ -0,0 +1,559 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../src/collector.h"
+#include "../src/memo.h"
+#include "../src/op.h"
+#include "../src/schedule.h"
+#include "../src/snapshot.h"
+#include "../src/value.h"
+#include "../src/vm.h"
+#include "minunit.h"
+
+#define I32(n) ((n) & 0xff), (((n) >> 8) & 0xff), (((n) >> 16) & 0xff), (((n) >> 24) & 0xff)
+
+#define THREADS 4
+#define RUNS_PER_THREAD 50
+
+/*
+ * let rec factorial n = if (n == 0) 1 else n * (factorial (n - 1)) in factorial 10
+ */
+static unsigned char factorial[] = {
+    ENTER, I32(1),
+    PUSH_CLOSURE, I32(31),
+    STORE_VAR, I32(0),
+    PUSH_VAR, I32(0), I32(0),
+    PUSH_INT, I32(10),
+    SWAP_CALL,
+    RET,
+    /* 31: factorial */
+    ENTER, I32(1),
+    STORE_VAR, I32(0),
+    PUSH_VAR, I32(0), I32(0),
+    PUSH_INT, I32(0),
+    EQ,
+    JMP_TRUE, I32(101),
+    PUSH_VAR, I32(0), I32(0),
+    PUSH_VAR, I32(1), I32(0),
+    PUSH_VAR, I32(0), I32(0),
+    PUSH_INT, I32(1),
+    SUB,
+    SWAP_CALL,
+    MUL,
+    JMP, I32(106),
+    /* 101: then */
+    PUSH_INT, I32(1),
+    /* 106: next */
+    RET};
+
+/*
+ * let rec factorial n = if (n == 0) 1 else n * (factorial (n - 1)) in factorial 10 + factorial 11
+ */
+static unsigned char factorials[] = {
+    ENTER, I32(1),
+    PUSH_CLOSURE, I32(47),
+    STORE_VAR, I32(0),
+    PUSH_VAR, I32(0), I32(0),
+    PUSH_INT, I32(10),
+    SWAP_CALL,
+    PUSH_VAR, I32(0), I32(0),
+    PUSH_INT, I32(11),
+    SWAP_CALL,
+    ADD,
+    RET,
+    /* 47: factorial */
+    ENTER, I32(1),
+    STORE_VAR, I32(0),
+    PUSH_VAR, I32(0), I32(0),
+    PUSH_INT, I32(0),
+    EQ,
+    JMP_TRUE, I32(117),
+    PUSH_VAR, I32(0), I32(0),
+    PUSH_VAR, I32(1), I32(0),
+    PUSH_VAR, I32(0), I32(0),
+    PUSH_INT, I32(1),
+    SUB,
+    SWAP_CALL,
+    MUL,
+    JMP, I32(122),
+    /* 117: then */
+    PUSH_INT, I32(1),
+    /* 122: next */
+    RET};
+
+/*
+ * let rec fib n = if (n == 0) 0 else if (n == 1) 1 else (fib (n - 1)) + (fib (n - 2)) in fib 18
+ *
+ * with fib (n - 1) SPAWNed.
+ */
+static unsigned char fib[] = {
+    ENTER, I32(1),
+    PUSH_CLOSURE, I32(31),
+    STORE_VAR, I32(0),
+    PUSH_VAR, I32(0), I32(0),
+    PUSH_INT, I32(18),
+    SWAP_CALL,
+    RET,
+    /* 31: fib */
+    ENTER, I32(1),
+    STORE_VAR, I32(0),
+    PUSH_VAR, I32(0), I32(0),
+    PUSH_INT, I32(0),
+    EQ,
+    JMP_TRUE, I32(118),
+    PUSH_VAR, I32(0), I32(0),
+    PUSH_INT, I32(1),
+    EQ,
+    JMP_TRUE, I32(128),
+    SPAWN, I32(134),
+    PUSH_VAR, I32(1), I32(0),
+    PUSH_VAR, I32(0), I32(0),
+    PUSH_INT, I32(2),
+    SUB,
+    SWAP_CALL,
+    JOIN,
+    ADD,
+    JMP, I32(133),
+    /* 118: zero */
+    PUSH_INT, I32(0),
+    JMP, I32(133),
+    /* 128: one */
+    PUSH_INT, I32(1),
+    /* 133: next */
+    RET,
+    /* 134: fib (n - 1) */
+    PUSH_VAR, I32(2), I32(0),
+    PUSH_VAR, I32(1), I32(0),
+    PUSH_INT, I32(1),
+    SUB,
+    SWAP_CALL,
+    RET};
+
+static unsigned char addBools[] = {
+    PUSH_TRUE,
+    PUSH_FALSE,
+    ADD,
+    RET};
+
+static unsigned char closure[] = {
+    PUSH_CLOSURE, I32(6),
+    RET,
+    /* 6: */
+    RET};
+
+static unsigned char divideByZero[] = {
+    PUSH_INT, I32(10),
+    PUSH_INT, I32(0),
+    DIV,
+    RET};
+
+static unsigned char divideOverflow[] = {
+    PUSH_INT, I32(INT32_MIN),
+    PUSH_INT, I32(-1),
+    DIV,
+    RET};
+
+/*
+ * let rec a = a in a
+ */
+static unsigned char unstoredVariable[] = {
+    ENTER, I32(1),
+    PUSH_VAR, I32(0), I32(0),
+    STORE_VAR, I32(0),
+    PUSH_VAR, I32(0), I32(0),
+    RET};
+
+static char *test_run_result(void)
+{
+    BciVM *vm = bci_newVM();
+
+    mu_assert_label(bci_load(vm, factorial, sizeof(factorial)) == BCI_OK);
+    mu_assert_label(bci_run(vm, 0) == BCI_OK);
+    mu_assert_label(bci_result(vm)->type == BCI_RESULT_INT);
+    mu_assert_label(bci_result(vm)->value == 3628800);
+    mu_assert_label(strcmp(bci_result(vm)->text, "3628800: Int") == 0);
+
+    mu_assert_label(bci_run(vm, 0) == BCI_OK);
+    mu_assert_label(bci_result(vm)->value == 3628800);
+
+    mu_assert_label(bci_load(vm, closure, sizeof(closure)) == BCI_OK);
+    mu_assert_label(bci_run(vm, 0) == BCI_OK);
+    mu_assert_label(bci_result(vm)->type == BCI_RESULT_CLOSURE);
+    mu_assert_label(bci_result(vm)->value == 6);
+    mu_assert_label(strcmp(bci_result(vm)->text, "c6#1") == 0);
+
+    bci_freeVM(vm);
+
+    return NULL;
+}
+
+static char *test_run_error(void)
+{
+    BciVM *vm = bci_newVM();
+
+    mu_assert_label(bci_run(vm, 0) == BCI_ERROR_NOT_LOADED);
+
+    mu_assert_label(bci_load(vm, addBools, sizeof(addBools)) == BCI_OK);
+    mu_assert_label(bci_run(vm, 0) == BCI_ERROR_TYPE_MISMATCH);
+    mu_assert_label(strcmp(bci_errorMessage(vm), "Run: ADD: not an int") == 0);
+    mu_assert_label(bci_result(vm)->type == BCI_RESULT_NONE);
+
+    /* Each is an error in the program, not a trap that takes the process with it. */
+    mu_assert_label(bci_load(vm, divideByZero, sizeof(divideByZero)) == BCI_OK);
+    mu_assert_label(bci_run(vm, 0) == BCI_ERROR_ARITHMETIC);
+    mu_assert_label(strcmp(bci_errorMessage(vm), "Run: DIV: division by zero") == 0);
+
+    mu_assert_label(bci_load(vm, divideOverflow, sizeof(divideOverflow)) == BCI_OK);
+    mu_assert_label(bci_run(vm, 0) == BCI_ERROR_ARITHMETIC);
+
+    mu_assert_label(bci_load(vm, unstoredVariable, sizeof(unstoredVariable)) == BCI_OK);
+    mu_assert_label(bci_run(vm, 0) == BCI_ERROR_ACTIVATION);
+    mu_assert_label(strcmp(bci_errorMessage(vm), "Run: PUSH_VAR: variable read before it is stored: 0") == 0);
+    mu_assert_label(bci_result(vm)->type == BCI_RESULT_NONE);
+
+    /* The VM is still usable. */
+    mu_assert_label(bci_load(vm, factorial, sizeof(factorial)) == BCI_OK);
+    mu_assert_label(bci_run(vm, 0) == BCI_OK);
+    mu_assert_label(bci_result(vm)->value == 3628800);
+
+    mu_assert_label(bci_loadFile(vm, "does-not-exist.bin") == BCI_ERROR_LOAD);
+
+    bci_freeVM(vm);
+
+    return NULL;
+}
+
+static char *test_resume(void)
+{
+    BciVM *vm = bci_newVM();
+    int yields = 0;
+    BciStatus status;
+
+    mu_assert_label(bci_resume(vm, 10) == BCI_ERROR_NOT_LOADED);
+
+    mu_assert_label(bci_load(vm, factorial, sizeof(factorial)) == BCI_OK);
+    mu_assert_label(bci_start(vm, 0) == BCI_OK);
+
+    while ((status = bci_resume(vm, 1)) == BCI_YIELDED)
+        yields++;
+
+    /* A budget is only checked on calls and backward jumps - factorial 10 makes 11 calls. */
+    mu_assert_label(status == BCI_OK);
+    mu_assert_label(yields == 11);
+    mu_assert_label(bci_result(vm)->value == 3628800);
+    mu_assert_label(bci_resume(vm, 10) == BCI_ERROR_NOT_LOADED);
+
+    mu_assert_label(bci_load(vm, addBools, sizeof(addBools)) == BCI_OK);
+    mu_assert_label(bci_start(vm, 0) == BCI_OK);
+    mu_assert_label(bci_resume(vm, 1) == BCI_ERROR_TYPE_MISMATCH);
+    mu_assert_label(strcmp(bci_errorMessage(vm), "Run: ADD: not an int") == 0);
+
+    bci_freeVM(vm);
+
+    return NULL;
+}
+
+static char *test_limits(void)
+{
+    BciVM *vm = bci_newVM();
+    BciLimits limits;
+
+    bci_load(vm, factorial, sizeof(factorial));
+    mu_assert_label(bci_run(vm, 0) == BCI_OK);
+    mu_assert_label(bci_usage(vm)->instructions > 100);
+
+    bci_defaultLimits(&limits);
+    limits.instructions = 50;
+    bci_setLimits(vm, &limits);
+    mu_assert_label(bci_run(vm, 0) == BCI_ERROR_LIMIT);
+    mu_assert_label(strcmp(bci_errorMessage(vm), "Run: instruction limit exceeded: 50 instructions") == 0);
+    mu_assert_label(bci_usage(vm)->instructions >= 50);
+
+    bci_defaultLimits(&limits);
+    limits.depth = 5;
+    bci_setLimits(vm, &limits);
+    mu_assert_label(bci_run(vm, 0) == BCI_ERROR_LIMIT);
+    mu_assert_label(strcmp(bci_errorMessage(vm), "Run: depth limit exceeded: 5 activations") == 0);
+    mu_assert_label(bci_usage(vm)->depth == 6);
+    mu_assert_label(bci_usage(vm)->stack > 0);
+
+    bci_defaultLimits(&limits);
+    limits.heapObjects = 12;
+    bci_setLimits(vm, &limits);
+    mu_assert_label(bci_run(vm, 0) == BCI_ERROR_LIMIT);
+    mu_assert_label(strcmp(bci_errorMessage(vm), "Run: heap object limit exceeded: 12 objects") == 0);
+    mu_assert_label(bci_usage(vm)->heapObjects <= 12);
+
+    bci_defaultLimits(&limits);
+    limits.heapBytes = 2560;
+    bci_setLimits(vm, &limits);
+    mu_assert_label(bci_run(vm, 0) == BCI_ERROR_LIMIT);
+    mu_assert_label(strcmp(bci_errorMessage(vm), "Run: heap byte limit exceeded: 2560 bytes") == 0);
+    mu_assert_label(bci_usage(vm)->heapBytes <= 2560);
+
+    /* Wherever the byte limit falls, including on growing the stack for an int, nothing leaks. */
+    unsigned char sum[5 * 600 + 599 + 1];
+    int32_t size = 0;
+
+    for (int i = 0; i < 600; i++)
+    {
+        unsigned char pushInt[] = {PUSH_INT, I32(i)};
+        memcpy(sum + size, pushInt, sizeof(pushInt));
+        size += sizeof(pushInt);
+    }
+    for (int i = 1; i < 600; i++)
+        sum[size++] = ADD;
+    sum[size++] = RET;
+
+    bci_load(vm, sum, size);
+    for (int64_t bytes = 1024; bytes <= 65536; bytes += 256)
+    {
+        bci_defaultLimits(&limits);
+        limits.heapBytes = bytes;
+        bci_setLimits(vm, &limits);
+
+        BciStatus status = bci_run(vm, 0);
+        mu_assert_label(status == BCI_ERROR_LIMIT || (status == BCI_OK && bci_result(vm)->value == 179700));
+    }
+    bci_load(vm, factorial, sizeof(factorial));
+
+    bci_defaultLimits(&limits);
+    limits.timeout = 0;
+    bci_setLimits(vm, &limits);
+    mu_assert_label(bci_run(vm, 0) == BCI_ERROR_LIMIT);
+    mu_assert_label(strcmp(bci_errorMessage(vm), "Run: deadline exceeded: 0ms") == 0);
+
+    bci_defaultLimits(&limits);
+    bci_setLimits(vm, &limits);
+    mu_assert_label(bci_run(vm, 0) == BCI_OK);
+    mu_assert_label(bci_result(vm)->value == 3628800);
+
+    bci_freeVM(vm);
+
+    return NULL;
+}
+
+static void scheduleCompleted(int32_t index, BciVM *vm, BciStatus status, void *context)
+{
+    int32_t *values = (int32_t *)context;
+
+    values[index] = status == BCI_OK ? bci_result(vm)->value : -1;
+}
+
+static char *test_heap_snapshot(void)
+{
+    char fileName[] = "/tmp/bci-snapshot-XXXXXX";
+    int fd = mkstemp(fileName);
+    mu_assert_label(fd >= 0);
+    close(fd);
+
+    BciVM *vm = bci_newVM();
+    Snapshot *snapshot = snapshot_new(fileName, 100);
+
+    bci_load(vm, factorial, sizeof(factorial));
+    bci_setSnapshot(vm, snapshot);
+    mu_assert_label(bci_run(vm, 0) == BCI_OK);
+    mu_assert_label(snapshot_taken(snapshot) == 1);
+
+    FILE *fp = fopen(fileName, "rb");
+    SnapshotHeader header;
+    mu_assert_label(fread(&header, sizeof(header), 1, fp) == 1);
+    fclose(fp);
+
+    /* Taken at the first call after 100 instructions, deep in the recursion. */
+    mu_assert_label(memcmp(header.magic, SNAPSHOT_MAGIC, 4) == 0);
+    mu_assert_label(header.instructions >= 100);
+    mu_assert_label(header.nodes > 10);
+    mu_assert_label(header.roots >= 3);
+
+    FILE *out = fopen("/dev/null", "w");
+    mu_assert_label(snapshot_analyze(fileName, 5, out));
+    fclose(out);
+
+    bci_freeVM(vm);
+    snapshot_free(snapshot);
+    unlink(fileName);
+
+    return NULL;
+}
+
+static char *test_memoize(void)
+{
+    BciVM *vm = bci_newVM();
+
+    bci_load(vm, factorials, sizeof(factorials));
+    mu_assert_label(bci_run(vm, 0) == BCI_OK);
+    int64_t instructions = bci_usage(vm)->instructions;
+
+    /* factorial 11 calls factorial 10, the most recent of the four results kept, which is found in the cache. */
+    Memo *memo = memo_new(4);
+    bci_setMemo(vm, memo);
+    mu_assert_label(bci_run(vm, 0) == BCI_OK);
+    mu_assert_label(bci_result(vm)->value == 43545600);
+    mu_assert_label(bci_usage(vm)->instructions < instructions);
+
+    bci_setMemo(vm, NULL);
+    memo_free(memo);
+    bci_freeVM(vm);
+
+    return NULL;
+}
+
+/* A closure made outside of any activation keeps its entries through collections. */
+static char *test_memoize_without_environment(void)
+{
+    MemoryState mm = value_newMemoryManager(16);
+    Memo *memo = memo_new(4);
+    MemoKey key;
+    ValueType type;
+    int32_t value;
+
+    mm.memo = memo;
+
+    Value *closure = value_newClosure(NULL, 5, &mm);
+    Value *argument = value_newInt(3, &mm);
+    mu_assert_label(memo_key(memo, closure, argument, &key));
+
+    Value *activation = value_newActivation(NULL, closure, -1, &mm);
+    memo_called(memo, &key, activation);
+    memo_returned(memo, activation, value_newInt(6, &mm));
+
+    forceGC(&mm);
+    value_newInt(0, &mm);
+    mu_assert_label(memo_find(memo, &key, &type, &value));
+    mu_assert_label(type == VInt && value == 6);
+
+    memo_free(memo);
+    value_destroyMemoryManager(&mm);
+
+    return NULL;
+}
+
+static char *test_parallel(void)
+{
+    BciVM *vm = bci_newVM();
+
+    bci_load(vm, fib, sizeof(fib));
+    mu_assert_label(bci_run(vm, 0) == BCI_OK);
+    mu_assert_label(bci_result(vm)->value == 2584);
+
+    bci_setParallel(vm, THREADS);
+    for (int i = 0; i < RUNS_PER_THREAD; i++)
+    {
+        mu_assert_label(bci_run(vm, 0) == BCI_OK);
+        mu_assert_label(bci_result(vm)->value == 2584);
+    }
+
+    /* An error raised by a task is raised again at its JOIN. */
+    BciLimits limits;
+    bci_defaultLimits(&limits);
+    limits.depth = 10;
+    bci_setLimits(vm, &limits);
+    mu_assert_label(bci_run(vm, 0) == BCI_ERROR_LIMIT);
+
+    bci_freeVM(vm);
+
+    return NULL;
+}
+
+static char *test_parallel_collector(void)
+{
+    BciVM *vm = bci_newVM();
+
+    /* A threshold of 0 marks and sweeps every heap in parallel, however small. */
+    Collector *collector = collector_new(THREADS, 0);
+    bci_setCollector(vm, collector);
+
+    bci_load(vm, fib, sizeof(fib));
+    mu_assert_label(bci_run(vm, 0) == BCI_OK);
+    mu_assert_label(bci_result(vm)->value == 2584);
+
+    bci_load(vm, factorials, sizeof(factorials));
+    mu_assert_label(bci_run(vm, 0) == BCI_OK);
+    mu_assert_label(bci_result(vm)->value == 43545600);
+
+    bci_freeVM(vm);
+    collector_free(collector);
+
+    return NULL;
+}
+
+static char *test_schedule(void)
+{
+    BciVM *vms[THREADS];
+    int32_t values[THREADS];
+
+    for (int i = 0; i < THREADS; i++)
+    {
+        vms[i] = bci_newVM();
+        values[i] = 0;
+        bci_load(vms[i], i % 2 == 0 ? factorial : addBools, i % 2 == 0 ? sizeof(factorial) : sizeof(addBools));
+        mu_assert_label(bci_start(vms[i], 0) == BCI_OK);
+    }
+
+    schedule_run(vms, THREADS, 2, 7, scheduleCompleted, values);
+
+    for (int i = 0; i < THREADS; i++)
+    {
+        mu_assert_label(values[i] == (i % 2 == 0 ? 3628800 : -1));
+        bci_freeVM(vms[i]);
+    }
+
+    return NULL;
+}
+
+static void *runFactorials(void *arg)
+{
+    int *failures = (int *)arg;
+    BciVM *vm = bci_newVM();
+
+    bci_load(vm, factorial, sizeof(factorial));
+    for (int i = 0; i < RUNS_PER_THREAD; i++)
+    {
+        if (bci_run(vm, 0) != BCI_OK || bci_result(vm)->value != 3628800)
+            *failures += 1;
+    }
+
+    bci_freeVM(vm);
+
+    return NULL;
+}
+
+static char *test_concurrent_vms(void)
+{
+    pthread_t threads[THREADS];
+    int failures[THREADS];
+
+    for (int i = 0; i < THREADS; i++)
+    {
+        failures[i] = 0;
+        pthread_create(&threads[i], NULL, runFactorials, &failures[i]);
+    }
+    for (int i = 0; i < THREADS; i++)
+    {
+        pthread_join(threads[i], NULL);
+        mu_assert_label(failures[i] == 0);
+    }
+
+    return NULL;
+}
+
+char *vm_tests(void)
+{
+    mu_run_test(test_run_result);
+    mu_run_test(test_run_error);
+    mu_run_test(test_resume);
+    mu_run_test(test_limits);
+    mu_run_test(test_heap_snapshot);
+    mu_run_test(test_memoize);
+    mu_run_test(test_memoize_without_environment);
+    mu_run_test(test_parallel);
+    mu_run_test(test_parallel_collector);
+    mu_run_test(test_schedule);
+    mu_run_test(test_concurrent_vms);
+
+    return NULL;
+}
@@ -0,0 +1,439 @@
+import { find, InstructionOpCode } from "./instructions.ts";
+import { ExecuteOptions } from "./run.ts";
+
+// An engine that keeps the VM's memory in typed arrays rather than in
+// JavaScript objects, so that the work of allocating and collecting is the
+// VM's own and comparable with bci-c's.
+//
+// A value is a tag and a 32 bit payload: an int or bool is held unboxed in
+// its payload and a closure by its address in the heap.  The operand stack is
+// a pair of arrays, one of tags and one of payloads.  The heap is an
+// Int32Array of words in which every object starts with a header word giving
+// its kind:
+//
+//   closure:    [CLOSURE, ip, previous activation]
+//   activation: [ACTIVATION, parent, closure, next ip, state]
+//   state:      [STATE, size, tag 0, payload 0, tag 1, payload 1, ...]
+//
+// The state, the variables that ENTER allocates, is an object of its own as
+// ENTER only runs after the call that created the activation.  Address 0 is
+// never allocated and stands for no object, and a next ip of -1 marks the
+// outermost activation.
+//
+// Objects are allocated by bumping the top of the heap.  When it is full the
+// objects reachable from the stack and the current activation are copied,
+// breadth first, into the other half of the heap, and both halves are
+// doubled while less than half of the heap is free after a collection.
+// Space is reserved before an instruction takes its operands off the stack
+// so that a collection always sees, and moves, every live value.
+
+const INT = 0;
+const BOOL = 1;
+const REF = 2;
+
+const CLOSURE = 1;
+const ACTIVATION = 2;
+const STATE = 3;
+const FORWARDED = 4;
+
+const CLOSURE_SIZE = 3;
+const ACTIVATION_SIZE = 5;
+const STATE_HEADER_SIZE = 2;
+
+const INITIAL_HEAP_WORDS = 1 << 16;
+const INITIAL_STACK_SIZE = 1 << 10;
+
+export const execute = (
+  block: Uint8Array,
+  ip: number,
+  options: ExecuteOptions = { debug: true },
+) => {
+  let heap = new Int32Array(INITIAL_HEAP_WORDS);
+  let spare = new Int32Array(INITIAL_HEAP_WORDS);
+  let top = 1;
+
+  let tags = new Uint8Array(INITIAL_STACK_SIZE);
+  let stack = new Int32Array(INITIAL_STACK_SIZE);
+  let sp = 0;
+
+  let instructions = 0;
+  let allocations = 0;
+  let collections = 0;
+  let gcMs = 0;
+
+  const objectSize = (p: number): number => {
+    switch (heap[p]) {
+      case CLOSURE:
+        return CLOSURE_SIZE;
+      case ACTIVATION:
+        return ACTIVATION_SIZE;
+      default:
+        return STATE_HEADER_SIZE + 2 * heap[p + 1];
+    }
+  };
+
+  // Copies the object at p, in the from space, to the end of the to space,
+  // leaving its new address behind it.
+  const forward = (p: number): number => {
+    if (p === 0) {
+      return 0;
+    }
+    if (heap[p] === FORWARDED) {
+      return heap[p + 1];
+    }
+
+    const size = objectSize(p);
+    const q = top;
+
+    for (let i = 0; i < size; i += 1) {
+      spare[q + i] = heap[p + i];
+    }
+    top += size;
+    heap[p] = FORWARDED;
+    heap[p + 1] = q;
+
+    return q;
+  };
+
+  const collect = (needed: number) => {
+    const start = performance.now();
+
+    top = 1;
+    for (let i = 0; i < sp; i += 1) {
+      if (tags[i] === REF) {
+        stack[i] = forward(stack[i]);
+      }
+    }
+    activation = forward(activation);
+
+    for (let scan = 1; scan < top;) {
+      switch (spare[scan]) {
+        case CLOSURE:
+          spare[scan + 2] = forward(spare[scan + 2]);
+          scan += CLOSURE_SIZE;
+          break;
+        case ACTIVATION:
+          spare[scan + 1] = forward(spare[scan + 1]);
+          spare[scan + 2] = forward(spare[scan + 2]);
+          spare[scan + 4] = forward(spare[scan + 4]);
+          scan += ACTIVATION_SIZE;
+          break;
+        default: {
+          const end = scan + STATE_HEADER_SIZE + 2 * spare[scan + 1];
+
+          for (let i = scan + STATE_HEADER_SIZE; i < end; i += 2) {
+            if (spare[i] === REF) {
+              spare[i + 1] = forward(spare[i + 1]);
+            }
+          }
+          scan = end;
+        }
+      }
+    }
+
+    [heap, spare] = [spare, heap];
+
+    let size = heap.length;
+    while (top + needed > size / 2) {
+      size *= 2;
+    }
+    if (size > heap.length) {
+      const grown = new Int32Array(size);
+
+      grown.set(heap.subarray(0, top));
+      heap = grown;
+      spare = new Int32Array(size);
+    }
+
+    collections += 1;
+    gcMs += performance.now() - start;
+  };
+
+  // Makes room for words more words of objects, collecting if there is not.
+  const reserve = (words: number) => {
+    if (top + words > heap.length) {
+      collect(words);
+    }
+  };
+
+  const allocate = (words: number): number => {
+    const p = top;
+
+    top += words;
+    allocations += 1;
+
+    return p;
+  };
+
+  const allocateActivation = (
+    parent: number,
+    closure: number,
+    nextIP: number,
+  ): number => {
+    const p = allocate(ACTIVATION_SIZE);
+
+    heap[p] = ACTIVATION;
+    heap[p + 1] = parent;
+    heap[p + 2] = closure;
+    heap[p + 3] = nextIP;
+    heap[p + 4] = 0;
+
+    return p;
+  };
+
+  const allocateClosure = (targetIP: number, previous: number): number => {
+    const p = allocate(CLOSURE_SIZE);
+
+    heap[p] = CLOSURE;
+    heap[p + 1] = targetIP;
+    heap[p + 2] = previous;
+
+    return p;
+  };
+
+  let activation = allocateActivation(0, 0, -1);
+
+  const push = (tag: number, value: number) => {
+    if (sp === stack.length) {
+      const grownTags = new Uint8Array(sp * 2);
+      const grownStack = new Int32Array(sp * 2);
+
+      grownTags.set(tags);
+      grownStack.set(stack);
+      tags = grownTags;
+      stack = grownStack;
+    }
+
+    tags[sp] = tag;
+    stack[sp] = value;
+    sp += 1;
+  };
+
+  const activationDepth = (a: number): number => {
+    let depth = 1;
+
+    while (heap[a + 2] !== 0) {
+      a = heap[heap[a + 2] + 2];
+      depth += 1;
+    }
+
+    return depth;
+  };
+
+  const valueToString = (tag: number, value: number, typed: boolean) => {
+    switch (tag) {
+      case INT:
+        return typed ? `${value}: Int` : `${value}`;
+      case BOOL:
+        return typed ? `${value !== 0}: Bool` : `${value !== 0}`;
+      default:
+        return `c${heap[value + 1]}#${activationDepth(heap[value + 2])}`;
+    }
+  };
+
+  const stackToString = (): string =>
+    `[${
+      Array.from(
+        { length: sp },
+        (_, i) => valueToString(tags[i], stack[i], false),
+      ).join(", ")
+    }]`;
+
+  const readIntFrom = (ip: number): number =>
+    block[ip] | (block[ip + 1] << 8) | (block[ip + 2] << 16) |
+    (block[ip + 3] << 24);
+
+  const logInstruction = (instruction: InstructionOpCode) => {
+    const op = find(instruction);
+
+    if (op !== undefined) {
+      const args = op.args.map((_, i) => readIntFrom(ip + i * 4));
+
+      console.log(
+        `${ip - 1}: ${op.name}${args.length > 0 ? " " : ""}${
+          args.join(" ")
+        }: ${stackToString()}`,
+      );
+    }
+  };
+
+  const bciState = (): string =>
+    `ip: ${ip}, stack: ${stackToString()}, activation: ${activation}`;
+
+  const readInt = (): number => {
+    const n = readIntFrom(ip);
+    ip += 4;
+    return n;
+  };
+
+  // As run.ts's, with the collections this engine makes itself.
+  const printStats = () => {
+    console.error(JSON.stringify({
+      instructions,
+      allocations,
+      collections,
+      gcNs: Math.round(gcMs * 1000000),
+      peakRssKb: Math.round(Deno.memoryUsage().rss / 1024),
+    }));
+  };
+
+  while (true) {
+    const op = block[ip++];
+    instructions += 1;
+
+    if (options.debug) {
+      logInstruction(op);
+    }
+
+    switch (op) {
+      case InstructionOpCode.JMP: {
+        ip = readInt();
+        break;
+      }
+
+      case InstructionOpCode.JMP_TRUE: {
+        const targetIP = readInt();
+
+        sp -= 1;
+        if (stack[sp] !== 0) {
+          ip = targetIP;
+        }
+        break;
+      }
+
+      case InstructionOpCode.PUSH_CLOSURE: {
+        const targetIP = readInt();
+
+        reserve(CLOSURE_SIZE);
+        push(REF, allocateClosure(targetIP, activation));
+        break;
+      }
+      case InstructionOpCode.PUSH_TRUE: {
+        push(BOOL, 1);
+        break;
+      }
+      case InstructionOpCode.PUSH_FALSE: {
+        push(BOOL, 0);
+        break;
+      }
+      case InstructionOpCode.PUSH_INT: {
+        push(INT, readInt());
+        break;
+      }
+      case InstructionOpCode.PUSH_VAR: {
+        let index = readInt();
+        const offset = STATE_HEADER_SIZE + 2 * readInt();
+
+        let a = activation;
+        while (index > 0) {
+          a = heap[heap[a + 2] + 2];
+          index -= 1;
+        }
+
+        const state = heap[a + 4];
+        push(heap[state + offset], heap[state + offset + 1]);
+        break;
+      }
+      case InstructionOpCode.ADD: {
+        sp -= 1;
+        stack[sp - 1] = (stack[sp - 1] + stack[sp]) | 0;
+        break;
+      }
+      case InstructionOpCode.SUB: {
+        sp -= 1;
+        stack[sp - 1] = (stack[sp - 1] - stack[sp]) | 0;
+        break;
+      }
+      case InstructionOpCode.MUL: {
+        sp -= 1;
+        stack[sp - 1] = (stack[sp - 1] * stack[sp]) | 0;
+        break;
+      }
+      case InstructionOpCode.DIV: {
+        sp -= 1;
+        stack[sp - 1] = (stack[sp - 1] / stack[sp]) | 0;
+        break;
+      }
+      case InstructionOpCode.EQ: {
+        sp -= 1;
+        tags[sp - 1] = BOOL;
+        stack[sp - 1] = stack[sp - 1] === stack[sp] ? 1 : 0;
+        break;
+      }
+      case InstructionOpCode.SWAP_CALL: {
+        reserve(ACTIVATION_SIZE);
+
+        const closure = stack[sp - 2];
+
+        tags[sp - 2] = tags[sp - 1];
+        stack[sp - 2] = stack[sp - 1];
+        sp -= 1;
+        activation = allocateActivation(activation, closure, ip);
+        ip = heap[closure + 1];
+        break;
+      }
+      case InstructionOpCode.ENTER: {
+        const size = readInt();
+
+        if (heap[activation + 4] !== 0) {
+          throw new Error(`ENTER: Activation already exists: ${bciState()}`);
+        }
+
+        reserve(STATE_HEADER_SIZE + 2 * size);
+
+        const state = allocate(STATE_HEADER_SIZE + 2 * size);
+        heap[state] = STATE;
+        heap[state + 1] = size;
+        heap.fill(0, state + STATE_HEADER_SIZE, top);
+        heap[activation + 4] = state;
+        break;
+      }
+      case InstructionOpCode.RET: {
+        if (heap[activation + 3] === -1) {
+          sp -= 1;
+          console.log(valueToString(tags[sp], stack[sp], true));
+          if (options.stats) {
+            printStats();
+          }
+          Deno.exit(0);
+        }
+
+        ip = heap[activation + 3];
+        activation = heap[activation + 1];
+        break;
+      }
+      case InstructionOpCode.STORE_VAR: {
+        const index = readInt();
+        const state = heap[activation + 4];
+
+        if (state === 0) {
+          throw new Error(
+            `STORE_VAR: Activation does not exist: ${bciState()}`,
+          );
+        }
+
+        sp -= 1;
+        heap[state + STATE_HEADER_SIZE + 2 * index] = tags[sp];
+        heap[state + STATE_HEADER_SIZE + 2 * index + 1] = stack[sp];
+        break;
+      }
+      case InstructionOpCode.SPAWN: {
+        // As run.ts, the thunk is called in place.
+        const targetIP = readInt();
+
+        reserve(CLOSURE_SIZE + ACTIVATION_SIZE);
+        activation = allocateActivation(
+          activation,
+          allocateClosure(targetIP, activation),
+          ip,
+        );
+        ip = targetIP;
+        break;
+      }
+      case InstructionOpCode.JOIN:
+        break;
+      default:
+        throw new Error(`Unknown InstructionOpCode: ${op}`);
+    }
+  }
+};
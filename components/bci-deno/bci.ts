@@ -1,5 +1,6 @@
 import * as CLI from "https://raw.githubusercontent.com/littlelanguages/deno-lib-console-cli/0.1.2/mod.ts";
 
+import { execute as executeArena } from "./arena.ts";
 import { asm, writeBinary } from "./asm.ts";
 import { dis, readBinary } from "./dis.ts";
 import { execute } from "./run.ts";
@@ -57,6 +58,14 @@ const runCmd = new CLI.ValueCommand(
       ["--debug", "-d"],
       "If enabled will display each instruction as it is executed.",
     ),
+    new CLI.FlagOption(
+      ["--stats"],
+      "If enabled will write execution statistics as JSON to stderr.",
+    ),
+    new CLI.FlagOption(
+      ["--arena"],
+      "If enabled will run with values and the heap held in typed arrays.",
+    ),
   ],
   {
     name: "FileName",
@@ -68,7 +77,14 @@ const runCmd = new CLI.ValueCommand(
     file: string | undefined,
     _vals: Map<string, unknown>,
   ) => {
-    execute(readBinary(file!), 0, { debug: _vals.get("debug") === true });
+    (_vals.get("arena") === true ? executeArena : execute)(
+      readBinary(file!),
+      0,
+      {
+        debug: _vals.get("debug") === true,
+        stats: _vals.get("stats") === true,
+      },
+    );
   },
 );
 
@@ -16,6 +16,8 @@ export enum InstructionOpCode {
   ENTER,
   RET,
   STORE_VAR,
+  SPAWN,
+  JOIN,
 }
 
 export enum OpParameter {
@@ -67,6 +69,8 @@ const instructions: Array<Instruction> = [
     opcode: InstructionOpCode.STORE_VAR,
     args: [OpParameter.OPInt],
   },
+  { name: "SPAWN", opcode: InstructionOpCode.SPAWN, args: [OpParameter.OPLabel] },
+  { name: "JOIN", opcode: InstructionOpCode.JOIN, args: [] },
 ];
 
 export const find = (opCode: InstructionOpCode): Instruction | undefined =>
@@ -51,6 +51,7 @@ type Activation = [
 
 export type ExecuteOptions = {
   debug?: boolean;
+  stats?: boolean;
 };
 
 export const execute = (
@@ -60,6 +61,8 @@ export const execute = (
 ) => {
   const stack: Array<Value> = [];
   let activation: Activation = [null, null, null, null];
+  let instructions = 0;
+  let allocations = 1;
 
   const stackToString = (): string => {
     const valueToString = (v: Value | null): string => {
@@ -123,8 +126,22 @@ export const execute = (
     return n;
   };
 
+  // A single JSON line on stderr so that stdout remains the program's result.
+  // The collector is V8's so collections are not visible, and Deno only
+  // reports the current resident set.
+  const printStats = () => {
+    console.error(JSON.stringify({
+      instructions,
+      allocations,
+      collections: null,
+      gcNs: null,
+      peakRssKb: Math.round(Deno.memoryUsage().rss / 1024),
+    }));
+  };
+
   while (true) {
     const op = block[ip++];
+    instructions += 1;
 
     if (options.debug) {
       logInstruction(op);
@@ -156,20 +173,24 @@ export const execute = (
           previous: activation,
         };
         stack.push(argument);
+        allocations += 1;
         break;
       }
       case InstructionOpCode.PUSH_TRUE: {
         stack.push({ tag: "BoolValue", value: true });
+        allocations += 1;
         break;
       }
       case InstructionOpCode.PUSH_FALSE: {
         stack.push({ tag: "BoolValue", value: false });
+        allocations += 1;
         break;
       }
       case InstructionOpCode.PUSH_INT: {
         const value = readInt();
 
         stack.push({ tag: "IntValue", value });
+        allocations += 1;
         break;
       }
       case InstructionOpCode.PUSH_VAR: {
@@ -189,6 +210,7 @@ export const execute = (
         const a = stack.pop() as IntValue;
 
         stack.push({ tag: "IntValue", value: (a.value + b.value) | 0 });
+        allocations += 1;
         break;
       }
       case InstructionOpCode.SUB: {
@@ -196,6 +218,7 @@ export const execute = (
         const a = stack.pop() as IntValue;
 
         stack.push({ tag: "IntValue", value: (a.value - b.value) | 0 });
+        allocations += 1;
         break;
       }
       case InstructionOpCode.MUL: {
@@ -203,6 +226,7 @@ export const execute = (
         const a = stack.pop() as IntValue;
 
         stack.push({ tag: "IntValue", value: (a.value * b.value) | 0 });
+        allocations += 1;
         break;
       }
       case InstructionOpCode.DIV: {
@@ -210,6 +234,7 @@ export const execute = (
         const a = stack.pop() as IntValue;
 
         stack.push({ tag: "IntValue", value: (a.value / b.value) | 0 });
+        allocations += 1;
         break;
       }
       case InstructionOpCode.EQ: {
@@ -217,6 +242,7 @@ export const execute = (
         const b = stack.pop() as IntValue;
 
         stack.push({ tag: "BoolValue", value: a.value === b.value });
+        allocations += 1;
         break;
       }
       case InstructionOpCode.SWAP_CALL: {
@@ -226,6 +252,7 @@ export const execute = (
         const newActivation: Activation = [activation, closure, ip, null];
         ip = closure.ip;
         activation = newActivation;
+        allocations += 1;
         break;
       }
       case InstructionOpCode.ENTER: {
@@ -241,6 +268,9 @@ export const execute = (
       case InstructionOpCode.RET: {
         if (activation[2] === null) {
           console.log(valueToString(stack.pop()!));
+          if (options.stats) {
+            printStats();
+          }
           Deno.exit(0);
         }
 
@@ -260,6 +290,23 @@ export const execute = (
         }
         break;
       }
+      case InstructionOpCode.SPAWN: {
+        // There is only the one thread: the thunk is called in place and its
+        // result is left where the matching JOIN expects it.
+        const targetIP = readInt();
+
+        const closure: ClosureValue = {
+          tag: "ClosureValue",
+          ip: targetIP,
+          previous: activation,
+        };
+        activation = [activation, closure, ip, null];
+        ip = targetIP;
+        allocations += 2;
+        break;
+      }
+      case InstructionOpCode.JOIN:
+        break;
       default:
         throw new Error(`Unknown InstructionOpCode: ${op}`);
     }
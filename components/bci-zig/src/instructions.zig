@@ -1,4 +1,4 @@
-pub const InstructionOpCode = enum { PUSH_TRUE, PUSH_FALSE, PUSH_INT, PUSH_VAR, PUSH_CLOSURE, PUSH_TUPLE, ADD, SUB, MUL, DIV, EQ, JMP, JMP_TRUE, SWAP_CALL, ENTER, RET, STORE_VAR };
+pub const InstructionOpCode = enum { PUSH_TRUE, PUSH_FALSE, PUSH_INT, PUSH_VAR, PUSH_CLOSURE, PUSH_TUPLE, ADD, SUB, MUL, DIV, EQ, JMP, JMP_TRUE, SWAP_CALL, ENTER, RET, STORE_VAR, SPAWN, JOIN };
 pub const OpParameter = enum { OP_INT, OP_LABEL };
 
 pub const Instruction = struct {
@@ -25,4 +25,6 @@ pub const instructions = [_]Instruction{
     .{ .name = "ENTER", .opCode = InstructionOpCode.ENTER, .parameters = &[_]OpParameter{OpParameter.OP_INT} },
     .{ .name = "RET", .opCode = InstructionOpCode.RET, .parameters = &[_]OpParameter{} },
     .{ .name = "STORE_VAR", .opCode = InstructionOpCode.STORE_VAR, .parameters = &[_]OpParameter{OpParameter.OP_INT} },
+    .{ .name = "SPAWN", .opCode = InstructionOpCode.SPAWN, .parameters = &[_]OpParameter{OpParameter.OP_LABEL} },
+    .{ .name = "JOIN", .opCode = InstructionOpCode.JOIN, .parameters = &[_]OpParameter{} },
 };
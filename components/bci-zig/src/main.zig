@@ -17,9 +17,15 @@ pub fn main() !void {
         const buffer: []u8 = try loadBinary(allocator, args[2]);
         defer allocator.free(buffer);
 
-        try execute(buffer);
+        try execute(buffer, false);
+    } else if (args.len == 4 and std.mem.eql(u8, args[1], "run") and std.mem.eql(u8, args[2], "--stats")) {
+        const buffer: []u8 = try loadBinary(allocator, args[3]);
+        defer allocator.free(buffer);
+
+        try execute(buffer, true);
     } else {
         std.debug.print("Usage: {s} dis <filename>\n", .{args[0]});
+        std.debug.print("       {s} run [--stats] <filename>\n", .{args[0]});
     }
 }
 
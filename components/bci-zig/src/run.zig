@@ -1,4 +1,5 @@
 const std = @import("std");
+const builtin = @import("builtin");
 const Instructions = @import("instructions.zig");
 
 // Design decisions:
@@ -73,11 +74,17 @@ const MemoryState = struct {
     memory_size: u32,
     memory_capacity: u32,
 
+    instructions: u64,
+    allocations: u64,
+    collections: u64,
+    gc_ns: i128,
+
     fn new_value(self: *MemoryState, vv: ValueValue) !*Value {
         gc(self);
 
         const v = try self.allocator.create(Value);
         self.memory_size += 1;
+        self.allocations += 1;
 
         v.colour = self.colour;
         v.v = vv;
@@ -225,13 +232,20 @@ fn force_gc(state: *MemoryState) void {
     state.colour = new_colour;
 }
 
+fn timed_force_gc(state: *MemoryState) void {
+    const start_time = std.time.nanoTimestamp();
+    force_gc(state);
+    state.gc_ns += std.time.nanoTimestamp() - start_time;
+    state.collections += 1;
+}
+
 fn gc(state: *MemoryState) void {
     const threshold_rate = 0.75;
 
     if (state.memory_size > state.memory_capacity) {
         const old_size = state.memory_size;
         const start_time = std.time.milliTimestamp();
-        force_gc(state);
+        timed_force_gc(state);
         const end_time = std.time.milliTimestamp();
         std.log.info("gc: time={d}ms, nodes freed={d},  heap size: {d}", .{ end_time - start_time, old_size - state.memory_size, state.memory_size });
 
@@ -243,7 +257,7 @@ fn gc(state: *MemoryState) void {
 }
 
 fn read_i32_from(buffer: []const u8, ip: u32) i32 {
-    return buffer[ip] + @as(i32, 8) * buffer[ip + 1] + @as(i32, 65536) * buffer[ip + 2] + @as(i32, 16777216) * buffer[ip + 3];
+    return std.mem.readIntLittle(i32, buffer[ip..][0..4]);
 }
 
 fn init_memory_state(allocator: std.mem.Allocator, buffer: []const u8) !MemoryState {
@@ -264,11 +278,29 @@ fn init_memory_state(allocator: std.mem.Allocator, buffer: []const u8) !MemorySt
         .root = activation,
         .memory_size = 1, // initialised to 1 to accomodate the root activation record
         .memory_capacity = 32,
+        .instructions = 0,
+        .allocations = 1,
+        .collections = 0,
+        .gc_ns = 0,
     };
 }
 
+fn peak_rss_kb() i64 {
+    const usage = std.os.getrusage(std.os.rusage.SELF);
+
+    const maxrss = @intCast(i64, usage.maxrss);
+
+    return if (builtin.os.tag == .macos) @divTrunc(maxrss, 1024) else maxrss;
+}
+
+// A single JSON line on stderr so that stdout remains the program's result.
+fn print_stats(state: *MemoryState) void {
+    std.debug.print("{{\"instructions\": {d}, \"allocations\": {d}, \"collections\": {d}, \"gcNs\": {d}, \"peakRssKb\": {d}}}\n", .{ state.instructions, state.allocations, state.collections, state.gc_ns, peak_rss_kb() });
+}
+
 fn process_instruction(state: *MemoryState) !bool {
     const instruction = state.read_u8();
+    state.instructions += 1;
 
     switch (@intToEnum(Instructions.InstructionOpCode, instruction)) {
         Instructions.InstructionOpCode.PUSH_TRUE => {
@@ -418,6 +450,18 @@ fn process_instruction(state: *MemoryState) !bool {
             }
             state.activation.v.a.data.?[@intCast(u32, index)] = v;
         },
+        Instructions.InstructionOpCode.SPAWN => {
+            // Single threaded: the thunk is called in place, leaving its result where JOIN expects it.
+            var targetIP = state.read_i32();
+            const closure = try state.new_closure_value(state.activation, @intCast(u32, targetIP));
+            const new_activation = try state.new_activation_value(state.activation, closure, state.ip);
+            state.ip = @intCast(u32, targetIP);
+            state.activation = new_activation;
+
+            _ = state.pop();
+            _ = state.pop();
+        },
+        Instructions.InstructionOpCode.JOIN => {},
         else => {
             std.log.err("Unknown instruction: {s}\n", .{Instructions.instructions[instruction].name});
             unreachable;
@@ -427,7 +471,7 @@ fn process_instruction(state: *MemoryState) !bool {
     return false;
 }
 
-pub fn execute(buffer: []const u8) !void {
+pub fn execute(buffer: []const u8, stats: bool) !void {
     var gpa = std.heap.GeneralPurposeAllocator(.{}){};
     const allocator = gpa.allocator();
 
@@ -435,6 +479,9 @@ pub fn execute(buffer: []const u8) !void {
 
     while (true) {
         if (try process_instruction(&state)) {
+            if (stats) {
+                print_stats(&state);
+            }
             state.deinit();
 
             // _ = gpa.detectLeaks();
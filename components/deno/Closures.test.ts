@@ -0,0 +1,40 @@
+import { assertEquals } from "https://deno.land/std@0.137.0/testing/asserts.ts";
+
+import { execute, executeReference } from "./Interpreter.ts";
+
+Deno.test("Agrees with the reference interpreter", () => {
+  [
+    "(\\a -> \\b -> \\c -> (a - b) / c) 20 2 4",
+    "let add a b = a + b ; incr = add 1 in incr 10",
+    "let rec fib n = if (n == 0) 0 else if (n == 1) 1 else (fib (n - 1)) + (fib (n - 2)) in fib 15",
+    "let rec isOdd n = if (n == 0) False else isEven (n - 1); isEven n = if (n == 0) True else isOdd (n - 1) in isOdd 7",
+    "let x n = let ss b = if (b == n) 1 else 2 in ss 5 in (x 5) * 10 + (x 3)",
+    "let x = 1 in let x = x + 1 in x * (let x = x * 10 in x)",
+  ].forEach((input) =>
+    assertEquals(execute(input)[0], executeReference(input)[0], input)
+  );
+});
+
+Deno.test("Closures keep the frames they were created in", () => {
+  assertEquals(
+    execute(
+      "let mk a = let b = a * 2 in \\c -> b + c in let f = mk 1 ; g = mk 3 in (f 0) * 100 + (g 0) * 10 + (f 1)",
+    )[0],
+    263,
+  );
+  assertEquals(
+    execute(
+      "let rec count n = if (n == 0) \\x -> x else let m = n - 1 in \\x -> count m (x + n) in count 4 0",
+    )[0],
+    10,
+  );
+});
+
+Deno.test("Deep recursion", () => {
+  assertEquals(
+    execute(
+      "let rec sum n = if (n == 0) 0 else n + (sum (n - 1)) in sum 1000",
+    )[0],
+    500500,
+  );
+});
@@ -0,0 +1,237 @@
+// deno-lint-ignore-file no-explicit-any
+import { Declaration, Expression, Op } from "./Parser.ts";
+
+// Compiles an expression into a tree of closures, each specialised to the
+// construct it evaluates, rather than dispatching on the syntax tree as
+// Interpreter.ts's evaluate does every time a node is evaluated.  evaluate is
+// kept as the reference these are checked against.
+//
+// Names are resolved once, before running, to a lexical address: how many
+// lambdas out the name is bound and its slot in that lambda's frame.  A frame
+// is an array with a slot for the parameter and one for every name the
+// lambda's body binds outside of nested lambdas, linked to the frame the
+// lambda was created in, so applying a lambda allocates one small array
+// rather than copying the environment.  Every name has a slot of its own so a
+// closure that captures a frame never sees a slot reused.  A name a session
+// has declared is resolved to its value.
+
+type Frame = { slots: Array<any>; parent: Frame | undefined };
+
+type Code = (frame: Frame) => any;
+
+type Address = { depth: number; slot: number };
+
+export type Compiled = { run: () => any };
+
+export const compile = (
+  expr: Expression,
+  globals: Map<string, any> = new Map(),
+): Compiled => {
+  const resolver = new Resolver(globals);
+  const code = resolver.compile(expr);
+  const frameSize = resolver.frameSize;
+
+  return { run: () => code({ slots: new Array(frameSize), parent: undefined }) };
+};
+
+// The values of the names a let or let rec declares, without evaluating its
+// body, as Interpreter.ts's declare.
+export const compileDeclarations = (
+  expr: Expression,
+  globals: Map<string, any> = new Map(),
+): Map<string, any> => {
+  if (expr.type !== "Let" && expr.type !== "LetRec") {
+    return new Map();
+  }
+
+  const resolver = new Resolver(globals);
+  const code = resolver.compileLet(
+    expr.declarations,
+    expr.type === "LetRec",
+    () => resolver.declared(expr.declarations),
+  );
+
+  return code({ slots: new Array(resolver.frameSize), parent: undefined });
+};
+
+class Resolver {
+  private globals: Map<string, any>;
+  private scopes = new Map<string, Array<Address>>();
+  private depth = 0;
+
+  // Slots taken in the frame of the lambda being compiled.
+  frameSize = 0;
+
+  constructor(globals: Map<string, any>) {
+    this.globals = globals;
+  }
+
+  compile(expr: Expression): Code {
+    switch (expr.type) {
+      case "App": {
+        const f = this.compile(expr.e1);
+        const a = this.compile(expr.e2);
+
+        return (frame) => f(frame)(a(frame));
+      }
+      case "If": {
+        const guard = this.compile(expr.guard);
+        const then = this.compile(expr.then);
+        const otherwise = this.compile(expr.else);
+
+        return (frame) => guard(frame) ? then(frame) : otherwise(frame);
+      }
+      case "Lam": {
+        const enclosingSize = this.frameSize;
+
+        this.depth += 1;
+        this.frameSize = 1;
+        this.bind(expr.name, { depth: this.depth, slot: 0 });
+        const body = this.compile(expr.expr);
+        this.unbind(expr.name);
+        const frameSize = this.frameSize;
+        this.depth -= 1;
+        this.frameSize = enclosingSize;
+
+        return (frame) => (x: any) => {
+          const slots = new Array(frameSize);
+
+          slots[0] = x;
+          return body({ slots, parent: frame });
+        };
+      }
+      case "Let":
+      case "LetRec":
+        return this.compileLet(
+          expr.declarations,
+          expr.type === "LetRec",
+          () => this.compile(expr.expr),
+        );
+      case "LBool":
+      case "LInt": {
+        const value = expr.value;
+
+        return (_) => value;
+      }
+      case "LTuple": {
+        const values = expr.values.map((v) => this.compile(v));
+
+        return (frame) => values.map((v) => v(frame));
+      }
+      case "Op": {
+        const left = this.compile(expr.left);
+        const right = this.compile(expr.right);
+
+        switch (expr.op) {
+          case Op.Equals:
+            return (frame) => left(frame) === right(frame);
+          case Op.Plus:
+            return (frame) => (left(frame) + right(frame)) | 0;
+          case Op.Minus:
+            return (frame) => (left(frame) - right(frame)) | 0;
+          case Op.Times:
+            return (frame) => (left(frame) * right(frame)) | 0;
+          case Op.Divide:
+            return (frame) => (left(frame) / right(frame)) | 0;
+        }
+        break;
+      }
+      case "Var": {
+        const addresses = this.scopes.get(expr.name);
+
+        if (addresses === undefined) {
+          const value = this.globals.get(expr.name);
+
+          return (_) => value;
+        }
+
+        const { depth, slot } = addresses[addresses.length - 1];
+        const up = this.depth - depth;
+
+        if (up === 0) {
+          return (frame) => frame.slots[slot];
+        }
+        if (up === 1) {
+          return (frame) => frame.parent!.slots[slot];
+        }
+        return (frame) => {
+          let f = frame;
+          for (let i = 0; i < up; i += 1) {
+            f = f.parent!;
+          }
+          return f.slots[slot];
+        };
+      }
+    }
+
+    throw new Error(`Unknown expression ${(expr as any).type}`);
+  }
+
+  compileLet(
+    declarations: Array<Declaration>,
+    recursive: boolean,
+    body: () => Code,
+  ): Code {
+    const slots: Array<number> = [];
+    const values: Array<Code> = [];
+
+    if (recursive) {
+      declarations.forEach((d) => slots.push(this.bindSlot(d.name)));
+      declarations.forEach((d) => values.push(this.compile(d.expr)));
+    } else {
+      declarations.forEach((d) => {
+        values.push(this.compile(d.expr));
+        slots.push(this.bindSlot(d.name));
+      });
+    }
+
+    const code = body();
+    [...declarations].reverse().forEach((d) => this.unbind(d.name));
+
+    return (frame) => {
+      for (let i = 0; i < values.length; i += 1) {
+        frame.slots[slots[i]] = values[i](frame);
+      }
+      return code(frame);
+    };
+  }
+
+  // Code returning the values of the innermost bindings of declarations' names.
+  declared(declarations: Array<Declaration>): Code {
+    const names = [...new Set(declarations.map((d) => d.name))];
+    const slots = names.map((name) => {
+      const addresses = this.scopes.get(name)!;
+      return addresses[addresses.length - 1].slot;
+    });
+
+    return (frame) =>
+      new Map(names.map((name, i) => [name, frame.slots[slots[i]]]));
+  }
+
+  private bindSlot(name: string): number {
+    const slot = this.frameSize++;
+
+    this.bind(name, { depth: this.depth, slot });
+
+    return slot;
+  }
+
+  private bind(name: string, address: Address) {
+    const addresses = this.scopes.get(name);
+
+    if (addresses === undefined) {
+      this.scopes.set(name, [address]);
+    } else {
+      addresses.push(address);
+    }
+  }
+
+  private unbind(name: string) {
+    const addresses = this.scopes.get(name)!;
+
+    addresses.pop();
+    if (addresses.length === 0) {
+      this.scopes.delete(name);
+    }
+  }
+}
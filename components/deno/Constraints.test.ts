@@ -4,23 +4,21 @@ import { inferExpression } from "./Infer.ts";
 import { parse } from "./Parser.ts";
 import { createFresh, emptyTypeEnv, Type } from "./Typing.ts";
 
-const solve = (expression: string): Type => {
-  const [constraints, type] = inferExpression(
+const inferred = (expression: string): [Constraints, Type] =>
+  inferExpression(
     emptyTypeEnv,
     parse(expression),
     new Constraints(),
     createFresh(),
   );
 
-  const subst = constraints.solve();
-
-  return type.apply(subst);
-};
-
 const assertType = (expression: string, expected: string) => {
+  const [constraints, type] = inferred(expression);
+
+  assertEquals(expected, type.apply(constraints.solve()).toString());
   assertEquals(
     expected,
-    solve(expression).toString(),
+    type.apply(constraints.solveByComposition()).toString(),
   );
 };
 
@@ -150,3 +148,16 @@ Deno.test("solve let rec? identity a = a in let rec? v1 = identity 10; v2 = iden
     "Bool",
   );
 });
+
+Deno.test("solve \\x -> x x", () => {
+  const [constraints] = inferred("\\x -> x x");
+
+  let error: { tag: string } | undefined;
+  try {
+    constraints.solve();
+  } catch (e) {
+    error = e;
+  }
+
+  assertEquals(error?.tag, "InfiniteTypeError");
+});
@@ -1,10 +1,14 @@
-import { Type } from "./Typing.ts";
+import { Type, Var } from "./Typing.ts";
 import { SyntaxError } from "./parser/Parser.ts";
 import {
   Location,
 } from "https://raw.githubusercontent.com/littlelanguages/scanpiler-deno-lib/0.1.1/location.ts";
 
-export type AnError = SyntaxError | UnificationMismatchError | UnknownNameError;
+export type AnError =
+  | SyntaxError
+  | UnificationMismatchError
+  | InfiniteTypeError
+  | UnknownNameError;
 
 export type UnificationMismatchError = {
   tag: "UnificationMismatchError";
@@ -12,6 +16,12 @@ export type UnificationMismatchError = {
   type2: Type;
 };
 
+export type InfiniteTypeError = {
+  tag: "InfiniteTypeError";
+  name: Var;
+  type: Type;
+};
+
 export type UnknownNameError = {
   tag: "UnknownNameError";
   name: string;
@@ -1,4 +1,10 @@
-import { Expression, Op } from "./Parser.ts";
+import {
+  Declaration,
+  Expression,
+  LetExpression,
+  LetRecExpression,
+  Op,
+} from "./Parser.ts";
 import { Constraints } from "./Constraints.ts";
 import {
   Pump,
@@ -29,19 +35,6 @@ export const inferExpression = (
   constraints: Constraints,
   pump: Pump,
 ): [Constraints, Type] => {
-  const fix = (
-    env: TypeEnv,
-    expr: Expression,
-    constraints: Constraints,
-  ): Type => {
-    const [_, t1] = inferExpression(env, expr, constraints, pump);
-    const tv = pump.next();
-
-    constraints.add(new TArr(tv, tv), t1);
-
-    return tv;
-  };
-
   const infer = (env: TypeEnv, expr: Expression): Type => {
     if (expr.type === "App") {
       const t1 = infer(env, expr.e1);
@@ -67,61 +60,11 @@ export const inferExpression = (
       const t = infer(env.extend(expr.name, new Scheme([], tv)), expr.expr);
       return new TArr(tv, t);
     }
-    if (expr.type === "Let") {
-      let newEnv = env;
-
-      for (const declaration of expr.declarations) {
-        const [nc, tb] = inferExpression(
-          newEnv,
-          declaration.expr,
-          constraints,
-          pump,
-        );
-
-        const subst = nc.solve();
-
-        newEnv = newEnv.apply(subst);
-        const sc = newEnv.generalise(tb.apply(subst));
-        newEnv = newEnv.extend(declaration.name, sc);
-      }
-
-      return infer(newEnv, expr.expr);
-    }
-    if (expr.type === "LetRec") {
-      const tvs = pump.nextN(expr.declarations.length);
-      const newEnv = expr.declarations.reduce(
-        (acc, declaration, idx) =>
-          acc.extend(declaration.name, new Scheme([], tvs[idx])),
-        env,
-      );
-
-      const declarationType = fix(
-        newEnv,
-        {
-          type: "Lam",
-          name: "_bob",
-          expr: {
-            type: "LTuple",
-            values: expr.declarations.map((d) => d.expr),
-            location: mkCoordinate(0, 0, 0),
-          },
-          location: mkCoordinate(0, 0, 0),
-        },
-        constraints,
+    if (expr.type === "Let" || expr.type === "LetRec") {
+      return infer(
+        inferDeclarations(env, expr, constraints, pump),
+        expr.expr,
       );
-      constraints.add(new TTuple(tvs), declarationType);
-      const subst = constraints.solve();
-      const solvedTypeEnv = env.apply(subst);
-      const solvedEnv = expr.declarations.reduce(
-        (acc, declaration, idx) =>
-          acc.extend(
-            declaration.name,
-            solvedTypeEnv.generalise(tvs[idx].apply(subst)),
-          ),
-        solvedTypeEnv,
-      );
-
-      return infer(solvedEnv, expr.expr);
     }
     if (expr.type === "LBool") {
       return typeBool.atLocation(expr.location);
@@ -161,3 +104,91 @@ export const inferExpression = (
 
   return [constraints, infer(env, expression)];
 };
+
+// The environment extended by the names a let or let rec declares, without
+// inferring its body, as a session defines them.  Declared in an environment
+// with no free variables their schemes are closed.
+export const inferDeclarations = (
+  env: TypeEnv,
+  expr: LetExpression | LetRecExpression,
+  constraints: Constraints,
+  pump: Pump,
+): TypeEnv =>
+  expr.type === "Let"
+    ? declare(env, expr.declarations, constraints, pump)
+    : declareRec(env, expr.declarations, constraints, pump);
+
+const declare = (
+  env: TypeEnv,
+  declarations: Array<Declaration>,
+  constraints: Constraints,
+  pump: Pump,
+): TypeEnv => {
+  let newEnv = env;
+
+  for (const declaration of declarations) {
+    const [nc, tb] = inferExpression(
+      newEnv,
+      declaration.expr,
+      constraints,
+      pump,
+    );
+
+    const subst = nc.solve();
+
+    newEnv = newEnv.apply(subst);
+    const sc = newEnv.generalise(tb.apply(subst));
+    newEnv = newEnv.extend(declaration.name, sc);
+  }
+
+  return newEnv;
+};
+
+const declareRec = (
+  env: TypeEnv,
+  declarations: Array<Declaration>,
+  constraints: Constraints,
+  pump: Pump,
+): TypeEnv => {
+  const fix = (env: TypeEnv, expr: Expression): Type => {
+    const [_, t1] = inferExpression(env, expr, constraints, pump);
+    const tv = pump.next();
+
+    constraints.add(new TArr(tv, tv), t1);
+
+    return tv;
+  };
+
+  const tvs = pump.nextN(declarations.length);
+  const newEnv = declarations.reduce(
+    (acc, declaration, idx) =>
+      acc.extend(declaration.name, new Scheme([], tvs[idx])),
+    env,
+  );
+
+  const declarationType = fix(
+    newEnv,
+    {
+      type: "Lam",
+      name: "_bob",
+      expr: {
+        type: "LTuple",
+        values: declarations.map((d) => d.expr),
+        location: mkCoordinate(0, 0, 0),
+      },
+      location: mkCoordinate(0, 0, 0),
+    },
+  );
+  constraints.add(new TTuple(tvs), declarationType);
+  const subst = constraints.solve();
+  const solvedTypeEnv = env.apply(subst);
+
+  return declarations.reduce(
+    (acc, declaration, idx) =>
+      acc.extend(
+        declaration.name,
+        solvedTypeEnv.generalise(tvs[idx].apply(subst)),
+      ),
+    solvedTypeEnv,
+  );
+};
@@ -1,8 +1,15 @@
 // deno-lint-ignore-file no-explicit-any
+import { compile } from "./Closures.ts";
 import { Constraints } from "./Constraints.ts";
 import { AnError } from "./Errors.ts";
 import { inferExpression } from "./Infer.ts";
-import { Expression, Op, parse } from "./Parser.ts";
+import {
+  Expression,
+  LetExpression,
+  LetRecExpression,
+  Op,
+  parse,
+} from "./Parser.ts";
 import { createFresh, emptyTypeEnv, Type } from "./Typing.ts";
 import { TToken } from "./parser/Scanner.ts";
 import { toString } from "https://raw.githubusercontent.com/littlelanguages/scanpiler-deno-lib/0.1.1/location.ts";
@@ -28,28 +35,33 @@ const binaryOps = new Map<number, (v1: any, v2: any) => any>([
   [Op.Divide, (a, b) => (a / b) | 0],
 ]);
 
-const evaluate = (expr: Expression, env: any): any => {
+const noGlobals = new Map<string, any>();
+
+// Evaluates with env, the names bound within the expression, in front of
+// globals, those a session has declared.  The globals are never copied into
+// env so the cost of binding a name does not grow with the session.
+export const evaluate = (
+  expr: Expression,
+  env: any,
+  globals: Map<string, any> = noGlobals,
+): any => {
   if (expr.type === "App") {
-    return evaluate(expr.e1, env)(evaluate(expr.e2, env));
+    return evaluate(expr.e1, env, globals)(evaluate(expr.e2, env, globals));
   }
   if (expr.type === "If") {
-    return evaluate(expr.guard, env)
-      ? evaluate(expr.then, env)
-      : evaluate(expr.else, env);
+    return evaluate(expr.guard, env, globals)
+      ? evaluate(expr.then, env, globals)
+      : evaluate(expr.else, env, globals);
   }
   if (expr.type === "Lam") {
     return (x: any) => {
       const newEnv = { ...env };
       newEnv[expr.name] = x;
-      return evaluate(expr.expr, newEnv);
+      return evaluate(expr.expr, newEnv, globals);
     };
   }
   if (expr.type === "Let" || expr.type === "LetRec") {
-    const newEnv = { ...env };
-    expr.declarations.forEach((d) => {
-      newEnv[d.name] = evaluate(d.expr, newEnv);
-    });
-    return evaluate(expr.expr, newEnv);
+    return evaluate(expr.expr, declare(expr, env, globals), globals);
   }
   if (expr.type === "LBool") {
     return expr.value;
@@ -58,23 +70,48 @@ const evaluate = (expr: Expression, env: any): any => {
     return expr.value;
   }
   if (expr.type === "LTuple") {
-    return expr.values.map((v) => evaluate(v, env));
+    return expr.values.map((v) => evaluate(v, env, globals));
   }
   if (expr.type === "Op") {
     return binaryOps.get(expr.op)!(
-      evaluate(expr.left, env),
-      evaluate(expr.right, env),
+      evaluate(expr.left, env, globals),
+      evaluate(expr.right, env, globals),
     );
   }
   if (expr.type === "Var") {
-    return env[expr.name];
+    return Object.hasOwn(env, expr.name)
+      ? env[expr.name]
+      : globals.get(expr.name);
   }
 };
 
+// env extended by the names a let or let rec declares, without evaluating its body.
+export const declare = (
+  expr: LetExpression | LetRecExpression,
+  env: any,
+  globals: Map<string, any> = noGlobals,
+): any => {
+  const newEnv = { ...env };
+  expr.declarations.forEach((d) => {
+    newEnv[d.name] = evaluate(d.expr, newEnv, globals);
+  });
+  return newEnv;
+};
+
+// Runs t compiled to closures over slot indexed frames, see Closures.ts.
 export const execute = (t: string): [any, Type] => {
   const ast = parse(t);
+  const type = solve(ast);
+
+  return [compile(ast).run(), type];
+};
+
+// As execute, walking the syntax tree with evaluate.
+export const executeReference = (t: string): [any, Type] => {
+  const ast = parse(t);
+  const type = solve(ast);
 
-  return [evaluate(ast, {}), solve(ast)];
+  return [evaluate(ast, {}), type];
 };
 
 const ttokenToString = (ttoken: TToken): string => {
@@ -134,6 +171,8 @@ export const formatError = (e: AnError): string => {
       } but found ${ttokenToString(e.found[0])} at ${toString(e.found[1])}`;
     case "UnificationMismatchError":
       return `Unification Mismatch: unable to unify ${e.type1.prettyPrint()} with ${e.type2.prettyPrint()}`;
+    case "InfiniteTypeError":
+      return `Infinite Type: unable to unify ${e.name} with ${e.type.prettyPrint()}`;
     case "UnknownNameError":
       return `Unknown Name: ${e.name} at ${toString(e.location)}`;
     default:
@@ -1,4 +1,5 @@
 import { execute as executeProgram, formatError } from "./Interpreter.ts";
+import { Session } from "./Session.ts";
 import { Subst, TVar, Type } from "./Typing.ts";
 
 const readline = (): string | null => {
@@ -37,16 +38,36 @@ const renameTypeVariables = (type: Type): Type => {
   return type.apply(subst);
 };
 
+// deno-lint-ignore no-explicit-any
+const format = (value: any, type: Type): string =>
+  `${value}: ${renameTypeVariables(type)}`;
+
 const execute = (line: string) => {
   const [value, type] = executeProgram(line);
 
-  console.log(`${value}: ${renameTypeVariables(type)}`);
+  console.log(format(value, type));
+};
+
+const executeInSession = (session: Session, line: string) => {
+  const { definitions, result } = session.execute(line);
+
+  for (const [name, value, type] of definitions) {
+    console.log(`${name} = ${format(value, type)}`);
+  }
+  if (result !== undefined) {
+    console.log(format(result[0], result[1]));
+  }
 };
 
 if (Deno.args.length === 0) {
   console.log("Welcome to the REPL of the Lambda Calculus Interpreter!");
   console.log('Type ".quit" to exit.');
   console.log("Enter a multi-line expression with ;; as a terminator.");
+  console.log(
+    "A let or let rec without an in declares its names for the rest of the session.",
+  );
+
+  const session = new Session();
 
   while (true) {
     const line = readline();
@@ -60,7 +81,7 @@ if (Deno.args.length === 0) {
       Deno.exit(0);
     } else {
       try {
-        execute(line);
+        executeInSession(session, line);
       } catch (e) {
         console.log(formatError(e));
       }
@@ -0,0 +1,91 @@
+import {
+  assertEquals,
+  assertThrows,
+} from "https://deno.land/std@0.137.0/testing/asserts.ts";
+
+import { Session } from "./Session.ts";
+import { TArr, Type } from "./Typing.ts";
+
+Deno.test("Declarations stay in scope", () => {
+  const session = new Session();
+
+  assertSession(
+    session,
+    "let add a b = a + b",
+    "add = function: Int -> Int -> Int",
+  );
+  assertSession(
+    session,
+    "let incr = add 1 ; ten = 10",
+    "incr = function: Int -> Int",
+    "ten = 10: Int",
+  );
+  assertSession(session, "incr ten", "11: Int");
+});
+
+Deno.test("Declarations are polymorphic", () => {
+  const session = new Session();
+
+  assertSession(session, "let id x = x", "id = function: V1 -> V1");
+  assertSession(session, "if (id True) id 1 else 2", "1: Int");
+});
+
+Deno.test("Recursive declarations", () => {
+  const session = new Session();
+
+  assertSession(
+    session,
+    "let rec isOdd n = if (n == 0) False else isEven (n - 1); isEven n = if (n == 0) True else isOdd (n - 1)",
+    "isOdd = function: Int -> Bool",
+    "isEven = function: Int -> Bool",
+  );
+  assertSession(session, "isOdd 5", "true: Bool");
+});
+
+Deno.test("Declaration with a nested let", () => {
+  const session = new Session();
+
+  assertSession(session, "let x = let y = 3 in y * 2", "x = 6: Int");
+  assertSession(session, "let y = 1 in x + y", "7: Int");
+});
+
+Deno.test("Redefinition leaves earlier definitions", () => {
+  const session = new Session();
+
+  assertSession(session, "let x = 1", "x = 1: Int");
+  assertSession(session, "let f y = x + y", "f = function: Int -> Int");
+  assertSession(session, "let x = True", "x = true: Bool");
+  assertSession(session, "f 1", "2: Int");
+  assertSession(session, "x", "true: Bool");
+});
+
+Deno.test("Failed input leaves the session", () => {
+  const session = new Session();
+
+  assertSession(session, "let x = 1", "x = 1: Int");
+  assertThrows(() => session.execute("let x = True ; y = x + 1"));
+  assertThrows(() => session.execute("y"));
+  assertSession(session, "x", "1: Int");
+});
+
+// deno-lint-ignore no-explicit-any
+const format = (value: any, type: Type): string =>
+  type instanceof TArr ? `function: ${type}` : `${value}: ${type}`;
+
+const assertSession = (
+  session: Session,
+  input: string,
+  ...expected: Array<string>
+) => {
+  const { definitions, result } = session.execute(input);
+
+  assertEquals(
+    [
+      ...definitions.map(([name, value, type]) =>
+        `${name} = ${format(value, type)}`
+      ),
+      ...(result === undefined ? [] : [format(result[0], result[1])]),
+    ],
+    expected,
+  );
+};
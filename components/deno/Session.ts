@@ -0,0 +1,91 @@
+// deno-lint-ignore-file no-explicit-any
+import { compile, compileDeclarations } from "./Closures.ts";
+import { Constraints } from "./Constraints.ts";
+import { inferDeclarations, inferExpression } from "./Infer.ts";
+import { Expression, parse } from "./Parser.ts";
+import { createFresh, Scheme, Type, TypeEnv } from "./Typing.ts";
+import { mkScanner, TToken } from "./parser/Scanner.ts";
+
+export type SessionResult = {
+  definitions: Array<[string, any, Type]>;
+  result?: [any, Type];
+};
+
+// A REPL session, whose inputs are expressions or top level declarations: a
+// let or let rec without its in and body.  A declaration's names stay in
+// scope for the inputs that follow, so each input is only parsed, inferred
+// and evaluated itself rather than with everything declared before it.
+//
+// The schemes of declared names are closed and so are kept as the globals of
+// each input's type environment.  Their values are kept in a map that each
+// input is compiled against, a declared name being resolved to its value as
+// the input is compiled, so redefining a name never changes the meaning of
+// the closures that used the old definition.  An input that fails leaves the
+// session as it was.
+export class Session {
+  private schemes = new Map<string, Scheme>();
+  private values = new Map<string, any>();
+
+  execute(input: string): SessionResult {
+    return isDeclaration(input)
+      ? { definitions: this.declare(parse(`${input}\nin 0`)) }
+      : { definitions: [], result: this.evaluate(parse(input)) };
+  }
+
+  private declare(expr: Expression): Array<[string, any, Type]> {
+    if (expr.type !== "Let" && expr.type !== "LetRec") {
+      return [];
+    }
+
+    const declared = inferDeclarations(
+      new TypeEnv(new Map(), this.schemes),
+      expr,
+      new Constraints(),
+      createFresh(),
+    ).declared();
+    const defined = compileDeclarations(expr, this.values);
+
+    for (const [name, scheme] of declared) {
+      this.schemes.set(name, scheme);
+      this.values.set(name, defined.get(name));
+    }
+
+    return [...declared].map((
+      [name, scheme],
+    ) => [name, defined.get(name), scheme.type]);
+  }
+
+  private evaluate(expr: Expression): [any, Type] {
+    const [constraints, type] = inferExpression(
+      new TypeEnv(new Map(), this.schemes),
+      expr,
+      new Constraints(),
+      createFresh(),
+    );
+    const exprType = type.apply(constraints.solve());
+
+    return [compile(expr, this.values).run(), exprType];
+  }
+}
+
+// A let with one fewer in than it has lets, one being missing from the let itself.
+const isDeclaration = (input: string): boolean => {
+  const scanner = mkScanner(input);
+  let lets = 0;
+  let ins = 0;
+
+  if (scanner.current()[0] !== TToken.Let) {
+    return false;
+  }
+
+  while (scanner.current()[0] !== TToken.EOS) {
+    if (scanner.current()[0] === TToken.Let) {
+      lets += 1;
+    } else if (scanner.current()[0] === TToken.In) {
+      ins += 1;
+    }
+    scanner.next();
+  }
+
+  return ins === lets - 1;
+};
@@ -231,8 +231,17 @@ export class Scheme {
 export class TypeEnv {
   protected items: Map<string, Scheme>;
 
-  constructor(items: Map<string, Scheme>) {
+  // Closed schemes, such as those a session has declared, looked up after
+  // items.  Having no free variables no substitution changes them, so they
+  // are shared rather than copied as the environment is extended.
+  protected globals: Map<string, Scheme>;
+
+  constructor(
+    items: Map<string, Scheme>,
+    globals: Map<string, Scheme> = new Map(),
+  ) {
     this.items = items;
+    this.globals = globals;
   }
 
   extend(name: string, scheme: Scheme): TypeEnv {
@@ -240,11 +249,14 @@ export class TypeEnv {
 
     result.set(name, scheme);
 
-    return new TypeEnv(result);
+    return new TypeEnv(result, this.globals);
   }
 
   apply(s: Subst): TypeEnv {
-    return new TypeEnv(Maps.map(this.items, (scheme) => scheme.apply(s)));
+    return new TypeEnv(
+      Maps.map(this.items, (scheme) => scheme.apply(s)),
+      this.globals,
+    );
   }
 
   ftv(): Set<Var> {
@@ -252,7 +264,12 @@ export class TypeEnv {
   }
 
   scheme(name: string): Scheme | undefined {
-    return this.items.get(name);
+    return this.items.get(name) ?? this.globals.get(name);
+  }
+
+  // The schemes of the names bound in items, as a session adds them to its globals.
+  declared(): Map<string, Scheme> {
+    return this.items;
   }
 
   generalise(t: Type): Scheme {
@@ -0,0 +1,230 @@
+// Runs the front end benchmarks and prints a JSON line for each benchmark and
+// size with the median time of every variant.  Variants of a benchmark compute
+// the same thing in different ways - each run returns its result as a string
+// and the benchmark fails if the variants disagree.  A variant whose cost
+// grows too quickly to be run at every size is only run up to its limit,
+// which --limit raises.
+//
+//   deno run --v8-flags=--stack-size=4000 bench.ts [<benchmark> ...]
+//     [--sizes=<n>,...] [--warmup=<n>] [--repetitions=<n>] [--limit=<n>]
+//
+// Generated programs nest deeply enough to need more than V8's default stack.
+
+import { Constraints } from "./Constraints.ts";
+import { compile } from "./Closures.ts";
+import { inferExpression } from "./Infer.ts";
+import { evaluate, execute } from "./Interpreter.ts";
+import { parse } from "./Parser.ts";
+import { Session } from "./Session.ts";
+import { createFresh, emptyTypeEnv } from "./Typing.ts";
+
+type Variant = { name: string; limit?: number; run: () => string };
+
+type Benchmark = {
+  name: string;
+  sizes: Array<number>;
+  variants: (size: number) => Array<Variant>;
+};
+
+// \f g h -> f 0 + g (f 1) + h 2 (g 2) + ... with size terms.  Every term's
+// constraints refer to the variables bound by those of the terms before it,
+// so solving by composition, which applies each binding to every constraint
+// still to be solved, is quadratic in size.
+const applications = (size: number): string =>
+  "\\f g h -> " + Array.from({ length: size }, (_, i) =>
+    i % 3 === 0 ? `f ${i}` : i % 3 === 1 ? `g (f ${i})` : `h ${i} (g ${i})`
+  ).join(" + ");
+
+const solveBenchmark: Benchmark = {
+  name: "solve",
+  sizes: [1000, 2000, 4000, 10000, 20000],
+  variants: (size) => {
+    const [constraints, type] = inferExpression(
+      emptyTypeEnv,
+      parse(applications(size)),
+      new Constraints(),
+      createFresh(),
+    );
+
+    return [
+      {
+        name: "unionFind",
+        run: () => type.apply(constraints.solve()).toString(),
+      },
+      {
+        name: "composition",
+        limit: 4000,
+        run: () => type.apply(constraints.solveByComposition()).toString(),
+      },
+    ];
+  },
+};
+
+// d0 = \x -> x; d1 = d0 1; d2 = \x -> d0 (d1 + x); ... each using the
+// polymorphic and monomorphic declarations before it.
+const declaration = (i: number): string =>
+  i % 3 === 0
+    ? `d${i} = \\x -> x`
+    : i % 3 === 1
+    ? `d${i} = d${i - 1} ${i}`
+    : `d${i} = \\x -> d${i - 2} (d${i - 1} + x)`;
+
+// The time of one input at the end of a session of size declarations, each
+// entered on its own.  The session only infers and evaluates the input
+// itself, so its time should stay flat as the session grows, where replaying
+// the declarations with the input grows with it.
+const sessionBenchmark: Benchmark = {
+  name: "session",
+  sizes: [1000, 2000, 5000, 10000, 20000],
+  variants: (size) => {
+    const session = new Session();
+    const last = size - 1 - (size - 2) % 3;
+
+    for (let i = 0; i < size; i += 1) {
+      session.execute(`let ${declaration(i)}`);
+    }
+
+    const input = `let x = d${last} in x + d${last}`;
+
+    return [
+      {
+        name: "session",
+        run: () => `${session.execute(input).result![0]}`,
+      },
+      {
+        name: "replay",
+        limit: 2000,
+        run: () =>
+          `${
+            execute(
+              `let ${
+                Array.from({ length: size }, (_, i) => declaration(i)).join(
+                  "; ",
+                )
+              } in ${input}`,
+            )[0]
+          }`,
+      },
+    ];
+  },
+};
+
+// Evaluates recursive programs of the given size with evaluate, which
+// dispatches on the syntax tree and binds names by copying the environment,
+// and with the closures it is compiled to, which address frame slots.  Both
+// are given the parsed program: the closures are compiled once, outside of
+// the runs timed, as the REPL compiles an input once.  JavaScript has no tail
+// calls, so sum's depth is kept within the stack.
+const interpretBenchmark: Benchmark = {
+  name: "interpret",
+  sizes: [15, 20, 25],
+  variants: (size) => {
+    const program = parse(
+      "let rec fib n = if (n == 0) 0 else if (n == 1) 1 else (fib (n - 1)) + (fib (n - 2)) ; " +
+        "sum n acc = if (n == 0) acc else sum (n - 1) (acc + n) " +
+        `in fib ${size} + sum (${size} * 100) 0`,
+    );
+    const compiled = compile(program);
+
+    return [
+      { name: "reference", run: () => `${evaluate(program, {})}` },
+      { name: "closures", run: () => `${compiled.run()}` },
+    ];
+  },
+};
+
+const benchmarks: Array<Benchmark> = [
+  solveBenchmark,
+  sessionBenchmark,
+  interpretBenchmark,
+];
+
+const run = (
+  benchmark: Benchmark,
+  size: number,
+  warmup: number,
+  repetitions: number,
+  limit: number | undefined,
+): boolean => {
+  const results = new Map<string, string>();
+  const times: { [name: string]: number } = {};
+
+  for (const variant of benchmark.variants(size)) {
+    if (
+      variant.limit !== undefined && size > Math.max(variant.limit, limit ?? 0)
+    ) {
+      continue;
+    }
+
+    for (let i = 0; i < warmup; i += 1) {
+      variant.run();
+    }
+
+    const samples: Array<number> = [];
+    for (let i = 0; i < repetitions; i += 1) {
+      const start = performance.now();
+      results.set(variant.name, variant.run());
+      samples.push(performance.now() - start);
+    }
+    samples.sort((a, b) => a - b);
+
+    times[variant.name] = Number(
+      samples[Math.floor(samples.length / 2)].toFixed(3),
+    );
+  }
+
+  console.log(
+    JSON.stringify({ benchmark: benchmark.name, size, medianMs: times }),
+  );
+
+  if (new Set(results.values()).size > 1) {
+    console.log(
+      `${benchmark.name} ${size}: variants disagree: ${
+        [...results.entries()].map(([name, result]) => `${name} = ${result}`)
+          .join(", ")
+      }`,
+    );
+    return false;
+  }
+
+  return true;
+};
+
+const options = new Map(
+  Deno.args.filter((arg) => arg.startsWith("--")).map((arg) => {
+    const [name, value] = arg.substring(2).split("=", 2);
+    return [name, value ?? ""];
+  }),
+);
+const names = Deno.args.filter((arg) => !arg.startsWith("--"));
+
+const unknown = names.filter((name) =>
+  benchmarks.every((benchmark) => benchmark.name !== name)
+);
+if (unknown.length > 0) {
+  console.log(`Unknown benchmark: ${unknown.join(", ")}`);
+  console.log(`Benchmarks: ${benchmarks.map((b) => b.name).join(", ")}`);
+  Deno.exit(1);
+}
+
+const sizes = options.get("sizes")?.split(",").map(Number);
+const warmup = Number(options.get("warmup") ?? 1);
+const repetitions = Number(options.get("repetitions") ?? 5);
+const limit = options.has("limit") ? Number(options.get("limit")) : undefined;
+
+let failed = false;
+for (
+  const benchmark of benchmarks.filter((b) =>
+    names.length === 0 || names.includes(b.name)
+  )
+) {
+  for (const size of sizes ?? benchmark.sizes) {
+    if (!run(benchmark, size, warmup, repetitions, limit)) {
+      failed = true;
+    }
+  }
+}
+
+if (failed) {
+  Deno.exit(1);
+}
@@ -0,0 +1,292 @@
+package stlc
+
+/*
+ * Compiles an expression into a tree of Kotlin closures, each specialised to
+ * the construct it evaluates, rather than dispatching on the syntax tree as
+ * Evaluator does every time a node is evaluated.  Evaluator is kept as the
+ * reference these are checked against.
+ *
+ * Names are resolved before running to an address: how many lambdas out the
+ * name is bound and its slot in that lambda's frame.  A frame is an array
+ * with a slot for the parameter and one for every name the lambda's body
+ * binds outside of nested lambdas, linked to the frame the lambda was created
+ * in.  Every name has a slot of its own so a closure that captures a frame
+ * never sees a slot reused.  A name a session has defined is resolved to its
+ * value.
+ *
+ * Arithmetic and conditions run through runInt and runBool, so an Int is
+ * only boxed when it is stored in a frame, passed or returned.
+ */
+class Frame(@JvmField val slots: Array<Any?>, @JvmField val parent: Frame?)
+
+abstract class Code {
+    abstract fun run(frame: Frame): Any
+
+    open fun runInt(frame: Frame): Int =
+        run(frame) as Int
+
+    open fun runBool(frame: Frame): Boolean =
+        run(frame) as Boolean
+}
+
+/* Code with the size of the frame it runs in. */
+class CompiledExpression(private val code: Code, private val frameSize: Int) {
+    fun run(): Any =
+        code.run(Frame(arrayOfNulls(frameSize), null))
+}
+
+fun compileClosures(e: Expression, globals: Map<String, Any> = emptyMap()): CompiledExpression {
+    val resolver = Resolver(globals)
+    val code = resolver.compile(e)
+
+    return CompiledExpression(code, resolver.frameSize)
+}
+
+/* The values of the names a let or let rec declares, without evaluating its body, as Evaluator.declare. */
+fun declareClosures(e: Expression, globals: Map<String, Any> = emptyMap()): Map<String, Any> {
+    val resolver = Resolver(globals)
+    val code = when (e) {
+        is LetExpression -> resolver.compileLet(e.decls, false) { resolver.declared(e.decls) }
+        is LetRecExpression -> resolver.compileLet(e.decls, true) { resolver.declared(e.decls) }
+        else -> return emptyMap()
+    }
+
+    @Suppress("UNCHECKED_CAST")
+    return CompiledExpression(code, resolver.frameSize).run() as Map<String, Any>
+}
+
+private data class Address(val depth: Int, val slot: Int)
+
+private class Resolver(private val globals: Map<String, Any>) {
+    private val scopes = HashMap<String, ArrayList<Address>>()
+    private var depth = 0
+
+    /* Slots taken in the frame of the lambda being compiled. */
+    var frameSize = 0
+        private set
+
+    fun compile(e: Expression): Code =
+        when (e) {
+            is AppExpression -> App(compile(e.e1), compile(e.e2))
+            is IfExpression -> If(compile(e.e1), compile(e.e2), compile(e.e3))
+
+            is LamExpression -> {
+                val enclosingSize = frameSize
+
+                depth += 1
+                frameSize = 1
+                bind(e.n, Address(depth, 0))
+                val body = compile(e.e)
+                unbind(e.n)
+                val size = frameSize
+                depth -= 1
+                frameSize = enclosingSize
+
+                Lam(body, size)
+            }
+
+            is LetExpression -> compileLet(e.decls, false) { compile(e.e) }
+            is LetRecExpression -> compileLet(e.decls, true) { compile(e.e) }
+            is LBoolExpression -> BoolLiteral(e.v)
+            is LIntExpression -> IntLiteral(e.v)
+            is LTupleExpression -> Tuple(e.es.map { compile(it) }.toTypedArray())
+
+            is OpExpression -> {
+                val left = compile(e.e1)
+                val right = compile(e.e2)
+
+                when (e.op) {
+                    Op.Plus -> Plus(left, right)
+                    Op.Minus -> Minus(left, right)
+                    Op.Times -> Times(left, right)
+                    Op.Divide -> Divide(left, right)
+                    Op.Equals -> Equals(left, right)
+                }
+            }
+
+            is VarExpression -> {
+                val address = scopes[e.name]?.lastOrNull()
+
+                when {
+                    address == null -> Constant(globals[e.name] ?: throw UnknownNameException(e.name, e.location))
+                    address.depth == depth -> Local(address.slot)
+                    address.depth == depth - 1 -> Enclosing(address.slot)
+                    else -> Outer(depth - address.depth, address.slot)
+                }
+            }
+        }
+
+    fun compileLet(decls: List<Declaration>, recursive: Boolean, body: () -> Code): Code {
+        val slots = IntArray(decls.size)
+        val values = ArrayList<Code>(decls.size)
+
+        if (recursive) {
+            decls.forEachIndexed { i, decl -> slots[i] = bindSlot(decl.n) }
+            decls.forEach { values.add(compile(it.e)) }
+        } else {
+            decls.forEachIndexed { i, decl ->
+                values.add(compile(decl.e))
+                slots[i] = bindSlot(decl.n)
+            }
+        }
+
+        val code = Let(values.toTypedArray(), slots, body())
+        decls.asReversed().forEach { unbind(it.n) }
+
+        return code
+    }
+
+    /* Code returning the values of the innermost bindings of decls' names. */
+    fun declared(decls: List<Declaration>): Code {
+        val names = decls.map { it.n }.distinct()
+
+        return Declared(names.toTypedArray(), names.map { scopes.getValue(it).last().slot }.toIntArray())
+    }
+
+    private fun bindSlot(name: String): Int {
+        val slot = frameSize++
+
+        bind(name, Address(depth, slot))
+
+        return slot
+    }
+
+    private fun bind(name: String, address: Address) {
+        scopes.getOrPut(name) { ArrayList() }.add(address)
+    }
+
+    private fun unbind(name: String) {
+        val addresses = scopes.getValue(name)
+
+        addresses.removeAt(addresses.size - 1)
+        if (addresses.isEmpty())
+            scopes.remove(name)
+    }
+}
+
+private class App(private val function: Code, private val argument: Code) : Code() {
+    @Suppress("UNCHECKED_CAST")
+    override fun run(frame: Frame): Any =
+        (function.run(frame) as (Any) -> Any)(argument.run(frame))
+}
+
+private class If(private val guard: Code, private val then: Code, private val otherwise: Code) : Code() {
+    override fun run(frame: Frame): Any =
+        if (guard.runBool(frame)) then.run(frame) else otherwise.run(frame)
+
+    override fun runInt(frame: Frame): Int =
+        if (guard.runBool(frame)) then.runInt(frame) else otherwise.runInt(frame)
+
+    override fun runBool(frame: Frame): Boolean =
+        if (guard.runBool(frame)) then.runBool(frame) else otherwise.runBool(frame)
+}
+
+private class Lam(private val body: Code, private val frameSize: Int) : Code() {
+    override fun run(frame: Frame): Any =
+        { x: Any ->
+            val slots = arrayOfNulls<Any>(frameSize)
+
+            slots[0] = x
+            body.run(Frame(slots, frame))
+        }
+}
+
+private class Let(private val values: Array<Code>, private val slots: IntArray, private val body: Code) : Code() {
+    private fun bind(frame: Frame) {
+        for (i in values.indices) {
+            frame.slots[slots[i]] = values[i].run(frame)
+        }
+    }
+
+    override fun run(frame: Frame): Any {
+        bind(frame)
+        return body.run(frame)
+    }
+
+    override fun runInt(frame: Frame): Int {
+        bind(frame)
+        return body.runInt(frame)
+    }
+
+    override fun runBool(frame: Frame): Boolean {
+        bind(frame)
+        return body.runBool(frame)
+    }
+}
+
+private class Declared(private val names: Array<String>, private val slots: IntArray) : Code() {
+    override fun run(frame: Frame): Any =
+        names.indices.associate { Pair(names[it], frame.slots[slots[it]]!!) }
+}
+
+private class BoolLiteral(private val value: Boolean) : Code() {
+    override fun run(frame: Frame): Any = value
+
+    override fun runBool(frame: Frame): Boolean = value
+}
+
+private class IntLiteral(private val value: Int) : Code() {
+    private val boxed: Any = value
+
+    override fun run(frame: Frame): Any = boxed
+
+    override fun runInt(frame: Frame): Int = value
+}
+
+private class Tuple(private val values: Array<Code>) : Code() {
+    override fun run(frame: Frame): Any =
+        values.map { it.run(frame) }
+}
+
+private class Constant(private val value: Any) : Code() {
+    override fun run(frame: Frame): Any = value
+}
+
+private class Local(private val slot: Int) : Code() {
+    override fun run(frame: Frame): Any = frame.slots[slot]!!
+}
+
+private class Enclosing(private val slot: Int) : Code() {
+    override fun run(frame: Frame): Any = frame.parent!!.slots[slot]!!
+}
+
+private class Outer(private val depth: Int, private val slot: Int) : Code() {
+    override fun run(frame: Frame): Any {
+        var f = frame
+        for (i in 0 until depth)
+            f = f.parent!!
+
+        return f.slots[slot]!!
+    }
+}
+
+private class Plus(private val left: Code, private val right: Code) : Code() {
+    override fun run(frame: Frame): Any = runInt(frame)
+
+    override fun runInt(frame: Frame): Int = left.runInt(frame) + right.runInt(frame)
+}
+
+private class Minus(private val left: Code, private val right: Code) : Code() {
+    override fun run(frame: Frame): Any = runInt(frame)
+
+    override fun runInt(frame: Frame): Int = left.runInt(frame) - right.runInt(frame)
+}
+
+private class Times(private val left: Code, private val right: Code) : Code() {
+    override fun run(frame: Frame): Any = runInt(frame)
+
+    override fun runInt(frame: Frame): Int = left.runInt(frame) * right.runInt(frame)
+}
+
+private class Divide(private val left: Code, private val right: Code) : Code() {
+    override fun run(frame: Frame): Any = runInt(frame)
+
+    override fun runInt(frame: Frame): Int = left.runInt(frame) / right.runInt(frame)
+}
+
+/* Only ints are compared: == is Int -> Int -> Bool. */
+private class Equals(private val left: Code, private val right: Code) : Code() {
+    override fun run(frame: Frame): Any = runBool(frame)
+
+    override fun runBool(frame: Frame): Boolean = left.runInt(frame) == right.runInt(frame)
+}
@@ -3,14 +3,85 @@ package stlc
 typealias Constraint = Pair<Type, Type>
 
 data class Constraints(private val constraints: MutableList<Constraint> = mutableListOf()) {
+    private var unionFind: Solver = InternedSolver()
+
+    /* Infers again with locations to say why the constraints cannot be solved, where inference has said how. */
+    private var explanation: (() -> Nothing)? = null
+
+    /* The number of constraints, from the first, that unionFind has unified. */
+    private var solved = 0
+
     fun add(t1: Type, t2: Type) {
         constraints.add(Pair(t1, t2))
     }
 
-    fun solve(): Subst =
+    fun solve(): Subst {
+        solveAdded()
+
+        return unionFind.subst()
+    }
+
+    /* Records that v was created at level, the depth of let declarations within which it was inferred. */
+    fun atLevel(v: TVar, level: Int): TVar {
+        unionFind.setLevel(v, level)
+
+        return v
+    }
+
+    /* Solves and then quantifies every variable of type that was created, and is still only reachable, deeper than level. */
+    fun generalise(type: Type, level: Int): Scheme {
+        solveAdded()
+
+        return unionFind.generalise(type, level)
+    }
+
+    fun explainedBy(explanation: () -> Nothing): Constraints {
+        this.explanation = explanation
+
+        return this
+    }
+
+    private fun solveAdded() {
+        if (solved < constraints.size)
+            unionFind.changing()
+
+        while (solved < constraints.size) {
+            val (t1, t2) = constraints[solved++]
+
+            try {
+                unionFind.unify(t1, t2)
+            } catch (e: Unsolvable) {
+                explain()
+            }
+        }
+    }
+
+    /*
+     * Throws the exception that says where the types that cannot be unified
+     * came from, which interned types do not know: inference is run again
+     * over located types where it has said how, and otherwise the constraints
+     * are unified again with the locations they were added with.
+     */
+    private fun explain(): Nothing {
+        explanation?.invoke()
+
+        val located = LocatedSolver()
+        constraints.subList(0, solved).forEach { (t1, t2) -> located.unify(t1, t2) }
+
+        throw IllegalStateException("Unsolvable constraints unify with locations: $this")
+    }
+
+    /* The original solver, which composes a substitution at every step, kept as a reference for solve. */
+    fun solveByComposition(): Subst =
         solver(constraints)
 
     override fun toString(): String = constraints.joinToString(", ") { "${it.first} ~ ${it.second}" }
+
+    companion object {
+        /* Constraints solved over their located types, slower than over interned ones but able to say where a type came from. */
+        fun located(): Constraints =
+            Constraints().also { it.unionFind = LocatedSolver() }
+    }
 }
 
 private data class Unifier(val subst: Subst, val constraints: List<Constraint>)
@@ -70,3 +141,326 @@ private fun solver(constraints: List<Constraint>): Subst {
 
     return su
 }
+
+private interface Solver {
+    fun setLevel(v: TVar, level: Int)
+
+    /* Called before more constraints are unified. */
+    fun changing()
+
+    fun unify(t1: Type, t2: Type)
+
+    fun generalise(type: Type, level: Int): Scheme
+
+    fun subst(): Subst
+}
+
+/* Thrown by InternedSolver for constraints that cannot be unified, which LocatedSolver then explains. */
+private class Unsolvable : RuntimeException()
+
+/*
+ * Solves constraints in place over the ids of a TypeStore.  A type variable is
+ * bound at most once, to a type or to another variable, and a variable is
+ * resolved by following its bindings, compressing the chain as it goes.
+ * Nothing is applied to the constraints that remain so, apart from the
+ * occurs check, solving is close to linear in their size.  Variables are
+ * bound in the same direction as solver binds them so that both produce the
+ * same types.
+ *
+ * Each unbound variable also has a level, the depth of let declarations
+ * within which it was created, and binding a variable lowers the level of
+ * every variable it is bound to to its own.  A variable deeper than a let is
+ * then not reachable from the names in scope at that let, so generalising
+ * need not look at them.  Variables without a level, those of the initial
+ * environment, are at level 0 and never generalised.
+ *
+ * As types are interned two are equal exactly when their ids are, and a type
+ * is resolved to a new id only where a variable within it is bound, so
+ * resolving an untouched type makes nothing.  Each id's resolution is kept
+ * until more constraints are unified.
+ */
+private class InternedSolver : Solver {
+    private val store = TypeStore()
+
+    /* By id, though only variables are bound, growing as the store does. */
+    private var bindings = IntArray(INITIAL_CAPACITY) { UNBOUND }
+    private var levels = IntArray(INITIAL_CAPACITY)
+    private var resolutions = IntArray(INITIAL_CAPACITY)
+
+    /* The generation each id was resolved in, those of earlier generations being stale. */
+    private var resolvedIn = IntArray(INITIAL_CAPACITY)
+    private var generation = 1
+
+    private val bound = ArrayList<Int>()
+
+    override fun subst(): Subst =
+        Subst(bound.associate { Pair(store.name(it), store.type(resolve(it))) })
+
+    override fun setLevel(v: TVar, level: Int) {
+        val id = store.variable(v.name)
+
+        reserve()
+        levels[id] = level
+    }
+
+    override fun generalise(type: Type, level: Int): Scheme {
+        val t = resolve(store.intern(type))
+
+        return Scheme(store.ftv(t).filter { levelOf(store.variable(it)) > level }.toSet(), store.type(t))
+    }
+
+    override fun changing() {
+        generation += 1
+    }
+
+    override fun unify(t1: Type, t2: Type) {
+        if (!unify(store.intern(t1), store.intern(t2)))
+            throw Unsolvable()
+    }
+
+    /* Makes room for every id in the store, which resolving adds to. */
+    private fun reserve() {
+        val capacity = bindings.size
+
+        if (store.count > capacity) {
+            val grown = maxOf(store.count, 2 * capacity)
+
+            bindings = bindings.copyOf(grown).also { it.fill(UNBOUND, capacity, grown) }
+            levels = levels.copyOf(grown)
+            resolutions = resolutions.copyOf(grown)
+            resolvedIn = resolvedIn.copyOf(grown)
+        }
+    }
+
+    private fun bindingOf(id: Int): Int =
+        if (id < bindings.size) bindings[id] else UNBOUND
+
+    private fun levelOf(id: Int): Int =
+        if (id < levels.size) levels[id] else 0
+
+    private fun find(id: Int): Int {
+        var end = id
+        while (bindingOf(end) != UNBOUND)
+            end = bindings[end]
+
+        var v = id
+        while (v != end) {
+            val next = bindings[v]
+            bindings[v] = end
+            v = next
+        }
+
+        return end
+    }
+
+    private fun bind(v: Int, type: Int): Boolean {
+        if (occurs(v, levelOf(v), type))
+            return false
+
+        reserve()
+        bindings[v] = type
+        bound.add(v)
+
+        return true
+    }
+
+    /* Lowers the level of every other variable within type to at most level on the way. */
+    private fun occurs(v: Int, level: Int, type: Int): Boolean {
+        if (!store.hasVariables(type))
+            return false
+
+        val t = find(type)
+
+        return when {
+            store.isVariable(t) -> {
+                if (levelOf(t) > level) {
+                    reserve()
+                    levels[t] = level
+                }
+                t == v
+            }
+
+            store.isArrow(t) -> occurs(v, level, store.domain(t)) || occurs(v, level, store.range(t))
+            store.isTuple(t) -> (0 until store.size(t)).any { occurs(v, level, store.element(t, it)) }
+            else -> false
+        }
+    }
+
+    private fun unify(t1: Int, t2: Int): Boolean {
+        val r1 = find(t1)
+        val r2 = find(t2)
+
+        return when {
+            r1 == r2 -> true
+            store.isVariable(r1) -> bind(r1, r2)
+            store.isVariable(r2) -> bind(r2, r1)
+            store.isArrow(r1) && store.isArrow(r2) ->
+                unify(store.domain(r1), store.domain(r2)) && unify(store.range(r1), store.range(r2))
+
+            store.isTuple(r1) && store.isTuple(r2) ->
+                store.size(r1) == store.size(r2) && (0 until store.size(r1)).all { unify(store.element(r1, it), store.element(r2, it)) }
+
+            else -> false
+        }
+    }
+
+    /* Resolves every variable within type, returning type itself if none is bound. */
+    private fun resolve(type: Int): Int {
+        if (!store.hasVariables(type))
+            return type
+
+        if (type < resolvedIn.size && resolvedIn[type] == generation)
+            return resolutions[type]
+
+        val t = find(type)
+        val result = when {
+            store.isArrow(t) -> store.arrow(resolve(store.domain(t)), resolve(store.range(t)))
+            store.isTuple(t) -> {
+                val size = store.size(t)
+
+                if ((0 until size).all { resolve(store.element(t, it)) == store.element(t, it) }) t
+                else store.tuple(IntArray(size) { resolve(store.element(t, it)) })
+            }
+
+            else -> t
+        }
+
+        reserve()
+        resolutions[type] = result
+        resolvedIn[type] = generation
+
+        return result
+    }
+
+    companion object {
+        private const val INITIAL_CAPACITY = 64
+        private const val UNBOUND = -1
+    }
+}
+
+/*
+ * Solves constraints as InternedSolver does but over the located types
+ * inference made, binding a variable to a type at the variable's location
+ * where the type has none, so that a type that cannot be unified is reported
+ * with where it came from.
+ */
+private class LocatedSolver : Solver {
+    private val bindings = HashMap<Var, Type>()
+    private val levels = HashMap<Var, Int>()
+
+    /* The resolved types of bound variables, valid until more constraints are unified. */
+    private var resolved = HashMap<Var, Type>()
+
+    override fun subst(): Subst =
+        Subst(bindings.keys.toList().associateWith { resolve(TVar(it)) })
+
+    override fun setLevel(v: TVar, level: Int) {
+        levels[v.name] = level
+    }
+
+    override fun generalise(type: Type, level: Int): Scheme {
+        val t = resolve(type)
+
+        return Scheme(t.ftv().filter { levelOf(it) > level }.toSet(), t)
+    }
+
+    override fun changing() {
+        if (resolved.isNotEmpty())
+            resolved = HashMap()
+    }
+
+    private fun levelOf(name: Var): Int =
+        levels[name] ?: 0
+
+    private fun find(t: Type): Type {
+        var end = t
+        while (end is TVar)
+            end = bindings[end.name] ?: break
+
+        var v = t
+        while (v is TVar && v !== end) {
+            val next = bindings[v.name] ?: break
+            bindings[v.name] = end
+            v = next
+        }
+
+        return end
+    }
+
+    private fun bind(v: TVar, type: Type) {
+        if (occurs(v.name, levelOf(v.name), type))
+            throw InfiniteTypeException(v.name, resolve(type))
+
+        bindings[v.name] = if (v.location == null || type.location != null) type else type.atLocation(v.location)
+    }
+
+    /* Lowers the level of every other variable within type to at most level on the way. */
+    private fun occurs(name: Var, level: Int, type: Type): Boolean =
+        if (!type.hasVariables) false
+        else when (val t = find(type)) {
+            is TVar -> {
+                if (levelOf(t.name) > level)
+                    levels[t.name] = level
+                t.name == name
+            }
+
+            is TArr -> occurs(name, level, t.domain) || occurs(name, level, t.range)
+            is TTuple -> t.types.any { occurs(name, level, it) }
+            else -> false
+        }
+
+    override fun unify(t1: Type, t2: Type) {
+        val r1 = find(t1)
+        val r2 = find(t2)
+
+        when {
+            r1 is TVar && r2 is TVar && r1.name == r2.name -> {}
+            r1 is TVar -> bind(r1, r2)
+            r2 is TVar -> bind(r2, r1)
+            r1 is TArr && r2 is TArr -> {
+                unify(r1.domain, r2.domain)
+                unify(r1.range, r2.range)
+            }
+
+            r1 is TTuple && r2 is TTuple ->
+                if (r1.types.size != r2.types.size)
+                    throw UnificationMismatchException(resolve(r1), resolve(r2))
+                else
+                    r1.types.zip(r2.types).forEach { (a, b) -> unify(a, b) }
+
+            r1 is TCon && r1 == r2 -> {}
+            else -> throw UnificationMismatchException(resolve(r1), resolve(r2))
+        }
+    }
+
+    /* Resolves every variable within type as Type.apply does, returning type itself if none is bound. */
+    private fun resolve(type: Type): Type {
+        if (type is TVar)
+            resolved[type.name]?.let { return it }
+
+        if (!type.hasVariables)
+            return type
+
+        val result = when (val t = find(type)) {
+            is TArr -> {
+                val domain = resolve(t.domain)
+                val range = resolve(t.range)
+
+                if (domain === t.domain && range === t.range) t else TArr(domain, range)
+            }
+
+            is TTuple -> {
+                val types = t.types.map { resolve(it) }
+
+                if (types.indices.all { types[it] === t.types[it] }) t else TTuple(types)
+            }
+
+            else -> t
+        }
+
+        if (type is TVar && bindings.containsKey(type.name))
+            resolved[type.name] = result
+
+        return result
+    }
+}
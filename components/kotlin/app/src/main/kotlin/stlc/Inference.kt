@@ -5,20 +5,69 @@ import io.littlelanguages.scanpiler.LocationCoordinate
 data class InferResult(val constraints: Constraints, val type: Type)
 
 fun infer(typeEnv: TypeEnv, e: Expression): InferResult {
-    val state = Inference()
+    val state = Inference(typeEnv, Constraints().explainedBy { explain(typeEnv) { infer(e) } })
 
-    val type = state.infer(typeEnv, e)
+    val type = state.infer(e)
 
     return InferResult(state.constraints, type)
 }
 
-private class Inference(val constraints: Constraints = Constraints(), val pump: Pump = Pump()) {
-    fun infer(typeEnv: TypeEnv, e: Expression): Type =
+/*
+ * The schemes of the names a let or let rec declares, without inferring its
+ * body, as a session defines them.  Declared at the top level they are closed
+ * and so hold in any later environment.
+ */
+fun inferDeclarations(typeEnv: TypeEnv, e: Expression): List<Pair<String, Scheme>> {
+    val state = Inference(typeEnv, Constraints().explainedBy { explain(typeEnv) { declarations(e) } })
+
+    return state.declarations(e)
+}
+
+/*
+ * Infers again with the constraints solved over located types, for those
+ * that cannot be solved over interned ones, to throw the exception that says
+ * where the types that fail to unify came from.  A scheme generalised by the
+ * interned solver has lost its locations so the inference is repeated from
+ * the start rather than the constraints replayed.
+ */
+private fun explain(typeEnv: TypeEnv, steps: Inference.() -> Unit): Nothing {
+    val state = Inference(typeEnv, Constraints.located())
+
+    state.steps()
+    state.constraints.solve()
+
+    throw IllegalStateException("Constraints unsolvable over interned types solved over located ones")
+}
+
+/*
+ * Generalises by level rather than by the free variables of the environment.
+ * The level is the depth of let declarations being inferred and every
+ * variable is created at the current level.  A declaration is solved, which
+ * only unifies the constraints added since the last declaration, and the
+ * variables of its type still deeper than the let are those that no name in
+ * scope can reach.
+ *
+ * Names are bound in a table of scopes that is updated in place as
+ * inference enters and leaves them, falling back to the initial environment.
+ */
+private class Inference(private val typeEnv: TypeEnv, val constraints: Constraints) {
+    private val pump = Pump()
+    private val scopes = HashMap<String, ArrayList<Scheme>>()
+    private var level = 0
+
+    fun declarations(e: Expression): List<Pair<String, Scheme>> =
+        when (e) {
+            is LetExpression -> declare(e.decls)
+            is LetRecExpression -> declareRec(e.decls)
+            else -> emptyList()
+        }
+
+    fun infer(e: Expression): Type =
         when (e) {
             is AppExpression -> {
-                val t1 = infer(typeEnv, e.e1)
-                val t2 = infer(typeEnv, e.e2)
-                val tv = pump.next()
+                val t1 = infer(e.e1)
+                val t2 = infer(e.e2)
+                val tv = fresh()
 
                 constraints.add(t1, TArr(t2, tv))
 
@@ -26,9 +75,9 @@ private class Inference(val constraints: Constraints = Constraints(), val pump:
             }
 
             is IfExpression -> {
-                val t1 = infer(typeEnv, e.e1)
-                val t2 = infer(typeEnv, e.e2)
-                val t3 = infer(typeEnv, e.e3)
+                val t1 = infer(e.e1)
+                val t2 = infer(e.e2)
+                val t3 = infer(e.e3)
 
                 constraints.add(t1, typeBool)
                 constraints.add(t2, t3)
@@ -37,8 +86,11 @@ private class Inference(val constraints: Constraints = Constraints(), val pump:
             }
 
             is LamExpression -> {
-                val tv = pump.next()
-                val t = infer(typeEnv + Pair(e.n, Scheme(setOf(), tv)), e.e)
+                val tv = fresh()
+
+                bind(e.n, Scheme(setOf(), tv))
+                val t = infer(e.e)
+                unbind(e.n)
 
                 TArr(tv, t)
             }
@@ -50,47 +102,30 @@ private class Inference(val constraints: Constraints = Constraints(), val pump:
                 typeInt.atLocation(e.location)
 
             is LTupleExpression ->
-                TTuple(e.es.map { infer(typeEnv, it) })
+                TTuple(e.es.map { infer(it) })
 
             is LetExpression -> {
-                var newTypeEnv = typeEnv
-
-                for (decl in e.decls) {
-                    val interimConstraints = constraints
-                    val inferredType = inferExpression(newTypeEnv, decl.e, interimConstraints)
-                    val subst = interimConstraints.solve()
-                    newTypeEnv = newTypeEnv.apply(subst)
-                    val sc = newTypeEnv.generalise(inferredType.apply(subst))
-                    newTypeEnv = newTypeEnv.extend(decl.n, sc)
-                }
-
-                infer(newTypeEnv, e.e)
+                declare(e.decls)
+
+                val t = infer(e.e)
+                e.decls.asReversed().forEach { unbind(it.n) }
+
+                t
             }
 
             is LetRecExpression -> {
-                val tvs = pump.nextN(e.decls.size)
-
-                val interimTypeEnv = typeEnv + e.decls.zip(tvs).map { (decl, tv) -> Pair(decl.n, Scheme(setOf(), tv)) }
-                val coordinate = LocationCoordinate(0, 0, 0)
-                val declarationType = fix(
-                    interimTypeEnv,
-                    LamExpression("_bob", LTupleExpression(e.decls.map { it.e }, coordinate), coordinate),
-                    constraints
-                )
-                constraints.add(declarationType, TTuple(tvs))
-
-                val subst = constraints.solve()
-                val solvedTypeEnv = typeEnv.apply(subst)
-                val newTypeEnv = solvedTypeEnv +
-                        e.decls.zip(tvs).map { (decl, tv) -> Pair(decl.n, solvedTypeEnv.generalise(tv.apply(subst))) }
-
-                infer(newTypeEnv, e.e)
+                declareRec(e.decls)
+
+                val t = infer(e.e)
+                e.decls.asReversed().forEach { unbind(it.n) }
+
+                t
             }
 
             is OpExpression -> {
-                val t1 = infer(typeEnv, e.e1)
-                val t2 = infer(typeEnv, e.e2)
-                val tv = pump.next().atLocation(e.location)
+                val t1 = infer(e.e1)
+                val t2 = infer(e.e2)
+                val tv = fresh().atLocation(e.location)
 
                 val u1 = TArr(t1, TArr(t2, tv), e.location)
                 val u2 = (ops[e.op] ?: typeError).atLocation(e.location)
@@ -100,23 +135,65 @@ private class Inference(val constraints: Constraints = Constraints(), val pump:
             }
 
             is VarExpression -> {
-                val scheme = typeEnv[e.name] ?: throw UnknownNameException(e.name, e.location)
+                val scheme = scopes[e.name]?.lastOrNull() ?: typeEnv[e.name] ?: throw UnknownNameException(e.name, e.location)
 
-                scheme.instantiate(pump).atLocation(e.location)
+                scheme.instantiate { fresh() }.atLocation(e.location)
             }
         }
 
-    private fun fix(typeEnv: TypeEnv, e: Expression, constraints: Constraints): Type {
-        val t1 = inferExpression(typeEnv, e, constraints)
-        val tv = pump.next()
+    /* Binds each of decls, in turn, returning their schemes. */
+    fun declare(decls: List<Declaration>): List<Pair<String, Scheme>> =
+        decls.map { decl ->
+            level += 1
+            val inferredType = infer(decl.e)
+            level -= 1
+
+            val scheme = constraints.generalise(inferredType, level)
+            bind(decl.n, scheme)
+
+            Pair(decl.n, scheme)
+        }
+
+    fun declareRec(decls: List<Declaration>): List<Pair<String, Scheme>> {
+        level += 1
+        val tvs = decls.map { fresh() }
+
+        decls.zip(tvs).forEach { (decl, tv) -> bind(decl.n, Scheme(setOf(), tv)) }
+        val coordinate = LocationCoordinate(0, 0, 0)
+        val declarationType = fix(
+            LamExpression("_bob", LTupleExpression(decls.map { it.e }, coordinate), coordinate)
+        )
+        constraints.add(declarationType, TTuple(tvs))
+        decls.asReversed().forEach { unbind(it.n) }
+        level -= 1
+
+        return decls.zip(tvs).map { (decl, tv) -> Pair(decl.n, constraints.generalise(tv, level)) }
+            .onEach { (name, scheme) -> bind(name, scheme) }
+    }
+
+    private fun fix(e: Expression): Type {
+        val t1 = infer(e)
+        val tv = fresh()
 
         constraints.add(TArr(tv, tv), t1)
 
         return tv
     }
 
-    private fun inferExpression(typeEnv: TypeEnv, e: Expression, constraints: Constraints): Type =
-        Inference(constraints, pump).infer(typeEnv, e)
+    private fun fresh(): TVar =
+        constraints.atLevel(pump.next(), level)
+
+    private fun bind(name: String, scheme: Scheme) {
+        scopes.getOrPut(name) { ArrayList() }.add(scheme)
+    }
+
+    private fun unbind(name: String) {
+        val schemes = scopes.getValue(name)
+
+        schemes.removeAt(schemes.size - 1)
+        if (schemes.isEmpty())
+            scopes.remove(name)
+    }
 }
 
 val ops = mapOf<Op, Type>(
@@ -4,14 +4,26 @@ data class ExecuteResult(val value: Any, val type: Type)
 
 fun execute(input: String): ExecuteResult {
     val ast = parse(input)
+    val exprType = solve(ast)
+
+    return ExecuteResult(compileClosures(ast).run(), exprType)
+}
+
+/* As execute, evaluating with Evaluator, the reference for the compiled closures. */
+fun executeReference(input: String): ExecuteResult {
+    val ast = parse(input)
+    val exprType = solve(ast)
+
+    return ExecuteResult(Evaluator(emptyMap()).evaluate(ast, emptyMap()), exprType)
+}
+
+private fun solve(ast: Expression): Type {
     val (constraints, type) = infer(
         emptyTypeEnv,
         ast
     )
 
-    val exprType = type.apply(constraints.solve())
-
-    return ExecuteResult(evaluate(ast, emptyMap()), exprType)
+    return type.apply(constraints.solve())
 }
 
 private val binaryOps: Map<Op, (Any, Any) -> Any> = mapOf(
@@ -22,48 +34,74 @@ private val binaryOps: Map<Op, (Any, Any) -> Any> = mapOf(
     Pair(Op.Equals) { a: Any, b: Any -> a == b }
 )
 
-@Suppress("UNCHECKED_CAST")
-private fun evaluate(ast: Expression, env: Map<String, Any>): Any =
-    when (ast) {
-        is AppExpression -> {
-            val function = evaluate(ast.e1, env) as (Any) -> Any
+/*
+ * Evaluates with env, the names bound within the expression, in front of
+ * globals, those a session has defined.  The globals are never copied into
+ * env so the cost of binding a name does not grow with the session.
+ */
+class Evaluator(private val globals: Map<String, Any>) {
+    @Suppress("UNCHECKED_CAST")
+    fun evaluate(ast: Expression, env: Map<String, Any>): Any =
+        when (ast) {
+            is AppExpression -> {
+                val function = evaluate(ast.e1, env) as (Any) -> Any
+
+                function(evaluate(ast.e2, env))
+            }
 
-            function(evaluate(ast.e2, env))
-        }
+            is IfExpression ->
+                if (evaluate(ast.e1, env) as Boolean) {
+                    evaluate(ast.e2, env)
+                } else {
+                    evaluate(ast.e3, env)
+                }
+
+            is LamExpression ->
+                { x: Any -> evaluate(ast.e, env + Pair(ast.n, x)) }
+
+            is LetExpression -> {
+                var newEnv = env
+
+                for (decl in ast.decls) {
+                    newEnv = newEnv + Pair(decl.n, evaluate(decl.e, newEnv))
+                }
 
-        is IfExpression ->
-            if (evaluate(ast.e1, env) as Boolean) {
-                evaluate(ast.e2, env)
-            } else {
-                evaluate(ast.e3, env)
+                evaluate(ast.e, newEnv)
             }
 
-        is LamExpression ->
-            { x: Any -> evaluate(ast.e, env + Pair(ast.n, x)) }
+            is LetRecExpression -> {
+                val newEnv = env.toMutableMap()
 
-        is LetExpression -> {
-            var newEnv = env
+                for (decl in ast.decls) {
+                    newEnv[decl.n] = evaluate(decl.e, newEnv)
+                }
 
-            for (decl in ast.decls) {
-                newEnv = newEnv + Pair(decl.n, evaluate(decl.e, newEnv))
+                evaluate(ast.e, newEnv)
             }
 
-            evaluate(ast.e, newEnv)
+            is LIntExpression -> ast.v
+            is LBoolExpression -> ast.v
+            is OpExpression -> binaryOps[ast.op]!!(evaluate(ast.e1, env), evaluate(ast.e2, env))
+            is VarExpression -> env[ast.name] ?: globals.getValue(ast.name)
+            is LTupleExpression -> ast.es.map { evaluate(it, env) }
         }
 
-        is LetRecExpression -> {
-            val newEnv = env.toMutableMap()
+    /* The values of the names a let or let rec declares, without evaluating its body. */
+    fun declare(e: Expression): Map<String, Any> =
+        when (e) {
+            is LetExpression ->
+                e.decls.fold(emptyMap<String, Any>()) { env, decl -> env + Pair(decl.n, evaluate(decl.e, env)) }
 
-            for (decl in ast.decls) {
-                newEnv[decl.n] = evaluate(decl.e, newEnv)
+            is LetRecExpression -> {
+                val env = HashMap<String, Any>()
+
+                for (decl in e.decls) {
+                    env[decl.n] = evaluate(decl.e, env)
+                }
+
+                env
             }
 
-            evaluate(ast.e, newEnv)
+            else -> emptyMap()
         }
-
-        is LIntExpression -> ast.v
-        is LBoolExpression -> ast.v
-        is OpExpression -> binaryOps[ast.op]!!(evaluate(ast.e1, env), evaluate(ast.e2, env))
-        is VarExpression -> env[ast.name]!!
-        is LTupleExpression -> ast.es.map { evaluate(it, env) }
-    }
+}
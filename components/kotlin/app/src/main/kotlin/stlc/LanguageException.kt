@@ -65,6 +65,11 @@ data class UnificationManyMismatchException(val t1: List<Type>, val t2: List<Typ
         "Unification Mismatch: unable to unify ${t1.joinToString(", ") { it.prettyPrint() }} with ${t2.joinToString(", ") { it.prettyPrint() }}"
 }
 
+data class InfiniteTypeException(val name: Var, val type: Type) : LanguageException() {
+    override fun formatMessage(): String =
+        "Infinite Type: unable to unify $name with ${type.prettyPrint()}"
+}
+
 data class UnknownNameException(val name: String, val location: Location) : LanguageException() {
     override fun formatMessage(): String =
         "Unknown Name: $name at ${location.asString()}"
@@ -1,14 +1,23 @@
 package stlc
 
-import stlc.bci.compileTo
+import stlc.bci.CompileCache
+import stlc.bci.compileProgram
 import java.io.File
 import kotlin.system.exitProcess
 
-fun main(args: Array<String>) {
+fun main(arguments: Array<String>) {
+    val parallel = arguments.contains("--parallel")
+    val noCache = arguments.contains("--no-cache")
+    val cacheStats = arguments.contains("--cache-stats")
+    val args = arguments.filter { it != "--parallel" && it != "--no-cache" && it != "--cache-stats" }
+
     if (args.isEmpty()) {
         println("Welcome to the REPL of the Lambda Calculus Interpreter!")
         println("Type \".quit\" to exit.")
         println("Enter a multi-line expression with ;; as a terminator.")
+        println("A let or let rec without an in declares its names for the rest of the session.")
+
+        val session = Session()
 
         while (true) {
             val input = readline().trim()
@@ -19,7 +28,7 @@ fun main(args: Array<String>) {
             }
 
             try {
-                executeInput(input)
+                executeInput(session, input)
             } catch (e: LanguageException) {
                 println(e.formatMessage())
             }
@@ -34,39 +43,45 @@ fun main(args: Array<String>) {
         }
     } else if (args.size == 2) {
         println("Compiling ${args[0]} to ${args[1]}")
+        val input = File(args[0]).readText()
+        val cache = if (noCache) null else CompileCache(CompileCache.defaultDirectory())
         try {
-            compileTo(File(args[0]).readText(), args[1])
+            val program = cache?.compile(input, parallel) ?: compileProgram(input, parallel)
+            val output = File(args[1])
+
+            output.delete()
+            output.appendBytes(program.bytes)
         } catch (e: LanguageException) {
             println(e.formatMessage())
             exitProcess(1)
+        } finally {
+            if (cacheStats && cache != null)
+                System.err.println("{\"cacheHits\": ${cache.hits}, \"cacheMisses\": ${cache.misses}, \"cacheFailures\": ${cache.failures}}")
         }
     } else {
-        println("Usage: tlca [file-name] [output-file]")
+        println("Usage: tlca [file-name] [[--parallel] [--no-cache] [--cache-stats] output-file]")
     }
 }
 
-private fun renameTypeVariables(t: Type): Type {
-    var i = 0
+private fun executeInput(input: String) {
+    println(format(execute(input)))
+}
 
-    fun nextVar(): String =
-        if (i < 26)
-            ('a' + i++).toString()
-        else
-            "t${i++ - 26}"
+private fun executeInput(session: Session, input: String) {
+    val (definitions, result) = session.execute(input)
 
-    val vars = t.ftv().toList()
-    val subst = Subst(vars.zip(vars.map { TVar(nextVar()) }).toMap())
-    return t.apply(subst)
+    for ((name, definition) in definitions) {
+        println("$name = ${format(definition)}")
+    }
+    if (result != null) {
+        println(format(result))
+    }
 }
 
-private fun executeInput(input: String) {
-    val (value, type) = execute(input)
+private fun format(result: ExecuteResult): String {
+    val (value, type) = result
 
-    if (type is TArr) {
-        println("function: ${renameTypeVariables(type)}")
-    } else {
-        println("$value: ${renameTypeVariables(type)}")
-    }
+    return if (type is TArr) "function: ${renameTypeVariables(type)}" else "$value: ${renameTypeVariables(type)}"
 }
 
 private fun readline(): String {
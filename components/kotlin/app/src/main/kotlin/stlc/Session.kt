@@ -0,0 +1,72 @@
+package stlc
+
+import stlc.parser.Scanner
+import stlc.parser.TToken
+import java.io.StringReader
+
+data class SessionResult(val definitions: List<Pair<String, ExecuteResult>>, val result: ExecuteResult?)
+
+/*
+ * A REPL session, whose inputs are expressions or top level declarations: a
+ * let or let rec without its in and body.  A declaration's names stay in
+ * scope for the inputs that follow, so each input is only parsed, inferred
+ * and evaluated itself rather than with everything declared before it.
+ *
+ * The schemes of declared names are closed and so are kept in a table that
+ * each input's inference looks names up in.  Their values are kept in a
+ * table that each input's compiled closures resolve names to as they are
+ * compiled, so redefining a name leaves the closures that used the old
+ * definition as they were.  An input that fails leaves the session as it
+ * was.
+ */
+class Session {
+    private val schemes = HashMap<String, Scheme>()
+
+    /* A view of schemes which, having no free variables, leave it none to cache. */
+    private val typeEnv = TypeEnv(schemes)
+    private val values = HashMap<String, Any>()
+
+    fun execute(input: String): SessionResult =
+        if (isDeclaration(input))
+            SessionResult(declare(parse("$input\nin 0")), null)
+        else
+            SessionResult(emptyList(), evaluate(parse(input)))
+
+    private fun declare(e: Expression): List<Pair<String, ExecuteResult>> {
+        val declared = inferDeclarations(typeEnv, e)
+        val defined = declareClosures(e, values)
+
+        values.putAll(defined)
+        schemes.putAll(declared)
+
+        return declared.toMap().map { (name, scheme) -> Pair(name, ExecuteResult(defined.getValue(name), scheme.type)) }
+    }
+
+    private fun evaluate(e: Expression): ExecuteResult {
+        val (constraints, type) = infer(typeEnv, e)
+        val exprType = type.apply(constraints.solve())
+
+        return ExecuteResult(compileClosures(e, values).run(), exprType)
+    }
+}
+
+/* A let with one fewer in than it has lets, one being missing from the let itself. */
+private fun isDeclaration(input: String): Boolean {
+    val scanner = Scanner(StringReader(input))
+    var lets = 0
+    var ins = 0
+
+    if (scanner.current().tToken != TToken.TLet)
+        return false
+
+    while (scanner.current().tToken != TToken.TEOS) {
+        when (scanner.current().tToken) {
+            TToken.TLet -> lets += 1
+            TToken.TIn -> ins += 1
+            else -> {}
+        }
+        scanner.next()
+    }
+
+    return ins == lets - 1
+}
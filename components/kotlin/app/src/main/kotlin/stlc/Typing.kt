@@ -4,7 +4,20 @@ import io.littlelanguages.scanpiler.Location
 
 typealias Var = String
 
+/*
+ * A type as inference makes it, with the location it was inferred at for
+ * error messages to report.  Its hash is worked out once, from its parts', so
+ * comparing two types looks no further than their hashes unless they are
+ * likely equal.  Constraints are solved over a TypeStore instead, where equal
+ * types are one node without a location.
+ */
 sealed class Type(open val location: Location?) {
+    /* Equal, whatever their locations, when two types are. */
+    abstract val hash: Int
+
+    abstract val hasVariables: Boolean
+
+    /* Returns this type itself if s binds none of its variables. */
     abstract fun apply(s: Subst): Type
 
     abstract fun ftv(): Set<Var>
@@ -13,14 +26,23 @@ sealed class Type(open val location: Location?) {
         if (location == null) toString() else "$this from ${location!!.asString()}"
 
     abstract fun atLocation(location: Location?): Type
+
+    final override fun hashCode(): Int = hash
 }
 
 data class TVar(val name: String, override val location: Location? = null) : Type(location) {
+    override val hash = 31 * name.hashCode() + 1
+
+    override val hasVariables: Boolean
+        get() = true
+
+    private var variables: Set<Var>? = null
+
     override fun apply(s: Subst): Type =
         s[name] ?: this
 
     override fun ftv(): Set<Var> =
-        setOf(name)
+        variables ?: setOf(name).also { variables = it }
 
     override fun atLocation(location: Location?): Type =
         TVar(name, location)
@@ -31,7 +53,12 @@ data class TVar(val name: String, override val location: Location? = null) : Typ
         other is TVar && name == other.name
 }
 
-data class TCon(private val name: String, override val location: Location? = null) : Type(location) {
+data class TCon(val name: String, override val location: Location? = null) : Type(location) {
+    override val hash = 31 * name.hashCode() + 2
+
+    override val hasVariables: Boolean
+        get() = false
+
     override fun apply(s: Subst): Type = this
 
     override fun ftv(): Set<Var> = emptySet()
@@ -45,26 +72,55 @@ data class TCon(private val name: String, override val location: Location? = nul
 }
 
 data class TTuple(val types: List<Type>, override val location: Location? = null) : Type(location) {
-    override fun apply(s: Subst): Type =
-        TTuple(types.map { it.apply(s) })
+    override val hash = types.fold(3) { h, t -> 31 * h + t.hash }
+
+    override val hasVariables = types.any { it.hasVariables }
+
+    private var variables: Set<Var>? = null
+
+    override fun apply(s: Subst): Type {
+        if (!hasVariables)
+            return this
+
+        val applied = types.map { it.apply(s) }
+
+        return if (applied.indices.all { applied[it] === types[it] }) this else TTuple(applied)
+    }
 
     override fun ftv(): Set<Var> =
-        types.fold(emptySet()) { acc, t -> acc + t.ftv() }
+        variables ?: types.fold(emptySet<Var>()) { acc, t -> acc + t.ftv() }.also { variables = it }
 
     override fun atLocation(location: Location?): Type = TTuple(types, location)
 
     override fun toString(): String = "(${types.joinToString(" * ")})"
 
     override fun equals(other: Any?): Boolean =
-        other is TTuple && types == other.types
+        other === this || other is TTuple && hash == other.hash && types == other.types
 }
 
 data class TArr(val domain: Type, val range: Type, override val location: Location? = null) : Type(location) {
-    override fun apply(s: Subst): Type =
-        TArr(domain.apply(s), range.apply(s))
+    override val hash = 31 * (31 * 4 + domain.hash) + range.hash
+
+    override val hasVariables = domain.hasVariables || range.hasVariables
+
+    private var variables: Set<Var>? = null
+
+    override fun apply(s: Subst): Type {
+        if (!hasVariables)
+            return this
+
+        val appliedDomain = domain.apply(s)
+        val appliedRange = range.apply(s)
+
+        return if (appliedDomain === domain && appliedRange === range) this else TArr(appliedDomain, appliedRange)
+    }
 
     override fun ftv(): Set<Var> =
-        domain.ftv() + range.ftv()
+        variables ?: when {
+            !domain.hasVariables -> range.ftv()
+            !range.hasVariables -> domain.ftv()
+            else -> domain.ftv() + range.ftv()
+        }.also { variables = it }
 
     override fun atLocation(location: Location?): Type = TArr(domain, range, location)
 
@@ -72,7 +128,194 @@ data class TArr(val domain: Type, val range: Type, override val location: Locati
         if (domain is TArr) "($domain) -> $range" else "$domain -> $range"
 
     override fun equals(other: Any?): Boolean =
-        other is TArr && domain == other.domain && range == other.range
+        other === this || other is TArr && hash == other.hash && domain == other.domain && range == other.range
+}
+
+/*
+ * The types of one inference interned as integer ids.  Asking for a variable,
+ * constant, arrow or tuple that has been made before gives back the same id,
+ * so two types are equal exactly when their ids are, and whether a type has
+ * variables, its free variables and the Type it stands for are each worked
+ * out once.  An interned type has no location, which stays with the Types
+ * inference makes, so equal types share an id wherever they were inferred.
+ */
+class TypeStore {
+    private val variables = HashMap<Var, Int>()
+    private val constants = HashMap<String, Int>()
+
+    private var kinds = IntArray(INITIAL_CAPACITY)
+
+    /* The domain of an arrow or where a tuple's elements start in elements. */
+    private var firsts = IntArray(INITIAL_CAPACITY)
+
+    /* The range of an arrow or the size of a tuple. */
+    private var seconds = IntArray(INITIAL_CAPACITY)
+    private var hashes = IntArray(INITIAL_CAPACITY)
+    private var open = BooleanArray(INITIAL_CAPACITY)
+    private val names = ArrayList<String?>()
+    private val ftvs = ArrayList<Set<Var>?>()
+    private val exported = ArrayList<Type?>()
+
+    private var elements = IntArray(INITIAL_CAPACITY)
+    private var elementCount = 0
+
+    /* The arrows and tuples, open addressed on their hashes and never more than half full. */
+    private var table = IntArray(2 * INITIAL_CAPACITY) { NONE }
+    private var entries = 0
+
+    var count = 0
+        private set
+
+    fun variable(name: Var): Int =
+        variables.getOrPut(name) { add(VARIABLE, 0, 0, name, 31 * name.hashCode() + 1, true) }
+
+    fun constant(name: String): Int =
+        constants.getOrPut(name) { add(CONSTANT, 0, 0, name, 31 * name.hashCode() + 2, false) }
+
+    fun arrow(domain: Int, range: Int): Int {
+        val hash = 31 * (31 * 4 + hashes[domain]) + hashes[range]
+        var slot = hash and (table.size - 1)
+
+        while (table[slot] != NONE) {
+            val id = table[slot]
+
+            if (hashes[id] == hash && kinds[id] == ARROW && firsts[id] == domain && seconds[id] == range)
+                return id
+            slot = (slot + 1) and (table.size - 1)
+        }
+
+        return enter(slot, add(ARROW, domain, range, null, hash, open[domain] || open[range]))
+    }
+
+    fun tuple(types: IntArray): Int {
+        var hash = 3
+        var hasVariables = false
+
+        for (t in types) {
+            hash = 31 * hash + hashes[t]
+            hasVariables = hasVariables || open[t]
+        }
+
+        var slot = hash and (table.size - 1)
+
+        while (table[slot] != NONE) {
+            val id = table[slot]
+
+            if (hashes[id] == hash && kinds[id] == TUPLE && seconds[id] == types.size && types.indices.all { element(id, it) == types[it] })
+                return id
+            slot = (slot + 1) and (table.size - 1)
+        }
+
+        while (elementCount + types.size > elements.size)
+            elements = elements.copyOf(2 * elements.size)
+        types.copyInto(elements, elementCount)
+        elementCount += types.size
+
+        return enter(slot, add(TUPLE, elementCount - types.size, types.size, null, hash, hasVariables))
+    }
+
+    fun intern(type: Type): Int =
+        when (type) {
+            is TVar -> variable(type.name)
+            is TCon -> constant(type.name)
+            is TArr -> arrow(intern(type.domain), intern(type.range))
+            is TTuple -> tuple(IntArray(type.types.size) { intern(type.types[it]) })
+        }
+
+    /* The Type that id stands for, made once and without a location. */
+    fun type(id: Int): Type =
+        exported[id] ?: when (kinds[id]) {
+            VARIABLE -> TVar(names[id]!!)
+            CONSTANT -> TCon(names[id]!!)
+            ARROW -> TArr(type(firsts[id]), type(seconds[id]))
+            else -> TTuple(List(seconds[id]) { type(element(id, it)) })
+        }.also { exported[id] = it }
+
+    fun hasVariables(id: Int): Boolean = open[id]
+
+    fun isVariable(id: Int): Boolean = kinds[id] == VARIABLE
+
+    fun isArrow(id: Int): Boolean = kinds[id] == ARROW
+
+    fun isTuple(id: Int): Boolean = kinds[id] == TUPLE
+
+    fun name(id: Int): String = names[id]!!
+
+    fun domain(id: Int): Int = firsts[id]
+
+    fun range(id: Int): Int = seconds[id]
+
+    fun size(id: Int): Int = seconds[id]
+
+    fun element(id: Int, index: Int): Int = elements[firsts[id] + index]
+
+    /* The free variables of id in the order Type.ftv gives them. */
+    fun ftv(id: Int): Set<Var> =
+        ftvs[id] ?: when {
+            !open[id] -> emptySet()
+            kinds[id] == VARIABLE -> setOf(names[id]!!)
+            kinds[id] == ARROW -> when {
+                !open[firsts[id]] -> ftv(seconds[id])
+                !open[seconds[id]] -> ftv(firsts[id])
+                else -> ftv(firsts[id]) + ftv(seconds[id])
+            }
+
+            else -> (0 until seconds[id]).fold(emptySet<Var>()) { acc, i -> acc + ftv(element(id, i)) }
+        }.also { ftvs[id] = it }
+
+    private fun add(kind: Int, first: Int, second: Int, name: String?, hash: Int, hasVariables: Boolean): Int {
+        if (count == kinds.size) {
+            val capacity = 2 * count
+
+            kinds = kinds.copyOf(capacity)
+            firsts = firsts.copyOf(capacity)
+            seconds = seconds.copyOf(capacity)
+            hashes = hashes.copyOf(capacity)
+            open = open.copyOf(capacity)
+        }
+
+        kinds[count] = kind
+        firsts[count] = first
+        seconds[count] = second
+        hashes[count] = hash
+        open[count] = hasVariables
+        names.add(name)
+        ftvs.add(null)
+        exported.add(null)
+
+        return count++
+    }
+
+    private fun enter(slot: Int, id: Int): Int {
+        table[slot] = id
+        entries += 1
+        if (2 * entries > table.size) {
+            val entered = table
+
+            table = IntArray(2 * entered.size) { NONE }
+            for (e in entered) {
+                if (e != NONE) {
+                    var s = hashes[e] and (table.size - 1)
+
+                    while (table[s] != NONE)
+                        s = (s + 1) and (table.size - 1)
+                    table[s] = e
+                }
+            }
+        }
+
+        return id
+    }
+
+    companion object {
+        private const val INITIAL_CAPACITY = 64
+        private const val NONE = -1
+
+        private const val VARIABLE = 0
+        private const val CONSTANT = 1
+        private const val ARROW = 2
+        private const val TUPLE = 3
+    }
 }
 
 val typeError = TCon("Error")
@@ -91,19 +334,19 @@ data class Subst(private val items: Map<Var, Type>) {
 
 val nullSubst = Subst(emptyMap())
 
-data class Scheme(private val names: Set<Var>, private val type: Type) {
+data class Scheme(private val names: Set<Var>, val type: Type) {
     fun apply(s: Subst): Scheme =
         Scheme(names, type.apply(s - names))
 
     fun ftv(): Set<Var> =
         type.ftv() - names
 
-    fun instantiate(pump: Pump): Type =
-        type.apply(Subst(names.toList().associateWith { pump.next() }))
+    fun instantiate(fresh: () -> TVar): Type =
+        type.apply(Subst(names.toList().associateWith { fresh() }))
 }
 
 data class TypeEnv(private val items: Map<String, Scheme>) {
-    private val ftv = items.toList().flatMap { it.second.ftv() }.toSet()
+    private val ftv by lazy { items.toList().flatMap { it.second.ftv() }.toSet() }
 
     fun extend(name: String, scheme: Scheme): TypeEnv =
         TypeEnv(items + Pair(name, scheme))
@@ -134,3 +377,18 @@ data class Pump(private var counter: Int = 0) {
     fun nextN(size: Int): List<TVar> =
         (1..size).map { next() }
 }
+
+// Renames the variables of t, in the order ftv gives them, a to z and then t0, t1, ... as the REPL prints them.
+fun renameTypeVariables(t: Type): Type {
+    var i = 0
+
+    fun nextVar(): String =
+        if (i < 26)
+            ('a' + i++).toString()
+        else
+            "t${i++ - 26}"
+
+    val vars = t.ftv().toList()
+    val subst = Subst(vars.zip(vars.map { TVar(nextVar()) }).toMap())
+    return t.apply(subst)
+}
@@ -5,21 +5,31 @@ import java.io.File
 class Builder {
     private val blocks = mutableListOf<BlockBuilder>()
 
-    private fun build(): List<Byte> {
-        val result = mutableListOf<Byte>()
-        val blockSizes = blocks.map { it.size() }
-        val blockOffsets = blocks.zip(blockSizes.scan(0) { acc, size -> acc + size }) { block, offset -> block.name to offset }.toMap()
+    // Lays the blocks out in the order they were created, then patches each
+    // label with the offset of the block or mark it names.
+    private fun build(): ByteArray {
+        val blockOffsets = HashMap<String, Int>()
+        var size = 0
 
         for (block in blocks) {
-            result.addAll(block.build(blockOffsets))
+            blockOffsets[block.name] = size
+            size += block.size()
+        }
+
+        val result = ByteArray(size)
+        for (block in blocks) {
+            block.build(result, blockOffsets)
         }
 
         return result
     }
 
+    fun toByteArray(): ByteArray =
+        build()
+
     fun writeTo(file: File) {
         file.delete()
-        file.appendBytes(build().toByteArray())
+        file.appendBytes(toByteArray())
     }
 
     fun createBlock(name: String): BlockBuilder {
@@ -30,24 +40,28 @@ class Builder {
 }
 
 class BlockBuilder(val name: String, val builder: Builder) {
-    private val instructions = mutableListOf<Byte>()
+    private var instructions = ByteArray(16)
+    private var size = 0
     private val patches = mutableListOf<Pair<Int, String>>()
     private val labels = mutableMapOf<String, Int>()
 
-    fun size() = instructions.size
+    fun size() = size
 
-    fun build(offsets: Map<String, Int>): List<Byte> {
+    // Copies this block into result at its offset and patches its labels - all four bytes of each.
+    fun build(result: ByteArray, offsets: Map<String, Int>) {
         val myOffset = offsets[name]!!
-        val result = instructions.toMutableList()
+
+        instructions.copyInto(result, myOffset, 0, size)
         for ((index, label) in patches) {
             val offset = offsets[label] ?: ((labels[label] ?: throw Exception("Unknown label $label")) + myOffset)
-            result[index] = offset.toByte()
+            writeInt(result, myOffset + index, offset)
         }
-        return result
     }
 
     fun writeByte(byte: Byte) {
-        instructions.add(byte)
+        if (size == instructions.size)
+            instructions = instructions.copyOf(size * 2)
+        instructions[size++] = byte
     }
 
     fun writeInt(v: Int) {
@@ -62,11 +76,18 @@ class BlockBuilder(val name: String, val builder: Builder) {
     }
 
     fun writeLabel(name: String) {
-        patches.add(instructions.size to name)
+        patches.add(size to name)
         writeInt(0)
     }
 
     fun markLabel(name: String) {
-        labels[name] = instructions.size
+        labels[name] = size
+    }
+
+    private fun writeInt(bytes: ByteArray, index: Int, v: Int) {
+        bytes[index] = v.toByte()
+        bytes[index + 1] = (v shr 8).toByte()
+        bytes[index + 2] = (v shr 16).toByte()
+        bytes[index + 3] = (v shr 24).toByte()
     }
-}
\ No newline at end of file
+}
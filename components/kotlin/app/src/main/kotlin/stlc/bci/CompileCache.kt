@@ -0,0 +1,156 @@
+package stlc.bci
+
+import java.io.ByteArrayOutputStream
+import java.io.File
+import java.nio.ByteBuffer
+import java.nio.ByteOrder
+import java.nio.file.Files
+import java.nio.file.StandardCopyOption
+
+// A directory of compiled programs addressed by their content, in the same
+// format as bci-c's cache.c: an entry is named by the FNV-1a hash of the
+// compiler's version, the options it compiled with and the source, and holds
+// those together with the program's type and bytecode.
+//
+// An entry is only a hit if what it holds matches exactly, so neither a hash
+// collision nor a damaged entry can stand in for a compilation.  An entry is
+// written to a temporary file that is then moved over its name, so that
+// compilers sharing a directory only ever see whole entries.  Failing to read
+// or write the cache only costs a compilation.
+//
+// Entry layout, little endian: "STLC", int32 format, and then the version,
+// options, source, type and bytecode, each an int32 length followed by its
+// bytes.
+class CompileCache(val directory: File) {
+    var hits = 0L
+        private set
+    var misses = 0L
+        private set
+    var failures = 0L
+        private set
+
+    // As compileProgram, taking the program from the cache if it has been
+    // compiled before and storing it if not.  A program that fails to compile
+    // throws as compileProgram does and is not stored.
+    fun compile(input: String, parallel: Boolean = false): CompiledProgram {
+        val options = options(parallel)
+        val file = File(directory, key(input, options))
+
+        val found = lookup(file, input, options)
+        if (found != null) {
+            hits += 1
+            return found
+        }
+
+        misses += 1
+
+        val program = compileProgram(input, parallel)
+        if (!store(file, input, options, program))
+            failures += 1
+
+        return program
+    }
+
+    private fun lookup(file: File, input: String, options: String): CompiledProgram? {
+        val bytes = try {
+            file.readBytes()
+        } catch (e: Exception) {
+            return null
+        }
+
+        val buffer = ByteBuffer.wrap(bytes).order(ByteOrder.LITTLE_ENDIAN)
+
+        fun field(): ByteArray? {
+            if (buffer.remaining() < 4)
+                return null
+            val length = buffer.int
+            if (length < 0 || length > buffer.remaining())
+                return null
+            val result = ByteArray(length)
+            buffer.get(result)
+            return result
+        }
+
+        fun matches(expected: String): Boolean =
+            field()?.contentEquals(expected.toByteArray()) ?: false
+
+        if (bytes.size < 8 || !bytes.copyOfRange(0, 4).contentEquals(MAGIC))
+            return null
+        buffer.position(4)
+        if (buffer.int != FORMAT || !matches(VERSION) || !matches(options) || !matches(input))
+            return null
+
+        val type = field() ?: return null
+        val block = field() ?: return null
+
+        return if (buffer.hasRemaining()) null else CompiledProgram(block, String(type))
+    }
+
+    private fun store(file: File, input: String, options: String, program: CompiledProgram): Boolean {
+        val output = ByteArrayOutputStream()
+
+        fun int(v: Int) {
+            output.write(ByteBuffer.allocate(4).order(ByteOrder.LITTLE_ENDIAN).putInt(v).array())
+        }
+
+        fun field(bytes: ByteArray) {
+            int(bytes.size)
+            output.write(bytes)
+        }
+
+        output.write(MAGIC)
+        int(FORMAT)
+        field(VERSION.toByteArray())
+        field(options.toByteArray())
+        field(input.toByteArray())
+        field(program.type.toByteArray())
+        field(program.bytes)
+
+        var temporary: File? = null
+        return try {
+            directory.mkdirs()
+            temporary = File.createTempFile(".${file.name}.", "", directory)
+            temporary.writeBytes(output.toByteArray())
+            Files.move(temporary.toPath(), file.toPath(), StandardCopyOption.ATOMIC_MOVE, StandardCopyOption.REPLACE_EXISTING)
+            true
+        } catch (e: Exception) {
+            temporary?.delete()
+            false
+        }
+    }
+
+    companion object {
+        // Bumped whenever the bytecode or type the compiler produces changes.
+        const val VERSION = "stlc-kotlin 3"
+
+        private const val FORMAT = 1
+        private val MAGIC = "STLC".toByteArray()
+
+        private fun options(parallel: Boolean): String =
+            if (parallel) "parallel" else ""
+
+        // Each part is hashed with its terminating NUL so that no two keys run together.
+        fun key(input: String, options: String): String {
+            var hash = -0x340d631b7bdddcdbL
+
+            for (part in listOf(VERSION, options, input)) {
+                for (byte in part.toByteArray() + 0.toByte()) {
+                    hash = hash xor (byte.toLong() and 0xff)
+                    hash *= 0x100000001b3L
+                }
+            }
+
+            return java.lang.Long.toUnsignedString(hash, 16).padStart(16, '0')
+        }
+
+        // The directory named by STLC_CACHE, or else stlc within XDG_CACHE_HOME or ~/.cache.
+        fun defaultDirectory(): File {
+            val cache = System.getenv("STLC_CACHE")
+            if (!cache.isNullOrEmpty())
+                return File(cache)
+
+            val xdg = System.getenv("XDG_CACHE_HOME")
+            return if (xdg.isNullOrEmpty()) File(System.getProperty("user.home"), ".cache/stlc") else File(xdg, "stlc")
+        }
+    }
+}
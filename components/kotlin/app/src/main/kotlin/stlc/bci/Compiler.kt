@@ -2,74 +2,256 @@ package stlc.bci
 
 import stlc.*
 import java.io.File
+import java.util.IdentityHashMap
+
+// With parallel the operands of an operator, or the components of a tuple,
+// that make calls are compiled into thunks which are SPAWNed so that an
+// interpreter with more than one thread can evaluate them while it evaluates
+// the operands that follow.  An operand is only SPAWNed if a later operand
+// also makes a call: there is then work to overlap with.  The language being
+// pure, the operands are independent of one another.
+fun compileTo(input: String, fileName: File, parallel: Boolean = false) {
+    fileName.delete()
+    fileName.appendBytes(compileProgram(input, parallel).bytes)
+}
+
+// A program's bytecode with its type as the REPL prints it.  A program's type
+// is never a tuple, so it is a function exactly when it has an arrow.
+class CompiledProgram(val bytes: ByteArray, val type: String) {
+    val isFunction: Boolean
+        get() = type.contains("->")
+}
 
-fun compileTo(input: String, fileName: File) {
+fun compileProgram(input: String, parallel: Boolean = false): CompiledProgram {
     val e = parse(input)
     val (constraints, type) = infer(emptyTypeEnv, e)
-    type.apply(constraints.solve())
+    val solved = type.apply(constraints.solve())
+
+    return CompiledProgram(compileBytes(e, parallel), renameTypeVariables(solved).toString())
+}
 
+// The bytecode of e, which must be well typed.
+fun compileBytes(e: Expression, parallel: Boolean = false): ByteArray {
     val builder = Builder()
 
-    compile(e, builder)
+    compile(e, builder, parallel)
 
-    builder.writeTo(fileName)
+    return builder.toByteArray()
 }
 
-fun compileTo(input: String, fileName: String) {
-    compileTo(input, File(fileName))
+fun compileTo(input: String, fileName: String, parallel: Boolean = false) {
+    compileTo(input, File(fileName), parallel)
 }
 
 data class Binding(val depth: Int, val offset: Int)
 
-data class Environment(val variables: Map<String, Binding>, val depth: Int = 0, val nextOffset: Int = 0) {
+/*
+ * The names in scope, each to its innermost binding.  A name is bound as
+ * compilation enters its scope and unbound as it leaves it, so binding a
+ * name costs the same however many are in scope.
+ */
+class Scopes {
+    private val bindings = HashMap<String, ArrayList<Binding>>()
+
+    operator fun get(name: String): Binding? =
+        bindings[name]?.lastOrNull()
+
+    fun bind(name: String, binding: Binding) {
+        bindings.getOrPut(name) { ArrayList() }.add(binding)
+    }
+
+    fun unbind(name: String) {
+        val names = bindings.getValue(name)
+
+        names.removeAt(names.size - 1)
+        if (names.isEmpty())
+            bindings.remove(name)
+    }
+}
+
+data class Environment(val scopes: Scopes, val depth: Int = 0, val nextOffset: Int = 0) {
     fun openScope(): Environment =
-        Environment(variables, depth + 1, 0)
+        Environment(scopes, depth + 1, 0)
 
-    fun bind(name: String): Environment =
-        Environment(variables + Pair(name, Binding(depth, nextOffset)), depth, nextOffset + 1)
+    /* Binds name at the next offset, until it is unbound from scopes. */
+    fun bind(name: String): Environment {
+        scopes.bind(name, Binding(depth, nextOffset))
+
+        return Environment(scopes, depth, nextOffset + 1)
+    }
+
+    /* Passes over slots taken by an expression compiled earlier in the same activation. */
+    fun skip(slots: Int): Environment =
+        Environment(scopes, depth, nextOffset + slots)
 }
 
-private fun compile(toplevel: Expression, builder: Builder) {
-    var labelNameGenerator = 0
+/*
+ * Whether each expression makes a call and the slots its activation needs
+ * for the names it binds, measured in a single pass before compiling so
+ * that neither is recomputed for every lambda, thunk and operand.  A let
+ * also needs the slots of its declarations' own lets.  Each subexpression
+ * binds its names in slots of its own, after those of the subexpressions
+ * compiled before it, as a closure made by one may read its slots after the
+ * next has run.
+ */
+private class Measures(private val parallel: Boolean) {
+    private val expensive = IdentityHashMap<Expression, Boolean>()
+    private val enterSize = IdentityHashMap<Expression, Int>()
+
+    fun expensive(e: Expression): Boolean =
+        expensive.getValue(e)
+
+    fun enterSize(e: Expression): Int =
+        enterSize.getValue(e)
+
+    fun spawned(es: List<Expression>): List<Boolean> {
+        val result = MutableList(es.size) { false }
+        var later = false
+
+        for (i in es.indices.reversed()) {
+            result[i] = parallel && later && expensive(es[i])
+            later = later || expensive(es[i])
+        }
 
-    fun nextLabelName() = "L${labelNameGenerator++}"
+        return result
+    }
 
-    fun enterSize(e:Expression): Int =
+    fun measure(e: Expression) {
         when (e) {
-            is AppExpression -> enterSize(e.e1) + enterSize(e.e2)
-            is IfExpression -> enterSize(e.e1) + enterSize(e.e2) + enterSize(e.e3)
-            is LamExpression -> 0
-            is LetExpression -> e.decls.size + enterSize(e.e)
-            is LetRecExpression -> e.decls.size + enterSize(e.e)
-            is VarExpression -> 0
-            is LIntExpression -> 0
-            is LBoolExpression -> 0
-            is LTupleExpression -> 0
-            is OpExpression -> enterSize(e.e1) + enterSize(e.e2)
+            is AppExpression -> {
+                measure(e.e1)
+                measure(e.e2)
+                record(e, true, enterSize(e.e1) + enterSize(e.e2))
+            }
+
+            is IfExpression -> {
+                measure(e.e1)
+                measure(e.e2)
+                measure(e.e3)
+                record(
+                    e,
+                    expensive(e.e1) || expensive(e.e2) || expensive(e.e3),
+                    enterSize(e.e1) + enterSize(e.e2) + enterSize(e.e3)
+                )
+            }
+
+            is LamExpression -> {
+                measure(e.e)
+                record(e, false, 0)
+            }
+
+            is LetExpression -> {
+                e.decls.forEach { measure(it.e) }
+                measure(e.e)
+                record(
+                    e,
+                    e.decls.any { expensive(it.e) } || expensive(e.e),
+                    e.decls.size + e.decls.sumOf { enterSize(it.e) } + enterSize(e.e)
+                )
+            }
+
+            is LetRecExpression -> {
+                e.decls.forEach { measure(it.e) }
+                measure(e.e)
+                record(
+                    e,
+                    e.decls.any { expensive(it.e) } || expensive(e.e),
+                    e.decls.size + e.decls.sumOf { enterSize(it.e) } + enterSize(e.e)
+                )
+            }
+
+            is VarExpression -> record(e, false, 0)
+            is LIntExpression -> record(e, false, 0)
+            is LBoolExpression -> record(e, false, 0)
+
+            is LTupleExpression -> {
+                e.es.forEach { measure(it) }
+                record(e, e.es.any { expensive(it) }, operandsEnterSize(e.es))
+            }
+
+            is OpExpression -> {
+                measure(e.e1)
+                measure(e.e2)
+                record(e, expensive(e.e1) || expensive(e.e2), operandsEnterSize(listOf(e.e1, e.e2)))
+            }
         }
+    }
+
+    // A SPAWNed operand binds its names in the thunk's activation rather than in this one.
+    private fun operandsEnterSize(es: List<Expression>): Int =
+        es.zip(spawned(es)).sumOf { (e, s) -> if (s) 0 else enterSize(e) }
+
+    private fun record(e: Expression, expensive: Boolean, enterSize: Int) {
+        this.expensive[e] = expensive
+        this.enterSize[e] = enterSize
+    }
+}
+
+private fun compile(toplevel: Expression, builder: Builder, parallel: Boolean) {
+    var labelNameGenerator = 0
+
+    fun nextLabelName() = "L${labelNameGenerator++}"
+
+    val measures = Measures(parallel)
+    measures.measure(toplevel)
 
     fun compileExpression(e: Expression, bb: BlockBuilder, env: Environment) {
+        fun compileThunk(e: Expression) {
+            val name = nextLabelName()
+
+            val thunkBlock = builder.createBlock(name)
+
+            val es = measures.enterSize(e)
+            if (es > 0) {
+                thunkBlock.writeOpCode(InstructionOpCode.ENTER)
+                thunkBlock.writeInt(es)
+            }
+            compileExpression(e, thunkBlock, env.openScope())
+            thunkBlock.writeOpCode(InstructionOpCode.RET)
+
+            bb.writeOpCode(InstructionOpCode.SPAWN)
+            bb.writeLabel(name)
+        }
+
+        fun compileOperands(es: List<Expression>) {
+            val spawns = measures.spawned(es)
+            var operandEnv = env
+
+            for ((operand, spawn) in es.zip(spawns)) {
+                if (spawn) {
+                    compileThunk(operand)
+                } else {
+                    compileExpression(operand, bb, operandEnv)
+                    operandEnv = operandEnv.skip(measures.enterSize(operand))
+                }
+            }
+            repeat(spawns.count { it }) {
+                bb.writeOpCode(InstructionOpCode.JOIN)
+            }
+        }
+
         when (e) {
             is AppExpression -> {
                 compileExpression(e.e1, bb, env)
-                compileExpression(e.e2, bb, env)
+                compileExpression(e.e2, bb, env.skip(measures.enterSize(e.e1)))
                 bb.writeOpCode(InstructionOpCode.SWAP_CALL)
             }
 
             is IfExpression -> {
                 val thenLabel = nextLabelName()
                 val nextLabel = nextLabelName()
+                val branchEnv = env.skip(measures.enterSize(e.e1))
 
                 compileExpression(e.e1, bb, env)
                 bb.writeOpCode(InstructionOpCode.JMP_TRUE)
                 bb.writeLabel(thenLabel)
 
-                compileExpression(e.e3, bb, env)
+                compileExpression(e.e3, bb, branchEnv)
                 bb.writeOpCode(InstructionOpCode.JMP)
                 bb.writeLabel(nextLabel)
 
                 bb.markLabel(thenLabel)
-                compileExpression(e.e2, bb, env)
+                compileExpression(e.e2, bb, branchEnv)
 
                 bb.markLabel(nextLabel)
             }
@@ -85,9 +267,7 @@ private fun compile(toplevel: Expression, builder: Builder) {
             }
 
             is LTupleExpression -> {
-                for (expr in e.es) {
-                    compileExpression(expr, bb, env)
-                }
+                compileOperands(e.es)
 
                 bb.writeOpCode(InstructionOpCode.PUSH_TUPLE)
                 bb.writeInt(e.es.size)
@@ -99,10 +279,11 @@ private fun compile(toplevel: Expression, builder: Builder) {
                 val lambdaBlock = builder.createBlock(name)
 
                 lambdaBlock.writeOpCode(InstructionOpCode.ENTER)
-                lambdaBlock.writeInt(1 + enterSize(e.e))
+                lambdaBlock.writeInt(1 + measures.enterSize(e.e))
                 lambdaBlock.writeOpCode(InstructionOpCode.STORE_VAR)
                 lambdaBlock.writeInt(0)
                 compileExpression(e.e, lambdaBlock, env.openScope().bind(e.n))
+                env.scopes.unbind(e.n)
                 lambdaBlock.writeOpCode(InstructionOpCode.RET)
 
                 bb.writeOpCode(InstructionOpCode.PUSH_CLOSURE)
@@ -113,14 +294,16 @@ private fun compile(toplevel: Expression, builder: Builder) {
                 var newEnv = env
 
                 for (d in e.decls) {
-                    compileExpression(d.e, bb, newEnv)
+                    // The declaration's own lets follow its slot.
+                    compileExpression(d.e, bb, newEnv.skip(1))
 
-                    newEnv = newEnv.bind(d.n)
                     bb.writeOpCode(InstructionOpCode.STORE_VAR)
-                    bb.writeInt(newEnv.variables[d.n]!!.offset)
+                    bb.writeInt(newEnv.nextOffset)
+                    newEnv = newEnv.bind(d.n).skip(measures.enterSize(d.e))
                 }
 
                 compileExpression(e.e, bb, newEnv)
+                e.decls.asReversed().forEach { env.scopes.unbind(it.n) }
             }
             is LetRecExpression -> {
                 var newEnv = env
@@ -132,15 +315,16 @@ private fun compile(toplevel: Expression, builder: Builder) {
                 for (d in e.decls) {
                     compileExpression(d.e, bb, newEnv)
                     bb.writeOpCode(InstructionOpCode.STORE_VAR)
-                    bb.writeInt(newEnv.variables[d.n]!!.offset)
+                    bb.writeInt(env.scopes[d.n]!!.offset)
+                    newEnv = newEnv.skip(measures.enterSize(d.e))
                 }
 
                 compileExpression(e.e, bb, newEnv)
+                e.decls.asReversed().forEach { env.scopes.unbind(it.n) }
             }
 
             is OpExpression -> {
-                compileExpression(e.e1, bb, env)
-                compileExpression(e.e2, bb, env)
+                compileOperands(listOf(e.e1, e.e2))
                 when (e.op) {
                     Op.Plus -> bb.writeOpCode(InstructionOpCode.ADD)
                     Op.Minus -> bb.writeOpCode(InstructionOpCode.SUB)
@@ -151,7 +335,7 @@ private fun compile(toplevel: Expression, builder: Builder) {
             }
 
             is VarExpression -> {
-                val binding = env.variables[e.name] ?: throw Exception("Unknown variable ${e.name}")
+                val binding = env.scopes[e.name] ?: throw Exception("Unknown variable ${e.name}")
                 bb.writeOpCode(InstructionOpCode.PUSH_VAR)
                 bb.writeInt(env.depth - binding.depth)
                 bb.writeInt(binding.offset)
@@ -160,12 +344,12 @@ private fun compile(toplevel: Expression, builder: Builder) {
     }
 
     val bb = builder.createBlock(nextLabelName())
-    val es = enterSize(toplevel)
+    val es = measures.enterSize(toplevel)
     if (es > 0) {
         bb.writeOpCode(InstructionOpCode.ENTER)
         bb.writeInt(es)
     }
 
-    compileExpression(toplevel, bb, Environment(emptyMap(), 0))
+    compileExpression(toplevel, bb, Environment(Scopes()))
     bb.writeOpCode(InstructionOpCode.RET)
 }
@@ -17,5 +17,7 @@ enum class InstructionOpCode(val code: Byte) {
     SWAP_CALL(13),
     ENTER(14),
     RET(15),
-    STORE_VAR(16)
+    STORE_VAR(16),
+    SPAWN(17),
+    JOIN(18)
 }
\ No newline at end of file
@@ -0,0 +1,102 @@
+package stlc.bench
+
+import java.lang.management.ManagementFactory
+import java.util.Locale
+import kotlin.system.exitProcess
+
+/*
+ * Runs the front end benchmarks and prints a JSON line for each benchmark
+ * and size with the median time of every variant and, where the JVM counts
+ * them, the bytes one run of it allocates.  Variants of a benchmark compute
+ * the same thing in different ways - each run returns its result as a string
+ * and the benchmark fails if the variants disagree.  A variant whose cost
+ * grows too quickly to be run at every size is only run up to its limit,
+ * which --limit raises.
+ *
+ *   java -cp app.jar stlc.bench.BenchKt [<benchmark> ...] [--sizes=<n>,...]
+ *     [--warmup=<n>] [--repetitions=<n>] [--limit=<n>]
+ */
+data class Variant(val name: String, val limit: Int?, val run: () -> String)
+
+data class Benchmark(val name: String, val sizes: List<Int>, val variants: (size: Int) -> List<Variant>)
+
+private val benchmarks = listOf(solveBenchmark, inferBenchmark, sessionBenchmark, compileBenchmark, interpretBenchmark)
+
+private val threads = ManagementFactory.getThreadMXBean() as? com.sun.management.ThreadMXBean
+
+private fun allocatedBytes(): Long =
+    threads?.getThreadAllocatedBytes(Thread.currentThread().id) ?: -1
+
+/* Generated programs nest deeply enough to need more than the default stack. */
+private const val STACK_SIZE = 1L shl 30
+
+fun main(arguments: Array<String>) {
+    val options = arguments.filter { it.startsWith("--") }.associate {
+        val option = it.drop(2).split("=", limit = 2)
+        Pair(option[0], option.getOrElse(1) { "" })
+    }
+    val names = arguments.filter { !it.startsWith("--") }
+
+    val unknown = names.filter { name -> benchmarks.none { it.name == name } }
+    if (unknown.isNotEmpty()) {
+        println("Unknown benchmark: ${unknown.joinToString(", ")}")
+        println("Benchmarks: ${benchmarks.joinToString(", ") { it.name }}")
+        exitProcess(1)
+    }
+
+    val sizes = options["sizes"]?.split(",")?.map { it.toInt() }
+    val warmup = options["warmup"]?.toInt() ?: 1
+    val repetitions = options["repetitions"]?.toInt() ?: 5
+    val limit = options["limit"]?.toInt()
+
+    var failed = false
+    val thread = Thread(null, {
+        for (benchmark in benchmarks.filter { names.isEmpty() || it.name in names }) {
+            for (size in sizes ?: benchmark.sizes) {
+                if (!run(benchmark, size, warmup, repetitions, limit))
+                    failed = true
+            }
+        }
+    }, "bench", STACK_SIZE)
+
+    thread.start()
+    thread.join()
+
+    if (failed)
+        exitProcess(1)
+}
+
+private fun run(benchmark: Benchmark, size: Int, warmup: Int, repetitions: Int, limit: Int?): Boolean {
+    val results = mutableMapOf<String, String>()
+    val times = mutableListOf<String>()
+    val allocations = mutableListOf<String>()
+
+    for (variant in benchmark.variants(size)) {
+        if (variant.limit != null && size > maxOf(variant.limit, limit ?: 0))
+            continue
+
+        repeat(warmup) { variant.run() }
+
+        val allocated = allocatedBytes()
+        variant.run()
+        if (allocated >= 0)
+            allocations.add("\"${variant.name}\": ${allocatedBytes() - allocated}")
+
+        val samples = (1..repetitions).map {
+            val start = System.nanoTime()
+            results[variant.name] = variant.run()
+            (System.nanoTime() - start) / 1000000.0
+        }.sorted()
+
+        times.add("\"${variant.name}\": ${String.format(Locale.ROOT, "%.3f", samples[samples.size / 2])}")
+    }
+
+    println("{\"benchmark\": \"${benchmark.name}\", \"size\": $size, \"medianMs\": {${times.joinToString(", ")}}, \"allocatedBytes\": {${allocations.joinToString(", ")}}}")
+
+    if (results.values.toSet().size > 1) {
+        println("${benchmark.name} $size: variants disagree: ${results.entries.joinToString(", ") { "${it.key} = ${it.value}" }}")
+        return false
+    }
+
+    return true
+}
@@ -0,0 +1,32 @@
+package stlc.bench
+
+import stlc.bci.compileBytes
+import stlc.parse
+
+/*
+ * Compiles, to bytecode, let d0 = 0; d1 = \x -> d0 + x; d2 = d1 d0; ...
+ * with size declarations in one scope, each using those before it, inside a
+ * lambda so that every name is read through a closure's activation.  Binding
+ * a name costs the same however many are in scope and each expression's
+ * frame size is measured once, so the time should grow linearly with size.
+ */
+val compileBenchmark = Benchmark("compile", listOf(10000, 20000, 50000, 100000)) { size ->
+    val program = parse(
+        "\\a -> let " + (0 until size).joinToString("; ") {
+            when {
+                it == 0 -> "d0 = a"
+                it % 2 == 1 -> "d$it = \\x -> d${it - 1} + x"
+                else -> "d$it = d${it - 1} d${it - 2}"
+            }
+        } + " in d${size - 1}"
+    )
+
+    listOf(
+        Variant("scopes", null) {
+            compileBytes(program).size.toString()
+        },
+        Variant("parallel", null) {
+            compileBytes(program, parallel = true).size.toString()
+        }
+    )
+}
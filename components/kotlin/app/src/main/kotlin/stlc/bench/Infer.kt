@@ -0,0 +1,33 @@
+package stlc.bench
+
+import stlc.emptyTypeEnv
+import stlc.infer
+import stlc.parse
+
+/*
+ * Infers and solves let d0 = \x -> x; d1 = d0 1; d2 = \x -> d0 (d1 + x); ...
+ * with size declarations, each using the polymorphic and monomorphic
+ * declarations before it.  Each declaration only solves its own constraints
+ * and generalises without scanning the names in scope, so the time should
+ * grow linearly with size.
+ */
+val inferBenchmark = Benchmark("infer", listOf(1000, 2000, 5000, 10000, 20000, 50000)) { size ->
+    val program = declarations(size)
+
+    listOf(
+        Variant("levels", null) {
+            val (constraints, type) = infer(emptyTypeEnv, parse(program))
+
+            type.apply(constraints.solve()).toString()
+        }
+    )
+}
+
+private fun declarations(size: Int): String =
+    "let " + (0 until size).joinToString("; ") {
+        when {
+            it % 3 == 0 -> "d$it = \\x -> x"
+            it % 3 == 1 -> "d$it = d${it - 1} $it"
+            else -> "d$it = \\x -> d${it - 2} (d${it - 1} + x)"
+        }
+    } + " in d${size - 1}"
@@ -0,0 +1,30 @@
+package stlc.bench
+
+import stlc.Evaluator
+import stlc.compileClosures
+import stlc.parse
+
+/*
+ * Evaluates recursive programs of the given size with the reference
+ * evaluator, which dispatches on the syntax tree and binds names by copying
+ * maps, and with the closures it is compiled to, which address frame slots.
+ * Both are given the parsed program: the closures are compiled once, outside
+ * of the runs timed, as a REPL compiles an input once.
+ */
+val interpretBenchmark = Benchmark("interpret", listOf(15, 20, 25)) { size ->
+    val program = parse(
+        "let rec fib n = if (n == 0) 0 else if (n == 1) 1 else (fib (n - 1)) + (fib (n - 2)) ; " +
+                "sum n acc = if (n == 0) acc else sum (n - 1) (acc + n) " +
+                "in fib $size + sum ($size * 1000) 0"
+    )
+    val compiled = compileClosures(program)
+
+    listOf(
+        Variant("reference", null) {
+            Evaluator(emptyMap()).evaluate(program, emptyMap()).toString()
+        },
+        Variant("closures", null) {
+            compiled.run().toString()
+        }
+    )
+}
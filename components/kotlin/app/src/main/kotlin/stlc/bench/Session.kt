@@ -0,0 +1,38 @@
+package stlc.bench
+
+import stlc.Session
+import stlc.execute
+
+/*
+ * The time of one input at the end of a session of size declarations, those
+ * of the infer benchmark each entered on their own.  The session only infers
+ * and evaluates the input itself, so its time should stay flat as the
+ * session grows, where replaying the declarations with the input grows with
+ * it.
+ */
+val sessionBenchmark = Benchmark("session", listOf(1000, 2000, 5000, 10000, 20000, 50000)) { size ->
+    val session = Session()
+    val last = size - 1 - (size - 2) % 3
+
+    for (i in 0 until size) {
+        session.execute("let ${declaration(i)}")
+    }
+
+    val input = "let x = d$last in x + d$last"
+
+    listOf(
+        Variant("session", null) {
+            session.execute(input).result!!.value.toString()
+        },
+        Variant("replay", 5000) {
+            execute("let " + (0 until size).joinToString("; ") { declaration(it) } + " in $input").value.toString()
+        }
+    )
+}
+
+private fun declaration(i: Int): String =
+    when {
+        i % 3 == 0 -> "d$i = \\x -> x"
+        i % 3 == 1 -> "d$i = d${i - 1} $i"
+        else -> "d$i = \\x -> d${i - 2} (d${i - 1} + x)"
+    }
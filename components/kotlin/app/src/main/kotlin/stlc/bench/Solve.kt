@@ -0,0 +1,30 @@
+package stlc.bench
+
+import stlc.emptyTypeEnv
+import stlc.infer
+import stlc.parse
+
+/*
+ * Solves the constraints inferred for \f g h -> f 0 + g (f 1) + h 2 (g 2) + ...
+ * with size terms.  Every term's constraints refer to the variables bound by
+ * those of the terms before it, so solving by composition, which applies each
+ * binding to every constraint still to be solved, is quadratic in size.
+ */
+val solveBenchmark = Benchmark("solve", listOf(1000, 2000, 4000, 10000, 20000, 50000)) { size ->
+    val (constraints, type) = infer(emptyTypeEnv, parse(applications(size)))
+
+    listOf(
+        // A copy has yet to solve any of its constraints.
+        Variant("unionFind", null) { type.apply(constraints.copy().solve()).toString() },
+        Variant("composition", 4000) { type.apply(constraints.solveByComposition()).toString() }
+    )
+}
+
+private fun applications(size: Int): String =
+    "\\f g h -> " + (0 until size).joinToString(" + ") {
+        when (it % 3) {
+            0 -> "f $it"
+            1 -> "g (f $it)"
+            else -> "h $it (g $it)"
+        }
+    }
@@ -0,0 +1,56 @@
+package stlc
+
+import kotlin.test.Test
+import kotlin.test.assertEquals
+
+class ClosuresTest {
+    private val programs = listOf(
+        "(\\a -> \\b -> a + b) 10 20",
+        "if (True) 1 else 2",
+        "let add a b = a + b ; incr = add 1 in incr 10",
+        "let rec fact n = if (n == 0) 1 else n * (fact (n - 1)) in fact 5",
+        "let rec isOdd n = if (n == 0) False else isEven (n - 1); isEven n = if (n == 0) True else isOdd (n - 1) in isEven 5",
+        "let rec fib n = if (n == 0) 0 else if (n == 1) 1 else (fib (n - 1)) + (fib (n - 2)) in fib 15",
+        "let x = let y = 3 in y * 2 ; z = let w = 1 in w in x + z",
+        "let id x = x in if (id True) id 1 else 2",
+        "let compose f g x = f (g x) ; double x = x * 2 in compose double double 5",
+        "let a = 1 in let f x = a + x in let a = 10 in f a",
+        "\\x -> let y = x + 1 in \\z -> let w = y * z in w - x",
+        "9 / 2 == 4"
+    )
+
+    @Test
+    fun agreeWithTheReference() {
+        for (program in programs) {
+            val expected = executeReference(program)
+            val actual = execute(program)
+
+            assertEquals(expected.type, actual.type, program)
+            if (expected.type !is TArr)
+                assertEquals(expected.value, actual.value, program)
+        }
+    }
+
+    @Test
+    fun closuresKeepTheirSlots() {
+        assertEquals(1, execute("let g = (let a = 1 in \\x -> a) ; h = (let b = 2 in b) in g 0").value)
+        assertEquals(3, execute("let f = \\x -> let y = x in \\z -> y in (f 3) 0 + ((f 4) 0) - 4").value)
+    }
+
+    @Test
+    fun outerFramesAreReached() {
+        assertEquals(6, execute("(\\a -> \\b -> \\c -> \\d -> a + b + c) 1 2 3 4").value)
+    }
+
+    @Test
+    fun declareAsTheReference() {
+        val e = parse("let rec fact n = if (n == 0) 1 else n * (fact (n - 1)) ; five = fact 5 in 0")
+
+        @Suppress("UNCHECKED_CAST")
+        val fact = declareClosures(e)["fact"] as (Any) -> Any
+
+        assertEquals(720, fact(6))
+        assertEquals(120, declareClosures(e)["five"])
+        assertEquals(Evaluator(emptyMap()).declare(e)["five"], declareClosures(e)["five"])
+    }
+}
@@ -1,7 +1,9 @@
 package stlc
 
+import io.littlelanguages.scanpiler.LocationCoordinate
 import kotlin.test.Test
 import kotlin.test.assertEquals
+import kotlin.test.assertFailsWith
 
 class ConstraintsTest {
     @Test
@@ -137,6 +139,27 @@ class ConstraintsTest {
         )
     }
 
+    @Test
+    fun `self application has an infinite type`() {
+        val (constraints, _) = infer(
+            emptyTypeEnv,
+            parse("\\x -> x x")
+        )
+
+        assertFailsWith<InfiniteTypeException> { constraints.solve() }
+    }
+
+    @Test
+    fun `constraints added directly are explained with their locations`() {
+        val constraints = Constraints()
+        val location = LocationCoordinate(4, 1, 5)
+
+        constraints.add(TArr(TVar("a"), TVar("a")), TArr(TCon("Bool", location), typeInt))
+
+        val e = assertFailsWith<UnificationMismatchException> { constraints.solve() }
+        assertEquals(location, e.t1.location)
+    }
+
     private fun assertType(expected: String, expression: String) {
         val (constraints, type) = infer(
             emptyTypeEnv,
@@ -144,5 +167,6 @@ class ConstraintsTest {
         )
 
         assertEquals(expected, type.apply(constraints.solve()).toString())
+        assertEquals(expected, type.apply(constraints.solveByComposition()).toString())
     }
 }
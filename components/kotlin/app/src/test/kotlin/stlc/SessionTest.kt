@@ -0,0 +1,77 @@
+package stlc
+
+import kotlin.test.Test
+import kotlin.test.assertEquals
+import kotlin.test.assertFailsWith
+
+class SessionTest {
+    @Test
+    fun declarationsStayInScope() {
+        val session = Session()
+
+        assertSession(session, "let add a b = a + b", "add = function: Int -> Int -> Int")
+        assertSession(session, "let incr = add 1 ; ten = 10", "incr = function: Int -> Int", "ten = 10: Int")
+        assertSession(session, "incr ten", "11: Int")
+    }
+
+    @Test
+    fun declarationsArePolymorphic() {
+        val session = Session()
+
+        assertSession(session, "let id x = x", "id = function: a -> a")
+        assertSession(session, "if (id True) id 1 else 2", "1: Int")
+    }
+
+    @Test
+    fun recursiveDeclarations() {
+        val session = Session()
+
+        assertSession(
+            session,
+            "let rec isOdd n = if (n == 0) False else isEven (n - 1); isEven n = if (n == 0) True else isOdd (n - 1)",
+            "isOdd = function: Int -> Bool",
+            "isEven = function: Int -> Bool"
+        )
+        assertSession(session, "isOdd 5", "true: Bool")
+    }
+
+    @Test
+    fun declarationWithNestedLet() {
+        val session = Session()
+
+        assertSession(session, "let x = let y = 3 in y * 2", "x = 6: Int")
+        assertSession(session, "let y = 1 in x + y", "7: Int")
+    }
+
+    @Test
+    fun redefinitionLeavesEarlierDefinitions() {
+        val session = Session()
+
+        assertSession(session, "let x = 1", "x = 1: Int")
+        assertSession(session, "let f y = x + y", "f = function: Int -> Int")
+        assertSession(session, "let x = True", "x = true: Bool")
+        assertSession(session, "f 1", "2: Int")
+        assertSession(session, "x", "true: Bool")
+    }
+
+    @Test
+    fun failedInputLeavesTheSession() {
+        val session = Session()
+
+        assertSession(session, "let x = 1", "x = 1: Int")
+        assertFailsWith<LanguageException> { session.execute("let x = True ; y = x + 1") }
+        assertFailsWith<LanguageException> { session.execute("y") }
+        assertSession(session, "x", "1: Int")
+    }
+}
+
+private fun assertSession(session: Session, input: String, vararg expected: String) {
+    val (definitions, result) = session.execute(input)
+
+    fun format(result: ExecuteResult): String =
+        if (result.type is TArr) "function: ${renameTypeVariables(result.type)}" else "${result.value}: ${result.type}"
+
+    val actual = definitions.map { (name, definition) -> "$name = ${format(definition)}" } + listOfNotNull(result?.let { format(it) })
+
+    assertEquals(expected.toList(), actual)
+}
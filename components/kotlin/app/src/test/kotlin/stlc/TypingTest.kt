@@ -0,0 +1,67 @@
+package stlc
+
+import io.littlelanguages.scanpiler.LocationCoordinate
+import kotlin.test.Test
+import kotlin.test.assertEquals
+import kotlin.test.assertFalse
+import kotlin.test.assertNotEquals
+import kotlin.test.assertSame
+
+class TypingTest {
+    @Test
+    fun equalTypesHaveEqualHashes() {
+        val t1 = TArr(TVar("a"), TTuple(listOf(typeInt, TVar("b"))))
+        val t2 = TArr(TVar("a"), TTuple(listOf(typeInt, TVar("b"))), LocationCoordinate(0, 1, 1))
+
+        assertEquals(t1.hash, t2.hash)
+        assertEquals(t1, t2)
+        assertNotEquals(t1, TArr(TVar("b"), TTuple(listOf(typeInt, TVar("a")))))
+        assertNotEquals<Type>(TVar("Int"), typeInt)
+    }
+
+    @Test
+    fun applyLeavesUntouchedTypesAlone() {
+        val closed = TArr(typeInt, TArr(typeBool, typeInt))
+        val open = TArr(closed, TVar("a"))
+        val subst = Subst(mapOf(Pair("b", typeInt)))
+
+        assertSame(closed, closed.apply(subst))
+        assertSame(open, open.apply(subst))
+        assertSame(closed, (open.apply(Subst(mapOf(Pair("a", typeBool)))) as TArr).domain)
+    }
+
+    @Test
+    fun ftv() {
+        val t = TArr(TVar("a"), TArr(TVar("b"), TVar("a")))
+
+        assertEquals(listOf("a", "b"), t.ftv().toList())
+        assertSame(t.ftv(), t.ftv())
+        assertEquals(emptySet<Var>(), TArr(typeInt, typeBool).ftv())
+    }
+
+    @Test
+    fun storeInternsEqualTypesOnce() {
+        val store = TypeStore()
+        val t = TArr(TVar("a"), TTuple(listOf(typeInt, TVar("b"))), LocationCoordinate(0, 1, 1))
+        val id = store.intern(t)
+
+        assertEquals(id, store.arrow(store.variable("a"), store.tuple(intArrayOf(store.constant("Int"), store.variable("b")))))
+        assertEquals(id, store.intern(TArr(TVar("a"), TTuple(listOf(typeInt, TVar("b"))))))
+        assertNotEquals(id, store.intern(TArr(TVar("b"), TTuple(listOf(typeInt, TVar("a"))))))
+        assertNotEquals(store.variable("Int"), store.constant("Int"))
+    }
+
+    @Test
+    fun storeWorksOutEachTypeOnce() {
+        val store = TypeStore()
+        val t = TArr(TVar("a"), TArr(TVar("b"), TVar("a")), LocationCoordinate(0, 1, 1))
+        val id = store.intern(t)
+
+        assertEquals(t, store.type(id))
+        assertSame(store.type(id), store.type(id))
+        assertSame(store.type(store.variable("a")), (store.type(id) as TArr).domain)
+        assertEquals(listOf("a", "b"), store.ftv(id).toList())
+        assertSame(store.ftv(id), store.ftv(id))
+        assertFalse(store.hasVariables(store.intern(TArr(typeInt, typeBool))))
+    }
+}
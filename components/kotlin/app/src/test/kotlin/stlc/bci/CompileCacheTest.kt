@@ -0,0 +1,93 @@
+package stlc.bci
+
+import stlc.LanguageException
+import java.nio.file.Files
+import kotlin.test.Test
+import kotlin.test.assertContentEquals
+import kotlin.test.assertEquals
+import kotlin.test.assertFailsWith
+
+class CompileCacheTest {
+    private val factorial = "let rec factorial n = if (n == 0) 1 else n * (factorial (n - 1)) in factorial 10"
+
+    private fun withCache(test: (CompileCache) -> Unit) {
+        val directory = Files.createTempDirectory("stlc-cache").toFile()
+        try {
+            test(CompileCache(directory))
+        } finally {
+            directory.deleteRecursively()
+        }
+    }
+
+    @Test
+    fun hitReturnsTheCompiledProgram() {
+        withCache { cache ->
+            val compiled = cache.compile(factorial)
+            val cached = cache.compile(factorial)
+
+            assertContentEquals(compileProgram(factorial).bytes, cached.bytes)
+            assertContentEquals(compiled.bytes, cached.bytes)
+            assertEquals("Int", cached.type)
+            assertEquals(1, cache.hits)
+            assertEquals(1, cache.misses)
+            assertEquals(0, cache.failures)
+        }
+    }
+
+    @Test
+    fun typeIsAsTheREPLPrintsIt() {
+        withCache { cache ->
+            cache.compile("\\f g x -> f (g x)")
+            val cached = cache.compile("\\f g x -> f (g x)")
+
+            assertEquals("(a -> b) -> (c -> a) -> c -> b", cached.type)
+            assertEquals(true, cached.isFunction)
+            assertEquals(1, cache.hits)
+        }
+    }
+
+    @Test
+    fun sourceAndOptionsAreEachTheirOwnEntry() {
+        withCache { cache ->
+            cache.compile(factorial)
+            cache.compile(factorial, parallel = true)
+            cache.compile("$factorial ")
+
+            assertEquals(0, cache.hits)
+            assertEquals(3, cache.misses)
+            assertEquals(3, cache.directory.listFiles()!!.size)
+        }
+    }
+
+    @Test
+    fun damagedEntryIsAMiss() {
+        withCache { cache ->
+            cache.compile(factorial)
+            val entry = cache.directory.listFiles()!!.single()
+            entry.writeBytes(entry.readBytes().copyOf(20))
+
+            val program = cache.compile(factorial)
+
+            assertContentEquals(compileProgram(factorial).bytes, program.bytes)
+            assertEquals(0, cache.hits)
+            assertEquals(2, cache.misses)
+
+            cache.compile(factorial)
+            assertEquals(1, cache.hits)
+        }
+    }
+
+    @Test
+    fun failedCompileIsNotStored() {
+        withCache { cache ->
+            assertFailsWith<LanguageException> { cache.compile("1 + True") }
+            assertEquals(0, cache.directory.listFiles()?.size ?: 0)
+        }
+    }
+
+    // FNV-1a over the version, options and source, each with a terminating NUL, as cache.c hashes them.
+    @Test
+    fun keyIsTheHashOfVersionOptionsAndSource() {
+        assertEquals("14e5fc0895c8e5c7", CompileCache.key("1", ""))
+    }
+}
@@ -1,10 +1,142 @@
 package stlc.bci
 
+import stlc.parse
 import kotlin.test.Test
+import kotlin.test.assertContentEquals
+import kotlin.test.assertEquals
 
 class CompilerTest {
     @Test
     fun checkCompile() {
         compileTo("let rec isOdd n = if (n == 0) False else isEven (n - 1); isEven n = if (n == 0) True else isOdd (n - 1) in isOdd 10", "output.bin")
     }
+
+    @Test
+    fun checkParallelCompile() {
+        compileTo("let rec fib n = if (n == 0) 0 else if (n == 1) 1 else (fib (n - 1)) + (fib (n - 2)) in fib 20", "output.bin", parallel = true)
+    }
+
+    @Test
+    fun compileFactorial() {
+        val expected = bytes(
+            op(InstructionOpCode.ENTER), int(1),
+            op(InstructionOpCode.PUSH_CLOSURE), int(31),
+            op(InstructionOpCode.STORE_VAR), int(0),
+            op(InstructionOpCode.PUSH_VAR), int(0), int(0),
+            op(InstructionOpCode.PUSH_INT), int(10),
+            op(InstructionOpCode.SWAP_CALL),
+            op(InstructionOpCode.RET),
+            // 31: factorial
+            op(InstructionOpCode.ENTER), int(1),
+            op(InstructionOpCode.STORE_VAR), int(0),
+            op(InstructionOpCode.PUSH_VAR), int(0), int(0),
+            op(InstructionOpCode.PUSH_INT), int(0),
+            op(InstructionOpCode.EQ),
+            op(InstructionOpCode.JMP_TRUE), int(101),
+            op(InstructionOpCode.PUSH_VAR), int(0), int(0),
+            op(InstructionOpCode.PUSH_VAR), int(1), int(0),
+            op(InstructionOpCode.PUSH_VAR), int(0), int(0),
+            op(InstructionOpCode.PUSH_INT), int(1),
+            op(InstructionOpCode.SUB),
+            op(InstructionOpCode.SWAP_CALL),
+            op(InstructionOpCode.MUL),
+            op(InstructionOpCode.JMP), int(106),
+            // 101: then
+            op(InstructionOpCode.PUSH_INT), int(1),
+            // 106: next
+            op(InstructionOpCode.RET)
+        )
+
+        assertContentEquals(expected, compileBytes(parse("let rec factorial n = if (n == 0) 1 else n * (factorial (n - 1)) in factorial 10")))
+    }
+
+    @Test
+    fun patchAllOfALabel() {
+        val size = 100
+        val program = "let " + (0 until size).joinToString("; ") { "d$it = $it" } + " in (\\x -> x) d0"
+        val bytes = compileBytes(parse(program))
+
+        // ENTER, then a PUSH_INT and STORE_VAR for each declaration, and then PUSH_CLOSURE.
+        val closure = 5 + size * 10
+        val lambda = bytes.size - 20
+
+        assertEquals(InstructionOpCode.PUSH_CLOSURE.code, bytes[closure])
+        assertEquals(lambda, readInt(bytes, closure + 1))
+        assertEquals(InstructionOpCode.ENTER.code, bytes[lambda])
+    }
+
+    @Test
+    fun letsWithinDeclarationsHaveSlotsOfTheirOwn() {
+        val expected = bytes(
+            op(InstructionOpCode.ENTER), int(4),
+            op(InstructionOpCode.PUSH_INT), int(3),
+            op(InstructionOpCode.STORE_VAR), int(1),
+            op(InstructionOpCode.PUSH_VAR), int(0), int(1),
+            op(InstructionOpCode.PUSH_INT), int(2),
+            op(InstructionOpCode.MUL),
+            op(InstructionOpCode.STORE_VAR), int(0),
+            op(InstructionOpCode.PUSH_INT), int(1),
+            op(InstructionOpCode.STORE_VAR), int(3),
+            op(InstructionOpCode.PUSH_VAR), int(0), int(3),
+            op(InstructionOpCode.STORE_VAR), int(2),
+            op(InstructionOpCode.PUSH_VAR), int(0), int(0),
+            op(InstructionOpCode.PUSH_VAR), int(0), int(2),
+            op(InstructionOpCode.ADD),
+            op(InstructionOpCode.RET)
+        )
+
+        assertContentEquals(expected, compileBytes(parse("let x = let y = 3 in y * 2 ; z = let w = 1 in w in x + z")))
+    }
+
+    // Storing c must not overwrite the b that a's closure reads.
+    @Test
+    fun closureKeepsTheLetWithinItsDeclaration() {
+        val expected = bytes(
+            op(InstructionOpCode.ENTER), int(3),
+            op(InstructionOpCode.PUSH_INT), int(7),
+            op(InstructionOpCode.STORE_VAR), int(1),
+            op(InstructionOpCode.PUSH_CLOSURE), int(51),
+            op(InstructionOpCode.STORE_VAR), int(0),
+            op(InstructionOpCode.PUSH_INT), int(3),
+            op(InstructionOpCode.STORE_VAR), int(2),
+            op(InstructionOpCode.PUSH_VAR), int(0), int(0),
+            op(InstructionOpCode.PUSH_INT), int(0),
+            op(InstructionOpCode.SWAP_CALL),
+            op(InstructionOpCode.RET),
+            // 51: \x -> b
+            op(InstructionOpCode.ENTER), int(1),
+            op(InstructionOpCode.STORE_VAR), int(0),
+            op(InstructionOpCode.PUSH_VAR), int(1), int(1),
+            op(InstructionOpCode.RET)
+        )
+
+        assertContentEquals(expected, compileBytes(parse("let a = let b = 7 in \\x -> b; c = 3 in a 0")))
+    }
+
+    @Test
+    fun compileManyBindings() {
+        val size = 20000
+        val program = "let " + (0 until size).joinToString("; ") { if (it == 0) "d0 = 0" else "d$it = d${it - 1} + 1" } + " in d${size - 1}"
+        val bytes = compileBytes(parse(program))
+
+        assertEquals(size, readInt(bytes, 1))
+        // The last declaration's PUSH_VAR, 30 bytes from the end, reads the one before it from its slot.
+        assertEquals(InstructionOpCode.PUSH_VAR.code, bytes[bytes.size - 30])
+        assertEquals(size - 2, readInt(bytes, bytes.size - 25))
+    }
 }
+
+private fun op(opCode: InstructionOpCode): List<Byte> =
+    listOf(opCode.code)
+
+private fun int(v: Int): List<Byte> =
+    listOf(v.toByte(), (v shr 8).toByte(), (v shr 16).toByte(), (v shr 24).toByte())
+
+private fun bytes(vararg parts: List<Byte>): ByteArray =
+    parts.flatMap { it }.toByteArray()
+
+private fun readInt(bytes: ByteArray, index: Int): Int =
+    (bytes[index].toInt() and 0xff) or
+            ((bytes[index + 1].toInt() and 0xff) shl 8) or
+            ((bytes[index + 2].toInt() and 0xff) shl 16) or
+            ((bytes[index + 3].toInt() and 0xff) shl 24)
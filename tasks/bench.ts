@@ -0,0 +1,388 @@
+// Runs the programs in scenarios/bench under each bytecode interpreter and
+// writes the results as JSON.  Every engine reports its own counters as a
+// JSON line on stderr when run with --stats; wall time is measured here.
+//
+//   deno run --allow-read --allow-write --allow-run tasks/bench.ts
+//     [--size=quick|full] [--engines=bci-c,bci-c-parallel,bci-c-gc-parallel,bci-zig,bci-deno,bci-deno-arena]
+//     [--warmup=<n>] [--repetitions=<n>] [--output=<file>]
+//     [--baseline=<file>] [--threshold=<percent>] [--counters=true]
+//
+// With --baseline the median wall time of each program and engine is
+// compared against an earlier run and the task fails if any has slowed by
+// more than the threshold.  With --counters engines that support it also
+// report hardware performance counters for the final repetition.
+
+import { asm, writeBinary } from "../components/bci-deno/asm.ts";
+
+const BENCH_HOME = "scenarios/bench";
+
+type Engine = {
+  name: string;
+  command: (binary: string) => Array<string>;
+  counters?: string;
+};
+
+const engines: Array<Engine> = [
+  {
+    name: "bci-c",
+    command: (binary) => ["components/bci-c/src/bci", "run", "--stats", binary],
+    counters: "--counters",
+  },
+  {
+    // SPAWNed thunks, as in fibParallel, on a thread per processor.
+    name: "bci-c-parallel",
+    command: (binary) => [
+      "components/bci-c/src/bci",
+      "run",
+      "--stats",
+      "--parallel",
+      binary,
+    ],
+    counters: "--counters",
+  },
+  {
+    // Compare gcMs against bci-c for the mark and sweep speed-up.  The
+    // threshold is low enough for deepSum's live heap to be collected in
+    // parallel.
+    name: "bci-c-gc-parallel",
+    command: (binary) => [
+      "components/bci-c/src/bci",
+      "run",
+      "--stats",
+      "--gc-threads",
+      "--gc-parallel-threshold=4096",
+      binary,
+    ],
+    counters: "--counters",
+  },
+  {
+    name: "bci-zig",
+    command: (binary) => [
+      "components/bci-zig/zig-out/bin/bci-zig",
+      "run",
+      "--stats",
+      binary,
+    ],
+  },
+  {
+    name: "bci-deno",
+    command: (binary) => [
+      "deno",
+      "run",
+      "--allow-read",
+      "components/bci-deno/bci.ts",
+      "run",
+      "--stats",
+      binary,
+    ],
+  },
+  {
+    // Ints unboxed and the heap in typed arrays, collected by the VM.
+    name: "bci-deno-arena",
+    command: (binary) => [
+      "deno",
+      "run",
+      "--allow-read",
+      "components/bci-deno/bci.ts",
+      "run",
+      "--stats",
+      "--arena",
+      binary,
+    ],
+  },
+];
+
+type Program = {
+  name: string;
+  file: string;
+  sizes: {
+    [size: string]: { params: { [name: string]: number }; expected: string };
+  };
+};
+
+type Stats = {
+  instructions: number;
+  allocations: number;
+  collections: number | null;
+  gcNs: number | null;
+  peakRssKb: number;
+  counters?: unknown;
+};
+
+type Result = {
+  program: string;
+  engine: string;
+  ok: boolean;
+  error?: string;
+  wallMs?: { median: number; min: number; max: number };
+  instructions?: number;
+  instructionsPerSecond?: number;
+  allocations?: number;
+  collections?: number | null;
+  gcMs?: number | null;
+  peakRssKb?: number;
+  counters?: unknown;
+};
+
+const parseArgs = (args: Array<string>): Map<string, string> => {
+  const result = new Map<string, string>();
+
+  for (const arg of args) {
+    const match = arg.match(/^--([a-z-]+)=(.*)$/);
+    if (match === null) {
+      throw new Error(`Invalid argument: ${arg}`);
+    }
+    result.set(match[1], match[2]);
+  }
+
+  return result;
+};
+
+// A parameter is the operand of the instruction following a "# @param <name>"
+// comment so that the source remains valid assembler at its full size.
+const instantiate = (
+  text: string,
+  params: { [name: string]: number },
+): string => {
+  const lines = text.split("\n");
+
+  for (let i = 0; i < lines.length; i++) {
+    const match = lines[i].trim().match(/^# @param ([A-Za-z]+)$/);
+
+    if (match !== null && params[match[1]] !== undefined) {
+      lines[i + 1] = lines[i + 1].replace(/-?\d+\s*$/, `${params[match[1]]}`);
+    }
+  }
+
+  return lines.join("\n");
+};
+
+const median = (values: Array<number>): number => {
+  const sorted = [...values].sort((a, b) => a - b);
+  const middle = Math.floor(sorted.length / 2);
+
+  return sorted.length % 2 === 1
+    ? sorted[middle]
+    : (sorted[middle - 1] + sorted[middle]) / 2;
+};
+
+const runOnce = async (
+  engine: Engine,
+  binary: string,
+  counters: boolean,
+): Promise<{ wallMs: number; stdout: string; stats?: Stats; error?: string }> => {
+  const [command, ...args] = engine.command(binary);
+  if (counters && engine.counters !== undefined) {
+    args.splice(args.length - 1, 0, engine.counters);
+  }
+  const start = performance.now();
+
+  let output: Deno.CommandOutput;
+  try {
+    output = await new Deno.Command(command, { args }).output();
+  } catch (e) {
+    return { wallMs: 0, stdout: "", error: `${e}` };
+  }
+
+  const wallMs = performance.now() - start;
+  const stdout = new TextDecoder().decode(output.stdout).trim();
+  const statsLine = new TextDecoder().decode(output.stderr).split("\n")
+    .filter((line) => line.startsWith("{")).pop();
+
+  if (!output.success) {
+    return { wallMs, stdout, error: `exit code ${output.code}: ${stdout}` };
+  }
+  if (statsLine === undefined) {
+    return { wallMs, stdout, error: "no statistics reported" };
+  }
+
+  return { wallMs, stdout, stats: JSON.parse(statsLine) };
+};
+
+const bench = async (
+  program: string,
+  expected: string,
+  engine: Engine,
+  binary: string,
+  warmup: number,
+  repetitions: number,
+  counters: boolean,
+): Promise<Result> => {
+  const result: Result = { program, engine: engine.name, ok: false };
+
+  for (let i = 0; i < warmup; i++) {
+    await runOnce(engine, binary, false);
+  }
+
+  const walls: Array<number> = [];
+  const gcs: Array<number> = [];
+  let stats: Stats | undefined = undefined;
+  let peakRssKb = 0;
+
+  for (let i = 0; i < repetitions; i++) {
+    const run = await runOnce(
+      engine,
+      binary,
+      counters && i === repetitions - 1,
+    );
+
+    if (run.error !== undefined) {
+      result.error = run.error;
+      return result;
+    }
+    if (run.stdout !== expected) {
+      result.error = `expected ${expected}: got ${run.stdout}`;
+      return result;
+    }
+
+    stats = run.stats!;
+    walls.push(run.wallMs);
+    if (stats.gcNs !== null) {
+      gcs.push(stats.gcNs / 1000000);
+    }
+    peakRssKb = Math.max(peakRssKb, stats.peakRssKb);
+  }
+
+  const wallMs = median(walls);
+
+  result.ok = true;
+  result.wallMs = {
+    median: wallMs,
+    min: Math.min(...walls),
+    max: Math.max(...walls),
+  };
+  result.instructions = stats!.instructions;
+  result.instructionsPerSecond = Math.round(
+    stats!.instructions / (wallMs / 1000),
+  );
+  result.allocations = stats!.allocations;
+  result.collections = stats!.collections;
+  result.gcMs = gcs.length === 0 ? null : median(gcs);
+  result.peakRssKb = peakRssKb;
+  if (stats!.counters !== undefined) {
+    result.counters = stats!.counters;
+  }
+
+  return result;
+};
+
+const compare = (
+  results: Array<Result>,
+  baseline: Array<Result>,
+  threshold: number,
+): number => {
+  let regressions = 0;
+
+  for (const result of results) {
+    const previous = baseline.find((r) =>
+      r.program === result.program && r.engine === result.engine
+    );
+
+    if (
+      previous === undefined || previous.wallMs === undefined ||
+      result.wallMs === undefined
+    ) {
+      continue;
+    }
+
+    const change = (result.wallMs.median - previous.wallMs.median) /
+      previous.wallMs.median * 100;
+    const regressed = change > threshold;
+
+    console.error(
+      `${regressed ? "REGRESSION" : "ok"}: ${result.program}: ${result.engine}: ${
+        previous.wallMs.median.toFixed(1)
+      }ms -> ${result.wallMs.median.toFixed(1)}ms (${
+        change >= 0 ? "+" : ""
+      }${change.toFixed(1)}%)`,
+    );
+    if (regressed) {
+      regressions += 1;
+    }
+  }
+
+  return regressions;
+};
+
+const main = async () => {
+  const args = parseArgs(Deno.args);
+  const size = args.get("size") ?? "full";
+  const warmup = parseInt(args.get("warmup") ?? "1");
+  const repetitions = parseInt(args.get("repetitions") ?? "5");
+  const counters = args.get("counters") === "true";
+  const selected = (args.get("engines") ?? engines.map((e) => e.name).join(","))
+    .split(",");
+
+  const programs: Array<Program> =
+    JSON.parse(Deno.readTextFileSync(`${BENCH_HOME}/bench.json`)).programs;
+  const results: Array<Result> = [];
+
+  for (const program of programs) {
+    const instance = program.sizes[size];
+    if (instance === undefined) {
+      throw new Error(`${program.name}: unknown size: ${size}`);
+    }
+
+    const binary = `${BENCH_HOME}/${program.name}-${size}.bin`;
+    writeBinary(
+      binary,
+      asm(instantiate(
+        Deno.readTextFileSync(`${BENCH_HOME}/${program.file}`),
+        instance.params,
+      )),
+    );
+
+    for (const engine of engines.filter((e) => selected.includes(e.name))) {
+      console.error(`- ${program.name}: ${engine.name}`);
+      results.push(
+        await bench(
+          program.name,
+          instance.expected,
+          engine,
+          binary,
+          warmup,
+          repetitions,
+          counters,
+        ),
+      );
+    }
+  }
+
+  const report = JSON.stringify(
+    {
+      date: new Date().toISOString(),
+      size,
+      warmup,
+      repetitions,
+      results,
+    },
+    null,
+    2,
+  );
+
+  if (args.has("output")) {
+    Deno.writeTextFileSync(args.get("output")!, report + "\n");
+  } else {
+    console.log(report);
+  }
+
+  const failures = results.filter((r) => !r.ok);
+  for (const failure of failures) {
+    console.error(
+      `failed: ${failure.program}: ${failure.engine}: ${failure.error}`,
+    );
+  }
+
+  let regressions = 0;
+  if (args.has("baseline")) {
+    regressions = compare(
+      results,
+      JSON.parse(Deno.readTextFileSync(args.get("baseline")!)).results,
+      parseFloat(args.get("threshold") ?? "10"),
+    );
+  }
+
+  Deno.exit(failures.length === 0 && regressions === 0 ? 0 : 1);
+};
+
+await main();